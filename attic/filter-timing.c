@@ -0,0 +1,135 @@
+/*
+ * Hack to time the aging and sort of the shift register that
+ * clock_filter() does for every sample.
+ *
+ * Feeds a million samples with random delays through one association
+ * and reports samples per second, for the sorting network of
+ * ntpd/ntp_filter.c and for the exchange sort clock_filter() used
+ * before.  The sum of the chosen delays is printed too; it must be the
+ * same for both.
+ *
+ * Usage: filter-timing [samples]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntpd.h"
+
+#define NS_PER_S	1000000000.0
+#define MAXDISP		16.0
+#define ALLAN		1024UL
+
+const char *progname = "filter-timing";	/* for msyslog() in libntp */
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* The aging and sort as clock_filter() had them. */
+static void
+old_sort(struct peer *p, double aging, double *dst, int *ord)
+{
+	double etemp;
+	int i, j, k;
+
+	j = p->filter_nextpt;
+	for (i = NTP_SHIFT - 1; i >= 0; i--) {
+		if (i != 0)
+			p->filter_disp[j] += aging;
+		if (p->filter_disp[j] >= MAXDISP) {
+			p->filter_disp[j] = MAXDISP;
+			dst[i] = MAXDISP;
+		} else if (p->update - p->filter_epoch[j] > ALLAN) {
+			dst[i] = p->filter_delay[j] + p->filter_disp[j];
+		} else {
+			dst[i] = p->filter_delay[j];
+		}
+		ord[i] = j;
+		j = (j + 1) % NTP_SHIFT;
+	}
+	for (i = 1; i < NTP_SHIFT; i++) {
+		for (j = 0; j < i; j++) {
+			if (dst[j] > dst[i]) {
+				k = ord[j];
+				ord[j] = ord[i];
+				ord[i] = k;
+				etemp = dst[j];
+				dst[j] = dst[i];
+				dst[i] = etemp;
+			}
+		}
+	}
+}
+
+/*
+ * Run n samples through the old sort or the new and return the
+ * samples per second.
+ */
+static double
+run(int n, bool old, double *sum)
+{
+	static double delay[1024];
+	static uptime_t step[1024];
+	struct peer peer;
+	double dst[NTP_SHIFT];
+	int ord[NTP_SHIFT];
+	double begin;
+	int i, j;
+
+	srandom(4242);
+	for (i = 0; i < 1024; i++) {
+		delay[i] = (random() % 100000) * 1e-6;
+		step[i] = 1 + (uptime_t)(random() % 2048);
+	}
+	ZERO(peer);
+	for (i = 0; i < NTP_SHIFT; i++)
+		peer.filter_disp[i] = MAXDISP;
+
+	*sum = 0;
+	begin = now();
+	for (i = 0; i < n; i++) {
+		j = peer.filter_nextpt;
+		peer.filter_delay[j] = delay[i % 1024];
+		peer.filter_disp[j] = 1e-5;
+		peer.filter_epoch[j] = peer.update;
+		peer.filter_nextpt = (j + 1) % NTP_SHIFT;
+		if (old)
+			old_sort(&peer, 15e-6 * step[i % 1024], dst, ord);
+		else
+			filter_sort(&peer, 15e-6 * step[i % 1024], MAXDISP,
+				    ALLAN, true, dst, ord);
+		*sum += dst[0];
+		peer.update += step[i % 1024];
+	}
+	return n / (now() - begin);
+}
+
+int
+main(int argc, char *argv[])
+{
+	double new_rate, old_rate, new_sum, old_sum;
+	int samples = 1000000;
+
+	if (argc > 1)
+		samples = atoi(argv[1]);
+	if (samples < 1)
+		samples = 1;
+
+	new_rate = run(samples, false, &new_sum);
+	old_rate = run(samples, true, &old_sum);
+	printf("# %d samples\n", samples);
+	printf("#        samples/s    sum of chosen delays\n");
+	printf("new %14.0f %23.9f\n", new_rate, new_sum);
+	printf("old %14.0f %23.9f\n", old_rate, old_sum);
+	return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Hack to time the parse of the JSON records of gpsd, the way the
+ * gpsd refclock takes them apart.
+ *
+ * Feeds a recorded second of gpsd output (TPV, SKY, PPS and TOFF)
+ * over and over through the key index of ntpd/ntp_gpsdjson.c and
+ * through the jsmn parse and key by key lookups the refclock used
+ * before, and reports records per second.  The sum of the numbers
+ * looked up is printed too; it must be the same for both.
+ *
+ * This is the benchmark half of the gpsdjson tests, kept here rather
+ * than in tests/ntpd/gpsdjson.c: a rate depends on the machine and
+ * what else runs on it, so it has nothing to pass or fail in a unit
+ * test, and the jsmn path it compares against is no longer in ntpd.
+ *
+ * Usage: gpsd-json-timing [seconds of output]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntp_stdlib.h"
+#include "ntp_gpsdjson.h"
+
+#define JSMN_STATIC
+#define JSMN_PARENT_LINKS
+#include "jsmn.h"
+
+#define NS_PER_S	1000000000.0
+#define JSMN_MAXTOK	350
+#define INVALID_TOKEN	(-1)
+
+const char *progname = "gpsd-json-timing";	/* for msyslog() in libntp */
+
+static const char *records[] = {
+	"{\"class\":\"TPV\",\"device\":\"/dev/ttyS0\",\"status\":2,\"mode\":3,"
+	"\"time\":\"2024-05-01T12:00:00.000Z\",\"leapseconds\":18,"
+	"\"ept\":0.005,\"lat\":48.123456789,\"lon\":11.567890123,"
+	"\"altHAE\":520.345,\"altMSL\":473.210,\"alt\":473.210,\"epx\":2.1,"
+	"\"epy\":2.9,\"epv\":4.5,\"track\":0.0,\"magtrack\":3.1,"
+	"\"magvar\":3.1,\"speed\":0.011,\"climb\":-0.002,\"eps\":0.5,"
+	"\"epc\":9.1,\"geoidSep\":47.135,\"eph\":3.8,\"sep\":6.1}",
+	"{\"class\":\"SKY\",\"device\":\"/dev/ttyS0\",\"xdop\":0.55,"
+	"\"ydop\":0.71,\"vdop\":1.10,\"tdop\":0.62,\"hdop\":0.9,\"gdop\":1.55,"
+	"\"pdop\":1.41,\"nSat\":8,\"uSat\":6,\"satellites\":["
+	"{\"PRN\":5,\"el\":42.0,\"az\":101.0,\"ss\":40.0,\"used\":true,\"gnssid\":0,\"svid\":5},"
+	"{\"PRN\":12,\"el\":13.0,\"az\":300.0,\"ss\":22.0,\"used\":false,\"gnssid\":0,\"svid\":12},"
+	"{\"PRN\":13,\"el\":66.0,\"az\":45.0,\"ss\":44.0,\"used\":true,\"gnssid\":0,\"svid\":13},"
+	"{\"PRN\":15,\"el\":28.0,\"az\":211.0,\"ss\":35.0,\"used\":true,\"gnssid\":0,\"svid\":15},"
+	"{\"PRN\":18,\"el\":8.0,\"az\":170.0,\"ss\":18.0,\"used\":false,\"gnssid\":0,\"svid\":18},"
+	"{\"PRN\":20,\"el\":51.0,\"az\":260.0,\"ss\":41.0,\"used\":true,\"gnssid\":0,\"svid\":20},"
+	"{\"PRN\":24,\"el\":36.0,\"az\":82.0,\"ss\":38.0,\"used\":true,\"gnssid\":0,\"svid\":24},"
+	"{\"PRN\":29,\"el\":19.0,\"az\":12.0,\"ss\":30.0,\"used\":true,\"gnssid\":0,\"svid\":29}"
+	"],\"time\":\"2024-05-01T12:00:00.000Z\"}",
+	"{\"class\":\"PPS\",\"device\":\"/dev/ttyS0\",\"real_sec\":1714564800,"
+	"\"real_nsec\":0,\"clock_sec\":1714564800,\"clock_nsec\":120,"
+	"\"precision\":-20,\"shm\":\"NTP2\",\"qErr\":3}",
+	"{\"class\":\"TOFF\",\"device\":\"/dev/ttyS0\",\"real_sec\":1714564800,"
+	"\"real_nsec\":0,\"clock_sec\":1714564800,\"clock_nsec\":90210345,"
+	"\"precision\":-1}",
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* The parse and lookups as refclock_gpsd.c had them. */
+typedef struct json_ctx {
+	char        * buf;
+	int           ntok;
+	jsmntok_t     tok[JSMN_MAXTOK];
+} json_ctx;
+
+static int
+old_skip(const json_ctx *ctx, int tid)
+{
+	if (tid >= 0 && tid < ctx->ntok) {
+		int len = ctx->tok[tid].size;
+
+		switch (ctx->tok[tid].type) {
+		case JSMN_OBJECT:
+			len *= 2;
+			/* FALLTHROUGH */
+		case JSMN_ARRAY:
+			for (++tid; len; --len)
+				tid = old_skip(ctx, tid);
+			break;
+		default:
+			++tid;
+			break;
+		}
+		if (tid > ctx->ntok)
+			tid = ctx->ntok;
+	}
+	return tid;
+}
+
+static const char *
+old_lookup(const json_ctx *ctx, const char *key, jsmntype_t what)
+{
+	int len, tid = 0;
+
+	if (ctx->tok[tid].type != JSMN_OBJECT)
+		return NULL;
+	len = ctx->tok[tid].size;
+	for (++tid; len && tid + 1 < ctx->ntok; --len) {
+		if (ctx->tok[tid].type != JSMN_STRING) {
+			tid = old_skip(ctx, tid);
+			tid = old_skip(ctx, tid);
+		} else if (strcmp(key, ctx->buf + ctx->tok[tid].start)) {
+			tid = old_skip(ctx, tid + 1);
+		} else if (what == ctx->tok[tid + 1].type) {
+			return ctx->buf + ctx->tok[tid + 1].start;
+		} else {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static bool
+old_parse(json_ctx *ctx, char *buf, size_t len)
+{
+	jsmn_parser jsm;
+	int         idx, rc;
+
+	jsmn_init(&jsm);
+	rc = jsmn_parse(&jsm, buf, len, ctx->tok, JSMN_MAXTOK);
+	if (rc <= 0)
+		return false;
+	ctx->buf  = buf;
+	ctx->ntok = rc;
+	if (JSMN_OBJECT != ctx->tok[0].type)
+		return false;
+	for (idx = 0; idx < ctx->ntok; ++idx)
+		if (ctx->tok[idx].end > ctx->tok[idx].start)
+			ctx->buf[ctx->tok[idx].end] = '\0';
+	return true;
+}
+
+static double
+num(const char *cp)
+{
+	return cp ? strtod(cp, NULL) : 0;
+}
+
+/* what the refclock takes from a record, the old way */
+static double
+old_record(char *buf, size_t len)
+{
+	static json_ctx ctx;
+	const char *cls;
+
+	if (!old_parse(&ctx, buf, len))
+		return 0;
+	cls = old_lookup(&ctx, "class", JSMN_STRING);
+	if (NULL == cls)
+		return 0;
+	if (!strcmp(cls, "TPV"))
+		return num(old_lookup(&ctx, "mode", JSMN_PRIMITIVE)) +
+		       num(old_lookup(&ctx, "ept", JSMN_PRIMITIVE)) +
+		       strlen(old_lookup(&ctx, "time", JSMN_STRING));
+	if (!strcmp(cls, "PPS") || !strcmp(cls, "TOFF"))
+		return num(old_lookup(&ctx, "real_sec", JSMN_PRIMITIVE)) +
+		       num(old_lookup(&ctx, "real_nsec", JSMN_PRIMITIVE)) +
+		       num(old_lookup(&ctx, "clock_sec", JSMN_PRIMITIVE)) +
+		       num(old_lookup(&ctx, "clock_nsec", JSMN_PRIMITIVE)) +
+		       num(old_lookup(&ctx, "precision", JSMN_PRIMITIVE));
+	return 0;
+}
+
+/* the same, from the key index */
+static double
+new_record(char *buf, size_t len)
+{
+	gpsd_json rec;
+	const char *cls;
+
+	if (!gpsd_json_parse(&rec, buf, len))
+		return 0;
+	cls = rec.val[GJK_CLASS];
+	if (GJT_STRING != rec.type[GJK_CLASS])
+		return 0;
+	if (!strcmp(cls, "TPV"))
+		return num(rec.val[GJK_MODE]) + num(rec.val[GJK_EPT]) +
+		       strlen(rec.val[GJK_TIME]);
+	if (!strcmp(cls, "PPS") || !strcmp(cls, "TOFF"))
+		return num(rec.val[GJK_REAL_SEC]) +
+		       num(rec.val[GJK_REAL_NSEC]) +
+		       num(rec.val[GJK_CLOCK_SEC]) +
+		       num(rec.val[GJK_CLOCK_NSEC]) +
+		       num(rec.val[GJK_PRECISION]);
+	return 0;
+}
+
+/*
+ * Run n seconds of output through the old parse or the new and return
+ * the records per second.
+ */
+static double
+run(int n, bool old, double *sum)
+{
+	static char buf[2048];
+	size_t len[COUNTOF(records)];
+	double begin;
+	int i;
+	unsigned int r;
+
+	for (r = 0; r < COUNTOF(records); r++)
+		len[r] = strlen(records[r]);
+	*sum = 0;
+	begin = now();
+	for (i = 0; i < n; i++) {
+		for (r = 0; r < COUNTOF(records); r++) {
+			/* the parse writes NULs into the record */
+			memcpy(buf, records[r], len[r]);
+			if (old)
+				*sum += old_record(buf, len[r]);
+			else
+				*sum += new_record(buf, len[r]);
+		}
+	}
+	return n * COUNTOF(records) / (now() - begin);
+}
+
+int
+main(int argc, char *argv[])
+{
+	double new_rate, old_rate, new_sum, old_sum;
+	int seconds = 200000;
+
+	if (argc > 1)
+		seconds = atoi(argv[1]);
+	if (seconds < 1)
+		seconds = 1;
+
+	new_rate = run(seconds, false, &new_sum);
+	old_rate = run(seconds, true, &old_sum);
+	printf("# %d seconds of gpsd output, %d records\n", seconds,
+	       seconds * (int)COUNTOF(records));
+	printf("#        records/s    sum of values\n");
+	printf("new %14.0f %16.0f\n", new_rate, new_sum);
+	printf("old %14.0f %16.0f\n", old_rate, old_sum);
+	return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Hack to time the parse of NMEA sentences, the way the nmea refclock
+ * takes them apart.
+ *
+ * Feeds a recorded second of receiver output over and over through
+ * the single pass split and field decoders of ntpd/ntp_nmea.c and
+ * through the field walk and sscanf() parsers the refclock used
+ * before, and reports sentences per second.  The sum of the times and
+ * dates decoded is printed too; it must be the same for both.
+ *
+ * Usage: nmea-timing [seconds of output]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntp_stdlib.h"
+#include "ntp_nmea.h"
+
+#define NS_PER_S	1000000000.0
+#define LINEMAX		128	/* BMAX of the refclock */
+
+const char *progname = "nmea-timing";	/* for msyslog() in libntp */
+
+static const char *sentences[] = {
+	"$GPRMC,123519.00,A,4807.038,N,01131.000,E,022.4,084.4,230394,"
+	"003.1,W*44",
+	"$GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,"
+	"*69",
+	"$GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39",
+	"$GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00"
+	"*74",
+	"$GPGSV,3,2,11,14,25,170,00,16,57,208,39,18,67,296,40,19,40,246,00"
+	"*74",
+	"$GPGSV,3,3,11,22,42,067,42,24,14,311,43,27,05,244,00,,,,*4D",
+	"$GNGLL,4807.038,N,01131.000,E,123519.00,A,A*78",
+	"$GPZDA,123519.00,23,03,1994,00,00*6C",
+	"$PGRMF,753,389737,230394,123519,11,4807.0380,N,01131.0000,E,A,2,0,"
+	"62,2,1*2D",
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* what a sentence comes to, for the sum */
+static double
+value(const struct calendar *jd, long ns, uint8_t leap)
+{
+	return jd->year * 400.0 + jd->month * 31.0 + jd->monthday +
+	       jd->hour * 3600.0 + jd->minute * 60.0 + jd->second +
+	       ns / NS_PER_S + leap;
+}
+
+/* The field walk and parsers as refclock_nmea.c had them. */
+typedef struct {
+	char  *base;
+	char  *cptr;
+	int    blen;
+	int    cidx;
+} nmea_data;
+
+static int
+old_init(nmea_data *data, char *cptr, int dlen)
+{
+	uint8_t cs_l = 0, cs_r = 0;
+	char *eptr, tmp;
+
+	eptr = cptr + dlen;
+	*eptr = '\0';
+	data->base = cptr;
+	data->cptr = cptr;
+	data->cidx = 0;
+	data->blen = dlen;
+	if (*cptr == '\0')
+		return CHECK_EMPTY;
+	if (*cptr++ != '$')
+		return CHECK_INVALID;
+	data->base++;
+	data->cptr++;
+	data->blen--;
+	if (*cptr < 'A' || *cptr > 'Z')
+		return CHECK_INVALID;
+	cs_l ^= *cptr++;
+	while ((*cptr >= 'A' && *cptr <= 'Z') ||
+	       (*cptr >= '0' && *cptr <= '9'))
+		cs_l ^= *cptr++;
+	if (*cptr != ',' || (cptr - data->base) < NMEA_PROTO_IDLEN)
+		return CHECK_INVALID;
+	cs_l ^= *cptr++;
+	while (*cptr && *cptr != '*')
+		cs_l ^= *cptr++;
+	if (*cptr == '\0')
+		return CHECK_VALID;
+	if (*cptr != '*' || cptr != eptr - 3 ||
+	    (cptr - data->base) >= NMEA_PROTO_MAXLEN)
+		return CHECK_INVALID;
+	for (cptr++; (tmp = *cptr) != '\0'; cptr++) {
+		if (tmp >= '0' && tmp <= '9')
+			cs_r = (cs_r << 4) + (tmp - '0');
+		else if (tmp >= 'A' && tmp <= 'F')
+			cs_r = (cs_r << 4) + (tmp - 'A' + 10);
+		else
+			break;
+	}
+	if (cptr != eptr || cs_l != cs_r)
+		return CHECK_INVALID;
+	return CHECK_CSVALID;
+}
+
+static char *
+old_field(nmea_data *data, int fn)
+{
+	char tmp;
+
+	if (fn < data->cidx) {
+		data->cidx = 0;
+		data->cptr = data->base;
+	}
+	while ((fn > data->cidx) && (tmp = *data->cptr) != '\0') {
+		data->cidx += (tmp == ',');
+		data->cptr++;
+	}
+	return data->cptr;
+}
+
+static uint8_t
+old_qual(nmea_data *rd, int idx, char tag, int inv)
+{
+	static const uint8_t table[2] = { LEAP_NOTINSYNC, LEAP_NOWARNING };
+	char *dp = old_field(rd, idx);
+
+	return table[*dp && ((*dp == tag) == !inv)];
+}
+
+static bool
+old_time(struct calendar *jd, long *ns, nmea_data *rd, int idx)
+{
+	static const unsigned long weight[4] = {
+		0, 100000000, 10000000, 1000000
+	};
+	unsigned int h, m, s;
+	int rc, p1, p2;
+	unsigned long f;
+
+	rc = sscanf(old_field(rd, idx), "%2u%2u%2u%n.%3lu%n",
+		    &h, &m, &s, &p1, &f, &p2);
+	if (rc < 3 || p1 != 6 || h > 23 || m > 59 || s > 60)
+		return false;
+	jd->hour = (uint8_t)h;
+	jd->minute = (uint8_t)m;
+	jd->second = (uint8_t)s;
+	*ns = (rc == 4) ? (long)(f * weight[p2 - p1 - 1]) : 0;
+	return true;
+}
+
+static bool
+old_date(struct calendar *jd, nmea_data *rd, int idx, bool full)
+{
+	unsigned int y, m, d;
+	int rc, p;
+	char *dp = old_field(rd, idx);
+
+	if (full) {
+		rc = sscanf(dp, "%2u,%2u,%4u%n", &d, &m, &y, &p);
+		if (rc != 3 || p != 10)
+			return false;
+	} else {
+		rc = sscanf(dp, "%2u%2u%2u%n", &d, &m, &y, &p);
+		if (rc != 3 || p != 6)
+			return false;
+	}
+	if (d < 1 || d > 31 || m < 1 || m > 12)
+		return false;
+	jd->monthday = (uint8_t)d;
+	jd->month = (uint8_t)m;
+	jd->year = (unsigned short)y;
+	return true;
+}
+
+static bool
+old_weekdata(gps_weektm *wd, nmea_data *rd, int weekidx, int timeidx,
+	     int leapidx)
+{
+	unsigned long secs;
+	int fcnt;
+
+	fcnt  = sscanf(old_field(rd, weekidx), "%hu", &wd->wt_week);
+	fcnt += sscanf(old_field(rd, timeidx), "%lu", &secs);
+	fcnt += sscanf(old_field(rd, leapidx), "%hd", &wd->wt_leap);
+	if (fcnt != 3 || wd->wt_week >= 1024 || secs >= 7*SECSPERDAY)
+		return false;
+	wd->wt_time = (uint32_t)secs;
+	return true;
+}
+
+/* what the refclock takes from a sentence, the old way */
+static double
+old_sentence(char *buf, size_t len)
+{
+	nmea_data rd;
+	struct calendar jd;
+	gps_weektm wd;
+	long ns = 0;
+	uint8_t leap = LEAP_NOWARNING;
+	char *cp;
+
+	ZERO(jd);
+	if (old_init(&rd, buf, (int)len) < CHECK_VALID)
+		return 0;
+	cp = old_field(&rd, 0);
+	if (strncmp(cp + 2, "RMC,", 4) == 0) {
+		if (!old_time(&jd, &ns, &rd, 1))
+			return 0;
+		leap = old_qual(&rd, 2, 'A', 0);
+		if (!old_date(&jd, &rd, 9, false))
+			return 0;
+	} else if (strncmp(cp + 2, "GGA,", 4) == 0) {
+		if (!old_time(&jd, &ns, &rd, 1))
+			return 0;
+		leap = old_qual(&rd, 6, '0', 1);
+	} else if (strncmp(cp + 2, "GLL,", 4) == 0) {
+		if (!old_time(&jd, &ns, &rd, 5))
+			return 0;
+		leap = old_qual(&rd, 6, 'A', 0);
+	} else if (strncmp(cp + 2, "ZDA,", 4) == 0) {
+		if (!old_time(&jd, &ns, &rd, 1) ||
+		    !old_date(&jd, &rd, 2, true))
+			return 0;
+	} else if (strncmp(cp + 2, "ZDG,", 4) == 0) {
+		if (!old_time(&jd, &ns, &rd, 1) ||
+		    !old_date(&jd, &rd, 2, true))
+			return 0;
+		leap = old_qual(&rd, 4, '0', 1);
+	} else if (strncmp(cp, "PGRMF,", 6) == 0) {
+		if (!old_weekdata(&wd, &rd, 1, 2, 5) ||
+		    !old_date(&jd, &rd, 3, false) ||
+		    !old_time(&jd, &ns, &rd, 4))
+			return 0;
+		leap = old_qual(&rd, 11, '0', 1);
+		return value(&jd, ns, leap) + wd.wt_week + wd.wt_time;
+	} else {
+		return 0;
+	}
+	return value(&jd, ns, leap);
+}
+
+/* the same, from the split sentence */
+static double
+new_sentence(char *buf, size_t len)
+{
+	nmea_sentence s;
+	struct calendar jd;
+	gps_weektm wd;
+	long ns = 0;
+	uint8_t leap = LEAP_NOWARNING;
+	const char *cp;
+	size_t flen;
+
+	ZERO(jd);
+	if (nmea_split(&s, buf, len) < CHECK_VALID)
+		return 0;
+	cp = nmea_field(&s, 0, &flen);
+	if (5 != flen)
+		return 0;
+	if (!memcmp(cp + 2, "RMC", 3)) {
+		if (!nmea_time(&s, 1, &jd, &ns))
+			return 0;
+		leap = nmea_qual(&s, 2, 'A', false);
+		if (!nmea_date(&s, 9, false, &jd))
+			return 0;
+	} else if (!memcmp(cp + 2, "GGA", 3)) {
+		if (!nmea_time(&s, 1, &jd, &ns))
+			return 0;
+		leap = nmea_qual(&s, 6, '0', true);
+	} else if (!memcmp(cp + 2, "GLL", 3)) {
+		if (!nmea_time(&s, 5, &jd, &ns))
+			return 0;
+		leap = nmea_qual(&s, 6, 'A', false);
+	} else if (!memcmp(cp + 2, "ZDA", 3)) {
+		if (!nmea_time(&s, 1, &jd, &ns) ||
+		    !nmea_date(&s, 2, true, &jd))
+			return 0;
+	} else if (!memcmp(cp + 2, "ZDG", 3)) {
+		if (!nmea_time(&s, 1, &jd, &ns) ||
+		    !nmea_date(&s, 2, true, &jd))
+			return 0;
+		leap = nmea_qual(&s, 4, '0', true);
+	} else if (!memcmp(cp, "PGRMF", 5)) {
+		if (!nmea_weekdata(&s, 1, 2, 5, &wd) ||
+		    !nmea_date(&s, 3, false, &jd) ||
+		    !nmea_time(&s, 4, &jd, &ns))
+			return 0;
+		leap = nmea_qual(&s, 11, '0', true);
+		return value(&jd, ns, leap) + wd.wt_week + wd.wt_time;
+	} else {
+		return 0;
+	}
+	return value(&jd, ns, leap);
+}
+
+/*
+ * Run n seconds of output through the old parse or the new and return
+ * the sentences per second.
+ */
+static double
+run(int n, bool old, double *sum)
+{
+	static char buf[LINEMAX];
+	size_t len[COUNTOF(sentences)];
+	double begin;
+	int i;
+	unsigned int r;
+
+	for (r = 0; r < COUNTOF(sentences); r++)
+		len[r] = strlen(sentences[r]);
+	*sum = 0;
+	begin = now();
+	for (i = 0; i < n; i++) {
+		for (r = 0; r < COUNTOF(sentences); r++) {
+			/* the old parse writes a NUL after the line */
+			memcpy(buf, sentences[r], len[r] + 1);
+			if (old)
+				*sum += old_sentence(buf, len[r]);
+			else
+				*sum += new_sentence(buf, len[r]);
+		}
+	}
+	return n * COUNTOF(sentences) / (now() - begin);
+}
+
+int
+main(int argc, char *argv[])
+{
+	double new_rate, old_rate, new_sum, old_sum;
+	int seconds = 200000;
+
+	if (argc > 1)
+		seconds = atoi(argv[1]);
+	if (seconds < 1)
+		seconds = 1;
+
+	new_rate = run(seconds, false, &new_sum);
+	old_rate = run(seconds, true, &old_sum);
+	printf("# %d seconds of receiver output, %d sentences\n", seconds,
+	       seconds * (int)COUNTOF(sentences));
+	printf("#      sentences/s    sum of values\n");
+	printf("new %14.0f %16.0f\n", new_rate, new_sum);
+	printf("old %14.0f %16.0f\n", old_rate, old_sum);
+	return 0;
+}
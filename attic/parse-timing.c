@@ -0,0 +1,150 @@
+/*
+ * Hack to time the input of libparse, the way the generic refclock
+ * feeds it.
+ *
+ * Feeds a stream of timecode telegrams, cut into reads the way a tty
+ * hands them over, through parse_ioread() a byte at a time and through
+ * parse_ioread_block() a read at a time, and reports bytes per second
+ * for each of a few clock formats.  The sum of the times decoded is
+ * printed too; it must be the same for both.
+ *
+ * Usage: parse-timing [telegrams]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntp_stdlib.h"
+#include "parse.h"
+
+#define NS_PER_S	1000000000.0
+#define READSIZE	64	/* bytes per read */
+
+const char *progname = "parse-timing";	/* for msyslog() in libntp */
+
+static const struct {
+	const char *format;
+	const char *telegram;
+} clocks[] = {
+	{ "Diem's Computime Radio Clock", "T:20:10:19:01:12:34:56\r\n" },
+	{ "ELV DCF7000", "20-10-19-01-12-34-56-00\r" },
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+static bool
+setup(parse_t *p, const char *name)
+{
+	parsectl_t dct;
+
+	memset(p, 0, sizeof(*p));
+	if (!parse_ioinit(p))
+		return false;
+	memset(&dct, 0, sizeof(dct));
+	dct.parseformat.parse_count = (unsigned short)(strlen(name) + 1);
+	memcpy(dct.parseformat.parse_buffer, name, strlen(name) + 1);
+	if (!parse_setfmt(&dct, p))
+		return false;
+	memset(&dct, 0, sizeof(dct));
+	dct.parsesetcs.parse_cs = PARSE_IO_CS7;
+	return parse_setcs(&dct, p);
+}
+
+/*
+ * Run the n telegrams of stream through format name, by the byte or by
+ * the read, and return the bytes per second, or -1 if there is no
+ * such format.
+ */
+static double
+run(const char *name, const char *stream, size_t len, bool block,
+    double *sum)
+{
+	static char buf[READSIZE];
+	parse_t p;
+	timestamp_t ts;
+	size_t pos, n, i, used;
+	double begin, elapsed;
+
+	*sum = 0;
+	if (!setup(&p, name))
+		return -1;
+	ts = lfpinit_u(3800000000U, 0);
+	begin = now();
+	for (pos = 0; pos < len; pos += n) {
+		n = (len - pos < READSIZE) ? len - pos : READSIZE;
+		/* the read lands in a buffer of the refclock */
+		memcpy(buf, stream + pos, n);
+		if (block) {
+			for (i = 0; i < n; i += used) {
+				if (parse_ioread_block(&p, buf + i, n - i,
+						       &used, &ts)) {
+					*sum += lfpuint(p.parse_dtime.parse_time);
+					parse_iodone(&p);
+				}
+			}
+		} else {
+			for (i = 0; i < n; i++) {
+				if (parse_ioread(&p, buf[i], &ts)) {
+					*sum += lfpuint(p.parse_dtime.parse_time);
+					parse_iodone(&p);
+				}
+			}
+		}
+	}
+	elapsed = now() - begin;
+	parse_ioend(&p);
+	return len / elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+	double block_rate, byte_rate, block_sum, byte_sum;
+	char *stream;
+	size_t tlen, len;
+	unsigned int c;
+	int telegrams = 1000000;
+	int i;
+
+	if (argc > 1)
+		telegrams = atoi(argv[1]);
+	if (telegrams < 1)
+		telegrams = 1;
+
+	printf("# %d telegrams, in reads of %d bytes\n", telegrams, READSIZE);
+	printf("#         bytes/s     sum of times  format\n");
+	for (c = 0; c < COUNTOF(clocks); c++) {
+		tlen = strlen(clocks[c].telegram);
+		len = tlen * (size_t)telegrams;
+		stream = malloc(len);
+		if (NULL == stream)
+			return 1;
+		for (i = 0; i < telegrams; i++)
+			memcpy(stream + tlen * (size_t)i, clocks[c].telegram, tlen);
+
+		block_rate = run(clocks[c].format, stream, len, true, &block_sum);
+		byte_rate = run(clocks[c].format, stream, len, false, &byte_sum);
+		if (block_rate < 0 || byte_rate < 0) {
+			printf("no format \"%s\"\n", clocks[c].format);
+		} else {
+			printf("block %11.0f %16.0f  %s\n", block_rate,
+			       block_sum, clocks[c].format);
+			printf("byte  %11.0f %16.0f  %s\n", byte_rate,
+			       byte_sum, clocks[c].format);
+		}
+		free(stream);
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Hack to time the building of the header of a server reply, as
+ * fast_xmit() does for every client request.
+ *
+ * Builds a million headers from a published snapshot of the system
+ * variables, patching the prebuilt template of ntpd/ntp_snapshot.c,
+ * and field by field as fast_xmit() did before, and reports headers
+ * per second for each.  The timestamps come from a counter rather than
+ * the system clock, so the figures are for the header alone.  A check
+ * sum over all the headers is printed; it must be the same for both.
+ *
+ * Usage: reply-timing [replies]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntpd.h"
+
+#define NS_PER_S	1000000000.0
+
+const char *progname = "reply-timing";	/* for msyslog() in libntp */
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* The header as fast_xmit() built it. */
+static void
+old_header(struct pkt *xpkt, const struct sys_snapshot *snap,
+	   uint8_t version, uint8_t ppoll, uint64_t org, l_fp rec)
+{
+	l_fp reftime = snap->reftime;
+
+	xpkt->li_vn_mode = PKT_LI_VN_MODE(snap->leap, version, MODE_SERVER);
+	xpkt->stratum = STRATUM_TO_PKT(snap->stratum);
+	xpkt->ppoll = ppoll;
+	xpkt->precision = snap->precision;
+	xpkt->refid = snap->refid;
+	xpkt->rootdelay = HTONS_FP(DTOUFP(snap->rootdelay));
+	xpkt->rootdisp = HTONS_FP(DTOUFP(snap->rootdisp));
+	if (snap->smearing) {
+		reftime += snap->smear_offset;
+		xpkt->refid = convertLFPToRefID(snap->smear_offset);
+	}
+	xpkt->reftime = htonl_fp(reftime);
+	xpkt->org.l_ui = htonl(org >> 32);
+	xpkt->org.l_uf = htonl(org & 0xFFFFFFFF);
+	if (snap->smearing)
+		rec += snap->smear_offset;
+	xpkt->rec = htonl_fp(rec);
+}
+
+/*
+ * Build n headers the old way or the new and return the headers per
+ * second.
+ */
+static double
+run(int n, bool old, uint32_t *sum)
+{
+	struct sys_snapshot snap;
+	struct pkt xpkt;
+	const uint32_t *w = (const uint32_t *)&xpkt;
+	l_fp t = 0xe0000000;
+	double begin;
+	int i, j;
+
+	*sum = 0;
+	begin = now();
+	for (i = 0; i < n; i++) {
+		sys_snapshot_read(&snap);
+		if (old)
+			old_header(&xpkt, &snap, 4, 6, t, t + 1);
+		else
+			sys_reply_header(&xpkt, &snap, 4, 6, t, t + 1);
+		xpkt.xmt = htonl_fp(t + 2);
+		for (j = 0; j < LEN_PKT_NOMAC / 4; j++)
+			*sum += w[j];
+		t += 0x10000;
+	}
+	return n / (now() - begin);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct sys_snapshot snap;
+	double new_rate, old_rate;
+	uint32_t new_sum, old_sum;
+	int replies = 1000000;
+
+	if (argc > 1)
+		replies = atoi(argv[1]);
+	if (replies < 1)
+		replies = 1;
+
+	ZERO(snap);
+	snap.leap = LEAP_NOWARNING;
+	snap.stratum = 2;
+	snap.precision = -24;
+	snap.rootdelay = 0.0123;
+	snap.rootdisp = 0.0456;
+	snap.rootdist = 0.0789;
+	snap.refid = htonl(0xc0000201);
+	snap.reftime = 0xe000000000000000;
+	sys_snapshot_publish(&snap);
+
+	new_rate = run(replies, false, &new_sum);
+	old_rate = run(replies, true, &old_sum);
+	printf("# %d replies\n", replies);
+	printf("#        replies/s   check sum\n");
+	printf("new %14.0f   %08x\n", new_rate, new_sum);
+	printf("old %14.0f   %08x\n", old_rate, old_sum);
+	return 0;
+}
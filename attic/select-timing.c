@@ -0,0 +1,223 @@
+/*
+ * Hack to time the selection algorithm of clock_select().
+ *
+ * Builds synthetic candidate sets of 10 to 2000 sources.  Each
+ * round moves the offset of one of them, as a clock_filter() update
+ * would, ages the root distances of all of them, and runs the
+ * intersection and cluster steps from ntpd/ntp_select.c on the set.
+ *
+ * For comparison the selection sort and pairwise cluster loop that
+ * clock_select() used before are timed on the same data.  Those are
+ * skipped for larger sets once a round takes more than 10 ms.
+ *
+ * Usage: select-timing [rounds]
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntpd.h"
+
+#define NS_PER_S	1000000000.0
+
+const char *progname = "select-timing";	/* for msyslog() in libntp */
+
+#define MINCLOCK	3
+#define MAXCLOCK	10
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* normally distributed, by Box-Muller */
+static double
+gauss(double sigma)
+{
+	double u = (random() + 1.0) / (RAND_MAX + 2.0);
+	double v = (random() + 1.0) / (RAND_MAX + 2.0);
+
+	return sigma * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* The intersection and cluster steps as clock_select() had them. */
+static int
+old_select(peer_select *peers, int nlist, double *lowp, double *highp)
+{
+	static struct endpoint *endpoint;
+	static int *indx;
+	static int size;
+	struct endpoint endp;
+	double d, e, f, g, high, low;
+	int allow, i, j, k, n, nl2;
+
+	if (nlist > size) {
+		size = nlist;
+		endpoint = realloc(endpoint, 2 * size * sizeof(*endpoint));
+		indx = realloc(indx, 2 * size * sizeof(*indx));
+	}
+	nl2 = 0;
+	for (i = 0; i < nlist; i++) {
+		endpoint[nl2].type = -1;
+		endpoint[nl2++].val = peers[i].peer->offset - peers[i].synch;
+		endpoint[nl2].type = 1;
+		endpoint[nl2++].val = peers[i].peer->offset + peers[i].synch;
+	}
+	for (i = 0; i < nl2; i++)
+		indx[i] = i;
+	for (i = 0; i < nl2; i++) {
+		endp = endpoint[indx[i]];
+		e = endp.val;
+		k = i;
+		for (j = i + 1; j < nl2; j++) {
+			endp = endpoint[indx[j]];
+			if (endp.val < e) {
+				e = endp.val;
+				k = j;
+			}
+		}
+		if (k != i) {
+			j = indx[k];
+			indx[k] = indx[i];
+			indx[i] = j;
+		}
+	}
+	low = 1e9;
+	high = -1e9;
+	for (allow = 0; 2 * allow < nlist; allow++) {
+		n = 0;
+		for (i = 0; i < nl2; i++) {
+			low = endpoint[indx[i]].val;
+			n -= endpoint[indx[i]].type;
+			if (n >= nlist - allow)
+				break;
+		}
+		n = 0;
+		for (j = nl2 - 1; j >= 0; j--) {
+			high = endpoint[indx[j]].val;
+			n += endpoint[indx[j]].type;
+			if (n >= nlist - allow)
+				break;
+		}
+		if (high > low)
+			break;
+	}
+	*lowp = low;
+	*highp = high;
+
+	while (1) {
+		d = 1e9;
+		e = -1e9;
+		g = 0;
+		k = 0;
+		for (i = 0; i < nlist; i++) {
+			if (peers[i].error < d)
+				d = peers[i].error;
+			peers[i].seljit = 0;
+			if (nlist > 1) {
+				f = 0;
+				for (j = 0; j < nlist; j++)
+					f += SQUARE(peers[j].peer->offset -
+						    peers[i].peer->offset);
+				peers[i].seljit = SQRT(f / (nlist - 1));
+			}
+			if (peers[i].seljit * peers[i].synch > e) {
+				g = peers[i].seljit;
+				e = peers[i].seljit * peers[i].synch;
+				k = i;
+			}
+		}
+		if (nlist <= max(1, MINCLOCK) || g <= d)
+			break;
+		for (j = k + 1; j < nlist; j++)
+			peers[j - 1] = peers[j];
+		nlist--;
+	}
+	return nlist;
+}
+
+/*
+ * Run rounds selections over n candidates, with the old code or the
+ * new, and return the mean time of one in seconds.
+ */
+static double
+run(int n, int rounds, bool old, int *survivors)
+{
+	struct peer *peer = calloc(n, sizeof(*peer));
+	peer_select *all = calloc(n, sizeof(*all));
+	peer_select *peers = calloc(n, sizeof(*peers));
+	double elapsed = 0, begin, low, high;
+	int i, r;
+
+	srandom(4242);
+	for (i = 0; i < n; i++) {
+		peer[i].offset = gauss(1e-3);
+		all[i].peer = &peer[i];
+		all[i].error = 2e-4 + fabs(gauss(1e-3));
+		all[i].synch = 0.01 + fabs(gauss(0.02));
+	}
+	for (r = 0; r < rounds; r++) {
+		/* a new sample for one peer, and everybody ages */
+		peer[random() % n].offset = gauss(1e-3);
+		for (i = 0; i < n; i++)
+			all[i].synch += 15e-6;
+		memcpy(peers, all, n * sizeof(*peers));
+
+		begin = now();
+		if (old) {
+			*survivors = old_select(peers, n, &low, &high);
+		} else {
+			select_intersect(peers, n, &low, &high);
+			*survivors = select_cluster(peers, n, MINCLOCK,
+						    MAXCLOCK);
+		}
+		elapsed += now() - begin;
+	}
+	free(peer);
+	free(all);
+	free(peers);
+	return elapsed / rounds;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int sizes[] = { 10, 20, 50, 100, 200, 500, 1000, 2000 };
+	double new_cost, old_cost = 0;
+	int new_surv, old_surv = 0;
+	int rounds = 100;
+	unsigned int i;
+
+	if (argc > 1)
+		rounds = atoi(argv[1]);
+	if (rounds < 1)
+		rounds = 1;
+
+	printf("# %d rounds per set, mean time per selection\n", rounds);
+	printf("#  peers      new (us)  left      old (us)  left\n");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		new_cost = run(sizes[i], rounds, false, &new_surv);
+		if (old_cost < 0.01)
+			old_cost = run(sizes[i], rounds, true, &old_surv);
+		else
+			old_cost = NAN;
+		if (isnan(old_cost))
+			printf("%8d %13.3f %5d %13s %5s\n", sizes[i],
+			       new_cost * 1e6, new_surv, "-", "-");
+		else
+			printf("%8d %13.3f %5d %13.3f %5d\n", sizes[i],
+			       new_cost * 1e6, new_surv, old_cost * 1e6,
+			       old_surv);
+	}
+	return 0;
+}
@@ -12,6 +12,10 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "ntp.h"
 #include "ntp_stdlib.h"
@@ -38,6 +42,37 @@ struct shmTime {
 	volatile int	valid;
 	unsigned	clockTimeStampNSec;	/* Unsigned ns timestamps */
 	unsigned	receiveTimeStampNSec;	/* Unsigned ns timestamps */
+	int		dummy[8];
+};
+
+/* the ring of mode bit 1, see ntpd/refclock_shm.c */
+#define SHM_RING_MAGIC		0x4e545052	/* NTPR */
+#define SHM_RING_VERSION	1
+
+struct shmSample {
+	volatile uint32_t seq;
+	int32_t		leap;
+	int64_t		clockTimeStampSec;
+	int64_t		receiveTimeStampSec;
+	uint32_t	clockTimeStampNSec;
+	uint32_t	receiveTimeStampNSec;
+	int32_t		precision;
+	int32_t		dummy;
+};
+
+struct shmRing {
+	volatile uint32_t magic;
+	uint32_t	version;
+	uint32_t	nslots;
+	uint32_t	slotsize;
+	volatile uint64_t head;
+	int32_t		dummy[8];
+	struct shmSample slot[64];
+};
+
+struct shmSegment {
+	struct shmTime	classic;
+	struct shmRing	ring;
 };
 
 static struct shmTime *
@@ -62,6 +97,89 @@ getShmTime (
 }
 
 
+/*
+ * ring_writer - write rate samples a second of the system clock, with
+ * some wobble, to the ring of a segment ntpd has set up, and ring the
+ * doorbell at bell after each, if given
+ */
+static void
+ring_writer (
+	int unit,
+	int rate,
+	const char *bell
+	)
+{
+	struct sockaddr_un sun;
+	int bellfd = -1;
+	void *seg;
+	struct shmRing *r;
+	struct shmSample *s;
+	struct timespec now, nap;
+	uint64_t n;
+	uint32_t lap;
+	long wobble;
+	int shmid;
+
+	shmid = shmget (0x4e545030+unit, sizeof (struct shmSegment), 0);
+	if (shmid == -1) {
+		perror ("shmget (is ntpd running with mode 2?)");
+		exit (1);
+	}
+	seg = shmat (shmid, 0, 0);
+	if (seg == (void *)-1) {
+		perror ("shmat");
+		exit (1);
+	}
+	r = &((struct shmSegment *)seg)->ring;
+	if (r->magic != SHM_RING_MAGIC || r->version != SHM_RING_VERSION ||
+	    r->slotsize != sizeof (struct shmSample)) {
+		fprintf (stderr, "no ring in segment %d\n", unit);
+		exit (1);
+	}
+	if (bell != NULL) {
+		memset (&sun, 0, sizeof (sun));
+		sun.sun_family = AF_UNIX;
+		strlcpy (sun.sun_path, bell, sizeof (sun.sun_path));
+		bellfd = socket (AF_UNIX, SOCK_DGRAM, 0);
+		if (bellfd < 0 || connect (bellfd, (struct sockaddr *)&sun,
+					   sizeof (sun)) < 0) {
+			perror ("doorbell");
+			exit (1);
+		}
+	}
+	if (rate < 1)
+		rate = 1;
+	nap.tv_sec = 0;
+	nap.tv_nsec = 1000000000L / rate;
+	printf ("ring writer, %u slots\n", r->nslots);
+	for (;;) {
+		clock_gettime (CLOCK_REALTIME, &now);
+		/* coverity[dc.weak_crypto] */
+		wobble = random () % 100000;
+		n = r->head;
+		lap = (uint32_t)(n / r->nslots);
+		s = &r->slot[n % r->nslots];
+		s->seq = 2 * lap + 1;
+		__sync_synchronize ();
+		s->receiveTimeStampSec = now.tv_sec;
+		s->receiveTimeStampNSec = (uint32_t)now.tv_nsec;
+		s->clockTimeStampSec = now.tv_sec;
+		s->clockTimeStampNSec = (uint32_t)((now.tv_nsec + wobble) % 1000000000L);
+		if (now.tv_nsec + wobble >= 1000000000L)
+			s->clockTimeStampSec++;
+		s->leap = 0;
+		s->precision = -20;
+		__sync_synchronize ();
+		s->seq = 2 * lap + 2;
+		__sync_synchronize ();
+		r->head = n + 1;
+		if (bellfd >= 0)
+			(void)send (bellfd, "", 1, 0);
+		nanosleep (&nap, NULL);
+	}
+}
+
+
 int
 main (
 	int argc,
@@ -76,7 +194,7 @@ main (
 
 	if (argc<=1) {
 	  usage:
-		printf ("usage: %s [uu:]{r[c][l]|w|snnn}\n",argv[0]);
+		printf ("usage: %s [uu:]{r[c][l]|w|snnn|Rnnn [bell]}\n",argv[0]);
 		printf ("       uu use clock unit uu (default: 2)\n");
 		printf ("       r read shared memory\n");
 		printf ("       c clear valid-flag\n");
@@ -85,6 +203,8 @@ main (
 		printf ("       snnnn set nsamples to nnn\n");
 		printf ("       lnnnn set leap to nnn\n");
 		printf ("       pnnnn set precision to -nnn\n");
+		printf ("       Rnnnn write the ring with current time, nnn times a second\n");
+		printf ("             and ring the doorbell socket named after it, if any\n");
 		exit (0);
 	}
 
@@ -97,6 +217,11 @@ main (
 		goto usage;
 	}
 
+	if ('R' == *argp) {
+		ring_writer(unit, atoi(argp + 1), argc > 2 ? argv[2] : NULL);
+		return 0;
+	}
+
 	p=getShmTime(unit);
 	switch (*argp) {
 	case 's':
@@ -0,0 +1,120 @@
+/*
+ * Hack to time the association polling part of timer().
+ *
+ * Sets up 10 to 10000 associations with polls of 64 to 1024 seconds
+ * and runs the timer for an hour, once scanning the whole peer list
+ * every tick as timer() used to, and once with the timer wheel of
+ * ntpd/ntp_wheel.c.  A poll just schedules the next one.
+ *
+ * Usage: wheel-timing [ticks]
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ntp.h"
+#include "ntpd.h"
+
+#define NS_PER_S	1000000000.0
+
+const char *progname = "wheel-timing";	/* for msyslog() in libntp */
+
+static uptime_t now;			/* the wheel only turns forward */
+
+static double
+clock_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / NS_PER_S;
+}
+
+/* what transmit() does to the timer state */
+static void
+poll(struct peer *p)
+{
+	p->nextdate = now + (1U << p->hpoll);
+	p->throttle += (1 << p->hpoll) - 2;
+}
+
+/*
+ * Run the timer over n associations for some ticks, the old way or
+ * the new, and return the mean time of one tick in seconds.
+ */
+static double
+run(int n, int ticks, bool old, unsigned long *polls)
+{
+	struct peer *peer = calloc(n, sizeof(*peer));
+	struct peer *list = NULL, *p;
+	double begin;
+	int i, t;
+
+	srandom(4242);
+	for (i = n - 1; i >= 0; i--) {
+		peer[i].hpoll = (uint8_t)(6 + random() % 5);
+		peer[i].nextdate = now + 1 +
+		    (uptime_t)(random() % (1 << peer[i].hpoll));
+		peer[i].p_link = list;
+		list = &peer[i];
+		if (!old)
+			wheel_schedule(&peer[i]);
+	}
+
+	*polls = 0;
+	begin = clock_now();
+	for (t = 0; t < ticks; t++) {
+		now++;
+		if (old) {
+			for (p = list; p != NULL; p = p->p_link) {
+				if (p->throttle > 0)
+					p->throttle--;
+				if (p->nextdate <= now) {
+					poll(p);
+					(*polls)++;
+				}
+			}
+		} else {
+			while ((p = wheel_due(now)) != NULL) {
+				poll(p);
+				wheel_schedule(p);
+				(*polls)++;
+			}
+		}
+	}
+	begin = clock_now() - begin;
+
+	for (i = 0; i < n; i++)
+		wheel_unschedule(&peer[i]);
+	free(peer);
+	return begin / ticks;
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int sizes[] = { 10, 100, 1000, 10000 };
+	unsigned long new_polls, old_polls;
+	double new_cost, old_cost;
+	int ticks = 3600;
+	unsigned int i;
+
+	if (argc > 1)
+		ticks = atoi(argv[1]);
+	if (ticks < 1)
+		ticks = 1;
+
+	printf("# %d ticks, mean time per tick\n", ticks);
+	printf("#  peers   wheel (ns)   polls    scan (ns)   polls\n");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		new_cost = run(sizes[i], ticks, false, &new_polls);
+		old_cost = run(sizes[i], ticks, true, &old_polls);
+		printf("%8d %12.1f %7lu %12.1f %7lu\n", sizes[i],
+		       new_cost * NS_PER_S, new_polls,
+		       old_cost * NS_PER_S, old_polls);
+	}
+	return 0;
+}
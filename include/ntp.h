@@ -190,6 +190,7 @@ struct peer_ctl {
 	uint32_t	mode;	/* only used by refclocks */
 #ifdef REFCLOCK
 	uint32_t	baud;
+	uint32_t	stages;	/* samples kept between polls, 0 default */
 	char		*path;
 	char		*ppspath;
 #endif /* REFCLOCK */
@@ -265,6 +266,7 @@ struct peer {
 	 */
 #ifdef REFCLOCK
 	struct refclockproc *procptr; /* refclock structure pointer */
+	struct peer *clk_link;	/* link pointer in refclock list */
 	bool	is_pps_driver;	/* is this the PPS driver? */
 	uint8_t	sstclktype;	/* clock type for system status word */
 #endif /* REFCLOCK */
@@ -318,8 +320,11 @@ struct peer {
 #define end_clear_to_zero update
 	int	unreach;	/* watchdog counter */
 	int	throttle;	/* rate control */
+	uptime_t	throttle_time;	/* throttle last brought up to date */
 	uptime_t	outdate;	/* send time last packet */
 	uptime_t	nextdate;	/* send time next packet */
+	struct peer *wheel_next; /* link pointer in timer wheel */
+	struct peer **wheel_pprev; /* link to us, NULL if not in wheel */
 
 	/*
 	 * Statistic counters
@@ -383,6 +388,16 @@ struct peer {
 #define	STRATUM_PKT_UNSPEC ((uint8_t)0) /* unspecified in packet */
 #define	STRATUM_UNSPEC	((uint8_t)16) /* unspecified */
 
+/*
+ * Dealing with stratum.  0 gets mapped to 16 incoming, and back to 0
+ * on output.
+ */
+#define	PKT_TO_STRATUM(s)	((uint8_t)(((s) == (STRATUM_PKT_UNSPEC)) ?\
+				(STRATUM_UNSPEC) : (s)))
+
+#define	STRATUM_TO_PKT(s)	((uint8_t)(((s) == (STRATUM_UNSPEC)) ?\
+				(STRATUM_PKT_UNSPEC) : (s)))
+
 /*
  * Values for peer.flags (unsigned int)
  */
@@ -404,6 +419,7 @@ struct peer {
 #define FLAG_NTS_NOVAL   0x8000u   /* do not validate the server certificate */
 #define FLAG_TSTAMP_PPS	0x10000u   /* PPS source provides absolute timestamp */
 #define	FLAG_LOOKUP	0x20000u   /* needs DNS or NTS lookup */
+#define	FLAG_THREAD	0x40000u   /* refclock read on its own thread */
 
 /* FLAG_DNS and FLAG_NTS stay on.
  * FLAG_LOOKUP gets turned off when lookup succeeds.
@@ -532,11 +548,10 @@ struct pkt {
 
 /*
  * To speed lookups, peers are hashed by the low order bits of the
- * remote IP address. These definitions relate to that.
+ * remote IP address and of the association ID.  The tables start at
+ * this size and grow with the number of associations.
  */
 #define	NTP_HASH_SIZE		128
-#define	NTP_HASH_MASK		(NTP_HASH_SIZE-1)
-#define	NTP_HASH_ADDR(src)	(sock_hash(src) & NTP_HASH_MASK)
 
 /*
  * min, and max.  Makes it easier to transliterate the spec without
@@ -729,6 +744,7 @@ struct restrict_u_tag {
 struct endpoint {
 	double	val;			/* offset of endpoint */
 	int	type;			/* interval entry/exit */
+	int	cand;			/* candidate it belongs to */
 };
 
 
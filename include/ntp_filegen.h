@@ -27,10 +27,55 @@
  */
 
 #define FGEN_FLAG_LINK		0x01 /* make a link to base name */
+#define FGEN_FLAG_BINARY	0x02 /* write fixed-width binary records */
 
 #define FGEN_FLAG_ENABLED	0x80 /* set this to really create files	  */
 				     /* without this, open is suppressed */
 
+/*
+ * Binary statistics files (FGEN_FLAG_BINARY)
+ *
+ * A binary generation file is named <fname>.bin<suffix> and starts
+ * with a self-describing header:
+ *
+ *	magic	  8 bytes  FILEGEN_BIN_MAGIC
+ *	hdrlen	  2 bytes  total header length
+ *	reclen	  2 bytes  length of every record
+ *	ncols	  2 bytes  number of column descriptors
+ *	reserved  2 bytes  zero
+ *	name	 16 bytes  statistics name, NUL padded
+ *	columns	 16 bytes each: name (14 bytes, NUL padded), type, width
+ *
+ * followed by fixed-width records.  Integers and doubles are stored
+ * little-endian and records carry no padding, so a reader can mmap()
+ * the file and step through it with a single record format.  Files
+ * are only appended to; the header is written when the file is empty.
+ *
+ * Column types:
+ *	'u'	unsigned 32-bit integer
+ *	'x'	unsigned 32-bit integer, shown in hex
+ *	'i'	signed 32-bit integer
+ *	'd'	IEEE 754 double
+ *	'f'	NTP 64-bit fixed point (l_fp)
+ *	's'	string, NUL padded to the column width
+ */
+#define FILEGEN_BIN_MAGIC	"NTPSBIN1"
+#define FILEGEN_BIN_HDRLEN	32	/* header length without columns */
+#define FILEGEN_BIN_COLLEN	16	/* length of a column descriptor */
+#define FILEGEN_BIN_NAMELEN	14	/* longest column name */
+#define FILEGEN_RECMAX		256	/* longest binary record */
+
+typedef struct filegen_column_tag {
+	const char *	name;	/* column name */
+	char		type;	/* column type, see above */
+	uint8_t		width;	/* width in bytes */
+} filegen_column;
+
+typedef struct filegen_record_tag {
+	size_t	len;			/* bytes used so far */
+	uint8_t	buf[FILEGEN_RECMAX];	/* record under construction */
+} filegen_record;
+
 typedef struct filegen_tag {
 	FILE *	fp;	/* file referring to current generation */
 	char *	dir;	/* currently always statsdir */
@@ -40,6 +85,9 @@ typedef struct filegen_tag {
 	time_t	id_hi;	/* upper bound of ident value */
 	uint8_t	type;	/* type of file generation */
 	uint8_t	flag;	/* flags modifying processing of file generation */
+	const filegen_column *cols; /* binary record layout, if supported */
+	uint8_t	ncols;	/* number of entries in cols */
+	uint16_t reclen; /* binary record length */
 } FILEGEN;
 
 extern	void	filegen_setup	(FILEGEN *, time_t);
@@ -48,6 +96,14 @@ extern	void	filegen_config	(FILEGEN *, const char *, const char *,
 extern	void	filegen_statsdir(void);
 extern	FILEGEN *filegen_get	(const char *);
 extern	void	filegen_register (const char *, const char *, FILEGEN *);
+extern	void	filegen_columns	(FILEGEN *, const filegen_column *,
+				 unsigned int);
+extern	void	filegen_write	(FILEGEN *, const filegen_record *);
+extern	void	filegen_put_u32	(filegen_record *, uint32_t);
+extern	void	filegen_put_i32	(filegen_record *, int32_t);
+extern	void	filegen_put_u64	(filegen_record *, uint64_t);
+extern	void	filegen_put_double(filegen_record *, double);
+extern	void	filegen_put_string(filegen_record *, const char *, size_t);
 #ifdef DEBUG
 extern	void	filegen_unregister(const char *);
 #endif
@@ -105,6 +105,22 @@ typedef struct {
          uint32_t        l_uf;
 } l_fp_w;
 
+/*
+ * Byte order conversion
+ */
+#define	HTONS_FP(x)	(htonl(x))
+
+/*
+ * Generate the wire-format version (that is, big-endian all the way down)
+ * of a timestamp expressed as a 64-bit scalar.
+ */
+static inline l_fp_w htonl_fp(l_fp lfp) {
+    l_fp_w lfpw;
+    lfpw.l_ui = htonl(lfpuint(lfp));
+    lfpw.l_uf = htonl(lfpfrac(lfp));
+    return lfpw;
+}
+
 #define	M_ISNEG(v_i)			/* v < 0 */ \
 	(((v_i) & 0x80000000) != 0)
 
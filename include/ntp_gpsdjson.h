@@ -0,0 +1,56 @@
+/*
+ * ntp_gpsdjson.h - the JSON records of gpsd, as the gpsd refclock
+ * reads them
+ */
+#ifndef GUARD_NTP_GPSDJSON_H
+#define GUARD_NTP_GPSDJSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the keys of the top level object the refclock looks at */
+typedef enum {
+	GJK_CLASS,
+	GJK_DEVICE,
+	GJK_ENABLE,
+	GJK_JSON,
+	GJK_REV,
+	GJK_RELEASE,
+	GJK_PROTO_MAJOR,
+	GJK_PROTO_MINOR,
+	GJK_MODE,
+	GJK_TIME,
+	GJK_EPT,
+	GJK_CLOCK_SEC,
+	GJK_CLOCK_NSEC,
+	GJK_CLOCK_MUSEC,
+	GJK_REAL_SEC,
+	GJK_REAL_NSEC,
+	GJK_REAL_MUSEC,
+	GJK_PRECISION,
+	GJK_SHM,
+	GJK_COUNT
+} gpsd_jkey;
+
+/* what a value is */
+typedef enum {
+	GJT_NONE,		/* key not present */
+	GJT_PRIMITIVE,		/* number, true, false or null */
+	GJT_STRING,
+	GJT_COMPOUND		/* object or array */
+} gpsd_jtype;
+
+/*
+ * A parsed record: for each key, its value as a NUL-terminated string
+ * in the record buffer, and its type.  Only the first of duplicate keys
+ * counts.
+ */
+typedef struct {
+	const char *	val[GJK_COUNT];
+	gpsd_jtype	type[GJK_COUNT];
+} gpsd_json;
+
+extern	int	gpsd_json_key	(const char *, size_t);
+extern	bool	gpsd_json_parse	(gpsd_json *, char *, size_t);
+
+#endif	/* GUARD_NTP_GPSDJSON_H */
@@ -0,0 +1,59 @@
+/*
+ * ntp_nmea.h - NMEA 0183 sentences, as the nmea refclock reads them
+ */
+#ifndef GUARD_NTP_NMEA_H
+#define GUARD_NTP_NMEA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ntp_calendar.h"
+#include "ntp_fp.h"
+#include "ntp_wrapdate.h"
+
+#define NMEA_PROTO_IDLEN	5	/* tag name must be at least 5 chars */
+#define NMEA_PROTO_MAXLEN	80	/* max chars in sentence, excluding CS */
+#define NMEA_PROTO_FIELDS	32	/* not official; limit on fields per record */
+
+/* results of nmea_split()
+ *
+ * Note: If a checksum is present, the checksum test must pass OK or the
+ * sentence is tagged invalid.
+ */
+#define CHECK_EMPTY  -1	/* no data			*/
+#define CHECK_INVALID 0	/* not a valid NMEA sentence	*/
+#define CHECK_VALID   1	/* valid but without checksum	*/
+#define CHECK_CSVALID 2	/* valid with checksum OK	*/
+
+/* the field index that stands for the checksum in nmea_wipe() */
+#define NMEA_CKSUM	(-1)
+
+/*
+ * A split sentence: where each field starts in the line, counted from
+ * the byte after the '$', and how long it is.  Field 0 is the name.
+ * Fields past the last one are empty, and so are those past
+ * NMEA_PROTO_FIELDS, which are not recorded.
+ */
+typedef struct {
+	char *		base;		/* the line, past the '$' */
+	int		nfield;		/* fields recorded */
+	int		cksum;		/* offset of the checksum digits,
+					 * or -1 if there are none */
+	uint16_t	start[NMEA_PROTO_FIELDS + 1];
+	uint16_t	len[NMEA_PROTO_FIELDS + 1];
+} nmea_sentence;
+
+extern	int	nmea_split	(nmea_sentence *, char *, size_t);
+extern	const char *nmea_field	(const nmea_sentence *, int, size_t *);
+extern	bool	nmea_field_is	(const nmea_sentence *, int, const char *);
+extern	void	nmea_wipe	(nmea_sentence *, int);
+extern	uint8_t	nmea_qual	(const nmea_sentence *, int, char, bool);
+extern	bool	nmea_time	(const nmea_sentence *, int,
+				 struct calendar *, long *);
+extern	bool	nmea_date	(const nmea_sentence *, int, bool,
+				 struct calendar *);
+extern	bool	nmea_weekdata	(const nmea_sentence *, int, int, int,
+				 gps_weektm *);
+
+#endif	/* GUARD_NTP_NMEA_H */
@@ -54,9 +54,58 @@ struct refclockstat {
 	uint8_t	currentstatus;	/* clock status */
 	uint8_t	lastevent;	/* last exception event */
 	uint8_t	leap;		/* leap bits */
+	const struct refclockdelay *iodelay; /* receive stamp delays */
+	int	stages;		/* samples kept between polls */
+	const struct refclocksummary *summary; /* the last poll */
 	struct	ctl_var *kv_list; /* additional variables */
 };
 
+/*
+ * Delays from the receive timestamp of refclock input to its hand-off
+ * to the driver, in bins of powers of two microseconds: bin 0 holds
+ * those under 1 us, bin i those from 2^(i-1) us up, and the last bin
+ * everything past that.
+ */
+#define	NDELAYBIN	24
+
+struct refclockdelay {
+	unsigned long	count;		/* delays recorded */
+	double	sum;			/* their sum, s */
+	double	max;			/* the largest, s */
+	unsigned long	bin[NDELAYBIN];	/* log2 histogram */
+};
+
+/*
+ * A sample of a refclock: its offset and when its input was received.
+ * The samples between polls are kept in a ring of refclockproc.nstage
+ * slots, one of which is always empty.
+ */
+struct refclocksample {
+	double	offset;		/* clock offset, s */
+	l_fp	stamp;		/* receive timestamp */
+};
+
+/*
+ * What the samples of a poll came to
+ */
+struct refclocksummary {
+	int	count;		/* samples */
+	int	kept;		/* of them, those averaged */
+	double	offset;		/* their mean, s */
+	double	jitter;		/* RMS of the gaps of the kept, s */
+	double	tau;		/* mean interval between samples, s, or 0
+				 * when adev and rate are not known */
+	double	adev;		/* Allan deviation at tau */
+	double	rate;		/* drift of the offsets, s/s */
+};
+
+extern	double	refsample_select(double *, int, int);
+extern	int	refsample_summarize(const struct refclocksample *, int,
+				    int, int, double *,
+				    struct refclocksummary *);
+extern	int	refsample_combine(const double *, int, double, double *,
+				  bool *, double *);
+
 /*
  * Reference clock I/O structure.  Used to provide an interface between
  * the reference clock drivers and the I/O module.
@@ -73,6 +122,8 @@ struct refclockio {
 	int	fd;		/* file descriptor */
 	unsigned long	recvcount;	/* count of receive completions */
 	bool	active;		/* true when in use */
+	struct refclockdelay delay;	/* stamp to hand-off delays */
+	struct refqueue *queue;	/* reader thread hand-off, if any */
 };
 
 /*
@@ -94,7 +145,8 @@ struct refclockbug {
  * Structure interface between the reference clock support
  * ntp_refclock.c and the driver utility routines
  */
-#define MAXSTAGE	60	/* max median filter stages  */
+#define MAXSTAGE	60	/* default samples kept between polls */
+#define STAGELIMIT	16384	/* the most the stages option may keep */
 #define NSTAGE		5	/* default median filter stages */
 #define BMAX		128	/* max timecode length */
 #define MAXDIAL		60	/* max length of modem dial strings */
@@ -124,12 +176,15 @@ struct refclockproc {
 	uint32_t	yearstart;	/* beginning of year */
 	int	coderecv;	/* put pointer */
 	int	codeproc;	/* get pointer */
+	int	nstage;		/* slots of the sample ring */
 	l_fp	lastref;	/* reference timestamp */
 	l_fp	lastrec;	/* receive timestamp */
 	double	offset;		/* mean offset */
 	double	disp;		/* sample dispersion */
 	double	jitter;		/* jitter (mean squares) */
-	double	filter[MAXSTAGE]; /* median filter */
+	struct refclocksample *filter; /* sample ring */
+	double	*work;		/* scratch of refclock_sample() */
+	struct refclocksummary summary; /* what the last poll came to */
 
 	/*
 	 * Configuration data
@@ -182,7 +237,7 @@ extern	void	refclock_control(sockaddr_u *,
 				 const struct refclockstat *,
 				 struct refclockstat *);
 extern	int	refclock_open	(char *, unsigned int, unsigned int);
-extern	void	refclock_timer	(struct peer *);
+extern	void	refclock_timer	(void);
 extern	void	refclock_transmit(struct peer *);
 extern 	bool	refclock_process(struct refclockproc *);
 extern 	bool	refclock_process_f(struct refclockproc *, double);
@@ -194,6 +249,8 @@ extern	int	refclock_gtlin	(struct recvbuf *, char *, int, l_fp *);
 extern	size_t	refclock_gtraw	(struct recvbuf *, char *, size_t, l_fp *);
 extern	bool	indicate_refclock_packet(struct refclockio *,
 					 struct recvbuf *);
+extern	double	refclock_delay_quantile(const struct refclockdelay *,
+					double);
 
 extern struct refclock refclock_none;
 
@@ -257,6 +314,12 @@ extern	struct refclock	refclock_pps;
 #define refclock_pps	refclock_none
 #endif
 
+#if defined (CLOCK_PPSMULTI) && defined(HAVE_PPSAPI)
+extern	struct refclock	refclock_ppsmulti;
+#else
+#define refclock_ppsmulti	refclock_none
+#endif
+
 #ifdef CLOCK_SPECTRACOM
 extern	struct refclock	refclock_spectracom;
 #else
@@ -0,0 +1,34 @@
+/*
+ * ntp_refqueue.h - refclock input read on a thread of its own
+ */
+#ifndef GUARD_NTP_REFQUEUE_H
+#define GUARD_NTP_REFQUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ntp_fp.h"
+
+#define	REFQ_SLOTS	64	/* reads the queue holds, a power of 2 */
+#define	REFQ_DATA	512	/* the most a read takes */
+
+/* one read of the device */
+struct refq_slot {
+	l_fp		stamp;		/* receive timestamp */
+	ssize_t		len;		/* bytes read, 0 at EOF, -1 on error */
+	int		err;		/* errno of the error */
+	uint8_t		data[REFQ_DATA];
+};
+
+struct refqueue;
+
+extern	struct refqueue *refq_start	(int, size_t);
+extern	void	refq_stop		(struct refqueue *);
+extern	int	refq_wakefd		(const struct refqueue *);
+extern	void	refq_clear		(struct refqueue *);
+extern	struct refq_slot *refq_peek	(struct refqueue *);
+extern	void	refq_release		(struct refqueue *);
+extern	unsigned long refq_dropped	(struct refqueue *);
+
+#endif	/* GUARD_NTP_REFQUEUE_H */
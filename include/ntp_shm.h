@@ -0,0 +1,50 @@
+/*
+ * ntp_shm.h - the time segment shared with SHM producers such as gpsd
+ *
+ * The SHM driver reads the segment of its unit, NTP0 for unit 0 and so
+ * on, and the gpsd driver the segments gpsd names in its records.  The
+ * layout is fixed by the producers already in the field: extend or
+ * union struct shmTime, do not change its size.
+ */
+#ifndef GUARD_NTP_SHM_H
+#define GUARD_NTP_SHM_H
+
+#include <time.h>
+
+#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
+# include <stdatomic.h>
+#endif /* HAVE_STDATOMIC_H */
+
+#define SHM_KEY_BASE	0x4e545030	/* "NTP0", the key of segment NTP0 */
+
+struct shmTime {
+	int    mode; /* 0 - if valid is set:
+		      *       use values,
+		      *       clear valid
+		      * 1 - if valid is set:
+		      *       if count before and after read of values is equal,
+		      *         use values
+		      *       clear valid
+		      */
+	volatile int    count;
+	time_t		clockTimeStampSec;
+	int		clockTimeStampUSec;
+	time_t		receiveTimeStampSec;
+	int		receiveTimeStampUSec;
+	int		leap;
+	int		precision;
+	int		nsamples;
+	volatile int    valid;
+	unsigned	clockTimeStampNSec;	/* Unsigned ns timestamps */
+	unsigned	receiveTimeStampNSec;	/* Unsigned ns timestamps */
+	int		dummy[8];
+};
+
+/* order the reads of a segment against the producer's writes */
+static inline void memory_barrier(void) {
+#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
+	atomic_thread_fence(memory_order_seq_cst);
+#endif /* HAVE_STDATOMIC_H */
+}
+
+#endif /* GUARD_NTP_SHM_H */
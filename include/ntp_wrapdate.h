@@ -1,4 +1,6 @@
 /* calendar / date helpers for GPS devices */
+#ifndef GUARD_NTP_WRAPDATE_H
+#define GUARD_NTP_WRAPDATE_H
 
 /*
  * NMEA gps week/time information
@@ -20,4 +22,5 @@ bool	gpsfix_century	(struct calendar * jd, const gps_weektm * wd,
 				 unsigned short * ccentury);
 l_fp    eval_gps_time	(const char *, const struct calendar * gpst,
 			 const struct timespec * gpso, bool trustl, short *epoch_wrap, const l_fp * xrecv);
+#endif	/* GUARD_NTP_WRAPDATE_H */
 // end
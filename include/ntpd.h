@@ -94,6 +94,7 @@ extern	endpt *	select_peerinterface	(struct peer *, sockaddr_u *,
 					 endpt *);
 extern	endpt *	findinterface		(sockaddr_u *);
 extern	void	interface_update	(interface_receiver_t, void *);
+extern	void	interface_rescan	(void);
 extern  void    io_handler              (void);
 extern	void	init_io		(void);
 extern	void	io_open_sockets	(void);
@@ -108,6 +109,11 @@ extern  uint64_t sent_count(void);
 extern  uint64_t notsent_count(void);
 extern  uint64_t handler_calls_count(void);
 extern  uint64_t handler_pkts_count(void);
+extern  uint64_t if_scans_count(void);
+extern  uint64_t if_events_count(void);
+extern  uint64_t kernel_drops_count(void);
+extern	void	io_prefilter	(bool);
+extern	void	io_prefilter_check	(void);
 extern  uptime_t counter_reset_time(void);
 
 /* ntp_loopfilter.c */
@@ -144,6 +150,13 @@ extern	struct peer *newpeer	(sockaddr_u *, const char *,
 				 uint8_t, const bool);
 extern	void	peer_add_hash (struct peer *);
 extern	void	peer_del_hash (struct peer *);
+struct peer_hash_stats {
+	unsigned int	size;		/* buckets */
+	unsigned int	entries;	/* peers in the table */
+	unsigned int	slots;		/* buckets in use */
+	unsigned int	longest;	/* longest chain */
+};
+extern	void	peer_hash_stats	(bool, struct peer_hash_stats *);
 extern	void	peer_all_reset	(void);
 extern	void	peer_clr_stats	(void);
 extern	void	refresh_all_peerinterfaces(void);
@@ -164,6 +177,7 @@ extern	double	sys_mindist;
 extern	double	sys_maxdisp;
 
 extern	void	poll_update	(struct peer *, uint8_t);
+extern	int	peer_throttle	(struct peer *);
 
 extern	void	clock_filter	(struct peer *, double, double, double);
 extern	void	init_proto	(const bool);
@@ -190,6 +204,57 @@ extern void set_use_stattime(uptime_t stattime);
 
 
 
+/* ntp_filter.c */
+extern	void	filter_sort	(struct peer *, double, double,
+				 unsigned long, bool, double *, int *);
+
+/* ntp_snapshot.c */
+/*
+ * The system variables as replies report them, published as a whole
+ * by the main thread and readable from any.
+ */
+struct sys_snapshot {
+	uint8_t	leap;			/* system leap indicator */
+	uint8_t	stratum;		/* system stratum */
+	int8_t	precision;		/* local clock precision */
+	bool	smearing;		/* leap smear in progress */
+	double	rootdelay;		/* roundtrip delay to primary source */
+	double	rootdisp;		/* dispersion to primary source */
+	double	rootdist;		/* distance to primary source */
+	refid_t	refid;			/* reference id */
+	l_fp	reftime;		/* last update time */
+	l_fp	smear_offset;		/* current leap smear offset */
+	uint8_t	reply[LEN_PKT_NOMAC];	/* server reply header, wire format */
+};
+extern	void	sys_snapshot_publish	(const struct sys_snapshot *);
+extern	unsigned int	sys_snapshot_read	(struct sys_snapshot *);
+extern	void	sys_reply_header	(struct pkt *,
+					 const struct sys_snapshot *,
+					 uint8_t, uint8_t, uint64_t, l_fp);
+
+/* ntp_prefilter.c */
+struct sock_filter;
+extern	int	prefilter_build	(int, struct sock_filter *, int);
+extern	bool	prefilter_attach	(SOCKET, int);
+extern	void	prefilter_detach	(SOCKET);
+extern	uint64_t	socket_drops	(SOCKET);
+
+/* ntp_select.c */
+/*
+ * peer_select groups statistics for a peer used by clock_select() and
+ * clock_cluster().
+ */
+typedef struct peer_select_tag {
+	struct peer *	peer;
+	double		synch;	/* sync distance */
+	double		error;	/* jitter */
+	double		seljit;	/* selection jitter */
+} peer_select;
+
+extern	void	select_intersect (const peer_select *, int, double *,
+				  double *);
+extern	int	select_cluster	(peer_select *, int, int, int);
+
 /* ntp_restrict.c */
 extern	void	init_restrict	(void);
 extern	unsigned short	restrictions	(sockaddr_u *);
@@ -198,15 +263,35 @@ extern	void	hack_restrict	(int, sockaddr_u *, sockaddr_u *,
 extern	void	restrict_source		(struct peer *);
 extern	void	unrestrict_source	(struct peer *);
 
+/* ntp_sched.c */
+struct sched_event {
+	struct sched_event *next;
+	struct timespec	due;		/* CLOCK_MONOTONIC */
+	void		(*func)(struct sched_event *);
+	bool		pending;	/* on the list */
+};
+extern	void	sched_at	(struct sched_event *, struct timespec);
+extern	void	sched_cancel	(struct sched_event *);
+extern	bool	sched_next	(struct timespec *);
+extern	struct sched_event *sched_due (struct timespec);
+
 /* ntp_timer.c */
 extern	void	init_timer	(void);
 extern	void	reinit_timer	(void);
 extern	void	timer		(void);
+extern	void	timer_poll_soon	(void);
 extern	void	timer_clr_stats (void);
 extern	void	timer_interfacetimeout (uptime_t);
 extern	int	interface_interval;
+extern	int	timer_fd;		/* timerfd, or -1 for SIGALRM */
 extern	uptime_t	orphwait;		/* orphan wait time */
 
+/* ntp_wheel.c */
+extern	bool	wheel_schedule	(struct peer *);
+extern	void	wheel_hurry	(void);
+extern	void	wheel_unschedule (struct peer *);
+extern	struct peer *wheel_due	(uptime_t);
+
 /* ntp_util.c */
 extern	void	init_util	(void);
 extern	void	write_stats	(void);
@@ -292,6 +377,17 @@ struct ntp_loop_data {
 };
 extern struct ntp_loop_data loop_data;
 
+/*
+ * How the loop filter adjusts the clock
+ */
+struct timex;
+struct clock_hooks {
+  bool (*step)(double);            /* step the clock by an offset (s) */
+  bool (*adjust)(double);          /* slew the clock by an offset (s) */
+  int  (*adjtime)(struct timex *); /* kernel discipline, ntp_adjtime() */
+};
+extern struct clock_hooks clock_hooks;
+
 /*
  * Clock state machine control flags
  */
@@ -390,6 +486,7 @@ struct system_variables {
 	struct peer *sys_peer;		/* current peer */
 };
 extern struct system_variables sys_vars;
+extern void	sys_publish	(void);
 
 /*
  * Nonspecified system state variables.
@@ -413,6 +510,7 @@ struct restriction_data {
   restrict_u *restrictlist6; /* IPv6 restriction list */
   int        ntp_minpkt;     /* minimum (log 2 s) */
   uint8_t    ntp_minpoll;    /* increment (log 2 s) */
+  unsigned int generation;   /* changes with the lists */
 };
 extern struct restriction_data rstrct;
 
@@ -229,6 +229,7 @@ typedef struct clocktime clocktime_t;
 #define PARSE_INP_SYNTH 0x08	/* just pass up synthesized time */
 
 typedef unsigned long parse_inp_fnc_t(parse_t *, char, timestamp_t *);
+typedef unsigned long parse_blk_fnc_t(parse_t *, const char *, size_t, size_t *, timestamp_t *);
 typedef unsigned long parse_cvt_fnc_t(unsigned char *, int, struct format *, clocktime_t *, void *);
 typedef unsigned long parse_pps_fnc_t(parse_t *, int, timestamp_t *);
 
@@ -246,6 +247,8 @@ struct clockformat {
 	const char     *name;		/* clock format name */
 	unsigned short  length;	/* maximum length of data packet */
 	unsigned short  plen;		/* length of private data - implies fixed format */
+	/* input of a whole read, as input would take it byte by byte - optional */
+	parse_blk_fnc_t *input_block;
 };
 
 typedef struct clockformat clockformat_t;
@@ -273,6 +276,7 @@ extern unsigned short nformats;
 extern bool  parse_ioinit (parse_t *);
 extern void parse_ioend (parse_t *);
 extern int  parse_ioread (parse_t *, char, timestamp_t *);
+extern int  parse_ioread_block (parse_t *, char *, size_t, size_t *, timestamp_t *);
 extern void parse_iodone (parse_t *);
 extern bool  parse_timecode (parsectl_t *, parse_t *);
 extern int  parse_getfmt (parsectl_t *, parse_t *);
@@ -282,6 +286,18 @@ extern bool  parse_setcs (parsectl_t *, parse_t *);
 extern unsigned int parse_addchar (parse_t *, char);
 extern unsigned int parse_end (parse_t *);
 
+/*
+ * block input of messages framed by a start and an end character:
+ * when the sample is stamped
+ */
+#define PARSE_STAMP_NONE	0	/* not here */
+#define PARSE_STAMP_START	1	/* at the start character */
+#define PARSE_STAMP_END		2	/* at the end character */
+#define PARSE_STAMP_FIRST	3	/* at the first character buffered */
+#define PARSE_NOSTART		(-1)	/* no start character */
+
+extern unsigned int parse_addblock (parse_t *, const char *, size_t, size_t *, int, int, int, timestamp_t *);
+
 extern int Strok (const unsigned char *, const unsigned char *)
 		__attribute__((pure));
 extern int Stoi (const unsigned char *, long *, int);
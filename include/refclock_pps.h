@@ -18,4 +18,6 @@ typedef enum {
 
 extern	bool	refclock_ppsapi(int, struct refclock_ppsctl *);
 extern	bool	refclock_params(int, struct refclock_ppsctl *);
+extern pps_status refclock_ppsfetch(struct peer *, struct refclock_ppsctl *,
+				     int, l_fp *, double *);
 extern pps_status refclock_catcher(struct peer *, struct refclock_ppsctl *, int);
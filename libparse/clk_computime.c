@@ -55,6 +55,7 @@ static struct format computime_fmt =
 
 static parse_cvt_fnc_t cvt_computime;
 static parse_inp_fnc_t inp_computime;
+static parse_blk_fnc_t blk_computime;
 
 clockformat_t clock_computime =
 {
@@ -64,7 +65,8 @@ clockformat_t clock_computime =
 	(void *)&computime_fmt,	/* conversion configuration */
 	"Diem's Computime Radio Clock",	/* Computime Radio Clock */
 	24,			/* string buffer */
-	0			/* no private data (complete packets) */
+	0,			/* no private data (complete packets) */
+	blk_computime	/* block input handling */
 };
 
 /*
@@ -149,6 +151,24 @@ inp_computime(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_computime
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_computime(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, 'T', '\n',
+			      PARSE_STAMP_START, tstamp);
+}
+
 /*
  * clk_computime.c,v
  * Revision 4.10  2005/04/16 17:32:10  kardel
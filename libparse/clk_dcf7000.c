@@ -28,6 +28,7 @@ static struct format dcf7000_fmt =
 
 static parse_cvt_fnc_t cvt_dcf7000;
 static parse_inp_fnc_t inp_dcf7000;
+static parse_blk_fnc_t blk_dcf7000;
 
 clockformat_t clock_dcf7000 = {
 	inp_dcf7000,			/* DCF7000 input handling */
@@ -36,7 +37,8 @@ clockformat_t clock_dcf7000 = {
 	(void *)&dcf7000_fmt,		/* conversion configuration */
 	"ELV DCF7000",		/* ELV clock */
 	24,				/* string buffer */
-	0				/* no private data (complete packets) */
+	0,				/* no private data (complete packets) */
+	blk_dcf7000		/* block input handling */
 };
 
 /*
@@ -140,6 +142,24 @@ inp_dcf7000(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_dcf7000
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_dcf7000(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, PARSE_NOSTART, '\r',
+			      PARSE_STAMP_END, tstamp);
+}
+
 /*
  * History:
  *
@@ -105,6 +105,7 @@ static struct format hopf6021_fmt =
 
 static parse_cvt_fnc_t cvt_hopf6021;
 static parse_inp_fnc_t inp_hopf6021;
+static parse_blk_fnc_t blk_hopf6021;
 
 clockformat_t clock_hopf6021 =
 {
@@ -114,7 +115,8 @@ clockformat_t clock_hopf6021 =
   (void *)&hopf6021_fmt,        /* conversion configuration */
   "hopf Funkuhr 6021",          /* clock format name */
   19,                           /* string buffer */
-  0                            /* private data length, no private data */
+  0,                            /* private data length, no private data */
+  blk_hopf6021                  /* block input handling */
 };
 
 /* parse_cvt_fnc_t cvt_hopf6021 */
@@ -233,6 +235,24 @@ inp_hopf6021(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_hopf6021
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_hopf6021(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, PARSE_NOSTART, ETX,
+			      PARSE_STAMP_END, tstamp);
+}
+
 /*
  * History:
  *
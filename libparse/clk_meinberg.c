@@ -181,6 +181,7 @@ static struct format meinberg_fmt[] =
 static parse_cvt_fnc_t cvt_meinberg;
 static parse_cvt_fnc_t cvt_mgps;
 static parse_inp_fnc_t mbg_input;
+static parse_blk_fnc_t mbg_input_block;
 static parse_inp_fnc_t gps_input;
 
 struct msg_buf
@@ -203,7 +204,8 @@ clockformat_t clock_meinberg[] =
 		0,		/* conversion configuration */
 		"Meinberg Standard", /* Meinberg simple format - beware */
 		32,				/* string buffer */
-		0		/* no private data (complete packets) */
+		0,		/* no private data (complete packets) */
+		mbg_input_block	/* block input handling */
 	},
 	{
 		mbg_input,	/* normal input handling */
@@ -212,7 +214,8 @@ clockformat_t clock_meinberg[] =
 		0,		/* conversion configuration */
 		"Meinberg Extended", /* Meinberg enhanced format */
 		32,		/* string buffer */
-		0		/* no private data (complete packets) */
+		0,		/* no private data (complete packets) */
+		mbg_input_block	/* block input handling */
 	},
 	{
 		gps_input,	/* no input handling */
@@ -221,7 +224,8 @@ clockformat_t clock_meinberg[] =
 		(void *)&meinberg_fmt[2], /* conversion configuration */
 		"Meinberg GPS Extended",  /* Meinberg FAU GPS format */
 		512,		/* string buffer */
-		sizeof(struct msg_buf)	/* no private data (complete packets) */
+		sizeof(struct msg_buf),	/* no private data (complete packets) */
+		0		/* binary messages, byte by byte */
 	}
 };
 
@@ -421,6 +425,24 @@ mbg_input(
 	}
 }
 
+/*
+ * parse_blk_fnc_t mbg_input_block
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+mbg_input_block(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, STX, ETX,
+			      PARSE_STAMP_START, tstamp);
+}
+
 
 /*
  * parse_cvt_fnc_t cvt_mgps
@@ -83,7 +83,8 @@ clockformat_t clock_rawdcf = {
 	"RAW DCF77 Timecode",		/* direct decoding / time synthesis */
 
 	BUFFER_MAX,			/* bit buffer */
-	sizeof(last_tcode_t)
+	sizeof(last_tcode_t),
+	0				/* bits are timed one by one */
 };
 
 static struct dcfparam
@@ -44,6 +44,7 @@ static struct format rcc8000_fmt = {
 
 static parse_cvt_fnc_t cvt_rcc8000;
 static parse_inp_fnc_t inp_rcc8000;
+static parse_blk_fnc_t blk_rcc8000;
 
 clockformat_t clock_rcc8000 = {
 	inp_rcc8000,			/* no input handling */
@@ -52,7 +53,8 @@ clockformat_t clock_rcc8000 = {
 	(void *)&rcc8000_fmt,		/* conversion configuration */
 	"Radiocode RCC8000",
 	31,				/* string buffer */
-	0				/* no private data */
+	0,				/* no private data */
+	blk_rcc8000		/* block input handling */
 };
 
 /* parse_cvt_fnc_t cvt_rcc8000 */
@@ -151,6 +153,24 @@ inp_rcc8000(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_rcc8000
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_rcc8000(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, PARSE_NOSTART, '\n',
+			      PARSE_STAMP_FIRST, tstamp);
+}
+
 /*
  * History:
  *
@@ -52,6 +52,7 @@
 
 static parse_cvt_fnc_t cvt_schmid;
 static parse_inp_fnc_t inp_schmid;
+static parse_blk_fnc_t blk_schmid;
 
 clockformat_t clock_schmid = {
 	inp_schmid,			/* no input handling */
@@ -61,6 +62,7 @@ clockformat_t clock_schmid = {
 	"Schmid",			/* Schmid receiver */
 	12,				/* binary data buffer */
 	0,				/* no private data (complete messages) */
+	blk_schmid		/* block input handling */
 };
 
 /* parse_cvt_fnc_t */
@@ -170,6 +172,24 @@ inp_schmid(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_schmid
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_schmid(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, PARSE_NOSTART, 0xFD,
+			      PARSE_STAMP_NONE, tstamp);
+}
+
 /*
  * History:
  *
@@ -34,6 +34,7 @@
 //////////////////////////////////////////////////////////////////////////////
 
 static parse_inp_fnc_t inp_sel240x;
+static parse_blk_fnc_t blk_sel240x;
 static parse_cvt_fnc_t cvt_sel240x;
 
 // Parse clock format structure describing the message above
@@ -64,7 +65,8 @@ clockformat_t clock_sel240x =
 	(void*)&sel240x_fmt,
 	"SEL B8",
 	25,
-	0
+	0,
+	blk_sel240x
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -100,6 +102,24 @@ inp_sel240x( parse_t      *parseio,
 	return rc;
 }
 
+/*
+ * parse_blk_fnc_t blk_sel240x
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_sel240x(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, '\x01', '\n',
+			      PARSE_STAMP_START, tstamp);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 static unsigned long
 cvt_sel240x( unsigned char *buffer,
@@ -40,6 +40,7 @@
 
 static parse_cvt_fnc_t cvt_trimtaip;
 static parse_inp_fnc_t inp_trimtaip;
+static parse_blk_fnc_t blk_trimtaip;
 
 clockformat_t clock_trimtaip =
 {
@@ -49,7 +50,8 @@ clockformat_t clock_trimtaip =
   (void *)&trimsv6_fmt,		/* conversion configuration */
   "Trimble TAIP",
   37,				/* string buffer */
-  0				/* no private data */
+  0,				/* no private data */
+  blk_trimtaip			/* block input handling */
 };
 
 /* parse_cvt_fnc_t cvt_trimtaip */
@@ -144,6 +146,24 @@ inp_trimtaip(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_trimtaip
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_trimtaip(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, '>', '<',
+			      PARSE_STAMP_START, tstamp);
+}
+
 /*
  * History:
  *
@@ -91,7 +91,8 @@ struct clockformat clock_trimtsip =
 	0,			/* no configuration data */
 	"Trimble TSIP",
 	400,			/* input buffer */
-	sizeof(struct trimble)	/* private data */
+	sizeof(struct trimble),	/* private data */
+	0			/* DLE stuffing is undone byte by byte */
 };
 
 #define ADDSECOND	0x01
@@ -86,6 +86,7 @@ clockformat_t   clock_varitext = {
 	"Varitext Radio Clock",	/* Varitext Radio Clock */
 	30,				/* string buffer */
 	sizeof(struct varitext),	/* Private data size required to hold current parse state */
+	0,				/* start and end are two characters each */
 };
 
 /*
@@ -57,6 +57,7 @@
 
 static parse_cvt_fnc_t cvt_wharton_400a;
 static parse_inp_fnc_t inp_wharton_400a;
+static parse_blk_fnc_t blk_wharton_400a;
 
 /*
  * parse_cvt_fnc_t cvt_wharton_400a
@@ -146,6 +147,24 @@ inp_wharton_400a(
 	}
 }
 
+/*
+ * parse_blk_fnc_t blk_wharton_400a
+ *
+ * grab a whole read from input stream
+ */
+static unsigned long
+blk_wharton_400a(
+	parse_t      *parseio,
+	const char   *buf,
+	size_t        len,
+	size_t       *used,
+	timestamp_t  *tstamp
+	)
+{
+	return parse_addblock(parseio, buf, len, used, STX, ETX,
+			      PARSE_STAMP_START, tstamp);
+}
+
 clockformat_t   clock_wharton_400a =
 {
 	inp_wharton_400a,	/* input handling function */
@@ -154,7 +173,8 @@ clockformat_t   clock_wharton_400a =
 	0,			/* conversion configuration */
 	"WHARTON 400A Series clock Output Format 1",	/* String format name */
 	15,			/* string buffer */
-	0			/* no private data (complete packets) */
+	0,			/* no private data (complete packets) */
+	blk_wharton_400a	/* block input handling */
 };
 
 /*
@@ -160,70 +160,154 @@ parse_end(
 	return PARSE_INP_TIME;
 }
 
-/*ARGSUSED*/
-int
-parse_ioread(
-	parse_t *parseio,
-	char ch,
-	timestamp_t *tstamp
+/*
+ * parse_addblock
+ *
+ * block input for formats whose messages run from a start character
+ * (PARSE_NOSTART for none) to an end character: does to the len bytes
+ * at buf what their per character input does - start the buffer anew
+ * at the start character, collect up to and including the end character
+ * and then hand the message on - but finds the delimiters with memchr()
+ * and copies what lies between them in one piece.  stamp tells where
+ * the sample is stamped.  Returns at the first completed message or
+ * overflow, with *used set to the bytes consumed.
+ */
+unsigned int
+parse_addblock(
+	       parse_t *parseio,
+	       const char *buf,
+	       size_t len,
+	       size_t *used,
+	       int start,
+	       int end,
+	       int stamp,
+	       timestamp_t *tstamp
+	       )
+{
+	const char *cp = buf;
+	const char *ep = buf + len;
+	const char *dp;		/* next delimiter, or ep */
+	const char *sp;		/* next start character, or NULL */
+	unsigned int rtc;
+	size_t n, room;
+
+	while (cp < ep) {
+		dp = memchr(cp, end, (size_t)(ep - cp));
+		if (NULL == dp) {
+			dp = ep;
+		}
+		sp = NULL;
+		if (PARSE_NOSTART != start) {
+			sp = memchr(cp, start, (size_t)(dp - cp));
+			if (NULL != sp) {
+				dp = sp;
+			}
+		}
+
+		n = (size_t)(dp - cp);
+		if (n) {
+			if (PARSE_STAMP_FIRST == stamp && !parseio->parse_index) {
+				parseio->parse_dtime.parse_stime = *tstamp;
+			}
+			room = parseio->parse_dsize - parseio->parse_index;
+			if (n > room) {
+				/*
+				 * buffer overflow - attempt to make the best of it
+				 */
+				memcpy(parseio->parse_data + parseio->parse_index, cp, room);
+				parseio->parse_index += (unsigned short)room;
+				cp += room;
+				*used = (size_t)(cp + 1 - buf);
+				return parse_restart(parseio, *cp);
+			}
+			memcpy(parseio->parse_data + parseio->parse_index, cp, n);
+			parseio->parse_index += (unsigned short)n;
+			cp = dp;
+		}
+		if (cp == ep) {
+			break;
+		}
+
+		if (NULL != sp) {
+			parseprintf(DD_PARSE, ("parse: parse_addblock: START seen\n"));
+			parseio->parse_index = 1;
+			parseio->parse_data[0] = *cp++;
+			if (PARSE_STAMP_START == stamp) {
+				parseio->parse_dtime.parse_stime = *tstamp;
+			}
+			continue;
+		}
+
+		parseprintf(DD_PARSE, ("parse: parse_addblock: END seen\n"));
+		if (PARSE_STAMP_END == stamp) {
+			parseio->parse_dtime.parse_stime = *tstamp;
+		}
+		*used = (size_t)(cp + 1 - buf);
+		if ((rtc = parse_addchar(parseio, *cp)) == PARSE_INP_SKIP) {
+			return parse_end(parseio);
+		}
+		return rtc;
+	}
+
+	*used = len;
+	return PARSE_INP_SKIP;
+}
+
+/*
+ * the bits of a character that are data at the configured character size
+ *
+ * within STREAMS CSx (x < 8) chars still have the upper bits set
+ * so we normalize the characters by masking unnecessary bits off.
+ *
+ * (ESR, 2015: Probably not necessary since STREAMS support has
+ * been removed, but harmless.)
+ */
+static char
+parse_csmask(
+	parse_t *parseio
 	)
 {
-	unsigned int updated = CVT_NONE;
-	/*
-	 * within STREAMS CSx (x < 8) chars still have the upper bits set
-	 * so we normalize the characters by masking unnecessary bits off.
-	 *
-	 * (ESR, 2015: Probably not necessary since STREAMS support has
-	 * been removed, but harmless.)
-	 */
 	switch (parseio->parse_ioflags & PARSE_IO_CSIZE) {
 	    case PARSE_IO_CS5:
-		ch &= 0x1F;
-		break;
+		return 0x1F;
 
 	    case PARSE_IO_CS6:
-		ch &= 0x3F;
-		break;
+		return 0x3F;
 
 	    case PARSE_IO_CS7:
-		ch &= 0x7F;
-		break;
+		return 0x7F;
 
 	    case PARSE_IO_CS8:
-		ch &= (char) 0xFFU;
-		break;
-
-            default:
+	    default:
                 /* huh? */
-                break;
+		return (char) 0xFFU;
 	}
+}
 
-	parseprintf(DD_PARSE, ("parse_ioread(0x%lx, char=0x%x, ..., ...)\n",
-                    (unsigned long)parseio, (unsigned)(ch & 0xFF)));
+/*
+ * digest what the input handler of the format made of the input:
+ * convert a complete sample and remember when the input came
+ */
+static int
+parse_status(
+	parse_t *parseio,
+	unsigned long input_status,
+	timestamp_t *tstamp
+	)
+{
+	unsigned int updated = CVT_NONE;
 
-	if (!clockformats[parseio->parse_lformat]->convert) {
-		parseprintf(DD_PARSE, ("parse_ioread: input dropped.\n"));
-		return CVT_NONE;
+	if (input_status & PARSE_INP_SYNTH) {
+		updated = CVT_OK;
 	}
 
-	if (clockformats[parseio->parse_lformat]->input) {
-		unsigned long input_status;
-
-		input_status = clockformats[parseio->parse_lformat]->input(parseio, ch, tstamp);
-
-		if (input_status & PARSE_INP_SYNTH) {
-			updated = CVT_OK;
-		}
-
-		if (input_status & PARSE_INP_TIME) {	/* time sample is available */
-			updated = (unsigned int) timepacket(parseio);
-		}
-
-		if (input_status & PARSE_INP_DATA) { /* got additional data */
-			updated |= CVT_ADDITIONAL;
-		}
+	if (input_status & PARSE_INP_TIME) {	/* time sample is available */
+		updated = (unsigned int) timepacket(parseio);
 	}
 
+	if (input_status & PARSE_INP_DATA) { /* got additional data */
+		updated |= CVT_ADDITIONAL;
+	}
 
 	/*
 	 * remember last character time
@@ -242,6 +326,86 @@ parse_ioread(
 		((updated & CVT_ADDITIONAL) != 0));
 }
 
+/*ARGSUSED*/
+int
+parse_ioread(
+	parse_t *parseio,
+	char ch,
+	timestamp_t *tstamp
+	)
+{
+	unsigned long input_status = PARSE_INP_SKIP;
+
+	ch &= parse_csmask(parseio);
+
+	parseprintf(DD_PARSE, ("parse_ioread(0x%lx, char=0x%x, ..., ...)\n",
+                    (unsigned long)parseio, (unsigned)(ch & 0xFF)));
+
+	if (!clockformats[parseio->parse_lformat]->convert) {
+		parseprintf(DD_PARSE, ("parse_ioread: input dropped.\n"));
+		return CVT_NONE;
+	}
+
+	if (clockformats[parseio->parse_lformat]->input) {
+		input_status = clockformats[parseio->parse_lformat]->input(parseio, ch, tstamp);
+	}
+
+	return parse_status(parseio, input_status, tstamp);
+}
+
+/*
+ * parse_ioread_block
+ *
+ * feed a whole read of len bytes at buf, all received at tstamp, as
+ * parse_ioread() would take it byte by byte.  Returns as soon as there
+ * is something to report, with *used set to the bytes consumed - the
+ * caller comes back for the rest.  Formats that scan a whole read for
+ * their delimiters do so in one go, the others get the bytes one by
+ * one.  buf is masked to the character size in place.
+ */
+int
+parse_ioread_block(
+	parse_t *parseio,
+	char *buf,
+	size_t len,
+	size_t *used,
+	timestamp_t *tstamp
+	)
+{
+	clockformat_t *fmt = clockformats[parseio->parse_lformat];
+	char mask;
+	size_t i;
+
+	if (!fmt->input_block || !fmt->convert) {
+		for (i = 0; i < len; i++) {
+			if (parse_ioread(parseio, buf[i], tstamp)) {
+				*used = i + 1;
+				return true;
+			}
+		}
+		*used = len;
+		return false;
+	}
+
+	mask = parse_csmask(parseio);
+	if ((char) 0xFFU != mask) {
+		for (i = 0; i < len; i++) {
+			buf[i] &= mask;
+		}
+	}
+
+	parseprintf(DD_PARSE, ("parse_ioread_block(0x%lx, %lu chars, ..., ...)\n",
+                    (unsigned long)parseio, (unsigned long)len));
+
+	*used = len;
+	if (0 == len) {
+		return false;
+	}
+	return parse_status(parseio,
+			    fmt->input_block(parseio, buf, len, used, tstamp),
+			    tstamp);
+}
+
 /*
  * parse_iodone
  *
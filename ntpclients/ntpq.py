@@ -1502,6 +1502,25 @@ usage: sysstats
         self.say("""\
 function: display monitor (mrulist) counters and limits
 usage: monstats
+""")
+
+    def do_hashstats(self, _line):
+        "display peer and association hash table occupancy"
+        hashstats = (
+            ("peer_hashsize",     "address buckets:      ", NTP_INT),
+            ("peer_hashslots",    "address slots in use: ", NTP_INT),
+            ("peer_hashlongest",  "address longest chain:", NTP_INT),
+            ("assoc_hashsize",    "assocID buckets:      ", NTP_INT),
+            ("assoc_hashslots",   "assocID slots in use: ", NTP_INT),
+            ("assoc_hashlongest", "assocID longest chain:", NTP_INT),
+        )
+        self.collect_display(associd=0, variables=hashstats,
+                             decodestatus=False)
+
+    def help_hashstats(self):
+        self.say("""\
+function: display peer and association hash table occupancy
+usage: hashstats
 """)
 
 # FIXME: This table should move to ntpd
@@ -1582,6 +1601,9 @@ usage: ntsinfo
             ("io_sendfailed", "packet send failures: ", NTP_INT),
             ("io_wakeups", "input wakeups:        ", NTP_INT),
             ("io_goodwakeups", "useful input wakeups: ", NTP_INT),
+            ("io_ifscans", "interface scans:      ", NTP_INT),
+            ("io_ifevents", "interface events:     ", NTP_INT),
+            ("io_kdropped", "kernel drops:         ", NTP_INT),
         )
         self.collect_display(associd=0, variables=iostats, decodestatus=False)
 
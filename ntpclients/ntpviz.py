@@ -8,6 +8,8 @@ ntpviz [-d LOGDIR]
        [-c | --clip]
        [-e endtime]
        [-g]
+       [-j JOBS | --jobs JOBS]
+       [-m POINTS | --max-points POINTS]
        [-n name]
        [-N | --nice]
        [-o OUTDIR]
@@ -45,12 +47,14 @@ import collections
 import csv
 import datetime
 import math
+import multiprocessing
 import re
 import os
 import socket
 import sys
 import subprocess
 import tempfile
+import time
 try:
     import argparse
 except ImportError:
@@ -149,11 +153,100 @@ class MyArgumentParser(argparse.ArgumentParser):
         return arg_line.split()
 
 
+# (phase, name, seconds) for each timed step, see timed()
+timings = []
+pr = None
+run_start = time.time()
+
+
 def print_profile():
     """called by atexit() on normal exit to print profile data"""
-    pr.disable()
-    pr.print_stats('tottime')
-    pr.print_stats('cumtime')
+    if pr is not None:
+        pr.disable()
+        pr.print_stats('tottime')
+        pr.print_stats('cumtime')
+
+    if not timings:
+        return
+    # times from worker processes overlap, so the phase totals can
+    # add up to more than the wall clock time
+    sys.stderr.write("ntpviz: INFO: timing profile, %d jobs, %.3f s wall\n"
+                     % (args.jobs, time.time() - run_start))
+    totals = collections.OrderedDict()
+    for (phase, name, secs) in sorted(timings, key=lambda t: -t[2]):
+        sys.stderr.write("  %-8s %9.3f s  %s\n" % (phase, secs, name))
+        totals[phase] = totals.get(phase, 0) + secs
+    for (phase, secs) in totals.items():
+        sys.stderr.write("  %-8s %9.3f s  total\n" % (phase, secs))
+
+
+def timed(phase, name, func, *params):
+    "Call func(*params), and note how long that took in timings."
+    begin = time.time()
+    ret = func(*params)
+    timings.append((phase, name, time.time() - begin))
+    return ret
+
+
+def init_worker(options, sites):
+    "Set up the globals of a worker process in the --jobs pool."
+    global args, statlist
+    args = options
+    statlist = sites
+
+
+def job_timings(mark):
+    "Remove and return the timings noted since len(timings) was mark."
+    ret = timings[mark:]
+    del timings[mark:]
+    return ret
+
+
+def load_site(params):
+    "Pool job: read the logs of one site, return (NTPViz, timings)."
+    mark = len(timings)
+    site = timed("load", params["statsdir"], lambda: NTPViz(**params))
+    return (site, job_timings(mark))
+
+
+def plot_site(job):
+    """Pool job: compute one plot of a site, and unless told not to, run
+    it through gnuplot.  Return (plot, timings)."""
+    (site, imagename, method, params, outfile) = job
+    mark = len(timings)
+    image = timed("compute", imagename,
+                  getattr(statlist[site], method), *params)
+    if image and outfile is not None:
+        try:
+            timed("gnuplot", imagename, gnuplot, image['plot'], outfile)
+        except SystemExit as e:
+            # a pool worker must not exit, let the parent do it
+            return (e, job_timings(mark))
+        # the parent has no use for the plot data any more
+        image['plot'] = ''
+    return (image, job_timings(mark))
+
+
+def run_jobs(func, jobs, sites=None):
+    """Map func over jobs, in a pool of args.jobs processes when that
+    is more than one.  Results come back in order."""
+    if 1 >= args.jobs or 1 >= len(jobs):
+        results = [func(job) for job in jobs]
+    else:
+        pool = multiprocessing.Pool(min(args.jobs, len(jobs)), init_worker,
+                                    (args, sites))
+        try:
+            results = pool.map(func, jobs, 1)
+        finally:
+            pool.close()
+            pool.join()
+    ret = []
+    for (result, times) in results:
+        timings.extend(times)
+        if isinstance(result, SystemExit):
+            raise result
+        ret.append(result)
+    return ret
 
 
 # standard deviation class
@@ -471,39 +564,48 @@ set rmargin 10
         "slice 0,item1, maybe item2, from rows, ready for gnuplot"
         # speed up by only sending gnuplot the data it will actually use
         # WARNING: this is hot code, only modify if you profile
-        # since we are looping the data, get the values too
+        # rows is a StatTable; the values come from all of it, the plot
+        # from a bounded sample of it when --max-points is given
         plot_data = ''
         last_time = 0
-        values1 = []
-        values2 = []
         if item2:
-            for row in rows:
-                try:
-                    values1.append(float(row[item1]))
-                    values2.append(float(row[item2]))
-                    if 2200000 < row[0] - last_time:
-                        # more than 2,200 seconds between points
-                        # data loss, add a break in the plot line
-                        plot_data += '\n'
-                    # fields: time, fld1, and fld2
-                    plot_data += row[1] + ' ' + row[item1] + ' ' \
-                        + row[item2] + '\n'
-                    last_time = row[0]
-                except IndexError:
-                    pass
+            pairs = [(value1, value2) for (value1, value2)
+                     in zip(rows.column(item1), rows.column(item2))
+                     if value1 == value1 and value2 == value2]
+            values1 = [pair[0] for pair in pairs]
+            values2 = [pair[1] for pair in pairs]
         else:
-            for row in rows:
-                try:
-                    values1.append(float(row[item1]))
-                    if 2200000 < row[0] - last_time:
-                        # more than 2,200 seconds between points
-                        # data loss, add a break in the plot line
-                        plot_data += '\n'
-                    # fields: time, fld
-                    plot_data += row[1] + ' ' + row[item1] + '\n'
-                    last_time = row[0]
-                except IndexError:
-                    pass
+            values1 = rows.values(item1)
+        if args.max_points and len(rows) > args.max_points:
+            rows = rows.downsample(args.max_points // 2, "minmax", item1)
+
+        times = rows.column(1)
+        if item2:
+            for (stamp, value1, value2) in zip(times, rows.column(item1),
+                                               rows.column(item2)):
+                if value1 != value1 or value2 != value2:
+                    # missing field
+                    continue
+                if 2200 < stamp - last_time:
+                    # more than 2,200 seconds between points
+                    # data loss, add a break in the plot line
+                    plot_data += '\n'
+                # fields: time, fld1, and fld2
+                plot_data += repr(stamp) + ' ' + repr(value1) + ' ' \
+                    + repr(value2) + '\n'
+                last_time = stamp
+        else:
+            for (stamp, value1) in zip(times, rows.column(item1)):
+                if value1 != value1:
+                    # missing field
+                    continue
+                if 2200 < stamp - last_time:
+                    # more than 2,200 seconds between points
+                    # data loss, add a break in the plot line
+                    plot_data += '\n'
+                # fields: time, fld
+                plot_data += repr(stamp) + ' ' + repr(value1) + '\n'
+                last_time = stamp
 
         # I know you want to replace the plot_data string concat with
         # or more join()s, do not do it, it is slower
@@ -1185,7 +1287,7 @@ plot \
         # TODO normalize to 0 to 100?
 
         # grab and sort the values, no need for the timestamp, etc.
-        values = [float(row[2]) for row in self.loopstats]
+        values = self.loopstats.values(2)
         stats = VizStats(values, 'Local Clock Offset')
         out = stats.percs
         out["fmt_x"] = stats.percs["fmt"]
@@ -1421,6 +1523,12 @@ Python by ESR, concept and gnuplot code by Dan Drown.
                         action="store_true",
                         dest='generate',
                         help="Run through gnuplot to make plot images")
+    parser.add_argument('-j', '--jobs',
+                        default=1,
+                        dest='jobs',
+                        help="Number of sites or plots to work on at "
+                             "once, 0 for one per CPU",
+                        type=int)
     parser.add_argument('-n', '--name',
                         default=socket.getfqdn(),
                         dest='sitename',
@@ -1436,6 +1544,12 @@ Python by ESR, concept and gnuplot code by Dan Drown.
     except OSError:
         pass
 
+    parser.add_argument('-m', '--max-points',
+                        default=0,
+                        dest='max_points',
+                        help="Plot at most this many points per series, "
+                             "0 for all",
+                        type=int)
     parser.add_argument('-o', '--outdir',
                         default="ntpgraphs",
                         dest='outdir',
@@ -1522,6 +1636,12 @@ Python by ESR, concept and gnuplot code by Dan Drown.
 
     args = parser.parse_args()
 
+    if 0 == args.jobs:
+        args.jobs = multiprocessing.cpu_count()
+    elif 0 > args.jobs:
+        sys.stderr.write("ntpviz: ERROR: --jobs must not be negative\n")
+        raise SystemExit(1)
+
     if args.nice:
         # run at lowest possible priority
         nice = os.nice(19)
@@ -1589,8 +1709,8 @@ Python by ESR, concept and gnuplot code by Dan Drown.
             pr = cProfile.Profile()
             pr.enable()
 
-            # register to dump debug on all normal exits
-            atexit.register(print_profile)
+        # register to dump timings, and profile, on all normal exits
+        atexit.register(print_profile)
 
     nice = 19       # always run nicely
     if 0 != nice:
@@ -1630,14 +1750,13 @@ Python by ESR, concept and gnuplot code by Dan Drown.
     plot = None
 
     if 1 == len(args.statsdirs):
-        statlist = [NTPViz(statsdir=args.statsdirs[0], sitename=args.sitename,
-                           period=args.period, starttime=args.starttime,
-                           endtime=args.endtime)]
+        sites = [dict(statsdir=args.statsdirs[0], sitename=args.sitename)]
     else:
-        statlist = [NTPViz(statsdir=d, sitename=d,
-                           period=args.period, starttime=args.starttime,
-                           endtime=args.endtime)
-                    for d in args.statsdirs]
+        sites = [dict(statsdir=d, sitename=d) for d in args.statsdirs]
+    for site in sites:
+        site.update(period=args.period, starttime=args.starttime,
+                    endtime=args.endtime)
+    statlist = run_jobs(load_site, sites)
 
     if len(statlist) == 1:
         stats = statlist[0]
@@ -1937,39 +2056,50 @@ ntpviz</a>, part of the <a href="https://www.ntpsec.org/">NTPsec project</a>
     if len(statlist) > 1:
         index_buffer += local_offset_multiplot(statlist)
     else:
-        # imagepairs in the order of the html entries
-        imagepairs = [
-            ("local-offset", stats.local_offset_gnuplot()),
+        # plots in the order of the html entries: image name, method
+        # and its arguments
+        plotlist = [
+            ("local-offset", "local_offset_gnuplot", ()),
             # skipa next one, redundant to one above
-            # ("local-error", stats.local_error_gnuplot()),
-            ("local-jitter", stats.local_offset_jitter_gnuplot()),
-            ("local-stability", stats.local_offset_stability_gnuplot()),
-            ("local-offset-histogram", stats.local_offset_histogram_gnuplot()),
-            ("local-temps", stats.local_temps_gnuplot()),
-            ("local-freq-temps", stats.local_freq_temps_plot()),
-            ("local-gps", stats.local_gps_gnuplot()),
-            ("peer-offsets", stats.peer_offsets_gnuplot()),
+            # ("local-error", "local_error_gnuplot", ()),
+            ("local-jitter", "local_offset_jitter_gnuplot", ()),
+            ("local-stability", "local_offset_stability_gnuplot", ()),
+            ("local-offset-histogram", "local_offset_histogram_gnuplot",
+             ()),
+            ("local-temps", "local_temps_gnuplot", ()),
+            ("local-freq-temps", "local_freq_temps_plot", ()),
+            ("local-gps", "local_gps_gnuplot", ()),
+            ("peer-offsets", "peer_offsets_gnuplot", ()),
         ]
 
         peerlist = list(stats.peersplit().keys())
         # sort for output order stability
         peerlist.sort()
         for key in peerlist:
-            imagepairs.append(("peer-offset-" + key,
-                               stats.peer_offsets_gnuplot([key])))
+            plotlist.append(("peer-offset-" + key,
+                             "peer_offsets_gnuplot", ([key],)))
 
-        imagepairs.append(("peer-jitters",
-                           stats.peer_jitters_gnuplot()))
+        plotlist.append(("peer-jitters", "peer_jitters_gnuplot", ()))
         for key in peerlist:
-            imagepairs.append(("peer-jitter-" + key,
-                               stats.peer_jitters_gnuplot([key])))
+            plotlist.append(("peer-jitter-" + key,
+                             "peer_jitters_gnuplot", ([key],)))
+
+        # compute and draw the plots, in parallel with --jobs
+        # Windows hates colons in filename
+        images = run_jobs(plot_site,
+                          [(0, imagename, method, params,
+                            os.path.join(args.outdir,
+                                         imagename.replace(':', '-') +
+                                         args.img_ext))
+                           for (imagename, method, params) in plotlist],
+                          statlist)
 
         stats = []
-        for (imagename, image) in imagepairs:
+        for ((imagename, method, params), image) in zip(plotlist, images):
             if not image:
                 continue
             if 1 <= args.debug_level:
-                sys.stderr.write("ntpviz: plotting %s\n" % image['title'])
+                sys.stderr.write("ntpviz: plotted %s\n" % image['title'])
             stats.append(image['stats'])
             # give each H2 an unique ID.
             div_id = image['title'].lower().replace(' ', '_').replace(':', '_')
@@ -1986,8 +2116,6 @@ ntpviz</a>, part of the <a href="https://www.ntpsec.org/">NTPsec project</a>
             if image['html']:
                 index_buffer += "<div>\n%s</div>\n" % image['html']
             index_buffer += "<br><br>\n"
-            gnuplot(image['plot'], os.path.join(args.outdir,
-                    imagename + args.img_ext))
             index_buffer += "</div>\n"
 
     # dump stats
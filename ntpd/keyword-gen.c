@@ -88,7 +88,9 @@ struct key_tok ntp_keywords[] = {
 { "noselect",		T_Noselect,		FOLLBY_TOKEN },
 { "true",		T_True,			FOLLBY_TOKEN },
 { "prefer",		T_Prefer,		FOLLBY_TOKEN },
+{ "stages",		T_Stages,		FOLLBY_TOKEN },
 { "subtype",		T_Subtype,		FOLLBY_TOKEN },
+{ "thread",		T_Thread,		FOLLBY_TOKEN },
 { "version",		T_Version,		FOLLBY_TOKEN },
 /*** MONITORING COMMANDS ***/
 /* stat */
@@ -104,6 +106,8 @@ struct key_tok ntp_keywords[] = {
 { "link",		T_Link,			FOLLBY_TOKEN },
 { "nolink",		T_Nolink,		FOLLBY_TOKEN },
 { "type",		T_Type,			FOLLBY_TOKEN },
+{ "text",		T_Text,			FOLLBY_TOKEN },
+{ "binary",		T_Binary,		FOLLBY_TOKEN },
 /* filegen_type */
 { "age",		T_Age,			FOLLBY_TOKEN },
 { "day",		T_Day,			FOLLBY_TOKEN },
@@ -171,6 +175,7 @@ struct key_tok ntp_keywords[] = {
 { "calibrate",		T_Calibrate,		FOLLBY_TOKEN },
 { "kernel",		T_Kernel,		FOLLBY_TOKEN },
 { "ntp",		T_Ntp,			FOLLBY_TOKEN },
+{ "prefilter",		T_Prefilter,		FOLLBY_TOKEN },
 { "stats",		T_Stats,		FOLLBY_TOKEN },
 /* rlimit_option */
 { "memlock",		T_Memlock,		FOLLBY_TOKEN },
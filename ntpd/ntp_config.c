@@ -621,6 +621,10 @@ create_peer_node(
 				my_node->ctl.flags |= FLAG_PREFER;
 				break;
 
+			case T_Thread:
+				my_node->ctl.flags |= FLAG_THREAD;
+				break;
+
 			case T_True:
 				my_node->ctl.flags |= FLAG_TRUE;
 				break;
@@ -715,6 +719,18 @@ create_peer_node(
 			my_node->ctl.baud = option->value.u;
 			break;
 
+		case T_Stages:
+			if (option->value.i < 1 ||
+			    option->value.i > STAGELIMIT) {
+				msyslog(LOG_ERR,
+					"CONFIG: stages: value (%d) out of range [1-%d]",
+					option->value.i, STAGELIMIT);
+				errflag = true;
+			} else {
+				my_node->ctl.stages = option->value.u;
+			}
+			break;
+
 			/*
 			 * Past this point are options the old syntax
 			 * handled in fudge processing. They're parsed
@@ -1393,6 +1409,14 @@ config_monitor(
 					filegen_flag &= ~FGEN_FLAG_LINK;
 					break;
 
+				case T_Binary:
+					filegen_flag |= FGEN_FLAG_BINARY;
+					break;
+
+				case T_Text:
+					filegen_flag &= ~FGEN_FLAG_BINARY;
+					break;
+
 				case T_Enable:
 					filegen_flag |= FGEN_FLAG_ENABLED;
 					break;
@@ -2121,6 +2145,7 @@ config_nic_rules(
 
 		add_nic_rule(match_type, if_name, prefixlen,
 			     action);
+		interface_rescan();
 		timer_interfacetimeout(current_time + 2);
 		if (if_name != NULL)
 			free(if_name);
@@ -2187,6 +2212,10 @@ apply_enable_disable(
 			proto_config(PROTO_NTP, (unsigned long)enable, 0.);
 			break;
 
+		case T_Prefilter:
+			io_prefilter(enable);
+			break;
+
 		case T_Stats:
 			proto_config(PROTO_FILEGEN, (unsigned long)enable, 0.);
 			break;
@@ -82,7 +82,7 @@ static	void	ctl_putclock	(int, struct refclockstat *, int);
 #endif	/* REFCLOCK */
 static	const struct ctl_var *ctl_getitem(const struct ctl_var *,
 					  char **);
-static	unsigned short ctlsysstatus	(void);
+static	unsigned short ctlsysstatus	(uint8_t);
 static	unsigned short	count_var	(const struct ctl_var *);
 static	void	control_unspec	(struct recvbuf *, int);
 static	void	read_status	(struct recvbuf *, int);
@@ -388,6 +388,24 @@ static const struct ctl_var sys_var[] = {
 #define CS_MRU_HASHSLOTS	106
 	{ CS_MRU_HASHSLOTS,		RO, "mru_hashslots" },
 #endif
+#define CS_PEER_HASHSIZE	(CS_MRU_HASHSLOTS + 1)
+	{ CS_PEER_HASHSIZE,	RO, "peer_hashsize" },
+#define CS_PEER_HASHSLOTS	(CS_MRU_HASHSLOTS + 2)
+	{ CS_PEER_HASHSLOTS,	RO, "peer_hashslots" },
+#define CS_PEER_HASHLONGEST	(CS_MRU_HASHSLOTS + 3)
+	{ CS_PEER_HASHLONGEST,	RO, "peer_hashlongest" },
+#define CS_ASSOC_HASHSIZE	(CS_MRU_HASHSLOTS + 4)
+	{ CS_ASSOC_HASHSIZE,	RO, "assoc_hashsize" },
+#define CS_ASSOC_HASHSLOTS	(CS_MRU_HASHSLOTS + 5)
+	{ CS_ASSOC_HASHSLOTS,	RO, "assoc_hashslots" },
+#define CS_ASSOC_HASHLONGEST	(CS_MRU_HASHSLOTS + 6)
+	{ CS_ASSOC_HASHLONGEST,	RO, "assoc_hashlongest" },
+#define CS_IO_IFSCANS		(CS_MRU_HASHSLOTS + 7)
+	{ CS_IO_IFSCANS,	RO, "io_ifscans" },
+#define CS_IO_IFEVENTS		(CS_MRU_HASHSLOTS + 8)
+	{ CS_IO_IFEVENTS,	RO, "io_ifevents" },
+#define CS_IO_KDROPPED		(CS_MRU_HASHSLOTS + 9)
+	{ CS_IO_KDROPPED,	RO, "io_kdropped" },
 #define	CS_MAXCODE		((sizeof(sys_var)/sizeof(sys_var[0])) - 1)
 	{ 0,                    EOV, "" }
 };
@@ -538,7 +556,11 @@ static const struct ctl_var clock_var[] = {
 	{ CC_FLAGS,		RO|DEF, "flags" },
 #define	CC_DEVICE	12
 	{ CC_DEVICE,		RO|DEF, "device" },
-#define	CC_VARLIST	13
+#define	CC_IODELAY	13
+	{ CC_IODELAY,		RO|DEF, "iodelay" },
+#define	CC_SAMPLES	14
+	{ CC_SAMPLES,		RO|DEF, "samples" },
+#define	CC_VARLIST	15
 	{ CC_VARLIST,		RO, 	"clock_var_list"},
 #define	CC_MAXCODE	CC_VARLIST
 	{ 0,			EOV,	""  }
@@ -601,6 +623,7 @@ static uint8_t	res_opcode;
 static associd_t res_associd;
 static unsigned short	res_frags;	/* datagrams in this response */
 static int	res_offset;	/* offset of payload in response */
+static struct sys_snapshot ctl_sys; /* system variables as of the request */
 static uint8_t * datapt;
 static int	datalinelen;
 static bool	datasent;	/* flag to avoid initial ", " */
@@ -764,7 +787,8 @@ process_control(
 	 * Pull enough data from the packet to make intelligent
 	 * responses
 	 */
-	rpkt.li_vn_mode = PKT_LI_VN_MODE(sys_vars.sys_leap, res_version,
+	sys_snapshot_read(&ctl_sys);
+	rpkt.li_vn_mode = PKT_LI_VN_MODE(ctl_sys.leap, res_version,
 					 MODE_CONTROL);
 	res_opcode = pkt->r_m_e_op;
 	rpkt.sequence = pkt->sequence;
@@ -912,10 +936,13 @@ ctlclkstatus(
 
 
 /*
- * ctlsysstatus - return the system status word
+ * ctlsysstatus - return the system status word, with leap for the
+ * leap indicator
  */
 static unsigned short
-ctlsysstatus(void)
+ctlsysstatus(
+	uint8_t	leap
+	)
 {
 	uint8_t this_clock;
 
@@ -929,7 +956,7 @@ ctlsysstatus(void)
 	if (sys_vars.sys_peer != 0)
 		this_clock = CTL_SST_TS_NTP;
 #endif /* REFCLOCK */
-	return CTL_SYS_STATUS(sys_vars.sys_leap, this_clock, ctl_sys_num_events,
+	return CTL_SYS_STATUS(leap, this_clock, ctl_sys_num_events,
 			      ctl_sys_last_event);
 }
 
@@ -1361,26 +1388,26 @@ ctl_putsys(
 
 	switch (varid) {
 
-	CASE_UINT(CS_LEAP, sys_vars.sys_leap);
+	CASE_UINT(CS_LEAP, ctl_sys.leap);
 
-	CASE_UINT(CS_STRATUM, sys_vars.sys_stratum);
+	CASE_UINT(CS_STRATUM, ctl_sys.stratum);
 
-	CASE_INT(CS_PRECISION, sys_vars.sys_precision);
+	CASE_INT(CS_PRECISION, ctl_sys.precision);
 
-	CASE_DBL(CS_ROOTDELAY, sys_vars.sys_rootdelay * MS_PER_S);
+	CASE_DBL(CS_ROOTDELAY, ctl_sys.rootdelay * MS_PER_S);
 
-	CASE_DBL(CS_ROOTDISPERSION, sys_vars.sys_rootdisp * MS_PER_S);
+	CASE_DBL(CS_ROOTDISPERSION, ctl_sys.rootdisp * MS_PER_S);
 
 	case CS_REFID:
-		if (sys_vars.sys_stratum > 1 &&
-                    sys_vars.sys_stratum < STRATUM_UNSPEC)
-			ctl_putadr(sys_var[varid].text, sys_vars.sys_refid,
+		if (ctl_sys.stratum > 1 &&
+                    ctl_sys.stratum < STRATUM_UNSPEC)
+			ctl_putadr(sys_var[varid].text, ctl_sys.refid,
                                    NULL);
 		else
-			ctl_putrefid(sys_var[varid].text, sys_vars.sys_refid);
+			ctl_putrefid(sys_var[varid].text, ctl_sys.refid);
 		break;
 
-	CASE_TS(CS_REFTIME, &sys_vars.sys_reftime);
+	CASE_TS(CS_REFTIME, &ctl_sys.reftime);
 
 	CASE_UINT(CS_POLL, clkstate.sys_poll);
 
@@ -1502,6 +1529,31 @@ ctl_putsys(
 
 	CASE_UINT(CS_MRU_HASHSLOTS, mon_data.mru_hashslots);
 
+	case CS_PEER_HASHSIZE:
+	case CS_PEER_HASHSLOTS:
+	case CS_PEER_HASHLONGEST:
+	case CS_ASSOC_HASHSIZE:
+	case CS_ASSOC_HASHSLOTS:
+	case CS_ASSOC_HASHLONGEST: {
+		struct peer_hash_stats hs;
+
+		peer_hash_stats(varid >= CS_ASSOC_HASHSIZE, &hs);
+		switch (varid) {
+		case CS_PEER_HASHSIZE:
+		case CS_ASSOC_HASHSIZE:
+			ctl_putuint(CV_NAME, hs.size);
+			break;
+		case CS_PEER_HASHSLOTS:
+		case CS_ASSOC_HASHSLOTS:
+			ctl_putuint(CV_NAME, hs.slots);
+			break;
+		default:
+			ctl_putuint(CV_NAME, hs.longest);
+			break;
+		}
+		break;
+		}
+
 	case CS_MRU_MEM: {
 		uint64_t u;
 		u = mon_data.mru_entries * sizeof(mon_entry);
@@ -1747,6 +1799,12 @@ ctl_putsys(
         ctl_putuint(sys_var[varid].text, handler_pkts_count());
 		break;
 
+	CASE_UINT(CS_IO_IFSCANS, if_scans_count());
+
+	CASE_UINT(CS_IO_IFEVENTS, if_events_count());
+
+	CASE_UINT(CS_IO_KDROPPED, kernel_drops_count());
+
 	CASE_UINT(CS_TIMERSTATS_RESET, current_time - timer_timereset);
 
 	CASE_UINT(CS_TIMER_OVERRUNS, alarm_overflow);
@@ -1775,7 +1833,7 @@ ctl_putsys(
 
 	CASE_UINT(CS_NUMCTLREQ, numctlreq);
 
-	CASE_DBL(CS_ROOTDISTANCE, sys_vars.sys_rootdist * MS_PER_S);
+	CASE_DBL(CS_ROOTDISTANCE, ctl_sys.rootdist * MS_PER_S);
 
 #ifndef DISABLE_NTS
 	CASE_UINT(CS_nts_client_send, nts_client_send);
@@ -1874,7 +1932,7 @@ ctl_putpeer(
 				: 0);
 		break;
 
-	CASE_UINT(CP_RATE, p->throttle);
+	CASE_UINT(CP_RATE, peer_throttle(p));
 
 	CASE_UINT(CP_LEAP, p->leap);
 
@@ -2162,6 +2220,46 @@ ctl_putclock(
 		}
 		break;
 
+	case CC_IODELAY:
+		if (pcs->iodelay == NULL || 0 == pcs->iodelay->count) {
+			if (mustput)
+				ctl_putstr(clock_var[id].text, "", 0);
+		} else {
+			const struct refclockdelay *rd = pcs->iodelay;
+			char buf[128];
+
+			snprintf(buf, sizeof(buf),
+				 "n=%lu mean=%.3f p50=%.3f p99=%.3f max=%.3f",
+				 rd->count, rd->sum / rd->count * MS_PER_S,
+				 refclock_delay_quantile(rd, 0.5) * MS_PER_S,
+				 refclock_delay_quantile(rd, 0.99) * MS_PER_S,
+				 rd->max * MS_PER_S);
+			ctl_putstr(clock_var[id].text, buf, strlen(buf));
+		}
+		break;
+
+	case CC_SAMPLES:
+		if (pcs->summary == NULL || 0 == pcs->summary->count) {
+			if (mustput)
+				ctl_putstr(clock_var[id].text, "", 0);
+		} else {
+			const struct refclocksummary *rs = pcs->summary;
+			char buf[160];
+			int len;
+
+			len = snprintf(buf, sizeof(buf),
+				       "stages=%d n=%d kept=%d offset=%.3f jitter=%.3f",
+				       pcs->stages, rs->count, rs->kept,
+				       rs->offset * MS_PER_S,
+				       rs->jitter * MS_PER_S);
+			if (rs->tau > 0 && len > 0 && len < (int)sizeof(buf))
+				snprintf(buf + len, sizeof(buf) - (size_t)len,
+					 " tau=%.3f adev=%.3e rate=%.3f",
+					 rs->tau, rs->adev, rs->rate * US_PER_S);
+			ctl_putstr(clock_var[id].text, buf, strlen(buf));
+		}
+		break;
+
 	case CC_VARLIST:
 		(void)CF_VARLIST(&clock_var[id], clock_var, pcs->kv_list);
 		break;
@@ -2354,7 +2452,7 @@ control_unspec(
 		}
 		rpkt.status = htons(ctlpeerstatus(peer));
 	} else
-		rpkt.status = htons(ctlsysstatus());
+		rpkt.status = htons(ctlsysstatus(ctl_sys.leap));
 	ctl_flushpkt(0);
 }
 
@@ -2403,7 +2501,7 @@ read_status(
 		return;
 	}
 	n = 0;
-	rpkt.status = htons(ctlsysstatus());
+	rpkt.status = htons(ctlsysstatus(ctl_sys.leap));
 	for (peer = peer_list; peer != NULL; peer = peer->p_link) {
 		a_st[n++] = htons(peer->associd);
 		a_st[n++] = htons(ctlpeerstatus(peer));
@@ -2487,7 +2585,7 @@ read_sysvars(void)
 	 * Wants system variables. Figure out which he wants
 	 * and give them to him.
 	 */
-	rpkt.status = htons(ctlsysstatus());
+	rpkt.status = htons(ctlsysstatus(ctl_sys.leap));
 	if (NULL != res_auth)  /* FIXME: what's this for?? */
 		ctl_sys_num_events = 0;
 	wants_count = CS_MAXCODE + 1 + count_var(ext_sys_var);
@@ -2596,7 +2694,7 @@ write_variables(
 	/*
 	 * Set status
 	 */
-	rpkt.status = htons(ctlsysstatus());
+	rpkt.status = htons(ctlsysstatus(ctl_sys.leap));
 
 	/*
 	 * Look through the variables. Dump out at the first sign of
@@ -3871,6 +3969,8 @@ read_clockstatus(
 	 * status.
 	 */
 	cs.kv_list = NULL;
+	cs.iodelay = NULL;
+	cs.summary = NULL;
 	refclock_control(&peer->srcadr, NULL, &cs);
 	kv = cs.kv_list;
 	/*
@@ -3984,7 +4084,7 @@ report_event(
 		ctl_sys_num_events++;
 		snprintf(statstr, sizeof(statstr),
 		    "0.0.0.0 %04x %02x %s",
-		    ctlsysstatus(), (unsigned)err, eventstr(err));
+		    ctlsysstatus(sys_vars.sys_leap), (unsigned)err, eventstr(err));
 		if (str != NULL) {
 			len = strlen(statstr);
 			snprintf(statstr + len, sizeof(statstr) - len,
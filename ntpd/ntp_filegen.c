@@ -43,6 +43,8 @@ static	void	filegen_open	(FILEGEN *, const time_t);
 static	int	valid_fileref	(const char *, const char *)
 			         __attribute__((pure));
 static	void	filegen_init	(const char *, const char *, FILEGEN *);
+static	void	filegen_header	(const FILEGEN *, FILE *);
+static	void	filegen_put_u16	(filegen_record *, uint16_t);
 #ifdef	DEBUG
 static	void	filegen_uninit		(FILEGEN *);
 #endif	/* DEBUG */
@@ -66,6 +68,9 @@ filegen_init(
 	fgp->id_hi = 0;
 	fgp->type = FILEGEN_DAY;
 	fgp->flag = FGEN_FLAG_LINK; /* not yet enabled !!*/
+	fgp->cols = NULL;
+	fgp->ncols = 0;
+	fgp->reclen = 0;
 }
 
 
@@ -108,7 +113,8 @@ filegen_open(
 	filename = emalloc(len);
 	fullname = emalloc(len);
 	savename = NULL;
-	snprintf(filename, len, "%s%s", gen->dir, gen->fname);
+	snprintf(filename, len, "%s%s%s", gen->dir, gen->fname,
+		 (gen->flag & FGEN_FLAG_BINARY) ? ".bin" : "");
 
 	/* where to place suffix */
 	suflen = strlcpy(fullname, filename, len);
@@ -291,6 +297,9 @@ filegen_open(
 		}
 		gen->fp = fp;
 
+		if (gen->flag & FGEN_FLAG_BINARY)
+			filegen_header(gen, fp);
+
 		if (gen->flag & FGEN_FLAG_LINK) {
 			/*
 			 * need to link file to basename
@@ -315,6 +324,44 @@ filegen_open(
 	return;
 }
 
+/*
+ * write the self-describing header of a binary generation file,
+ * unless we are appending to one that already has it
+ */
+static void
+filegen_header(
+	const FILEGEN *	gen,
+	FILE *		fp
+	)
+{
+	filegen_record hdr;
+	struct stat stats;
+	unsigned int i;
+
+	if (fstat(fileno(fp), &stats) != 0 || stats.st_size != 0)
+		return;
+
+	hdr.len = 0;
+	filegen_put_string(&hdr, FILEGEN_BIN_MAGIC, 8);
+	filegen_put_u16(&hdr, (uint16_t)(FILEGEN_BIN_HDRLEN
+				+ gen->ncols * FILEGEN_BIN_COLLEN));
+	filegen_put_u16(&hdr, gen->reclen);
+	filegen_put_u16(&hdr, gen->ncols);
+	filegen_put_u16(&hdr, 0);
+	filegen_put_string(&hdr, gen->fname, 16);
+	fwrite(hdr.buf, hdr.len, 1, fp);
+
+	for (i = 0; i < gen->ncols; i++) {
+		hdr.len = 0;
+		filegen_put_string(&hdr, gen->cols[i].name,
+				   FILEGEN_BIN_NAMELEN);
+		hdr.buf[hdr.len++] = (uint8_t)gen->cols[i].type;
+		hdr.buf[hdr.len++] = gen->cols[i].width;
+		fwrite(hdr.buf, hdr.len, 1, fp);
+	}
+	fflush(fp);
+}
+
 /*
  * this function sets up gen->fp to point to the correct
  * generation of the file for the time specified by 'now'
@@ -400,6 +447,13 @@ filegen_config(
 		return;
 }
 
+	if ((flag & FGEN_FLAG_BINARY) && NULL == gen->cols) {
+		msyslog(LOG_ERR,
+			"LOG: no binary format for \"%s\", writing text",
+			gen->fname);
+		flag &= ~(unsigned int)FGEN_FLAG_BINARY;
+	}
+
 	if (NULL != gen->fp) {
 		fclose(gen->fp);
 		gen->fp = NULL;
@@ -486,6 +540,130 @@ valid_fileref(
 }
 
 
+/*
+ * filegen_columns - declare the binary record layout of a file set
+ */
+void
+filegen_columns(
+	FILEGEN *		gen,
+	const filegen_column *	cols,
+	unsigned int		ncols
+	)
+{
+	unsigned int i;
+	unsigned int reclen = 0;
+
+	for (i = 0; i < ncols; i++)
+		reclen += cols[i].width;
+	INSIST(reclen <= FILEGEN_RECMAX);
+
+	gen->cols = cols;
+	gen->ncols = (uint8_t)ncols;
+	gen->reclen = (uint16_t)reclen;
+}
+
+
+/*
+ * filegen_write - append one binary record to the current generation
+ */
+void
+filegen_write(
+	FILEGEN *		gen,
+	const filegen_record *	rec
+	)
+{
+	if (NULL == gen->fp)
+		return;
+
+	if (rec->len != gen->reclen) {
+		msyslog(LOG_ERR,
+			"LOG: %s record length %zu, expected %u",
+			gen->fname, rec->len, gen->reclen);
+		return;
+	}
+	fwrite(rec->buf, rec->len, 1, gen->fp);
+	fflush(gen->fp);
+}
+
+
+/*
+ * binary record assembly, little-endian, no padding
+ */
+static void
+filegen_put_u16(
+	filegen_record *	rec,
+	uint16_t		val
+	)
+{
+	REQUIRE(rec->len + 2 <= sizeof(rec->buf));
+	rec->buf[rec->len++] = (uint8_t)val;
+	rec->buf[rec->len++] = (uint8_t)(val >> 8);
+}
+
+void
+filegen_put_u32(
+	filegen_record *	rec,
+	uint32_t		val
+	)
+{
+	int i;
+
+	REQUIRE(rec->len + 4 <= sizeof(rec->buf));
+	for (i = 0; i < 4; i++)
+		rec->buf[rec->len++] = (uint8_t)(val >> (8 * i));
+}
+
+void
+filegen_put_i32(
+	filegen_record *	rec,
+	int32_t			val
+	)
+{
+	filegen_put_u32(rec, (uint32_t)val);
+}
+
+void
+filegen_put_u64(
+	filegen_record *	rec,
+	uint64_t		val
+	)
+{
+	int i;
+
+	REQUIRE(rec->len + 8 <= sizeof(rec->buf));
+	for (i = 0; i < 8; i++)
+		rec->buf[rec->len++] = (uint8_t)(val >> (8 * i));
+}
+
+void
+filegen_put_double(
+	filegen_record *	rec,
+	double			val
+	)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &val, sizeof(bits));
+	filegen_put_u64(rec, bits);
+}
+
+void
+filegen_put_string(
+	filegen_record *	rec,
+	const char *		str,
+	size_t			width
+	)
+{
+	size_t slen;
+
+	REQUIRE(rec->len + width <= sizeof(rec->buf));
+	slen = strnlen(str, width);
+	memcpy(&rec->buf[rec->len], str, slen);
+	memset(&rec->buf[rec->len + slen], 0, width - slen);
+	rec->len += width;
+}
+
+
 /*
  * filegen registry
  */
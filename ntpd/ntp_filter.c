@@ -0,0 +1,104 @@
+/*
+ * ntp_filter.c - the sample sort of clock_filter()
+ *
+ * clock_filter() runs for every sample of every association.  Each
+ * time it ages the dispersions of the NTP_SHIFT stages of the shift
+ * register, computes a distance for each and sorts the stages by it.
+ *
+ * The register is always eight stages, so the sort is a fixed sorting
+ * network: 19 compare-exchanges in six layers, where the exchange sort
+ * it replaces took 28 compares and a data dependent number of swaps.
+ * The compare-exchanges are written as selects rather than branches,
+ * and the stages of a layer are independent, so the compiler can keep
+ * it all in registers and vectorize it where the target allows.  The
+ * aging runs over the register arrays of the peer in storage order
+ * for the same reason.
+ *
+ * Stages at the same distance are ordered newest first.  The exchange
+ * sort left them in an order that depended on the history of the
+ * sort; the sample picked, the first, is the same either way.
+ */
+#include "config.h"
+
+#include "ntpd.h"
+
+/*
+ * filter_cswap - the compare-exchange of the network: order stages a
+ * and b by distance, and by age if that is the same
+ */
+#define filter_cswap(a, b)						\
+do {									\
+	bool	swap_ = (dist[a] > dist[b]) |				\
+	    (!(dist[a] < dist[b]) & (age[a] > age[b]));		\
+	double	d_ = swap_ ? dist[b] : dist[a];				\
+	int	t_ = swap_ ? age[b] : age[a];				\
+									\
+	dist[b] = swap_ ? dist[a] : dist[b];				\
+	dist[a] = d_;							\
+	age[b] = swap_ ? age[a] : age[b];				\
+	age[a] = t_;							\
+} while (false)
+
+
+/*
+ * filter_sort - age the dispersions of the shift register of a peer
+ * by aging, except for the newest sample, and return the distances of
+ * the stages in dst[] and their register indexes in ord[], newest
+ * first.  If sort is true, both are sorted by distance.
+ *
+ * A stage whose dispersion has reached maxdisp is clamped there, and
+ * so is its distance.  Otherwise the distance is its delay, plus its
+ * dispersion if it is older than allan seconds.
+ */
+void
+filter_sort(
+	struct peer *	peer,
+	double		aging,
+	double		maxdisp,
+	unsigned long	allan,
+	bool		sort,
+	double *	dst,
+	int *		ord
+	)
+{
+	double	dist[NTP_SHIFT];
+	int	age[NTP_SHIFT];
+	int	newest;
+	int	i, t;
+
+	newest = (peer->filter_nextpt + NTP_SHIFT - 1) % NTP_SHIFT;
+	for (i = 0; i < NTP_SHIFT; i++) {
+		if (i != newest)
+			peer->filter_disp[i] += aging;
+		if (peer->filter_disp[i] >= maxdisp)
+			peer->filter_disp[i] = maxdisp;
+	}
+	for (i = 0; i < NTP_SHIFT; i++) {
+		t = (newest + NTP_SHIFT - i) % NTP_SHIFT;
+		if (peer->filter_disp[t] >= maxdisp)
+			dist[i] = maxdisp;
+		else if (peer->update - peer->filter_epoch[t] > allan)
+			dist[i] = peer->filter_delay[t] +
+			    peer->filter_disp[t];
+		else
+			dist[i] = peer->filter_delay[t];
+		age[i] = i;
+	}
+
+	/* an optimal network for eight keys, layer by layer */
+	if (sort) {
+		filter_cswap(0, 2); filter_cswap(1, 3);
+		filter_cswap(4, 6); filter_cswap(5, 7);
+		filter_cswap(0, 4); filter_cswap(1, 5);
+		filter_cswap(2, 6); filter_cswap(3, 7);
+		filter_cswap(0, 1); filter_cswap(2, 3);
+		filter_cswap(4, 5); filter_cswap(6, 7);
+		filter_cswap(2, 4); filter_cswap(3, 5);
+		filter_cswap(1, 4); filter_cswap(3, 6);
+		filter_cswap(1, 2); filter_cswap(3, 4); filter_cswap(5, 6);
+	}
+	for (i = 0; i < NTP_SHIFT; i++) {
+		dst[i] = dist[i];
+		ord[i] = (newest + NTP_SHIFT - age[i]) % NTP_SHIFT;
+	}
+}
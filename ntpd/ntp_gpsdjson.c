@@ -0,0 +1,282 @@
+/*
+ * ntp_gpsdjson.c - index the JSON records of gpsd
+ *
+ * The gpsd refclock gets a TPV record and, with a PPS, a PPS and a
+ * TOFF record every second, and takes up to eight fields from each.
+ * It used to have jsmn split a record into tokens, nested ones like
+ * the satellites of a SKY record included, and then look up each field
+ * by name: a walk over the keys of the record, with a strcmp() against
+ * every one and a recursive skip over every value.
+ *
+ * Instead, one pass over the record finds the keys of the top level
+ * object and files the values of those the refclock knows under a
+ * fixed index, found by a switch on the length of the key and a byte
+ * or two of it.  Nested objects and arrays are stepped over by counting
+ * brackets and are never split up.  Values are left in place in the
+ * record buffer and NUL-terminated there.  Like jsmn, this does not
+ * undo escapes in strings; gpsd does not send any the refclock reads.
+ */
+#include "config.h"
+
+#include <string.h>
+
+#include "ntp_gpsdjson.h"
+
+/* what ends the bytes a scan can step over */
+#define END_STRING	0x01	/* " \ */
+#define END_COMPOUND	0x02	/* " { [ } ] */
+#define END_PRIMITIVE	0x04	/* , : } ] space, and the NUL */
+
+static const unsigned char ends[256] = {
+	['\0'] = END_PRIMITIVE,
+	['\t'] = END_PRIMITIVE, ['\n'] = END_PRIMITIVE,
+	['\r'] = END_PRIMITIVE, [' '] = END_PRIMITIVE,
+	[','] = END_PRIMITIVE, [':'] = END_PRIMITIVE,
+	['"'] = END_STRING | END_COMPOUND,
+	['\\'] = END_STRING,
+	['{'] = END_COMPOUND, ['['] = END_COMPOUND,
+	['}'] = END_COMPOUND | END_PRIMITIVE,
+	[']'] = END_COMPOUND | END_PRIMITIVE,
+};
+
+#define SCAN(cp, ep, what) \
+	while ((cp) < (ep) && !(ends[(unsigned char)*(cp)] & (what))) \
+		++(cp)
+
+/*
+ * key_is - id if the len bytes at k are name, else -1
+ */
+static int
+key_is(
+	const char *	k,
+	const char *	name,
+	int		id
+	)
+{
+	return memcmp(k, name, strlen(name)) ? -1 : id;
+}
+
+
+/*
+ * gpsd_json_key - the index of the key of len bytes at k, or -1 if it
+ * is none the refclock uses
+ */
+int
+gpsd_json_key(
+	const char *	k,
+	size_t		len
+	)
+{
+	switch (len) {
+	case 3:
+		if ('e' == k[0])
+			return key_is(k, "ept", GJK_EPT);
+		if ('s' == k[0])
+			return key_is(k, "shm", GJK_SHM);
+		return key_is(k, "rev", GJK_REV);
+	case 4:
+		if ('j' == k[0])
+			return key_is(k, "json", GJK_JSON);
+		if ('m' == k[0])
+			return key_is(k, "mode", GJK_MODE);
+		return key_is(k, "time", GJK_TIME);
+	case 5:
+		return key_is(k, "class", GJK_CLASS);
+	case 6:
+		if ('d' == k[0])
+			return key_is(k, "device", GJK_DEVICE);
+		return key_is(k, "enable", GJK_ENABLE);
+	case 7:
+		return key_is(k, "release", GJK_RELEASE);
+	case 8:
+		return key_is(k, "real_sec", GJK_REAL_SEC);
+	case 9:
+		if ('c' == k[0])
+			return key_is(k, "clock_sec", GJK_CLOCK_SEC);
+		if ('r' == k[0])
+			return key_is(k, "real_nsec", GJK_REAL_NSEC);
+		return key_is(k, "precision", GJK_PRECISION);
+	case 10:
+		if ('c' == k[0])
+			return key_is(k, "clock_nsec", GJK_CLOCK_NSEC);
+		return key_is(k, "real_musec", GJK_REAL_MUSEC);
+	case 11:
+		if ('c' == k[0])
+			return key_is(k, "clock_musec", GJK_CLOCK_MUSEC);
+		if ('a' == k[7])
+			return key_is(k, "proto_major", GJK_PROTO_MAJOR);
+		return key_is(k, "proto_minor", GJK_PROTO_MINOR);
+	default:
+		return -1;
+	}
+}
+
+
+static char *
+skip_space(
+	char *	cp,
+	char *	ep
+	)
+{
+	while (cp < ep && (' ' == *cp || '\t' == *cp || '\r' == *cp ||
+			   '\n' == *cp))
+		++cp;
+	return cp;
+}
+
+
+/*
+ * string_end - the closing quote of the string whose body starts at
+ * cp, or NULL if there is none before ep
+ */
+static char *
+string_end(
+	char *	cp,
+	char *	ep
+	)
+{
+	for (;;) {
+		SCAN(cp, ep, END_STRING);
+		if (cp == ep)
+			return NULL;
+		if ('"' == *cp)
+			return cp;
+		if (++cp == ep)		/* the escaped byte */
+			return NULL;
+		++cp;
+	}
+}
+
+
+/*
+ * compound_end - just past the object or array that starts at cp, or
+ * NULL if it does not end before ep
+ */
+static char *
+compound_end(
+	char *	cp,
+	char *	ep
+	)
+{
+	unsigned int	depth = 0;
+
+	for (;;) {
+		SCAN(cp, ep, END_COMPOUND);
+		if (cp == ep)
+			return NULL;
+		switch (*cp) {
+		case '{':
+		case '[':
+			++depth;
+			break;
+		case '}':
+		case ']':
+			if (0 == --depth)
+				return cp + 1;
+			break;
+		case '"':
+			cp = string_end(cp + 1, ep);
+			if (NULL == cp)
+				return NULL;
+			break;
+		default:
+			break;
+		}
+		++cp;
+	}
+}
+
+
+/*
+ * gpsd_json_parse - parse the record of len bytes in buf and index it
+ * into rec.  Returns false if it is not a complete JSON object.
+ */
+bool
+gpsd_json_parse(
+	gpsd_json *	rec,
+	char *		buf,
+	size_t		len
+	)
+{
+	char *		cp = buf;
+	char *		ep = buf + len;
+	char *		key;
+	char *		val;
+	char *		vend;
+	size_t		klen;
+	gpsd_jtype	type;
+	int		id;
+	char		sep;
+
+	memset(rec, 0, sizeof(*rec));
+	cp = skip_space(cp, ep);
+	if (cp == ep || '{' != *cp)
+		return false;
+	cp = skip_space(cp + 1, ep);
+	if (cp < ep && '}' == *cp)
+		return true;
+
+	for (;;) {
+		/* "key" : */
+		if (cp == ep || '"' != *cp)
+			return false;
+		key = cp + 1;
+		cp = string_end(key, ep);
+		if (NULL == cp)
+			return false;
+		klen = (size_t)(cp - key);
+		cp = skip_space(cp + 1, ep);
+		if (cp == ep || ':' != *cp)
+			return false;
+		cp = skip_space(cp + 1, ep);
+		if (cp == ep)
+			return false;
+
+		/* the value, up to vend */
+		switch (*cp) {
+		case '"':
+			val = cp + 1;
+			vend = string_end(val, ep);
+			if (NULL == vend)
+				return false;
+			cp = vend + 1;
+			type = GJT_STRING;
+			break;
+		case '{':
+		case '[':
+			val = cp;
+			vend = compound_end(cp, ep);
+			if (NULL == vend)
+				return false;
+			cp = vend;
+			type = GJT_COMPOUND;
+			break;
+		default:
+			val = cp;
+			SCAN(cp, ep, END_PRIMITIVE);
+			if (cp == val)
+				return false;
+			vend = cp;
+			type = GJT_PRIMITIVE;
+			break;
+		}
+
+		/* , or } follows; it may be overwritten by the NUL */
+		cp = skip_space(cp, ep);
+		if (cp == ep)
+			return false;
+		sep = *cp++;
+		if (',' != sep && '}' != sep)
+			return false;
+		*vend = '\0';
+
+		id = gpsd_json_key(key, klen);
+		if (id >= 0 && GJT_NONE == rec->type[id]) {
+			rec->val[id] = val;
+			rec->type[id] = type;
+		}
+		if ('}' == sep)
+			return true;
+		cp = skip_space(cp, ep);
+	}
+}
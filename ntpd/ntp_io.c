@@ -17,6 +17,7 @@
 #include "ntp_io.h"
 #include "ntp_lists.h"
 #include "ntp_refclock.h"
+#include "ntp_refqueue.h"
 #include "ntp_stdlib.h"
 #include "ntp_assert.h"
 #include "ntp_dns.h"
@@ -30,6 +31,7 @@
 # include <net/route.h>
 # ifdef HAVE_LINUX_RTNETLINK_H
 #  include <linux/rtnetlink.h>
+#  include <sys/ioctl.h>
 # endif
 #endif
 
@@ -96,6 +98,10 @@ struct packet_counters {
 	/* It's not needed now that the kernel time stamps packets. */
 	uint64_t handler_calls;	/* number of calls to interrupt handler */
 	uint64_t handler_pkts;	/* number of pkts received by handler */
+	uint64_t if_scans;	/* full interface scans */
+	uint64_t if_events;	/* addresses added or deleted by routing messages */
+	uint64_t kdropped;	/* dropped by the kernel on closed sockets */
+	uint64_t kdropped_base;	/* dropped by the kernel before the reset */
 	uptime_t io_timereset;	/* time counters were reset */
 };
 volatile struct packet_counters pkt_count;
@@ -106,6 +112,22 @@ volatile struct packet_counters pkt_count;
 struct ntp_io_data io_data;
 static int ninterfaces;			/* total # of interfaces */
 
+/*
+ * Kernel prefilter of the sockets, see ntp_prefilter.c
+ */
+static bool prefilter_on;		/* enable prefilter */
+static unsigned int prefilter_gen;	/* restrict generation filtered */
+
+/*
+ * Where the routing socket reports address changes (netlink), they are
+ * applied to the interface list as they arrive, and an interface
+ * update only has to rescan all the addresses after messages were
+ * lost or when a change cannot be applied on its own.
+ */
+static bool	if_incremental;		/* routing socket keeps list current */
+static bool	if_rescan;		/* full interface scan needed */
+static bool	if_found_new;		/* address added since last update */
+
 extern  SOCKET  open_socket     (sockaddr_u *, bool, endpt *);
 
 static bool
@@ -220,7 +242,17 @@ struct remaddr {
 	endpt *			ep;
 };
 
-static remaddr_t * remoteaddr_list;
+/*
+ * The address list maps each local address to its endpt.  It is
+ * hashed by address, and the table doubles whenever it averages
+ * REMADDR_LOAD addresses a bucket.
+ */
+#define	REMADDR_HASH_MIN	16	/* initial buckets */
+#define	REMADDR_LOAD		2
+
+static remaddr_t **	remoteaddr_hash;	/* buckets */
+static unsigned int	remoteaddr_size;	/* buckets, a power of two */
+static unsigned int	remoteaddr_count;	/* addresses in the list */
 
 static endpt *	wildipv4;
 static endpt *	wildipv6;
@@ -255,7 +287,9 @@ static void		maintain_activefds(int fd, bool closing);
 static int	read_network_packet	(SOCKET, endpt *);
 static void input_handler (fd_set *);
 #ifdef REFCLOCK
-static int	read_refclock_packet	(SOCKET, struct refclockio *);
+static int	read_refclock_packet	(SOCKET, struct refclockio *,
+					 const l_fp *);
+static void	read_refclock_queue	(struct refclockio *);
 #endif
 
 /*
@@ -789,6 +823,7 @@ remove_interface(
 			ep->sent,
 			ep->notsent,
 			current_time - ep->starttime);
+		pkt_count.kdropped += socket_drops(ep->fd);
 		close_and_delete_fd_from_list(ep->fd);
 		ep->fd = INVALID_SOCKET;
 	}
@@ -1242,6 +1277,16 @@ refresh_interface(
 #endif /* !OS_MISSES_SPECIFIC_ROUTE_UPDATES */
 }
 
+/*
+ * interface_rescan - have the next interface update scan all the
+ * addresses, as after a change to the nic rules
+ */
+void
+interface_rescan(void)
+{
+	if_rescan = true;
+}
+
 /*
  * interface_update - externally callable update function
  */
@@ -1255,7 +1300,15 @@ interface_update(
 	if (io_data.disable_dynamic_updates)
 		return;
 
-	new_interface_found = update_interfaces(NTP_PORT, receiver, data);
+	if (if_incremental && !if_rescan) {
+		/* phase 3 of update_interfaces() only */
+		refresh_all_peerinterfaces();
+		new_interface_found = if_found_new;
+	} else
+		new_interface_found = update_interfaces(NTP_PORT, receiver,
+							data);
+	if_rescan = false;
+	if_found_new = false;
 
 	if (!new_interface_found)
 		return;
@@ -1383,6 +1436,124 @@ is_valid(
 	return check_flags6(psau, name, flags6) ? false : true;
 }
 
+/*
+ * interface_prototype - fill in the prototype endpt for an address the
+ * system reports and check if and how it is to be used.  Returns false
+ * if it is not.
+ */
+static bool
+interface_prototype(
+	isc_interface_t *	isc_if,
+	endpt *			enumep,
+	unsigned short		port
+	)
+{
+	unsigned int	family;
+
+	/* See if we have a valid family to use */
+	family = isc_if->address.family;
+	if (AF_INET != family && AF_INET6 != family)
+		return false;
+	if (AF_INET == family && !ipv4_works)
+		return false;
+	if (AF_INET6 == family && !ipv6_works)
+		return false;
+
+	/* create prototype */
+	init_interface(enumep);
+
+	convert_isc_if(isc_if, enumep, port);
+
+	DPRINT_INTERFACE(4, (enumep, "examining ", "\n"));
+
+	/*
+	 * Check if and how we are going to use the interface.
+	 */
+	switch (interface_action(enumep->name, &enumep->sin,
+				 enumep->flags)) {
+
+	default:
+	case ACTION_IGNORE:
+		DPRINT(4, ("ignoring interface %s (%s) - by nic rules\n",
+			   enumep->name, socktoa(&enumep->sin)));
+		return false;
+
+	case ACTION_LISTEN:
+		DPRINT(4, ("listen interface %s (%s) - by nic rules\n",
+			   enumep->name, socktoa(&enumep->sin)));
+		enumep->ignore_packets = false;
+		break;
+
+	case ACTION_DROP:
+		DPRINT(4, ("drop on interface %s (%s) - by nic rules\n",
+			   enumep->name, socktoa(&enumep->sin)));
+		enumep->ignore_packets = true;
+		break;
+	}
+
+	/* interfaces must be UP to be usable */
+	if (!(enumep->flags & INT_UP)) {
+		DPRINT(4, ("skipping interface %s (%s) - DOWN\n",
+			   enumep->name, socktoa(&enumep->sin)));
+		return false;
+	}
+
+	/*
+	 * skip any interfaces UP and bound to a wildcard
+	 * address - some dhcp clients produce that in the
+	 * wild
+	 */
+	if (is_wildcard_addr(&enumep->sin))
+		return false;
+
+	if (is_anycast(&enumep->sin, isc_if->name))
+		return false;
+
+	/*
+	 * skip any address that is an invalid state to be used
+	 */
+	if (!is_valid(&enumep->sin, isc_if->name))
+		return false;
+
+	return true;
+}
+
+
+/*
+ * interface_gone - delete an interface whose address has gone away,
+ * reassigning its peers to other interfaces
+ */
+static void
+interface_gone(
+	endpt *			ep,
+	interface_receiver_t	receiver,
+	void *			data
+	)
+{
+	interface_info_t	ifi;
+
+	DPRINT_INTERFACE(3, (ep, "updating ", "GONE - deleting\n"));
+	remove_interface(ep);
+
+	ifi.action = IFS_DELETED;
+	ifi.ep = ep;
+	if (receiver != NULL)
+		(*receiver)(data, &ifi);
+
+	/* disconnect peers from deleted endpt. */
+	while (ep->peers != NULL)
+		set_peerdstadr(ep->peers, NULL);
+
+	/*
+	 * update globals in case we lose
+	 * a loopback interface
+	 */
+	if (ep == io_data.loopback_interface)
+		io_data.loopback_interface = NULL;
+
+	delete_interface(ep);
+}
+
 /*
  * update_interface strategy
  *
@@ -1421,12 +1592,12 @@ update_interfaces(
 	bool			result;
 	isc_interface_t		isc_if;
 	int			new_interface_found;
-	unsigned int		family;
 	endpt			enumep;
 	endpt *			ep;
 	endpt *			next_ep;
 
 	DPRINT(3, ("update_interfaces(%d)\n", port));
+	pkt_count.if_scans++;
 
 	/*
 	 * phase one - scan interfaces
@@ -1456,69 +1627,7 @@ update_interfaces(
 		if (!result)
 			break;
 
-		/* See if we have a valid family to use */
-		family = isc_if.address.family;
-		if (AF_INET != family && AF_INET6 != family)
-			continue;
-		if (AF_INET == family && !ipv4_works)
-			continue;
-		if (AF_INET6 == family && !ipv6_works)
-			continue;
-
-		/* create prototype */
-		init_interface(&enumep);
-
-		convert_isc_if(&isc_if, &enumep, port);
-
-		DPRINT_INTERFACE(4, (&enumep, "examining ", "\n"));
-
-		/*
-		 * Check if and how we are going to use the interface.
-		 */
-		switch (interface_action(enumep.name, &enumep.sin,
-					 enumep.flags)) {
-
-                default:
-		case ACTION_IGNORE:
-			DPRINT(4, ("ignoring interface %s (%s) - by nic rules\n",
-				   enumep.name, socktoa(&enumep.sin)));
-			continue;
-
-		case ACTION_LISTEN:
-			DPRINT(4, ("listen interface %s (%s) - by nic rules\n",
-				   enumep.name, socktoa(&enumep.sin)));
-			enumep.ignore_packets = false;
-			break;
-
-		case ACTION_DROP:
-			DPRINT(4, ("drop on interface %s (%s) - by nic rules\n",
-				   enumep.name, socktoa(&enumep.sin)));
-			enumep.ignore_packets = true;
-			break;
-		}
-
-		 /* interfaces must be UP to be usable */
-		if (!(enumep.flags & INT_UP)) {
-			DPRINT(4, ("skipping interface %s (%s) - DOWN\n",
-				   enumep.name, socktoa(&enumep.sin)));
-			continue;
-		}
-
-		/*
-		 * skip any interfaces UP and bound to a wildcard
-		 * address - some dhcp clients produce that in the
-		 * wild
-		 */
-		if (is_wildcard_addr(&enumep.sin))
-			continue;
-
-		if (is_anycast(&enumep.sin, isc_if.name))
-			continue;
-
-		/*
-		 * skip any address that is an invalid state to be used
-		 */
-		if (!is_valid(&enumep.sin, isc_if.name))
+		if (!interface_prototype(&isc_if, &enumep, port))
 			continue;
 
 		/*
@@ -1645,27 +1754,7 @@ update_interfaces(
 		if ((INT_WILDCARD & ep->flags) || ep->phase == sys_interphase)
 			continue;
 
-		DPRINT_INTERFACE(3, (ep, "updating ",
-				     "GONE - deleting\n"));
-		remove_interface(ep);
-
-		ifi.action = IFS_DELETED;
-		ifi.ep = ep;
-		if (receiver != NULL)
-			(*receiver)(data, &ifi);
-
-		/* disconnect peers from deleted endpt. */
-		while (ep->peers != NULL)
-			set_peerdstadr(ep->peers, NULL);
-
-		/*
-		 * update globals in case we lose
-		 * a loopback interface
-		 */
-		if (ep == io_data.loopback_interface)
-			io_data.loopback_interface = NULL;
-
-		delete_interface(ep);
+		interface_gone(ep, receiver, data);
 	}
 
 	/*
@@ -1949,6 +2038,12 @@ open_socket(
 		set_wildcard_reuse(AF(addr), 1);
 #endif
 
+	/*
+	 * filter before binding, so nothing gets in unfiltered
+	 */
+	if (prefilter_on)
+		prefilter_attach(fd, AF(addr));
+
 	/*
 	 * bind the local address.
 	 */
@@ -2045,31 +2140,70 @@ sendpkt(
 
 
 #ifdef REFCLOCK
+/*
+ * deliver_refclock_packet - pass len bytes of refclock input in rb,
+ * received at ts, on to the driver
+ */
+static void
+deliver_refclock_packet(
+	struct refclockio *	rp,
+	struct recvbuf *	rb,
+	size_t			len,
+	l_fp			ts
+	)
+{
+	/*
+	 * Got one. Mark how and when it got here,
+	 * put it on the full list and do bookkeeping.
+	 */
+	rb->recv_length = len;
+	rb->recv_peer = rp->srcclock;
+	rb->dstadr = 0;
+	rb->fd = rp->fd;
+	rb->recv_time = ts;
+
+	if (!indicate_refclock_packet(rp, rb)) {
+		rp->recvcount++;
+		// FIXME: should have separate slot for refclock packets
+		pkt_count.received++;
+	}
+}
+
+
 /*
  * Routine to read the refclock packets for a specific interface
  * Return the number of bytes read. That way we know if we should
  * read it again or go on to the next one if no bytes returned
  *
+ * The data is stamped with *wakeup if given, else with the time just
+ * before the read.
+ *
  * Note: too big to inline
  */
 static int
 read_refclock_packet(
 	SOCKET			fd,
-	struct refclockio *	rp
+	struct refclockio *	rp,
+	const l_fp *		wakeup
 	)
 {
 	size_t			i;
 	ssize_t			buflen;
 	int			saved_errno;
-	int			consumed;
 	struct recvbuf *	rb;
 	l_fp			ts;
 
 	/* Could read earlier in normal case,
 	 * but too early gets wrong time if data arrives
 	 * while we are busy processing other packets.
+	 * The first read after select() takes the time it returned
+	 * instead: that data was waiting by then, however long the
+	 * clocks before this one took.  The drain reads stamp their own.
 	 */
-	get_systime(&ts);
+	if (NULL != wakeup)
+		ts = *wakeup;
+	else
+		get_systime(&ts);
 
 	rb = get_free_recv_buffer();
 
@@ -2099,24 +2233,53 @@ read_refclock_packet(
 		return (int)buflen;
 	}
 
-	/*
-	 * Got one. Mark how and when it got here,
-	 * put it on the full list and do bookkeeping.
-	 */
-	rb->recv_length = (size_t)buflen;
-	rb->recv_peer = rp->srcclock;
-	rb->dstadr = 0;
-	rb->fd = fd;
-	rb->recv_time = ts;
+	deliver_refclock_packet(rp, rb, (size_t)buflen, ts);
+	return (int)buflen;
+}
 
-	consumed = indicate_refclock_packet(rp, rb);
-	if (!consumed) {
-		rp->recvcount++;
-		// FIXME: should have separate slot for refclock packets
-		pkt_count.received++;
-	}
 
-	return (int)buflen;
+/*
+ * read_refclock_queue - pass on the input the reader thread of a
+ * refclock has queued, and report its end
+ */
+static void
+read_refclock_queue(
+	struct refclockio *	rp
+	)
+{
+	struct refq_slot *	sp;
+	struct recvbuf *	rb;
+	size_t			len;
+	l_fp			ts;
+	const char *		clk;
+
+	refq_clear(rp->queue);
+	pkt_count.dropped += refq_dropped(rp->queue);
+	/* the driver may close the clock, and the queue with it */
+	while (NULL != rp->queue && NULL != (sp = refq_peek(rp->queue))) {
+		if (sp->len <= 0) {
+			clk = refclock_name(rp->srcclock);
+			if (sp->len < 0)
+				msyslog(LOG_ERR, "IO: %s read: %s", clk,
+					strerror(sp->err));
+			else
+				msyslog(LOG_ERR, "IO: %s read EOF", clk);
+			maintain_activefds(refq_wakefd(rp->queue), true);
+			refq_release(rp->queue);
+			break;
+		}
+		rb = get_free_recv_buffer();
+		if (NULL == rb) {
+			pkt_count.dropped++;
+			refq_release(rp->queue);
+			continue;
+		}
+		len = (size_t)sp->len;
+		ts = sp->stamp;
+		memcpy(rb->recv_buffer, sp->data, len);
+		refq_release(rp->queue);
+		deliver_refclock_packet(rp, rb, len, ts);
+	}
 }
 #endif	/* REFCLOCK */
 
@@ -2257,25 +2420,37 @@ io_handler(void)
 	bool flag;
 	sigset_t runMask;
 	fd_set rdfdes;
+	int maxfd;
 	int nfound;
 
 	/*
-	 * Use select() on all input fd's for unlimited
-	 * time.  select() will terminate on SIGALARM or on the
-	 * reception of input.
+	 * Use select() on all input fd's and the timerfd, if there is
+	 * one, for unlimited time.  select() will terminate on the
+	 * timer, on SIGALARM or on the reception of input.
 	 */
 	pthread_sigmask(SIG_BLOCK, &blockMask, &runMask);
 	flag = sig_flags.sawALRM || sig_flags.sawQuit || sig_flags.sawHUP || \
 	  sig_flags.sawDNS;
 	if (!flag) {
 	  rdfdes = activefds;
-	  nfound = pselect(maxactivefd+1, &rdfdes, NULL, NULL, NULL, &runMask);
+	  maxfd = maxactivefd;
+	  if (timer_fd >= 0) {
+	    FD_SET(timer_fd, &rdfdes);
+	    maxfd = max(maxfd, timer_fd);
+	  }
+	  nfound = pselect(maxfd+1, &rdfdes, NULL, NULL, NULL, &runMask);
 	} else {
 	  nfound = -1;
 	  errno = EINTR;
 	}
 	pthread_sigmask(SIG_SETMASK, &runMask, NULL);
 
+	if (nfound > 0 && timer_fd >= 0 && FD_ISSET(timer_fd, &rdfdes)) {
+		sig_flags.sawALRM = true;
+		FD_CLR(timer_fd, &rdfdes);
+		if (--nfound == 0)
+			return;
+	}
 	if (nfound > 0) {
 		input_handler(&rdfdes);
 	} else if (nfound == -1 && errno != EINTR) {
@@ -2306,6 +2481,7 @@ input_handler(
 	struct refclockio *rp;
 	int		saved_errno;
 	const char *	clk;
+	l_fp		wakeup;
 #endif
 #ifdef USE_ROUTING_SOCKET
 	struct asyncio_reader *	asyncio_reader;
@@ -2323,6 +2499,10 @@ input_handler(
 	++pkt_count.handler_pkts;
 
 #ifdef REFCLOCK
+	wakeup = 0;
+	if (NULL != refio)
+		get_systime(&wakeup);
+
 	/*
 	 * Check out the reference clocks first, if any
 	 */
@@ -2330,10 +2510,10 @@ input_handler(
 	for (rp = refio; rp != NULL; rp = rp->next) {
 		fd = rp->fd;
 
-		if (!FD_ISSET(fd, fds))
+		if (NULL != rp->queue || !FD_ISSET(fd, fds))
 			continue;
 		++select_count;
-		buflen = read_refclock_packet(fd, rp);
+		buflen = read_refclock_packet(fd, rp, &wakeup);
 		/*
 		 * The first read must succeed after select()
 		 * indicates readability, or we've reached
@@ -2356,7 +2536,7 @@ input_handler(
 		} else {
 			/* drain any remaining refclock input */
 			do {
-				buflen = read_refclock_packet(fd, rp);
+				buflen = read_refclock_packet(fd, rp, NULL);
 			} while (buflen > 0);
 		}
 	}
@@ -2374,6 +2554,20 @@ input_handler(
 			} while (buflen > 0);
 	}
 
+#ifdef REFCLOCK
+	/*
+	 * Then the reference clocks read on threads of their own.
+	 * Their input is stamped already, so it can wait.
+	 */
+	for (rp = refio; rp != NULL; rp = rp->next) {
+		if (NULL == rp->queue ||
+		    !FD_ISSET(refq_wakefd(rp->queue), fds))
+			continue;
+		++select_count;
+		read_refclock_queue(rp);
+	}
+#endif /* REFCLOCK */
+
 #ifdef USE_ROUTING_SOCKET
 	/*
 	 * scan list of asyncio readers - currently only used for routing sockets
@@ -2488,9 +2682,99 @@ findinterface(
 }
 
 /*
- * findlocalinterface - find local interface corresponding to addr,
- * which does not have any of flags set.  If bast is nonzero, addr is
- * a broadcast address.
+ * Source address cache.  findlocalinterface() asks the kernel which
+ * local address it would send from to a destination.  The answer only
+ * changes when the addresses or routes of the host do, and the routing
+ * socket tells us when that happens, so the answers are kept here,
+ * direct mapped by destination address, until the next routing
+ * message.  Then an interface rescan, which looks up every association
+ * that is not reaching its server, costs memory lookups rather than
+ * four system calls per association.  Without a routing socket nothing
+ * is cached.
+ */
+#define	SRCCACHE_MIN	64		/* initial slots */
+#define	SRCCACHE_MAX	16384		/* most slots */
+
+struct srccache_entry {
+	sockaddr_u	dst;
+	sockaddr_u	src;
+	unsigned int	gen;		/* valid if srccache_gen */
+	bool		found;		/* false if the kernel had no route */
+};
+
+static struct srccache_entry *srccache;
+static unsigned int	srccache_size;	/* slots, a power of two */
+static unsigned int	srccache_gen = 1; /* new slots are stale */
+static bool		srccache_enabled; /* routing socket is open */
+
+
+/*
+ * srccache_flush - forget all the cached source addresses
+ */
+static void
+srccache_flush(void)
+{
+	srccache_gen++;
+	DPRINT(3, ("srccache_flush: generation %u\n", srccache_gen));
+}
+
+
+/*
+ * srccache_slot - the cache slot for a destination
+ */
+static inline struct srccache_entry *
+srccache_slot(
+	sockaddr_u *	dst
+	)
+{
+	return &srccache[sock_hash(dst) & (srccache_size - 1)];
+}
+
+
+/*
+ * srccache_store - remember the source address for a destination, or
+ * that there is none if src is NULL.  When a slot is taken by another
+ * destination, the cache grows up to SRCCACHE_MAX slots.
+ */
+static void
+srccache_store(
+	sockaddr_u *	dst,
+	sockaddr_u *	src
+	)
+{
+	struct srccache_entry *old;
+	struct srccache_entry *ent;
+	unsigned int	oldsize;
+	unsigned int	i;
+
+	if (srccache_size == 0) {
+		srccache_size = SRCCACHE_MIN;
+		srccache = emalloc_zero(srccache_size * sizeof(*srccache));
+	}
+	ent = srccache_slot(dst);
+	if (ent->gen == srccache_gen && !SOCK_EQ(&ent->dst, dst) &&
+	    srccache_size < SRCCACHE_MAX) {
+		old = srccache;
+		oldsize = srccache_size;
+		srccache_size *= 2;
+		srccache = emalloc_zero(srccache_size * sizeof(*srccache));
+		for (i = 0; i < oldsize; i++)
+			if (old[i].gen == srccache_gen)
+				*srccache_slot(&old[i].dst) = old[i];
+		free(old);
+		ent = srccache_slot(dst);
+	}
+	ent->dst = *dst;
+	ent->found = (src != NULL);
+	if (src != NULL)
+		ent->src = *src;
+	ent->gen = srccache_gen;
+}
+
+
+/*
+ * kernel_srcaddr - find the local address the kernel sends from to
+ * addr.
  *
  * This code attempts to find the local sending address for an outgoing
  * address by connecting a new socket to destinationaddress:NTP_PORT
@@ -2500,38 +2784,73 @@ findinterface(
  * ntpd. preferably we would have used an API call - but its not there -
  * so this is the best we can do here short of duplicating to entire routing
  * logic in ntpd which would be a silly and really unportable thing to do.
- *
  */
-static endpt *
-findlocalinterface(
-	sockaddr_u *	addr
+static bool
+kernel_srcaddr(
+	sockaddr_u *	addr,
+	sockaddr_u *	saddr
 	)
 {
 	socklen_t	sockaddrlen;
-	endpt *		iface;
-	sockaddr_u	saddr;
 	SOCKET		s;
 	int		rtn;
-	int		flags = INT_WILDCARD;
-
-	DPRINT(4, ("Finding interface for addr %s in list of addresses\n",
-		   socktoa(addr)));
 
 	s = socket(AF(addr), SOCK_DGRAM, 0);
 	if (INVALID_SOCKET == s)
-		return NULL;
+		return false;
 
 	rtn = connect(s, &addr->sa, SOCKLEN(addr));
 	if (SOCKET_ERROR == rtn) {
 		close(s);
-		return NULL;
+		return false;
 	}
 
-	sockaddrlen = sizeof(saddr);
-	rtn = getsockname(s, &saddr.sa, &sockaddrlen);
+	sockaddrlen = sizeof(*saddr);
+	rtn = getsockname(s, &saddr->sa, &sockaddrlen);
 	close(s);
-	if (SOCKET_ERROR == rtn)
-		return NULL;
+	return (SOCKET_ERROR != rtn);
+}
+
+
+/*
+ * findlocalinterface - find local interface corresponding to addr,
+ * which does not have any of flags set.  If bast is nonzero, addr is
+ * a broadcast address.
+ *
+ * The kernel picks the local address, see kernel_srcaddr(), and its
+ * answers are cached while the routing socket can report a change.
+ */
+static endpt *
+findlocalinterface(
+	sockaddr_u *	addr
+	)
+{
+	struct srccache_entry *ent;
+	endpt *		iface;
+	sockaddr_u	saddr;
+	int		flags = INT_WILDCARD;
+
+	DPRINT(4, ("Finding interface for addr %s in list of addresses\n",
+		   socktoa(addr)));
+
+	ent = (srccache_enabled && srccache_size > 0) ?
+	    srccache_slot(addr) : NULL;
+	if (ent != NULL && ent->gen == srccache_gen &&
+	    SOCK_EQ(&ent->dst, addr)) {
+		if (!ent->found)
+			return NULL;
+		saddr = ent->src;
+	} else {
+		if (!kernel_srcaddr(addr, &saddr)) {
+			/* a socket failure is not an answer to keep */
+			if (srccache_enabled && errno != EMFILE &&
+			    errno != ENFILE && errno != ENOBUFS)
+				srccache_store(addr, NULL);
+			return NULL;
+		}
+		if (srccache_enabled)
+			srccache_store(addr, &saddr);
+	}
 
 	DPRINT(4, ("findlocalinterface: kernel maps %s to %s\n",
 		   socktoa(addr), socktoa(&saddr)));
@@ -2722,6 +3041,53 @@ getinterface(
 	return iface;
 }
 
+/*
+ * prefilter_all - (re)attach or detach the prefilter of every socket
+ */
+static void
+prefilter_all(void)
+{
+	endpt *	ep;
+
+	prefilter_gen = rstrct.generation;
+	for (ep = io_data.ep_list; ep != NULL; ep = ep->elink) {
+		if (INVALID_SOCKET == ep->fd)
+			continue;
+		if (prefilter_on)
+			prefilter_attach(ep->fd, ep->family);
+		else
+			prefilter_detach(ep->fd);
+	}
+}
+
+
+/*
+ * io_prefilter - turn the kernel prefilter of the sockets on or off
+ */
+void
+io_prefilter(
+	bool	enable
+	)
+{
+	if (enable == prefilter_on)
+		return;
+	prefilter_on = enable;
+	prefilter_all();
+}
+
+
+/*
+ * io_prefilter_check - rebuild the prefilters if the restrict lists
+ * changed since they were built.  Called once a second.
+ */
+void
+io_prefilter_check(void)
+{
+	if (prefilter_on && prefilter_gen != rstrct.generation)
+		prefilter_all();
+}
+
+
 /*
  * io_clr_stats - clear I/O module statistics
  */
@@ -2736,6 +3102,11 @@ io_clr_stats(void)
 
 	pkt_count.handler_calls = 0;
 	pkt_count.handler_pkts = 0;
+	pkt_count.if_scans = 0;
+	pkt_count.if_events = 0;
+	pkt_count.kdropped = 0;
+	pkt_count.kdropped_base = 0;	/* count from here on */
+	pkt_count.kdropped_base = kernel_drops_count();
 	pkt_count.io_timereset = current_time;
 }
 
@@ -2795,6 +3166,35 @@ uint64_t handler_pkts_count(void) {
   return pkt_count.handler_pkts;
 }
 
+/*
+ * if_scans_count - return the number of full interface scans
+ */
+uint64_t if_scans_count(void) {
+  return pkt_count.if_scans;
+}
+
+/*
+ * if_events_count - return the number of addresses added or deleted
+ * without a full scan
+ */
+uint64_t if_events_count(void) {
+  return pkt_count.if_events;
+}
+
+/*
+ * kernel_drops_count - return the number of packets the kernel dropped
+ * on our sockets, by the prefilter or for want of buffer space
+ */
+uint64_t kernel_drops_count(void) {
+  uint64_t drops = pkt_count.kdropped;
+  endpt *ep;
+
+  for (ep = io_data.ep_list; ep != NULL; ep = ep->elink)
+    if (ep->fd != INVALID_SOCKET)
+      drops += socket_drops(ep->fd);
+  return drops - pkt_count.kdropped_base;
+}
+
 /*
  * counter_reset_time - return the time of the last counter reset
  */
@@ -2829,6 +3229,22 @@ io_addclock(
 	 */
 	add_fd_to_list(rio->fd, FD_TYPE_FILE);
 
+	/*
+	 * or hand it to a reader thread, and wait for that instead
+	 */
+	rio->queue = NULL;
+	if (NULL != rio->srcclock &&
+	    (FLAG_THREAD & rio->srcclock->cfg.flags)) {
+		rio->queue = refq_start(rio->fd, rio->datalen);
+		if (NULL == rio->queue) {
+			msyslog(LOG_ERR, "IO: %s reader thread: %s",
+				refclock_name(rio->srcclock), strerror(errno));
+		} else {
+			maintain_activefds(rio->fd, true);
+			maintain_activefds(refq_wakefd(rio->queue), false);
+		}
+	}
+
 	return true;
 }
 
@@ -2848,6 +3264,11 @@ io_closeclock(
 	 */
 	rio->active = false;
 	UNLINK_SLIST(unlinked, refio, rio, next, struct refclockio);
+	if (NULL != rio->queue) {
+		maintain_activefds(refq_wakefd(rio->queue), true);
+		refq_stop(rio->queue);
+		rio->queue = NULL;
+	}
 	if (NULL != unlinked) {
 		/*
 		 * Close the descriptor.
@@ -2917,6 +3338,48 @@ close_and_delete_fd_from_list(
 }
 
 
+/*
+ * remoteaddr_bucket - the bucket of the address list for an address
+ */
+static inline remaddr_t **
+remoteaddr_bucket(
+	const sockaddr_u *addr
+	)
+{
+	return &remoteaddr_hash[sock_hash(addr) & (remoteaddr_size - 1)];
+}
+
+
+/*
+ * remoteaddr_resize - rehash the address list into size buckets
+ */
+static void
+remoteaddr_resize(
+	unsigned int	size
+	)
+{
+	remaddr_t **	bucket;
+	remaddr_t *	entry;
+	remaddr_t *	next;
+	unsigned int	i, b;
+
+	bucket = emalloc_zero(size * sizeof(*bucket));
+	for (i = 0; i < remoteaddr_size; i++) {
+		for (entry = remoteaddr_hash[i]; entry != NULL; entry = next) {
+			next = entry->link;
+			b = sock_hash(&entry->addr) & (size - 1);
+			entry->link = bucket[b];
+			bucket[b] = entry;
+		}
+	}
+	free(remoteaddr_hash);
+	remoteaddr_hash = bucket;
+	remoteaddr_size = size;
+	DPRINT(2, ("remoteaddr_resize: %u buckets for %u addresses\n",
+		   size, remoteaddr_count));
+}
+
+
 static void
 add_addr_to_list(
 	sockaddr_u *	addr,
@@ -2924,16 +3387,23 @@ add_addr_to_list(
 	)
 {
 	remaddr_t *laddr;
+	remaddr_t **bucket;
 
 #ifdef DEBUG
 	if (find_addr_in_list(addr) == NULL) {
 #endif
 		/* not there yet - add to list */
+		if (remoteaddr_count >= remoteaddr_size * REMADDR_LOAD)
+			remoteaddr_resize(max(REMADDR_HASH_MIN,
+					      remoteaddr_size * 2));
 		laddr = emalloc(sizeof(*laddr));
 		laddr->addr = *addr;
 		laddr->ep = ep;
 
-		LINK_SLIST(remoteaddr_list, laddr, link);
+		bucket = remoteaddr_bucket(addr);
+		laddr->link = *bucket;
+		*bucket = laddr;
+		remoteaddr_count++;
 
 		DPRINT(4, ("Added addr %s to list of addresses\n",
 			   socktoa(addr)));
@@ -2945,26 +3415,34 @@ add_addr_to_list(
 }
 
 
+/*
+ * delete_interface_from_list - remove the address of an endpt from
+ * the address list.  Only its own address, ep->sin, is ever added.
+ */
 static void
 delete_interface_from_list(
 	endpt *iface
 	)
 {
-	remaddr_t *unlinked;
+	remaddr_t **pp;
+	remaddr_t *entry;
 
-	for (;;) {
-		UNLINK_EXPR_SLIST(unlinked, remoteaddr_list, iface ==
-		    UNLINK_EXPR_SLIST_CURRENT()->ep, link,
-		    remaddr_t);
+	if (0 == remoteaddr_size)
+		return;
 
-		if (unlinked == NULL) {
-			break;
+	pp = remoteaddr_bucket(&iface->sin);
+	while ((entry = *pp) != NULL) {
+		if (entry->ep != iface) {
+			pp = &entry->link;
+			continue;
 		}
+		*pp = entry->link;
+		remoteaddr_count--;
 		DPRINT(4, ("Deleted addr %s for interface #%u %s "
 			   "from list of addresses\n",
-			   socktoa(&unlinked->addr), iface->ifnum,
+			   socktoa(&entry->addr), iface->ifnum,
 			   iface->name));
-		free(unlinked);
+		free(entry);
 	}
 }
 
@@ -2979,12 +3457,14 @@ find_addr_in_list(
 	DPRINT(4, ("Searching for addr %s in list of addresses - ",
 		   socktoa(addr)));
 
-	for (entry = remoteaddr_list;
-	     entry != NULL;
-	     entry = entry->link) {
-		if (SOCK_EQ(&entry->addr, addr)) {
-			DPRINT(4, ("FOUND\n"));
-			return entry->ep;
+	if (remoteaddr_size > 0) {
+		for (entry = *remoteaddr_bucket(addr);
+		     entry != NULL;
+		     entry = entry->link) {
+			if (SOCK_EQ(&entry->addr, addr)) {
+				DPRINT(4, ("FOUND\n"));
+				return entry->ep;
+			}
 		}
 	}
 
@@ -3008,6 +3488,285 @@ latoa(
 #  define UPDATE_GRACE	2	/* wait UPDATE_GRACE seconds before scanning */
 # endif
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+/*
+ * netlink_ifaddr - describe the address in an RTM_NEWADDR or
+ * RTM_DELADDR message the way the interface iterator would, but for
+ * the flags of the interface.  Returns false if the message is
+ * malformed.
+ */
+static bool
+netlink_ifaddr(
+	struct nlmsghdr *	nh,
+	isc_interface_t *	isc_if
+	)
+{
+	struct ifaddrmsg *	ifa;
+	struct rtattr *		rta;
+	const void *		addr = NULL;
+	const void *		local = NULL;
+	const void *		bcast = NULL;
+	const char *		label = NULL;
+	char			ifname[IF_NAMESIZE];
+	uint8_t *		mask;
+	size_t			alen;
+	unsigned int		bits;
+	unsigned int		i;
+	int			len;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+		return false;
+	ifa = NLMSG_DATA(nh);
+	if (AF_INET == ifa->ifa_family)
+		alen = sizeof(isc_if->address.type.in);
+	else
+		alen = sizeof(isc_if->address.type.in6);
+
+	len = (int)IFA_PAYLOAD(nh);
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (IFA_LABEL == rta->rta_type) {
+			if (memchr(RTA_DATA(rta), '\0', RTA_PAYLOAD(rta)))
+				label = RTA_DATA(rta);
+			continue;
+		}
+		if (RTA_PAYLOAD(rta) < alen)
+			continue;
+		switch (rta->rta_type) {
+		case IFA_ADDRESS:
+			addr = RTA_DATA(rta);
+			break;
+		case IFA_LOCAL:
+			local = RTA_DATA(rta);
+			break;
+		case IFA_BROADCAST:
+			bcast = RTA_DATA(rta);
+			break;
+		default:
+			break;
+		}
+	}
+	/* on a point-to-point link IFA_ADDRESS is the other end */
+	if (NULL == local)
+		local = addr;
+	if (NULL == local)
+		return false;
+
+	ZERO(*isc_if);
+	if (label != NULL)
+		strlcpy(isc_if->name, label, sizeof(isc_if->name));
+	else if (if_indextoname(ifa->ifa_index, ifname) != NULL)
+		strlcpy(isc_if->name, ifname, sizeof(isc_if->name));
+	isc_if->af = ifa->ifa_family;
+	isc_if->ifindex = ifa->ifa_index;
+	isc_if->address.family = ifa->ifa_family;
+	isc_if->netmask.family = ifa->ifa_family;
+	isc_if->broadcast.family = ifa->ifa_family;
+	memcpy(&isc_if->address.type, local, alen);
+	if (bcast != NULL)
+		memcpy(&isc_if->broadcast.type, bcast, alen);
+	if (AF_INET6 == ifa->ifa_family &&
+	    IN6_IS_ADDR_LINKLOCAL(&isc_if->address.type.in6))
+		isc_if->address.zone = ifa->ifa_index;
+	mask = (uint8_t *)&isc_if->netmask.type;
+	bits = min(ifa->ifa_prefixlen, alen * 8);
+	for (i = 0; i < bits; i++)
+		mask[i / 8] |= (uint8_t)(0x80 >> (i % 8));
+	return true;
+}
+
+
+/*
+ * netlink_ifflags - get the flags of the interface of an address.
+ * Returns false if the interface is not running, or is gone.
+ */
+static bool
+netlink_ifflags(
+	isc_interface_t *	isc_if
+	)
+{
+	struct ifreq	ifr;
+	int		fd;
+	int		rtn;
+
+	ZERO(ifr);
+	if (if_indextoname(isc_if->ifindex, ifr.ifr_name) == NULL)
+		return false;
+	if ((fd = socket((int)isc_if->af, SOCK_DGRAM, 0)) < 0)
+		return false;
+	rtn = ioctl(fd, SIOCGIFFLAGS, &ifr);
+	close(fd);
+	if (rtn < 0 || !(ifr.ifr_flags & IFF_RUNNING))
+		return false;
+
+	if (ifr.ifr_flags & IFF_UP)
+		isc_if->flags |= INTERFACE_F_UP;
+	if (ifr.ifr_flags & IFF_POINTOPOINT)
+		isc_if->flags |= INTERFACE_F_POINTTOPOINT;
+	if (ifr.ifr_flags & IFF_LOOPBACK)
+		isc_if->flags |= INTERFACE_F_LOOPBACK;
+	if (ifr.ifr_flags & IFF_BROADCAST)
+		isc_if->flags |= INTERFACE_F_BROADCAST;
+	if (ifr.ifr_flags & IFF_MULTICAST)
+		isc_if->flags |= INTERFACE_F_MULTICAST;
+	return true;
+}
+
+
+/*
+ * netlink_newaddr - create the interface for an address that was
+ * added.  Returns false if a full interface scan is needed instead.
+ */
+static bool
+netlink_newaddr(
+	struct nlmsghdr *	nh
+	)
+{
+	struct ifaddrmsg *	ifa = NLMSG_DATA(nh);
+	isc_interface_t		isc_if;
+	endpt			enumep;
+	endpt *			ep;
+
+	if (!netlink_ifaddr(nh, &isc_if))
+		return false;
+	/* announced again once duplicate address detection is done */
+	if (ifa->ifa_flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED))
+		return true;
+	/* and the link coming up is a scan, see netlink_link() */
+	if (!netlink_ifflags(&isc_if))
+		return true;
+	if (!interface_prototype(&isc_if, &enumep, NTP_PORT))
+		return true;
+
+	ep = getinterface(&enumep.sin, INT_WILDCARD);
+	if (ep != NULL) {
+		/* a refresh of the lifetimes, or the address is shared */
+		return (ep->ifindex == enumep.ifindex);
+	}
+
+	ep = create_interface(NTP_PORT, &enumep);
+	if (NULL == ep) {
+		msyslog(LOG_INFO,
+			"IO: failed to init interface for address %s",
+			socktoa(&enumep.sin));
+		return true;
+	}
+	DPRINT_INTERFACE(3, (ep, "updating ", " new - created\n"));
+	pkt_count.if_events++;
+	if_found_new = true;
+	return true;
+}
+
+
+/*
+ * netlink_deladdr - delete the interface of an address that was
+ * deleted.  Returns false if a full interface scan is needed instead.
+ */
+static bool
+netlink_deladdr(
+	struct nlmsghdr *	nh
+	)
+{
+	isc_interface_t	isc_if;
+	endpt		enumep;
+	endpt *		ep;
+
+	if (!netlink_ifaddr(nh, &isc_if))
+		return false;
+	init_interface(&enumep);
+	convert_isc_if(&isc_if, &enumep, NTP_PORT);
+
+	ep = getinterface(&enumep.sin, INT_WILDCARD);
+	if (NULL == ep)
+		return true;
+	/* it may still be on another interface */
+	if (ep->ifindex != isc_if.ifindex ||
+	    !strcmp(ep->name, "*multiple*"))
+		return false;
+
+	interface_gone(ep, NULL, NULL);
+	pkt_count.if_events++;
+	return true;
+}
+
+
+/*
+ * netlink_link - delete the interfaces of a link that went down.
+ * Returns false if a full interface scan is needed instead, as when a
+ * link comes up: the kernel does not announce its addresses again.
+ */
+static bool
+netlink_link(
+	struct nlmsghdr *	nh
+	)
+{
+	struct ifinfomsg *	ifi;
+	endpt *			ep;
+	endpt *			next_ep;
+	const unsigned int	upflags = IFF_UP | IFF_RUNNING;
+	bool			running;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+		return false;
+	ifi = NLMSG_DATA(nh);
+	running = (RTM_NEWLINK == nh->nlmsg_type &&
+		   (ifi->ifi_flags & upflags) == upflags);
+
+	for (ep = io_data.ep_list; ep != NULL; ep = ep->elink) {
+		if ((INT_WILDCARD & ep->flags) ||
+		    ep->ifindex != (unsigned int)ifi->ifi_index)
+			continue;
+		if (running)
+			return true;	/* we have its addresses */
+		if (!strcmp(ep->name, "*multiple*"))
+			return false;
+	}
+	if (running)
+		return false;
+
+	for (ep = io_data.ep_list; ep != NULL; ep = next_ep) {
+		next_ep = ep->elink;
+		if ((INT_WILDCARD & ep->flags) ||
+		    ep->ifindex != (unsigned int)ifi->ifi_index)
+			continue;
+		interface_gone(ep, NULL, NULL);
+		pkt_count.if_events++;
+	}
+	return true;
+}
+
+
+/*
+ * netlink_update - apply a routing message to the interface list.
+ * Returns false if a full interface scan is needed instead.
+ */
+static bool
+netlink_update(
+	struct nlmsghdr *	nh
+	)
+{
+	struct ifaddrmsg *	ifa = NLMSG_DATA(nh);
+
+	switch (nh->nlmsg_type) {
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+			return false;
+		if (AF_INET != ifa->ifa_family &&
+		    AF_INET6 != ifa->ifa_family)
+			return true;
+		if (RTM_NEWADDR == nh->nlmsg_type)
+			return netlink_newaddr(nh);
+		return netlink_deladdr(nh);
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		return netlink_link(nh);
+	default:
+		/* routes: refreshing the peer interfaces is enough */
+		return true;
+	}
+}
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
 static void
 process_routing_msgs(struct asyncio_reader *reader)
 {
@@ -3026,6 +3785,9 @@ process_routing_msgs(struct asyncio_reader *reader)
 		 * discard ourselves if we are not needed anymore
 		 * usually happens when running unprivileged
 		 */
+		srccache_flush();
+		srccache_enabled = false;
+		if_incremental = false;
 		remove_asyncio_reader(reader);
 		delete_asyncio_reader(reader);
 		return;
@@ -3034,12 +3796,18 @@ process_routing_msgs(struct asyncio_reader *reader)
 	cnt = read(reader->fd, buffer, sizeof(buffer));
 
 	if (cnt < 0) {
+		/* messages may have been lost */
+		srccache_flush();
+		if_rescan = true;
+		timer_interfacetimeout(current_time + UPDATE_GRACE);
 		if (errno == ENOBUFS) {
 			msyslog(LOG_ERR,
 				"IO: routing socket reports: %s", strerror(errno));
 		} else {
 			msyslog(LOG_ERR,
 				"IO: routing socket reports: %s - disabling", strerror(errno));
+			srccache_enabled = false;
+			if_incremental = false;
 			remove_asyncio_reader(reader);
 			delete_asyncio_reader(reader);
 		}
@@ -3064,6 +3832,9 @@ process_routing_msgs(struct asyncio_reader *reader)
 				"IO: version mismatch (got %d - expected %d) on routing socket - disabling",
 				rtm.rtm_version, RTM_VERSION);
 
+			srccache_flush();
+			srccache_enabled = false;
+			if_incremental = false;
 			remove_asyncio_reader(reader);
 			delete_asyncio_reader(reader);
 			return;
@@ -3117,6 +3888,11 @@ process_routing_msgs(struct asyncio_reader *reader)
 			 */
 			DPRINT(3, ("routing message op = %d: scheduling interface update\n",
 				   msg_type));
+#ifdef HAVE_LINUX_RTNETLINK_H
+			if (if_incremental && !netlink_update(nh))
+				if_rescan = true;
+#endif
+			srccache_flush();
 			timer_interfacetimeout(current_time + UPDATE_GRACE);
 			break;
 #ifdef HAVE_LINUX_RTNETLINK_H
@@ -3176,6 +3952,12 @@ init_async_notifications()
 	reader->receiver = process_routing_msgs;
 
 	add_asyncio_reader(reader, FD_TYPE_SOCKET);
+#ifndef OS_MISSES_SPECIFIC_ROUTE_UPDATES
+	srccache_enabled = true;
+# ifdef HAVE_LINUX_RTNETLINK_H
+	if_incremental = true;
+# endif
+#endif
 	msyslog(LOG_INFO,
 		"IO: Listening on routing socket on fd #%d for interface updates",
 		fd);
@@ -131,6 +131,19 @@ static void set_freq(double);	/* set frequency */
 static char relative_path[PATH_MAX + 1]; /* relative path per recursive make */
 static char *this_file = NULL;
 
+static bool	step_clock(double);
+static bool	slew_clock(double);
+
+/*
+ * Clock adjustment hooks.  ntpd adjusts the system clock; the replay
+ * harness points these at a simulated one.
+ */
+struct clock_hooks clock_hooks = {
+	.step = step_clock,
+	.adjust = slew_clock,
+	.adjtime = ntp_adjtime_ns
+};
+
 static struct timex ntv;	/* ntp_adjtime() parameters */
 static int	pll_status;	/* last kernel status bits */
 #if defined(STA_NANO) && defined(NTP_API) && NTP_API == 4
@@ -186,6 +199,25 @@ sync_status(const char *what, int ostatus, int nstatus) {
 	report_event(EVNT_KERN, NULL, tbuf);
 }
 
+/*
+ * step_clock, slew_clock - adjust the system clock by an offset (s)
+ */
+static bool
+step_clock(
+	double	offset
+	)
+{
+	return step_systime(offset, ntp_set_tod);
+}
+
+static bool
+slew_clock(
+	double	offset
+	)
+{
+	return adj_systime(offset, adjtime);
+}
+
 /*
  * file_name - return pointer to non-relative portion of this C file pathname
  */
@@ -480,12 +512,12 @@ local_clock(
 	if (clock_ctl.mode_ntpdate) {
 		if (  ( fp_offset > loop_data.clock_max_fwd  && loop_data.clock_max_fwd  > 0)
 		   || (-fp_offset > loop_data.clock_max_back && loop_data.clock_max_back > 0)) {
-			step_systime(fp_offset, ntp_set_tod);
+			clock_hooks.step(fp_offset);
 			msyslog(LOG_NOTICE, "CLOCK: time set %+.6f s",
 			    fp_offset);
 			printf("ntpd: time set %+.6fs\n", fp_offset);
 		} else {
-			adj_systime(fp_offset, adjtime);
+			clock_hooks.adjust(fp_offset);
 			msyslog(LOG_NOTICE, "CLOCK: time slew %+.6f s",
 			    fp_offset);
 			printf("ntpd: time slew %+.6fs\n", fp_offset);
@@ -611,7 +643,7 @@ local_clock(
 			snprintf(tbuf, sizeof(tbuf), "%+.6f s",
 			    fp_offset);
 			report_event(EVNT_CLOCKRESET, NULL, tbuf);
-			step_systime(fp_offset, ntp_set_tod);
+			clock_hooks.step(fp_offset);
 			reinit_timer();
 			clkstate.tc_counter = 0;
 			clkstate.clock_jitter = LOGTOD(sys_vars.sys_precision);
@@ -641,7 +673,7 @@ local_clock(
 		 * the stepout threshold.
 		 */
 		case EVNT_NSET:
-			adj_systime(fp_offset, adjtime);
+			clock_hooks.adjust(fp_offset);
 			rstclock(EVNT_FREQ, fp_offset);
 			break;
 
@@ -784,7 +816,7 @@ local_clock(
 		 * the pps. In any case, fetch the kernel offset,
 		 * frequency and jitter.
 		 */
-		ntp_adj_ret = ntp_adjtime_ns(&ntv);
+		ntp_adj_ret = clock_hooks.adjtime(&ntv);
 		/*
 		 * A squeal is a return status < 0, or a state change.
 		 */
@@ -811,7 +843,7 @@ local_clock(
 			loop_tai = sys_tai;
 			ntv.modes = MOD_TAI;
 			ntv.constant = (long)sys_tai;
-			if ((ntp_adj_ret = ntp_adjtime_ns(&ntv)) != 0) {
+			if ((ntp_adj_ret = clock_hooks.adjtime(&ntv)) != 0) {
 			    ntp_adjtime_error_handler(__func__, &ntv, ntp_adj_ret, errno, false, true, __LINE__ - 1);
 			}
 		}
@@ -965,7 +997,7 @@ adj_host_clock(
 	 * but does not automatically stop slewing when an offset
 	 * has decayed to zero.
 	 */
-	adj_systime(offset_adj + freq_adj, adjtime);
+	clock_hooks.adjust(offset_adj + freq_adj);
 }
 
 
@@ -1039,7 +1071,7 @@ set_freq(
 			loop_desc = "kernel";
 			ntv.freq = DTOFREQ(loop_data.drift_comp);
 		}
-		if ((ntp_adj_ret = ntp_adjtime_ns(&ntv)) != 0) {
+		if ((ntp_adj_ret = clock_hooks.adjtime(&ntv)) != 0) {
 		    ntp_adjtime_error_handler(__func__, &ntv, ntp_adj_ret, errno, false, false, __LINE__ - 1);
 		}
 	}
@@ -1060,7 +1092,7 @@ start_kern_loop(void)
 	ntv.maxerror = sys_maxdisp;
 	ntv.esterror = sys_maxdisp;
 	ntv.constant = clkstate.sys_poll; /* why is it that here constant is unconditionally set to sys_poll, whereas elsewhere is is modified depending on nanosecond vs. microsecond kernel? */
-	if ((ntp_adj_ret = ntp_adjtime_ns(&ntv)) != 0) {
+	if ((ntp_adj_ret = clock_hooks.adjtime(&ntv)) != 0) {
 	    ntp_adjtime_error_handler(__func__, &ntv, ntp_adj_ret, errno, false, false, __LINE__ - 1);
 	}
 
@@ -1194,7 +1226,7 @@ loop_config(
 			memset((char *)&ntv, 0, sizeof(ntv));
 			ntv.modes = MOD_STATUS;
 			ntv.status = STA_UNSYNC;
-			ntp_adjtime_ns(&ntv);
+			clock_hooks.adjtime(&ntv);
 			sync_status("kernel time sync disabled",
 				pll_status,
 				ntv.status);
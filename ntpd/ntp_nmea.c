@@ -0,0 +1,414 @@
+/*
+ * ntp_nmea.c - split NMEA 0183 sentences and decode their fields
+ *
+ * The nmea refclock used to check a sentence in one pass and then find
+ * each field it wanted by walking the commas again from where the last
+ * lookup stopped, or from the start when it went backwards, and to read
+ * the numbers with sscanf().  A sentence had its line walked three or
+ * four times, and each number cost a format string interpretation.
+ *
+ * Instead, the one pass that checks the syntax and the checksum also
+ * records where each field starts and how long it is, and the fields
+ * are then read by index straight from that.  Numbers are read digit by
+ * digit, in the fixed widths NMEA gives them.  The line is left as it
+ * is; nothing is NUL-terminated, as the refclock still shows and logs
+ * the whole line.
+ */
+#include "config.h"
+
+#include <string.h>
+
+#include "ntp.h"
+#include "ntp_nmea.h"
+
+
+/*
+ * nmea_split - check the syntax of the sentence of len bytes at line,
+ * verify its checksum and record its fields
+ *
+ * format is $XXXXX,1,2,3,4*ML
+ *
+ * 8-bit XOR of characters between $ and * noninclusive is transmitted
+ * in last two chars M and L holding most and least significant nibbles
+ * in hex representation such as:
+ *
+ *   $GPGLL,5057.970,N,00146.110,E,142451,A*27
+ *   $GPVTG,089.0,T,,,15.2,N,,*7F
+ *
+ * Some other constraints:
+ * + The field name must at least 5 upcase characters or digits and must
+ *   start with a character.  Proprietary names, a 'P' and the three
+ *   characters of the maker, may have 4, like u-blox's $PUBX.
+ * + The checksum (if present) must be uppercase hex digits.
+ * + The length of a sentence is limited to 80 characters (not including
+ *   the final CR/LF nor the checksum, but including the leading '$')
+ *
+ * Returns CHECK_EMPTY for an empty line, CHECK_INVALID if it is not a
+ * valid NMEA sentence or the checksum is wrong, CHECK_VALID if it is
+ * one without a checksum and CHECK_CSVALID if it is one with a good
+ * checksum.  The fields are only recorded for the last two.
+ */
+int
+nmea_split(
+	nmea_sentence *	s,
+	char *		line,
+	size_t		len
+	)
+{
+	const char *	cp = line;
+	const char *	ep = line + len;
+	uint8_t		cs_l = 0;	/* checksum local computed */
+	int		cs_r;		/* checksum remote given */
+	int		nf;		/* fields recorded */
+	int		open;		/* the one being read, or -1 */
+	int		i;
+
+	if (0 == len || '\0' == *cp)
+		return CHECK_EMPTY;
+	if (*cp++ != '$' || len > UINT16_MAX)
+		return CHECK_INVALID;
+	s->base = line + 1;
+	s->cksum = -1;
+
+	/* -*- field name: '[A-Z][A-Z0-9]{4,},' */
+	if (cp == ep || *cp < 'A' || *cp > 'Z')
+		return CHECK_INVALID;
+	cs_l ^= (uint8_t)*cp++;
+	while (cp < ep && ((*cp >= 'A' && *cp <= 'Z') ||
+			   (*cp >= '0' && *cp <= '9')))
+		cs_l ^= (uint8_t)*cp++;
+	if (cp == ep || *cp != ',')
+		return CHECK_INVALID;
+	i = (int)(cp - s->base);
+	if (i < NMEA_PROTO_IDLEN && !('P' == s->base[0] && i >= 4))
+		return CHECK_INVALID;
+
+	/* -*- data: '[^*]*', each comma ends a field and starts one */
+	s->start[0] = 0;
+	open = 0;
+	nf = 1;
+	while (cp < ep && *cp != '*') {
+		if ('\0' == *cp)
+			return CHECK_INVALID;
+		if (',' == *cp) {
+			if (open >= 0)
+				s->len[open] = (uint16_t)(cp - s->base -
+							  s->start[open]);
+			if (nf <= NMEA_PROTO_FIELDS) {
+				s->start[nf] = (uint16_t)(cp + 1 - s->base);
+				open = nf++;
+			} else {
+				open = -1;
+			}
+		}
+		cs_l ^= (uint8_t)*cp++;
+	}
+	if (open >= 0)
+		s->len[open] = (uint16_t)(cp - s->base - s->start[open]);
+	s->nfield = nf;
+
+	/* -*- checksum field: (\*[0-9A-F]{2})?$ */
+	if (cp == ep)
+		return CHECK_VALID;
+	if (cp != ep - 3 || (cp - s->base) >= NMEA_PROTO_MAXLEN)
+		return CHECK_INVALID;
+	cs_r = 0;
+	for (i = 1; i <= 2; i++) {
+		if (cp[i] >= '0' && cp[i] <= '9')
+			cs_r = (cs_r << 4) + (cp[i] - '0');
+		else if (cp[i] >= 'A' && cp[i] <= 'F')
+			cs_r = (cs_r << 4) + (cp[i] - 'A' + 10);
+		else
+			return CHECK_INVALID;
+	}
+	if (cs_l != cs_r)
+		return CHECK_INVALID;
+	s->cksum = (int)(cp + 1 - s->base);
+	return CHECK_CSVALID;
+}
+
+
+/*
+ * nmea_field - field idx of a split sentence and, if lenp is not NULL,
+ * its length.  Fields that are not there are empty.
+ */
+const char *
+nmea_field(
+	const nmea_sentence *	s,
+	int			idx,
+	size_t *		lenp
+	)
+{
+	if (idx < 0 || idx >= s->nfield) {
+		if (lenp != NULL)
+			*lenp = 0;
+		return "";
+	}
+	if (lenp != NULL)
+		*lenp = s->len[idx];
+	return s->base + s->start[idx];
+}
+
+
+/*
+ * nmea_field_is - whether field idx is str
+ */
+bool
+nmea_field_is(
+	const nmea_sentence *	s,
+	int			idx,
+	const char *		str
+	)
+{
+	const char *	f;
+	size_t		len;
+
+	f = nmea_field(s, idx, &len);
+	return len == strlen(str) && !memcmp(f, str, len);
+}
+
+
+/*
+ * nmea_wipe - overwrite field idx, or with NMEA_CKSUM the checksum,
+ * with '_' in the line.  Decimal points are left, so the precision
+ * still shows.
+ *
+ * This affects what a remote user can see with
+ *
+ * ntpq -c clockvar <server>
+ *
+ * Note that this also removes the wiped fields from any clockstats
+ * log.	 Some NTP operators monitor their NMEA GPS using the change in
+ * location in clockstats over time as as a proxy for the quality of
+ * GPS reception and thereby time reported.
+ */
+void
+nmea_wipe(
+	nmea_sentence *	s,
+	int		idx
+	)
+{
+	char *	cp;
+	size_t	len;
+
+	if (NMEA_CKSUM == idx) {
+		if (s->cksum < 0)
+			return;
+		cp = s->base + s->cksum;
+		len = 2;
+	} else {
+		if (idx < 0 || idx >= s->nfield)
+			return;
+		cp = s->base + s->start[idx];
+		len = s->len[idx];
+	}
+	for ( ; len; cp++, len--)
+		if ('.' != *cp)
+			*cp = '_';
+}
+
+
+/*
+ * nmea_qual - sync status from field idx
+ *
+ * If the first character of the field matches the tag value, return
+ * LEAP_NOWARNING and LEAP_NOTINSYNC otherwise.  If the 'inverted' flag
+ * is given, just the opposite value is returned.  If the field is
+ * empty, the result is LEAP_NOTINSYNC.
+ */
+uint8_t
+nmea_qual(
+	const nmea_sentence *	s,
+	int			idx,
+	char			tag,
+	bool			inv
+	)
+{
+	const char *	f;
+	size_t		len;
+
+	f = nmea_field(s, idx, &len);
+	if (len && ((*f == tag) != inv))
+		return LEAP_NOWARNING;
+	return LEAP_NOTINSYNC;
+}
+
+
+/*
+ * digits - read the n decimal digits at cp into *val, false if they are
+ * not all digits
+ */
+static bool
+digits(
+	const char *	cp,
+	size_t		n,
+	unsigned long *	val
+	)
+{
+	unsigned long	v = 0;
+
+	for ( ; n; cp++, n--) {
+		if (*cp < '0' || *cp > '9')
+			return false;
+		v = v * 10 + (unsigned long)(*cp - '0');
+	}
+	*val = v;
+	return true;
+}
+
+
+/*
+ * number - read field idx as an unsigned number of 1 to 9 digits
+ */
+static bool
+number(
+	const nmea_sentence *	s,
+	int			idx,
+	unsigned long *		val
+	)
+{
+	const char *	f;
+	size_t		len;
+
+	f = nmea_field(s, idx, &len);
+	return len >= 1 && len <= 9 && digits(f, len, val);
+}
+
+
+/*
+ * nmea_time - read the time of day in HHMMSS[.sss] format from field
+ * idx into jd and its fraction, in nanoseconds, into *ns.  Digits of
+ * the fraction past the milliseconds are ignored.
+ *
+ * returns true on success, false on failure
+ */
+bool
+nmea_time(
+	const nmea_sentence *	s,
+	int			idx,
+	struct calendar *	jd,
+	long *			ns
+	)
+{
+	static const unsigned long weight[4] = {
+		0, 100000000, 10000000, 1000000
+	};
+	const char *	f;
+	size_t		len, n;
+	unsigned long	h, m, sec, frac;
+
+	f = nmea_field(s, idx, &len);
+	if (len < 6 || !digits(f, 2, &h) || !digits(f + 2, 2, &m) ||
+	    !digits(f + 4, 2, &sec))
+		return false;
+	frac = 0;
+	n = 0;
+	if (len > 6) {
+		if ('.' != f[6])
+			return false;
+		n = len - 7;
+		if (!digits(f + 7, n, &frac))
+			return false;
+		if (n > 3) {
+			(void)digits(f + 7, 3, &frac);
+			n = 3;
+		}
+	}
+
+	/* value sanity check */
+	if (h > 23 || m > 59 || sec > 60)
+		return false;
+
+	jd->hour   = (uint8_t)h;
+	jd->minute = (uint8_t)m;
+	jd->second = (uint8_t)sec;
+	*ns = (long)(frac * weight[n]);
+	return true;
+}
+
+
+/*
+ * nmea_date - read a date into jd: a partial one in DDMMYY format from
+ * field idx or, if full, a whole one spread over fields idx to idx+2
+ * as DD,MM,YYYY.  A partial date leaves the two digits of the year in
+ * jd->year.
+ *
+ * returns true on success, false on failure
+ */
+bool
+nmea_date(
+	const nmea_sentence *	s,
+	int			idx,
+	bool			full,
+	struct calendar *	jd
+	)
+{
+	const char *	f;
+	size_t		len;
+	unsigned long	y, m, d;
+
+	if (full) {
+		f = nmea_field(s, idx, &len);
+		if (2 != len || !digits(f, 2, &d))
+			return false;
+		f = nmea_field(s, idx + 1, &len);
+		if (2 != len || !digits(f, 2, &m))
+			return false;
+		f = nmea_field(s, idx + 2, &len);
+		if (4 != len || !digits(f, 4, &y))
+			return false;
+	} else {
+		f = nmea_field(s, idx, &len);
+		if (6 != len || !digits(f, 2, &d) || !digits(f + 2, 2, &m) ||
+		    !digits(f + 4, 2, &y))
+			return false;
+	}
+
+	/* value sanity check */
+	if (d < 1 || d > 31 || m < 1 || m > 12)
+		return false;
+
+	jd->monthday = (uint8_t)d;
+	jd->month    = (uint8_t)m;
+	jd->year     = (unsigned short)y;
+	return true;
+}
+
+
+/*
+ * nmea_weekdata - read the GPS week number, the GPS time-of-week and
+ * the leap seconds GPS to UTC from fields weekidx, timeidx and leapidx
+ *
+ * returns true on success, false on failure
+ */
+bool
+nmea_weekdata(
+	const nmea_sentence *	s,
+	int			weekidx,
+	int			timeidx,
+	int			leapidx,
+	gps_weektm *		wd
+	)
+{
+	const char *	f;
+	size_t		len;
+	unsigned long	week, secs, leap;
+	bool		neg;
+
+	if (!number(s, weekidx, &week) || week >= 1024 ||
+	    !number(s, timeidx, &secs) || secs >= 7 * SECSPERDAY)
+		return false;
+	f = nmea_field(s, leapidx, &len);
+	neg = (len && '-' == *f);
+	if (len && ('-' == *f || '+' == *f)) {
+		f++;
+		len--;
+	}
+	if (len < 1 || len > 4 || !digits(f, len, &leap))
+		return false;
+
+	wd->wt_week = (unsigned short)week;
+	wd->wt_time = (uint32_t)secs;
+	wd->wt_leap = (short)(neg ? -(long)leap : (long)leap);
+	return true;
+}
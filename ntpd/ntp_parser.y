@@ -60,6 +60,7 @@
 %token	<Integer>	T_Average
 %token	<Integer>	T_Baud
 %token	<Integer>	T_Bias
+%token	<Integer>	T_Binary
 %token	<Integer>	T_Burst
 %token	<Integer>	T_Calibrate
 %token	<Integer>	T_Ca
@@ -178,6 +179,7 @@
 %token	<Integer>	T_Pool
 %token	<Integer>	T_Ppspath
 %token	<Integer>	T_Prefer
+%token	<Integer>	T_Prefilter
 %token	<Integer>	T_Protostats
 %token	<Integer>	T_Rawstats
 %token	<Integer>	T_Refclock
@@ -192,6 +194,7 @@
 %token	<Integer>	T_Setvar
 %token	<Integer>	T_Source
 %token	<Integer>	T_Stacksize
+%token	<Integer>	T_Stages
 %token	<Integer>	T_Statistics
 %token	<Integer>	T_Stats
 %token	<Integer>	T_Statsdir
@@ -204,6 +207,8 @@
 %token	<String>	T_String		/* Not a token */
 %token	<Integer>	T_Sys
 %token	<Integer>	T_Sysstats
+%token	<Integer>	T_Text
+%token	<Integer>	T_Thread
 %token	<Integer>	T_Tick
 %token	<Integer>	T_Time1
 %token	<Integer>	T_Time2
@@ -293,6 +298,7 @@
 %type	<Integer>	system_option_local_flag_keyword
 %type	<Attr_val_fifo>	system_option_list
 %type	<Integer>	t_default_or_zero
+%type	<Integer>	text_binary
 %type	<Integer>	tinker_option_keyword
 %type	<Attr_val>	tinker_option
 %type	<Attr_val_fifo>	tinker_option_list
@@ -422,6 +428,7 @@ option_flag_keyword
 	|	T_Noval
 	|	T_Nts
 	|	T_Prefer
+	|	T_Thread
 	|	T_True
 	;
 
@@ -451,6 +458,7 @@ option_int_keyword
 	|	T_Version
 	|	T_Baud
 	|	T_Holdover
+	|	T_Stages
 	;
 
 option_double
@@ -703,6 +711,21 @@ filegen_option
 				yyerror(err);
 			}
 		}
+	|	text_binary
+		{
+			const char *err;
+
+			if (lex_from_file()) {
+				$$ = create_attr_ival(T_Flag, $1);
+			} else {
+				$$ = NULL;
+				if (T_Binary == $1)
+					err = "filegen binary remote config ignored";
+				else
+					err = "filegen text remote config ignored";
+				yyerror(err);
+			}
+		}
 	|	enable_disable
 			{ $$ = create_attr_ival(T_Flag, $1); }
 	;
@@ -712,6 +735,11 @@ link_nolink
 	|	T_Nolink
 	;
 
+text_binary
+	:	T_Text
+	|	T_Binary
+	;
+
 enable_disable
 	:	T_Enable
 	|	T_Disable
@@ -1058,7 +1086,8 @@ system_option_flag_keyword
 	;
 
 system_option_local_flag_keyword
-	:	T_Stats
+	:	T_Prefilter
+	|	T_Stats
 	;
 
 /* Tinker Commands
@@ -3,6 +3,7 @@
  */
 #include "config.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <sys/types.h>
 
@@ -29,12 +30,35 @@
  * demobilizes the association and deallocates the structure.
  */
 /*
- * Peer hash tables
+ * Peer hash tables.  Each is an array of lists indexed by the low
+ * bits of a hash, chained through the link at the given offset in
+ * struct peer.  A table doubles when its chains average more than
+ * PEER_HASH_LOAD peers and halves when they average less than a
+ * quarter of that, but never below NTP_HASH_SIZE buckets, so the
+ * chains stay short however many associations there are.
  */
-static struct peer *peer_hash[NTP_HASH_SIZE];	/* peer hash table */
-static int	peer_hash_count[NTP_HASH_SIZE];	/* peers in each bucket */
-static struct peer *assoc_hash[NTP_HASH_SIZE];	/* association ID hash table */
-static int	assoc_hash_count[NTP_HASH_SIZE];/* peers in each bucket */
+#define	PEER_HASH_LOAD	2
+
+struct peer_hash {
+	struct peer **	bucket;
+	int *		count;		/* peers in each bucket */
+	unsigned int	size;		/* buckets, a power of two */
+	unsigned int	entries;	/* peers in the table */
+	size_t		link;		/* offset of the chain link */
+	unsigned int	(*hash)(const struct peer *);
+};
+
+static unsigned int	adr_hash(const struct peer *);
+static unsigned int	aid_hash(const struct peer *);
+
+static struct peer_hash peer_hash = {	/* peer hash table */
+	.link = offsetof(struct peer, adr_link),
+	.hash = adr_hash
+};
+static struct peer_hash assoc_hash = {	/* association ID hash table */
+	.link = offsetof(struct peer, aid_link),
+	.hash = aid_hash
+};
 struct peer *peer_list;				/* peer structures list */
 static struct peer *peer_free;			/* peer structures free list */
 static int	peer_free_count;		/* count of free structures */
@@ -69,6 +93,9 @@ static struct peer *	findexistingpeer_name(const char *, unsigned short,
 					      struct peer *, int);
 static struct peer *	findexistingpeer_addr(sockaddr_u *,
 					      struct peer *, int);
+static void		hash_resize(struct peer_hash *, unsigned int);
+static void		hash_add(struct peer_hash *, struct peer *);
+static bool		hash_del(struct peer_hash *, struct peer *);
 static void		free_peer(struct peer *);
 static void		getmorepeermem(void);
 static	void		peer_reset	(struct peer *);
@@ -94,6 +121,9 @@ init_peer(void)
 	total_peer_structs = COUNTOF(init_peer_alloc);
 	peer_free_count = COUNTOF(init_peer_alloc);
 
+	hash_resize(&peer_hash, NTP_HASH_SIZE);
+	hash_resize(&assoc_hash, NTP_HASH_SIZE);
+
 	/*
 	 * Initialize our first association ID
 	 */
@@ -104,6 +134,119 @@ init_peer(void)
 }
 
 
+static unsigned int
+adr_hash(
+	const struct peer *p
+	)
+{
+	return sock_hash(&p->srcadr);
+}
+
+
+static unsigned int
+aid_hash(
+	const struct peer *p
+	)
+{
+	return p->associd;
+}
+
+
+static inline struct peer **
+hash_link(
+	const struct peer_hash *h,
+	struct peer *		p
+	)
+{
+	return (struct peer **)((char *)p + h->link);
+}
+
+
+/*
+ * hash_resize - rehash a peer hash table into size buckets
+ */
+static void
+hash_resize(
+	struct peer_hash *h,
+	unsigned int	size
+	)
+{
+	struct peer **	bucket;
+	int *		count;
+	struct peer *	p;
+	struct peer *	next;
+	unsigned int	i, b;
+
+	bucket = emalloc_zero(size * sizeof(*bucket));
+	count = emalloc_zero(size * sizeof(*count));
+	for (i = 0; i < h->size; i++) {
+		for (p = h->bucket[i]; p != NULL; p = next) {
+			next = *hash_link(h, p);
+			b = (*h->hash)(p) & (size - 1);
+			*hash_link(h, p) = bucket[b];
+			bucket[b] = p;
+			count[b]++;
+		}
+	}
+	free(h->bucket);
+	free(h->count);
+	h->bucket = bucket;
+	h->count = count;
+	h->size = size;
+	DPRINT(1, ("hash_resize: %u buckets for %u peers\n", size,
+		   h->entries));
+}
+
+
+/*
+ * hash_add - put a peer in a hash table, growing it if need be
+ */
+static void
+hash_add(
+	struct peer_hash *h,
+	struct peer *	p
+	)
+{
+	unsigned int	b;
+
+	if (h->entries >= h->size * PEER_HASH_LOAD)
+		hash_resize(h, h->size * 2);
+	b = (*h->hash)(p) & (h->size - 1);
+	*hash_link(h, p) = h->bucket[b];
+	h->bucket[b] = p;
+	h->count[b]++;
+	h->entries++;
+}
+
+
+/*
+ * hash_del - take a peer out of a hash table, shrinking it if it is
+ * mostly empty.  Returns false if the peer was not in it.
+ */
+static bool
+hash_del(
+	struct peer_hash *h,
+	struct peer *	p
+	)
+{
+	struct peer **	pp;
+	unsigned int	b;
+
+	b = (*h->hash)(p) & (h->size - 1);
+	for (pp = &h->bucket[b]; *pp != p; pp = hash_link(h, *pp))
+		if (*pp == NULL)
+			return false;
+	*pp = *hash_link(h, p);
+	*hash_link(h, p) = NULL;
+	h->count[b]--;
+	h->entries--;
+	if (h->size > NTP_HASH_SIZE &&
+	    h->entries < h->size * PEER_HASH_LOAD / 8)
+		hash_resize(h, h->size / 2);
+	return true;
+}
+
+
 /*
  * getmorepeermem - add more peer structures to the free list
  */
@@ -175,7 +318,8 @@ findexistingpeer_addr(
 	 * address.
 	 */
 	if (NULL == start_peer)
-		peer = peer_hash[NTP_HASH_ADDR(addr)];
+		peer = peer_hash.bucket[sock_hash(addr) &
+					(peer_hash.size - 1)];
 	else
 		peer = start_peer->adr_link;
 
@@ -230,8 +374,8 @@ findpeer(
 
 	findpeer_calls++;
 	srcadr = &rbufp->recv_srcadr;
-	hash = NTP_HASH_ADDR(srcadr);
-        for (p = peer_hash[hash]; p != NULL; p = p->adr_link) {
+	hash = sock_hash(srcadr) & (peer_hash.size - 1);
+        for (p = peer_hash.bucket[hash]; p != NULL; p = p->adr_link) {
                 /* [Classic Bug 3072] ensure interface of peer matches */
                 if (p->dstadr != rbufp->dstadr) continue;
 
@@ -256,8 +400,8 @@ findpeerbyassoc(
 	unsigned int hash;
 
 	assocpeer_calls++;
-	hash = assoc & NTP_HASH_MASK;
-	for (p = assoc_hash[hash]; p != NULL; p = p->aid_link) {
+	hash = assoc & (assoc_hash.size - 1);
+	for (p = assoc_hash.bucket[hash]; p != NULL; p = p->aid_link) {
 		if (assoc == p->associd)
 			break;
 	}
@@ -365,30 +509,16 @@ free_peer(
 	)
 {
 	struct peer *	unlinked;
-	int		hash;
 
 
 	if ((MDF_UCAST & p->cast_flags) && !(FLAG_LOOKUP & p->cfg.flags)) {
-		hash = NTP_HASH_ADDR(&p->srcadr);
-		peer_hash_count[hash]--;
-
-		UNLINK_SLIST(unlinked, peer_hash[hash], p, adr_link,
-			     struct peer);
-		if (NULL == unlinked) {
-			peer_hash_count[hash]++;
+		if (!hash_del(&peer_hash, p))
 			msyslog(LOG_ERR, "ERR: peer %s not in address table!",
 				socktoa(&p->srcadr));
-		}
 	}
 
 	/* Remove him from the association hash as well. */
-	hash = p->associd & NTP_HASH_MASK;
-	assoc_hash_count[hash]--;
-
-	UNLINK_SLIST(unlinked, assoc_hash[hash], p, aid_link,
-		     struct peer);
-	if (NULL == unlinked) {
-		assoc_hash_count[hash]++;
+	if (!hash_del(&assoc_hash, p)) {
 		msyslog(LOG_ERR,
 			"ERR: peer %s not in association ID table!",
 			socktoa(&p->srcadr));
@@ -401,6 +531,8 @@ free_peer(
 		msyslog(LOG_ERR, "ERR: %s not in peer list!",
 			socktoa(&p->srcadr));
 
+	wheel_unschedule(p);
+
 	if (p->hostname != NULL)
 		free(p->hostname);
 
@@ -551,7 +683,6 @@ newpeer(
 	)
 {
 	struct peer *	peer;
-	unsigned int	hash;
 	const char *	name;	/* for error messages */
 
 	if (NULL != hostname) {
@@ -692,9 +823,7 @@ newpeer(
 		peer_add_hash(peer);
 		restrict_source(peer);
 	}
-	hash = peer->associd & NTP_HASH_MASK;
-	LINK_SLIST(assoc_hash[hash], peer, aid_link);
-	assoc_hash_count[hash]++;
+	hash_add(&assoc_hash, peer);
 	LINK_SLIST(peer_list, peer, p_link);
 
 	mprintf_event(PEVNT_MOBIL, peer, "assoc %d", peer->associd);
@@ -707,27 +836,39 @@ newpeer(
 
 void peer_del_hash (struct peer *peer)
 {
-        unsigned int hash;
-        struct peer *unlinked;
-
-        hash = NTP_HASH_ADDR(&peer->srcadr);
-        peer_hash_count[hash]--;
-
-        UNLINK_SLIST(unlinked, peer_hash[hash], peer, adr_link, struct peer);
-        if (NULL == unlinked) {
-            peer_hash_count[hash]++;
+        if (!hash_del(&peer_hash, peer))
             msyslog(LOG_ERR, "ERR: peer %s not in address table!",
                 socktoa(&peer->srcadr));
-        }
 }
 
 void peer_add_hash (struct peer *peer)
 {
-	unsigned int	hash;
+	hash_add(&peer_hash, peer);
+}
 
-	hash = NTP_HASH_ADDR(&peer->srcadr);
-	LINK_SLIST(peer_hash[hash], peer, adr_link);
-	peer_hash_count[hash]++;
+
+/*
+ * peer_hash_stats - occupancy of the address (false) or association
+ * ID (true) hash table
+ */
+void
+peer_hash_stats(
+	bool			assoc,
+	struct peer_hash_stats *st
+	)
+{
+	const struct peer_hash *h = assoc ? &assoc_hash : &peer_hash;
+	unsigned int	i;
+
+	st->size = h->size;
+	st->entries = h->entries;
+	st->slots = 0;
+	st->longest = 0;
+	for (i = 0; i < h->size; i++) {
+		if (h->count[i] > 0)
+			st->slots++;
+		st->longest = max(st->longest, (unsigned int)h->count[i]);
+	}
 }
 
 /*
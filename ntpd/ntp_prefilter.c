@@ -0,0 +1,343 @@
+/*
+ * ntp_prefilter.c - drop unwanted packets in the kernel
+ *
+ * Every packet that receive() throws away at once still costs a
+ * recvmsg(), a receive buffer and the early checks.  During a flood of
+ * garbage or of traffic from restricted hosts that is where the time
+ * goes.  With "enable prefilter", each socket gets a classic BPF
+ * filter that drops those packets before they are queued:
+ *
+ *  - what is_packet_not_low_rot() rejects: payloads shorter than a
+ *    control header, versions outside NTP_OLDVERSION..NTP_VERSION and
+ *    modes other than client, server and control;
+ *  - packets from multicast sources, which restrictions() ignores;
+ *  - what check_early_restrictions() rejects by the restrict entry of
+ *    the source: ignore, noserve for all but control packets, noquery
+ *    for control packets, and version for other than NTP_VERSION.
+ *
+ * The entries are tested in the order of the restrict lists, so the
+ * first that matches decides, as in match_restrict4_addr() and
+ * match_restrict6_addr().  "flake" is left to user space.  A packet
+ * whose network header is not of the family of the socket, such as an
+ * IPv4-mapped one, is passed up untouched.
+ *
+ * The filter is built again when the restrict lists change.  Packets it
+ * drops are not seen by the restrict hit counts or the protocol
+ * statistics; the kernel counts them in the drops of the socket.
+ */
+#include "config.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_LINUX_FILTER_H
+# include <linux/filter.h>
+# include <linux/sock_diag.h>
+#endif
+
+#include "ntpd.h"
+#include "ntp_endian.h"
+#include "ntp_stdlib.h"
+
+#ifdef HAVE_LINUX_FILTER_H
+
+#define PF_ACCEPT	0xffffffffU	/* keep all of the packet */
+#define PF_DROP		0
+#define PF_UDPHDR	8		/* data starts at the UDP header */
+#define PF_LVM		PF_UDPHDR	/* offset of li_vn_mode */
+#define PF_VERSION(v)	((uint32_t)(v) << 3)
+#define PF_BLOCK	16		/* longest test or verdict */
+
+/* a program under construction */
+struct pf_prog {
+	struct sock_filter *	insn;
+	int			len;
+	int			max;
+};
+
+
+/*
+ * pf_emit - append an instruction, if there is room
+ */
+static void
+pf_emit(
+	struct pf_prog *	p,
+	uint16_t		code,
+	uint8_t			jt,
+	uint8_t			jf,
+	uint32_t		k
+	)
+{
+	if (p->len < p->max) {
+		p->insn[p->len].code = code;
+		p->insn[p->len].jt = jt;
+		p->insn[p->len].jf = jf;
+		p->insn[p->len].k = k;
+	}
+	p->len++;
+}
+
+
+/*
+ * pf_verdict - the action for a packet whose source matched an entry
+ * with the given flags
+ */
+static void
+pf_verdict(
+	struct pf_prog *	p,
+	unsigned short		flags
+	)
+{
+	bool	noserve = (RES_DONTSERVE & flags) != 0;
+	bool	noquery = (RES_NOQUERY & flags) != 0;
+
+	if ((RES_IGNORE & flags) || (noserve && noquery)) {
+		pf_emit(p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+		return;
+	}
+	if (noserve || noquery) {
+		pf_emit(p, BPF_LD | BPF_B | BPF_ABS, 0, 0, PF_LVM);
+		pf_emit(p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 7);
+		/* drop control packets for noquery, others for noserve */
+		pf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, noquery ? 0 : 1,
+			noquery ? 1 : 0, MODE_CONTROL);
+		pf_emit(p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+	}
+	if (RES_VERSION & flags) {
+		pf_emit(p, BPF_LD | BPF_B | BPF_ABS, 0, 0, PF_LVM);
+		pf_emit(p, BPF_ALU | BPF_AND | BPF_K, 0, 0, PF_VERSION(7));
+		pf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, 1, 0,
+			PF_VERSION(NTP_VERSION));
+		pf_emit(p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+	}
+	pf_emit(p, BPF_RET | BPF_K, 0, 0, PF_ACCEPT);
+}
+
+
+/*
+ * pf_word - append a test that source address word i, saved in M[i],
+ * masked with mask is addr.  The jump on failure is patched later.
+ */
+static void
+pf_word(
+	struct pf_prog *	p,
+	int			i,
+	uint32_t		addr,
+	uint32_t		mask
+	)
+{
+	if (0 == mask)
+		return;
+	pf_emit(p, BPF_LD | BPF_MEM, 0, 0, (uint32_t)i);
+	if (mask != 0xffffffffU)
+		pf_emit(p, BPF_ALU | BPF_AND | BPF_K, 0, 0, mask);
+	pf_emit(p, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, addr);
+}
+
+
+/*
+ * pf_entry - append the tests and the verdict for one restrict entry.
+ * Every test that fails skips the rest of the entry.
+ */
+static void
+pf_entry(
+	struct pf_prog *	p,
+	const restrict_u *	res,
+	bool			v6
+	)
+{
+	struct sock_filter	tinsn[PF_BLOCK], vinsn[PF_BLOCK];
+	struct pf_prog		test = { tinsn, 0, PF_BLOCK };
+	struct pf_prog		verdict = { vinsn, 0, PF_BLOCK };
+	int			i;
+
+	if (v6) {
+		for (i = 0; i < 4; i++)
+			pf_word(&test, i,
+				ntp_be32dec(&res->u.v6.addr.s6_addr[4 * i]),
+				ntp_be32dec(&res->u.v6.mask.s6_addr[4 * i]));
+	} else {
+		pf_word(&test, 0, res->u.v4.addr, res->u.v4.mask);
+	}
+	if (RESM_NTPONLY & res->mflags) {
+		/* the source port is first in the UDP header */
+		pf_emit(&test, BPF_LD | BPF_H | BPF_ABS, 0, 0, 0);
+		pf_emit(&test, BPF_JMP | BPF_JEQ | BPF_K, 0, 0, NTP_PORT);
+	}
+	pf_verdict(&verdict, res->flags);
+
+	for (i = 0; i < test.len; i++) {
+		if (BPF_CLASS(tinsn[i].code) == BPF_JMP)
+			tinsn[i].jf = (uint8_t)(test.len - 1 - i + verdict.len);
+		pf_emit(p, tinsn[i].code, tinsn[i].jt, tinsn[i].jf,
+			tinsn[i].k);
+	}
+	for (i = 0; i < verdict.len; i++)
+		pf_emit(p, vinsn[i].code, vinsn[i].jt, vinsn[i].jf,
+			vinsn[i].k);
+}
+
+
+/*
+ * prefilter_build - build the filter for sockets of family from the
+ * current restrict lists into prog, which has room for max
+ * instructions.  Returns the length of the program, or -1 if it does
+ * not fit.
+ */
+int
+prefilter_build(
+	int			family,
+	struct sock_filter *	prog,
+	int			max
+	)
+{
+	struct pf_prog		p = { prog, 0, max };
+	const restrict_u *	res;
+	bool			v6 = (AF_INET6 == family);
+	int			i;
+
+	/* what is_packet_not_low_rot() rejects */
+	pf_emit(&p, BPF_LD | BPF_W | BPF_LEN, 0, 0, 0);
+	pf_emit(&p, BPF_JMP | BPF_JGE | BPF_K, 1, 0, PF_UDPHDR + 12);
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+	pf_emit(&p, BPF_LD | BPF_B | BPF_ABS, 0, 0, PF_LVM);
+	pf_emit(&p, BPF_ALU | BPF_AND | BPF_K, 0, 0, PF_VERSION(7));
+	pf_emit(&p, BPF_JMP | BPF_JGE | BPF_K, 1, 0,
+		PF_VERSION(NTP_OLDVERSION));
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+	pf_emit(&p, BPF_JMP | BPF_JGT | BPF_K, 0, 1, PF_VERSION(NTP_VERSION));
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+	pf_emit(&p, BPF_LD | BPF_B | BPF_ABS, 0, 0, PF_LVM);
+	pf_emit(&p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 7);
+	pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 3, 0, MODE_CLIENT);
+	pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 2, 0, MODE_SERVER);
+	pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, MODE_CONTROL);
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+
+	/* only a network header of our family has the address we expect */
+	pf_emit(&p, BPF_LD | BPF_B | BPF_ABS, 0, 0, (uint32_t)SKF_NET_OFF);
+	pf_emit(&p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xf0);
+	pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 1, 0, v6 ? 0x60 : 0x40);
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_ACCEPT);
+
+	/* save the source address in M[], dropping multicast sources */
+	if (v6) {
+		for (i = 3; i >= 0; i--) {
+			pf_emit(&p, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+				(uint32_t)(SKF_NET_OFF + 8 + 4 * i));
+			pf_emit(&p, BPF_ST, 0, 0, (uint32_t)i);
+		}
+		pf_emit(&p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xff000000U);
+		pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0xff000000U);
+	} else {
+		pf_emit(&p, BPF_LD | BPF_W | BPF_ABS, 0, 0,
+			(uint32_t)(SKF_NET_OFF + 12));
+		pf_emit(&p, BPF_ST, 0, 0, 0);
+		pf_emit(&p, BPF_ALU | BPF_AND | BPF_K, 0, 0, 0xf0000000U);
+		pf_emit(&p, BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0xe0000000U);
+	}
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_DROP);
+
+	/* the restrict entries, first match first */
+	for (res = v6 ? rstrct.restrictlist6 : rstrct.restrictlist4;
+	     res != NULL; res = res->link)
+		pf_entry(&p, res, v6);
+	pf_emit(&p, BPF_RET | BPF_K, 0, 0, PF_ACCEPT);
+
+	return (p.len <= max) ? p.len : -1;
+}
+
+
+/*
+ * prefilter_attach - attach a filter built from the current restrict
+ * lists to a socket of family.  Returns false if the filter could not
+ * be built or attached; any old filter is then removed.
+ */
+bool
+prefilter_attach(
+	SOCKET	fd,
+	int	family
+	)
+{
+	static struct sock_filter prog[BPF_MAXINSNS];
+	struct sock_fprog	fprog;
+	int			len;
+
+	len = prefilter_build(family, prog, BPF_MAXINSNS);
+	if (len < 0) {
+		msyslog(LOG_WARNING,
+			"IO: restrict list too long for a socket prefilter");
+		prefilter_detach(fd);
+		return false;
+	}
+	fprog.len = (unsigned short)len;
+	fprog.filter = prog;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+		       sizeof(fprog)) < 0) {
+		msyslog(LOG_ERR, "IO: setsockopt SO_ATTACH_FILTER fd=%d: %s",
+			fd, strerror(errno));
+		prefilter_detach(fd);
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ * prefilter_detach - remove the filter of a socket, if it has one
+ */
+void
+prefilter_detach(
+	SOCKET	fd
+	)
+{
+	int	on = 1;
+
+	(void)setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &on, sizeof(on));
+}
+
+#else	/* !HAVE_LINUX_FILTER_H */
+
+bool
+prefilter_attach(
+	SOCKET	fd,
+	int	family
+	)
+{
+	UNUSED_ARG(fd);
+	UNUSED_ARG(family);
+	return false;
+}
+
+void
+prefilter_detach(
+	SOCKET	fd
+	)
+{
+	UNUSED_ARG(fd);
+}
+
+#endif	/* !HAVE_LINUX_FILTER_H */
+
+
+/*
+ * socket_drops - return the number of packets the kernel dropped for a
+ * socket, by filter or for want of buffer space, where it says
+ */
+uint64_t
+socket_drops(
+	SOCKET	fd
+	)
+{
+#if defined(SO_MEMINFO) && defined(HAVE_LINUX_FILTER_H)
+	uint32_t	meminfo[SK_MEMINFO_VARS];
+	socklen_t	len = sizeof(meminfo);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0 &&
+	    len > SK_MEMINFO_DROPS * sizeof(meminfo[0]))
+		return meminfo[SK_MEMINFO_DROPS];
+#else
+	UNUSED_ARG(fd);
+#endif
+	return 0;
+}
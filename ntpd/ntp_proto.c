@@ -20,23 +20,6 @@
 #include <unistd.h>
 
 
-/*
- * Byte order conversion
- */
-#define	HTONS_FP(x)	(htonl(x))
-
-/*
- * Generate the wire-format version (that is, big-endian all the way down)
- * of a timestamp expressed as a 64-bit scalar.
- */
-static inline l_fp_w htonl_fp(l_fp lfp) {
-    l_fp_w lfpw;
-    lfpw.l_ui = htonl(lfpuint(lfp));
-    lfpw.l_uf = htonl(lfpfrac(lfp));
-    return lfpw;
-}
-
-
 /*
  * Definitions for the clear() routine.  We use memset() to clear
  * the parts of the peer structure which go to zero.  These are
@@ -68,27 +51,6 @@ static inline l_fp_w htonl_fp(l_fp lfp) {
 
 #define DIFF(x, y) (SQUARE((x) - (y)))
 
-/*
- * Dealing with stratum.  0 gets mapped to 16 incoming, and back to 0
- * on output.
- */
-#define	PKT_TO_STRATUM(s)	((uint8_t)(((s) == (STRATUM_PKT_UNSPEC)) ?\
-				(STRATUM_UNSPEC) : (s)))
-
-#define	STRATUM_TO_PKT(s)	((uint8_t)(((s) == (STRATUM_UNSPEC)) ?\
-				(STRATUM_PKT_UNSPEC) : (s)))
-
-/*
- * peer_select groups statistics for a peer used by clock_select() and
- * clock_cluster().
- */
-typedef struct peer_select_tag {
-	struct peer *	peer;
-	double		synch;	/* sync distance */
-	double		error;	/* jitter */
-	double		seljit;	/* selection jitter */
-} peer_select;
-
 /*
  * System variables are declared here. Unless specified otherwise, all
  * times are in seconds.
@@ -539,6 +501,7 @@ handle_procpkt(
 			report_event(PEVNT_RATE, peer, NULL);
 			peer->burst = peer->retry = 0;
 			peer->throttle = (NTP_SHIFT + 1) * (1 << peer->cfg.minpoll);
+			peer->throttle_time = current_time;
 			if (rbufp->pkt.ppoll > peer->cfg.minpoll)
 			    peer->cfg.minpoll = min(peer->ppoll, 10);
 			poll_update(peer, min(rbufp->pkt.ppoll, 10));
@@ -846,8 +809,9 @@ transmit(
 		    (peer_associations < sys_maxclock ||
 		     sys_survivors < sys_minclock))
 			if (!dns_probe(peer)) {
-			    /* DNS thread busy, try again soon */
+			    /* DNS thread busy, try again next tick */
 			    peer->nextdate = current_time;
+			    wheel_schedule(peer);
 			    return;
                      }
 		poll_update(peer, hpoll);
@@ -859,6 +823,7 @@ transmit(
 		peer->outdate = current_time;
 		if (!dns_probe(peer)) {
 			peer->nextdate = current_time;
+			wheel_schedule(peer);
 			return;
 		}
 		poll_update(peer, hpoll);
@@ -1137,6 +1102,21 @@ clock_update(
 }
 
 
+/*
+ * poll_schedule - file the peer in the timer wheel for its next poll.
+ * If that has come already, the timer sends it without waiting for
+ * the next tick.
+ */
+static void
+poll_schedule(
+	struct peer *peer
+	)
+{
+	if (wheel_schedule(peer))
+		timer_poll_soon();
+}
+
+
 /*
  * poll_update - update peer poll interval
  */
@@ -1179,11 +1159,13 @@ poll_update(
 	 * slink away. If called from the poll process, delay 1 s for a
 	 * reference clock, otherwise 2 s.
 	 */
-	utemp = current_time + (unsigned long)max(peer->throttle - (NTP_SHIFT - 1) *
-	    (1 << peer->cfg.minpoll), rstrct.ntp_minpkt);
+	utemp = current_time + (unsigned long)max(peer_throttle(peer) -
+	    (NTP_SHIFT - 1) * (1 << peer->cfg.minpoll), rstrct.ntp_minpkt);
 	if (peer->burst > 0) {
-		if (peer->nextdate > current_time)
+		if (peer->nextdate > current_time) {
+			poll_schedule(peer);
 			return;
+		}
 #ifdef REFCLOCK
 		else if (peer->cfg.flags & FLAG_REFCLOCK)
 			peer->nextdate = current_time + RESP_DELAY;
@@ -1228,6 +1210,27 @@ poll_update(
 		   peer->burst, peer->retry, peer->throttle,
 		   utemp - current_time, peer->nextdate -
 		   current_time));
+	poll_schedule(peer);
+}
+
+
+/*
+ * peer_throttle - return the rate control headway of a peer.  It
+ * drains by one a second, which is accounted for here when it is
+ * looked at rather than by the timer.
+ */
+int
+peer_throttle(
+	struct peer *peer	/* peer structure pointer */
+	)
+{
+	uptime_t elapsed = current_time - peer->throttle_time;
+
+	if (peer->throttle > 0)
+		peer->throttle = (elapsed < (uptime_t)peer->throttle) ?
+		    peer->throttle - (int)elapsed : 0;
+	peer->throttle_time = current_time;
+	return peer->throttle;
 }
 
 
@@ -1296,6 +1299,7 @@ peer_clear(
 	DPRINT(1, ("peer_clear: at %u next %u associd %d refid %s\n",
 		   current_time, peer->nextdate, peer->associd,
 		   ident));
+	poll_schedule(peer);
 }
 
 
@@ -1344,43 +1348,15 @@ clock_filter(
 	 * distance at that value. If the time since the last update is
 	 * less than the Allan intercept use the delay; otherwise, use
 	 * the sum of the delay and dispersion.
+	 *
+	 * If the clock has stabilized, sort the samples by distance.
+	 * See ntp_filter.c.
 	 */
 	dtemp = loop_data.clock_phi * (current_time - peer->update);
 	peer->update = current_time;
-	for (i = NTP_SHIFT - 1; i >= 0; i--) {
-		if (i != 0)
-			peer->filter_disp[j] += dtemp;
-		if (peer->filter_disp[j] >= sys_maxdisp) {
-			peer->filter_disp[j] = sys_maxdisp;
-			dst[i] = sys_maxdisp;
-		} else if (peer->update - peer->filter_epoch[j] >
-		    (unsigned long)ULOGTOD(clkstate.allan_xpt)) {
-			dst[i] = peer->filter_delay[j] +
-			    peer->filter_disp[j];
-		} else {
-			dst[i] = peer->filter_delay[j];
-		}
-		ord[i] = j;
-		j = (j + 1) % NTP_SHIFT;
-	}
-
-	/*
-	 * If the clock has stabilized, sort the samples by distance.
-	 */
-	if (freq_cnt == 0) {
-		for (i = 1; i < NTP_SHIFT; i++) {
-			for (j = 0; j < i; j++) {
-				if (dst[j] > dst[i]) {
-					k = ord[j];
-					ord[j] = ord[i];
-					ord[i] = k;
-					etemp = dst[j];
-					dst[j] = dst[i];
-					dst[i] = etemp;
-				}
-			}
-		}
-	}
+	filter_sort(peer, dtemp, sys_maxdisp,
+		    (unsigned long)ULOGTOD(clkstate.allan_xpt), freq_cnt == 0,
+		    dst, ord);
 
 	/*
 	 * Copy the index list to the association structure so ntpq
@@ -1425,6 +1401,7 @@ clock_filter(
 	 */
 	if (m == 0) {
 		clock_select();
+		sys_publish();
 		return;
 	}
 	etemp = fabs(peer->offset - peer->filter_offset[k]);
@@ -1474,8 +1451,10 @@ clock_filter(
 	DPRINT(1, ("clock_filter: n %d off %.6f del %.6f dsp %.6f jit %.6f\n",
 		   m, peer->offset, peer->delay, peer->disp,
 		   peer->jitter));
-	if (peer->burst == 0 || sys_vars.sys_leap == LEAP_NOTINSYNC)
+	if (peer->burst == 0 || sys_vars.sys_leap == LEAP_NOTINSYNC) {
 		clock_select();
+		sys_publish();
+	}
 }
 
 
@@ -1492,15 +1471,13 @@ void
 clock_select(void)
 {
 	struct peer *peer;
-	int	i, j, k, n;
-	int	nlist, nl2;
-	int	allow;
+	int	i, j;
+	int	nlist;
 	int	speer;
-	double	d, e, f, g;
+	double	e;
 	double	high, low;
 	double	speermet;
 	double	orphmet = 2.0 * UINT32_MAX; /* 2x is greater than */
-	struct endpoint endp;
 	struct peer *osys_peer;
 	struct peer *sys_prefer = NULL;	/* prefer peer */
 	struct peer *typesystem = NULL;
@@ -1510,17 +1487,11 @@ clock_select(void)
 	struct peer *typelocal = NULL;
 	struct peer *typepps = NULL;
 #endif /* REFCLOCK */
-	static struct endpoint *endpoint = NULL;
-	static int *indx = NULL;
 	static peer_select *peers = NULL;
-	static unsigned int endpoint_size = 0;
-	static unsigned int peers_size = 0;
-	static unsigned int indx_size = 0;
-	size_t octets;
 
 	/*
-	 * Initialize and create endpoint, index and peer lists big
-	 * enough to handle all associations.
+	 * Initialize and create the peer list big enough to handle
+	 * all associations.
 	 */
 	osys_peer = sys_vars.sys_peer;
 	sys_survivors = 0;
@@ -1538,13 +1509,7 @@ clock_select(void)
 	for (peer = peer_list; peer != NULL; peer = peer->p_link) {
 		nlist++;
 	}
-	endpoint_size = ALIGNED_SIZE((unsigned int)nlist * 2 * sizeof(*endpoint));
-	peers_size = ALIGNED_SIZE((unsigned int)nlist * sizeof(*peers));
-	indx_size = ALIGNED_SIZE((unsigned int)nlist * 2 * sizeof(*indx));
-	octets = endpoint_size + peers_size + indx_size;
-	endpoint = erealloc(endpoint, octets);
-	peers = INC_ALIGNED_PTR(endpoint, endpoint_size);
-	indx = INC_ALIGNED_PTR(peers, peers_size);
+	peers = erealloc(peers, (size_t)nlist * sizeof(*peers));
 
 	/*
 	 * Initially, we populate the island with all the rifraff peers
@@ -1556,7 +1521,7 @@ clock_select(void)
 	 * has dwindled to sys_minclock, the survivors split a million
 	 * bucks and collectively crank the chimes.
 	 */
-	nlist = nl2 = 0;	/* none yet */
+	nlist = 0;	/* none yet */
 	for (peer = peer_list; peer != NULL; peer = peer->p_link) {
 		peer->new_status = CTL_PST_SEL_REJECT;
 
@@ -1635,108 +1600,16 @@ clock_select(void)
 		 * idol.
 		 */
 		peer->new_status = CTL_PST_SEL_SANE;
-		f = root_distance(peer);
 		peers[nlist].peer = peer;
 		peers[nlist].error = peer->jitter;
-		peers[nlist].synch = f;
+		peers[nlist].synch = root_distance(peer);
 		nlist++;
-
-		/*
-		 * Insert each interval endpoint on the unsorted
-		 * endpoint[] list.
-		 */
-		e = peer->offset;
-		endpoint[nl2].type = -1;	/* lower end */
-		endpoint[nl2].val = e - f;
-		nl2++;
-		endpoint[nl2].type = 1;		/* upper end */
-		endpoint[nl2].val = e + f;
-		nl2++;
 	}
 	/*
-	 * Construct sorted indx[] of endpoint[] indexes ordered by
-	 * offset.
+	 * Find the intersection interval of the candidates, low to
+	 * high, see select_intersect().
 	 */
-	for (i = 0; i < nl2; i++) {
-		indx[i] = i;
-	}
-	for (i = 0; i < nl2; i++) {
-		endp = endpoint[indx[i]];
-		e = endp.val;
-		k = i;
-		for (j = i + 1; j < nl2; j++) {
-			endp = endpoint[indx[j]];
-			if (endp.val < e) {
-				e = endp.val;
-				k = j;
-			}
-		}
-		if (k != i) {
-			j = indx[k];
-			indx[k] = indx[i];
-			indx[i] = j;
-		}
-	}
-	for (i = 0; i < nl2; i++)
-		DPRINT(3, ("select: endpoint %2d %.6f\n",
-			   endpoint[indx[i]].type, endpoint[indx[i]].val));
-
-	/*
-	 * This is the actual algorithm that cleaves the truechimers
-	 * from the falsetickers. The original algorithm was described
-	 * in Keith Marzullo's dissertation, but has been modified for
-	 * better accuracy.
-	 *
-	 * Briefly put, we first assume there are no falsetickers, then
-	 * scan the candidate list first from the low end upwards and
-	 * then from the high end downwards. The scans stop when the
-	 * number of intersections equals the number of candidates less
-	 * the number of falsetickers. If this doesn't happen for a
-	 * given number of falsetickers, we bump the number of
-	 * falsetickers and try again. If the number of falsetickers
-	 * becomes equal to or greater than half the number of
-	 * candidates, the Albanians have won the Byzantine wars and
-	 * correct synchronization is not possible.
-	 *
-	 * Here, nlist is the number of candidates and allow is the
-	 * number of falsetickers. Upon exit, the truechimers are the
-	 * survivors with offsets not less than low and not greater than
-	 * high. There may be none of them.
-	 */
-	low = 1e9;
-	high = -1e9;
-	for (allow = 0; 2 * allow < nlist; allow++) {
-
-		/*
-		 * Bound the interval (low, high) as the smallest
-		 * interval containing points from the most sources.
-		 */
-		n = 0;
-		for (i = 0; i < nl2; i++) {
-			low = endpoint[indx[i]].val;
-			n -= endpoint[indx[i]].type;
-			if (n >= nlist - allow) {
-				break;
-}
-		}
-		n = 0;
-		for (j = nl2 - 1; j >= 0; j--) {
-			high = endpoint[indx[j]].val;
-			n += endpoint[indx[j]].type;
-			if (n >= nlist - allow) {
-				break;
-}
-		}
-
-		/*
-		 * If an interval containing truechimers is found, stop.
-		 * If not, increase the number of falsetickers and go
-		 * around again.
-		 */
-		if (high > low) {
-			break;
-}
-	}
+	select_intersect(peers, nlist, &low, &high);
 
 	/*
 	 * Clustering algorithm. Whittle candidate list of falsetickers,
@@ -1815,49 +1688,9 @@ clock_select(void)
 	}
 
 	/*
-	 * Now, vote outliers off the island by select jitter weighted
-	 * by root distance. Continue voting as long as there are more
-	 * than sys_minclock survivors and the select jitter of the peer
-	 * with the worst metric is greater than the minimum peer
-	 * jitter. Stop if we are about to discard a TRUE or PREFER
-	 * peer, who of course have the immunity idol.
+	 * Now, vote outliers off the island, see select_cluster().
 	 */
-	while (1) {
-		d = 1e9; // Minimum peer jitter
-		e = -1e9; // Worst peer select jitter * synch
-		g = 0; // Worst peer select jitter
-		k = 0; // Index of the worst peer
-		for (i = 0; i < nlist; i++) {
-			if (peers[i].error < d) {
-				d = peers[i].error;
-			}
-			peers[i].seljit = 0;
-			if (nlist > 1) {
-				f = 0;
-				for (j = 0; j < nlist; j++)
-					f += DIFF(peers[j].peer->offset,
-					    peers[i].peer->offset);
-				peers[i].seljit = SQRT(f / (nlist - 1));
-			}
-			if (peers[i].seljit * peers[i].synch > e) {
-				g = peers[i].seljit;
-				e = peers[i].seljit * peers[i].synch;
-				k = i;
-			}
-		}
-		if (nlist <= max(1, sys_minclock) || g <= d ||
-		    ((FLAG_TRUE | FLAG_PREFER) & peers[k].peer->cfg.flags))
-			break;
-
-		DPRINT(3, ("select: drop %s seljit %.6f jit %.6f\n",
-			   socktoa(&peers[k].peer->srcadr), g, d));
-		if (nlist > sys_maxclock)
-			peers[k].peer->new_status = CTL_PST_SEL_EXCESS;
-		for (j = k + 1; j < nlist; j++) {
-			peers[j - 1] = peers[j];
-		}
-		nlist--;
-	}
+	nlist = select_cluster(peers, nlist, sys_minclock, sys_maxclock);
 
 	/*
 	 * What remains is a list usually not greater than sys_minclock
@@ -2185,7 +2018,7 @@ peer_xmit(
 
 	peer->sent++;
         peer->outcount++;
-	peer->throttle += (1 << peer->cfg.minpoll) - 2;
+	peer->throttle = peer_throttle(peer) + (1 << peer->cfg.minpoll) - 2;
 	DPRINT(1, ("transmit: at %u %s->%s mode %d keyid %08x len %u\n",
 		   current_time, peer->dstadr ?
 		   socktoa(&peer->dstadr->sin) : "-",
@@ -2194,15 +2027,31 @@ peer_xmit(
 }
 
 
+/*
+ * sys_publish - publish the system variables for the reply paths.
+ * Called after each round of changes to them.
+ */
+void
+sys_publish(void)
+{
+	struct sys_snapshot snap;
+
+	ZERO(snap);
+	snap.leap = sys_vars.sys_leap;
+	snap.stratum = sys_vars.sys_stratum;
+	snap.precision = sys_vars.sys_precision;
+	snap.rootdelay = sys_vars.sys_rootdelay;
+	snap.rootdisp = sys_vars.sys_rootdisp;
+	snap.rootdist = sys_vars.sys_rootdist;
+	snap.refid = sys_vars.sys_refid;
+	snap.reftime = sys_vars.sys_reftime;
 #ifdef ENABLE_LEAP_SMEAR
-
-static void
-leap_smear_add_offs(l_fp *t) {
-	t += leap_smear.offset;
+	snap.smearing = leap_smear.in_progress;
+	snap.smear_offset = leap_smear.offset;
+#endif
+	sys_snapshot_publish(&snap);
 }
 
-#endif	/* ENABLE_LEAP_SMEAR */
-
 /*
  * fast_xmit - Send packet for nonpersistent association. Note that
  * neither the source or destination can be a broadcast address.
@@ -2255,65 +2104,35 @@ fast_xmit(
 		xpkt.xmt.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
 
 	/*
-	 * This is a normal packet. Use the system variables.
+	 * This is a normal packet. Use the system variables, as last
+	 * published, so that the reply is of a single update.  The
+	 * header was built then; only the version, poll and timestamps
+	 * are the request's.
+	 *
+	 * If we are inside the leap smear interval the current smear
+	 * offset is added to the receive and transmit times, as it was
+	 * to the reftime, to make sure the reftime isn't later than
+	 * them.
 	 */
 	} else {
-#ifdef ENABLE_LEAP_SMEAR
-		/*
-		 * Make copies of the variables which can be affected by smearing.
-		 */
-		l_fp this_ref_time;
-		l_fp this_recv_time;
-#endif
-
-		/*
-		 * If we are inside the leap smear interval we add the
-		 * current smear offset to the packet receive time, to
-		 * the packet transmit time, and eventually to the
-		 * reftime to make sure the reftime isn't later than
-		 * the transmit/receive times.
-		 */
-		xpkt.li_vn_mode = PKT_LI_VN_MODE(sys_vars.sys_leap,
-		    PKT_VERSION(rbufp->pkt.li_vn_mode), MODE_SERVER);
-		xpkt.stratum = STRATUM_TO_PKT(sys_vars.sys_stratum);
-		xpkt.ppoll = max(rbufp->pkt.ppoll, rstrct.ntp_minpoll);
-		xpkt.precision = sys_vars.sys_precision;
-		xpkt.refid = sys_vars.sys_refid;
-		xpkt.rootdelay = HTONS_FP(DTOUFP(sys_vars.sys_rootdelay));
-		xpkt.rootdisp = HTONS_FP(DTOUFP(sys_vars.sys_rootdisp));
+		struct sys_snapshot snap;
 
+		sys_snapshot_read(&snap);
+		sys_reply_header(&xpkt, &snap,
+		    PKT_VERSION(rbufp->pkt.li_vn_mode),
+		    max(rbufp->pkt.ppoll, rstrct.ntp_minpoll),
+		    rbufp->pkt.xmt, rbufp->recv_time);
 #ifdef ENABLE_LEAP_SMEAR
-		this_ref_time = sys_vars.sys_reftime;
-		if (leap_smear.in_progress) {
-			leap_smear_add_offs(&this_ref_time);
-			xpkt.refid = convertLFPToRefID(leap_smear.offset);
+		if (snap.smearing)
 			DPRINT(2, ("fast_xmit: leap_smear.in_progress: refid %8x, smear %s\n",
 				ntohl(xpkt.refid),
-				lfptoa(leap_smear.offset, 8)
+				lfptoa(snap.smear_offset, 8)
 				));
-		}
-		xpkt.reftime = htonl_fp(this_ref_time);
-#else
-		xpkt.reftime = htonl_fp(sys_vars.sys_reftime);
-#endif
-
-		xpkt.org.l_ui = htonl(rbufp->pkt.xmt >> 32);
-		xpkt.org.l_uf = htonl(rbufp->pkt.xmt & 0xFFFFFFFF);
-
-#ifdef ENABLE_LEAP_SMEAR
-		this_recv_time = rbufp->recv_time;
-		if (leap_smear.in_progress)
-			leap_smear_add_offs(&this_recv_time);
-		xpkt.rec = htonl_fp(this_recv_time);
-#else
-		xpkt.rec = htonl_fp(rbufp->recv_time);
 #endif
 
 		get_systime(&xmt_tx);
-#ifdef ENABLE_LEAP_SMEAR
-		if (leap_smear.in_progress)
-			leap_smear_add_offs(&xmt_tx);
-#endif
+		if (snap.smearing)
+			xmt_tx += snap.smear_offset;
 		xpkt.xmt = htonl_fp(xmt_tx);
 	}
 
@@ -2505,6 +2324,7 @@ void dns_take_status(struct peer* peer, DNS_Status status) {
 		return; /* hpoll already in use by new server */
 	peer->hpoll = hpoll;
 	peer->nextdate = current_time + (1U << hpoll);
+	poll_schedule(peer);
 }
 
 #ifndef DISABLE_NTS
@@ -2527,6 +2347,7 @@ static void restart_nts_ke(struct peer *peer) {
 	peer->hpoll = hpoll;
 	peer->nextdate = current_time + (1U << hpoll);
 	peer->cfg.flags |= FLAG_LOOKUP;
+	poll_schedule(peer);
 };
 #endif
 
@@ -2776,6 +2597,7 @@ set_sys_tick_precision(
 }
 
 	sys_vars.sys_precision = (int8_t)i;
+	sys_publish();
 }
 #endif
 
@@ -2813,6 +2635,7 @@ init_proto(const bool verbose)
 	stat_count.use_stattime = current_time;
 	clock_ctl.hardpps_enable = false;
 	stats_control = true;
+	sys_publish();
 }
 
 
@@ -13,6 +13,7 @@
 #include "ntp_calendar.h"
 #include "timespecops.h"
 
+#include <math.h>
 #include <stdio.h>
 
 #ifdef HAVE_SYS_IOCTL_H
@@ -27,10 +28,11 @@
 #endif /* HAVE_PPSAPI */
 
 
-#define SAMPLE(x)	pp->coderecv = (pp->coderecv + 1) % MAXSTAGE; \
-			pp->filter[pp->coderecv] = (x); \
+#define SAMPLE(x, t)	pp->coderecv = (pp->coderecv + 1) % pp->nstage; \
+			pp->filter[pp->coderecv].offset = (x); \
+			pp->filter[pp->coderecv].stamp = (t); \
 			if (pp->coderecv == pp->codeproc) \
-				pp->codeproc = (pp->codeproc + 1) % MAXSTAGE;
+				pp->codeproc = (pp->codeproc + 1) % pp->nstage;
 
 #define TTY	struct termios
 
@@ -65,11 +67,11 @@
 /* #define LF		0x0a	* ASCII LF UNUSED */
 
 bool	cal_enable;		/* enable refclock calibrate */
+static struct peer *refclock_list;	/* running clocks */
 
 /*
  * Forward declarations
  */
-static int refclock_cmpl_fp (const void *, const void *);
 static int refclock_sample (struct refclockproc *);
 static bool refclock_setup (int, unsigned int, unsigned int);
 
@@ -200,6 +202,9 @@ refclock_newpeer(
 	pp->conf = refclock_conf[clktype];
 	pp->timestarted = current_time;
 	pp->io.fd = -1;
+	pp->nstage = (peer->cfg.stages ? (int)peer->cfg.stages : MAXSTAGE) + 1;
+	pp->filter = emalloc_zero((size_t)pp->nstage * sizeof(*pp->filter));
+	pp->work = emalloc(2 * (size_t)pp->nstage * sizeof(*pp->work));
 
 	/*
 	 * Set peer.pmode based on the hmode. For appearances only.
@@ -216,6 +221,7 @@ refclock_newpeer(
 		return false;
 	}
 	peer->refid = pp->refid;
+	LINK_SLIST(refclock_list, peer, clk_link);
 	return true;
 }
 
@@ -228,6 +234,8 @@ refclock_unpeer(
 	struct peer *peer	/* peer structure pointer */
 	)
 {
+	struct peer *unlinked;
+
 	/*
 	 * Wiggle the driver to release its resources, then give back
 	 * the interface structure.
@@ -235,6 +243,8 @@ refclock_unpeer(
 	if (NULL == peer->procptr)
 		return;
 
+	UNLINK_SLIST(unlinked, refclock_list, peer, clk_link, struct peer);
+
 	/* There's a standard shutdown sequence if user didn't declare one */
 	if (peer->procptr->conf->clock_shutdown)
 		(peer->procptr->conf->clock_shutdown)(peer->procptr);
@@ -244,28 +254,34 @@ refclock_unpeer(
 		if (-1 != peer->procptr->io.fd)
 			io_closeclock(&peer->procptr->io);
 	}
+	free(peer->procptr->filter);
+	free(peer->procptr->work);
 	free(peer->procptr);
 	peer->procptr = NULL;
 }
 
 
 /*
- * refclock_timer - called once per second for housekeeping.
+ * refclock_timer - called once per second for housekeeping of all
+ * the clocks.
  */
 void
-refclock_timer(
-	struct peer *p
-	)
+refclock_timer(void)
 {
+	struct peer *		p;
+	struct peer *		next_peer;
 	struct refclockproc *	pp;
 	int			unit;
 
-	pp = p->procptr;
-	unit = pp->refclkunit;
-	if (pp->conf->clock_timer)
-		(*pp->conf->clock_timer)(unit, p);
-	if (pp->action != NULL && pp->nextaction <= current_time)
-		(*pp->action)(p);
+	for (p = refclock_list; p != NULL; p = next_peer) {
+		next_peer = p->clk_link;
+		pp = p->procptr;
+		unit = pp->refclkunit;
+		if (pp->conf->clock_timer)
+			(*pp->conf->clock_timer)(unit, p);
+		if (pp->action != NULL && pp->nextaction <= current_time)
+			(*pp->action)(p);
+	}
 }
 
 
@@ -325,28 +341,6 @@ refclock_transmit(
 }
 
 
-/*
- * Compare two doubles - used with qsort()
- */
-static int
-refclock_cmpl_fp(
-	const void *p1,
-	const void *p2
-	)
-{
-	const double *dp1 = (const double *)p1;
-	const double *dp2 = (const double *)p2;
-
-	if (*dp1 < *dp2) {
-		return COMPARE_LESSTHAN;
-	}
-	if (*dp1 > *dp2) {
-		return COMPARE_GREATERTHAN;
-	}
-	return COMPARE_EQUAL;
-}
-
-
 /*
  * refclock_process_offset - update median filter
  *
@@ -369,7 +363,7 @@ refclock_process_offset(
 	lftemp = lasttim;
 	lftemp -= lastrec;
 	doffset = lfptod(lftemp);
-	SAMPLE(doffset + fudge);
+	SAMPLE(doffset + fudge, lastrec);
 }
 
 
@@ -432,67 +426,37 @@ refclock_process(
 /*
  * refclock_sample - process a pile of samples from the clock
  *
- * This routine implements a recursive median filter to suppress spikes
- * in the data, as well as determine a performance statistic. It
- * calculates the mean offset and RMS jitter. A time adjustment
- * fudgetime1 can be added to the final offset to compensate for various
- * systematic errors. The routine returns the number of samples
- * processed, which could be zero.
+ * This routine trims the samples furthest from their median to
+ * suppress spikes in the data, as well as determine a performance
+ * statistic. It calculates the mean offset and RMS jitter of the rest,
+ * and the rate and Allan deviation of all of them (ntp_refsample.c).
+ * A time adjustment fudgetime1 can be added to the final offset to
+ * compensate for various systematic errors. The routine returns the
+ * number of samples processed, which could be zero.
  */
 static int
 refclock_sample(
 	struct refclockproc *pp		/* refclock structure pointer */
 	)
 {
-	size_t	i, j, k, m, n;
-	double	off[MAXSTAGE];
-	double	offset;
+	int	n;
 
 	/*
-	 * Copy the raw offsets and sort into ascending order. Don't do
-	 * anything if the buffer is empty.
+	 * Don't do anything if the buffer is empty.
 	 */
-	n = 0;
-	while (pp->codeproc != pp->coderecv) {
-		pp->codeproc = (pp->codeproc + 1) % MAXSTAGE;
-		off[n] = pp->filter[pp->codeproc];
-		n++;
-	}
+	n = (pp->coderecv - pp->codeproc + pp->nstage) % pp->nstage;
 	if (n == 0)
 		return (0);
 
-	if (n > 1)
-		qsort(off, n, sizeof(off[0]), refclock_cmpl_fp);
-
-	/*
-	 * Reject the furthest from the median of the samples until
-	 * approximately 60 percent of the samples remain.
-	 */
-	i = 0; j = n;
-	m = n - (n * 4) / 10;
-	while ((j - i) > m) {
-		offset = off[(j + i) / 2];
-		if (off[j - 1] - offset < offset - off[i])
-			i++;	/* reject low end */
-		else
-			j--;	/* reject high end */
-	}
-
-	/*
-	 * Determine the offset and jitter.
-	 */
-	pp->offset = 0;
-	pp->jitter = 0;
-	for (k = i; k < j; k++) {
-		pp->offset += off[k];
-		if (k > i)
-			pp->jitter += SQUARE(off[k] - off[k - 1]);
-	}
-	pp->offset /= m;
-	pp->jitter = SQRT(pp->jitter / m);
+	refsample_summarize(pp->filter, pp->nstage,
+			    (pp->codeproc + 1) % pp->nstage, n, pp->work,
+			    &pp->summary);
+	pp->codeproc = pp->coderecv;
+	pp->offset = pp->summary.offset;
+	pp->jitter = pp->summary.jitter;
 	DPRINT(1, ("refclock_sample: n %d offset %.6f disp %.6f jitter %.6f\n",
-		   (int)n, pp->offset, pp->disp, pp->jitter));
-	return (int)n;
+		   n, pp->offset, pp->disp, pp->jitter));
+	return n;
 }
 
 
@@ -643,6 +607,69 @@ refclock_gtraw(
 }
 
 
+/*
+ * refclock_delay_add - record the delay from the receive timestamp of a
+ * buffer to now
+ */
+static void
+refclock_delay_add(
+	struct refclockdelay *	rd,
+	l_fp			stamp
+	)
+{
+	l_fp		now;
+	double		delay;
+	unsigned long	us;
+	int		i;
+
+	get_systime(&now);
+	now -= stamp;
+	delay = (double)lfptod(now);
+	if (delay < 0)		/* stepped under us */
+		delay = 0;
+	rd->count++;
+	rd->sum += delay;
+	if (delay > rd->max)
+		rd->max = delay;
+	us = (unsigned long)(delay * US_PER_S);
+	for (i = 0; us != 0 && i < NDELAYBIN - 1; i++)
+		us >>= 1;
+	rd->bin[i]++;
+}
+
+
+/*
+ * refclock_delay_quantile - the delay below which the fraction q of
+ * those recorded fall, as the upper edge of its bin, in seconds.  The
+ * last bin has no upper edge; the largest delay stands in for it.
+ */
+double
+refclock_delay_quantile(
+	const struct refclockdelay *	rd,
+	double				q
+	)
+{
+	unsigned long	want;
+	unsigned long	seen = 0;
+	double		edge;
+	int		i;
+
+	if (0 == rd->count)
+		return 0;
+	want = (unsigned long)ceil(q * rd->count);
+	if (want < 1)
+		want = 1;
+	for (i = 0; i < NDELAYBIN - 1; i++) {
+		seen += rd->bin[i];
+		if (seen >= want) {
+			edge = ldexp(1, i) / US_PER_S;
+			return (edge < rd->max) ? edge : rd->max;
+		}
+	}
+	return rd->max;
+}
+
+
 /*
  * indicate_refclock_packet()
  *
@@ -660,6 +687,8 @@ indicate_refclock_packet(
 	struct recvbuf *	rb
 	)
 {
+	refclock_delay_add(&rio->delay, rb->recv_time);
+
 	/* Does this refclock use direct input routine? */
 	if (rio->io_input != NULL && (*rio->io_input)(rb) == 0) {
 		/*
@@ -923,6 +952,9 @@ refclock_control(
 		out->clockdesc = pp->clockdesc;
 		out->lencode = (unsigned short)pp->lencode;
 		out->p_lastcode = pp->a_lastcode;
+		out->iodelay = &pp->io.delay;
+		out->stages = pp->nstage - 1;
+		out->summary = &pp->summary;
 	}
 
 	/*
@@ -1009,37 +1041,36 @@ refclock_params(
 
 
 /*
- * refclock_catcher - called once per second
+ * refclock_ppsfetch - fetch the latest PPS edge
  *
- * This routine is called once per second. It snatches the PPS
- * timestamp from the kernel and saves the sign-extended fraction in
- * a circular buffer for processing at the next poll event.
+ * This routine snatches the most recent PPS timestamp from the kernel
+ * and returns it, with its sign-extended fraction of a second, if it
+ * is one not seen before.  The PPSAPI parameters are set from mode
+ * the first time round.
  */
 pps_status
-refclock_catcher(
+refclock_ppsfetch(
 	struct peer *peer,		/* peer structure pointer */
 	struct refclock_ppsctl *ap,	/* PPS context structure pointer */
-	int	mode			/* mode bits */
+	int	mode,			/* mode bits */
+	l_fp	*stamp,			/* timestamp of the edge */
+	double	*frac			/* its offset from the second */
 	)
 {
-	struct refclockproc *pp;
 	pps_info_t pps_info;
 	struct timespec timeout;
 	double	dtemp;
 
-	UNUSED_ARG(mode);
-
 	/*
 	 * We require the clock to be synchronized before setting the
 	 * parameters. When the parameters have been set, fetch the
 	 * most recent PPS timestamp.
 	 */
-	pp = peer->procptr;
 	if (ap->handle == 0)
 		return PPS_SETUP;
 
 	if (ap->pps_params.mode == 0 && sys_vars.sys_leap != LEAP_NOTINSYNC) {
-		if (!refclock_params(pp->sloppyclockflag, ap))
+		if (!refclock_params(mode, ap))
 			return PPS_SETUP;
 	}
 	timeout.tv_sec = 0;
@@ -1069,16 +1100,44 @@ refclock_catcher(
 		return PPS_NREADY;
 	}
 
-	/*
-	 * Convert to signed fraction offset and stuff in median filter.
-	 */
-	setlfpuint(pp->lastrec, (uint32_t)ap->ts.tv_sec + JAN_1970);
+	setlfpuint(*stamp, (uint32_t)ap->ts.tv_sec + JAN_1970);
 	dtemp = ap->ts.tv_nsec * S_PER_NS;
-	setlfpfrac(pp->lastrec, (uint32_t)(dtemp * FRAC));
+	setlfpfrac(*stamp, (uint32_t)(dtemp * FRAC));
 	if (dtemp > .5) {
 		dtemp -= 1.;
 	}
-	SAMPLE(-dtemp + pp->fudgetime1);
+	*frac = dtemp;
+	return PPS_OK;
+}
+
+
+/*
+ * refclock_catcher - called once per second
+ *
+ * This routine is called once per second. It fetches the PPS
+ * timestamp and saves the sign-extended fraction in a circular buffer
+ * for processing at the next poll event.
+ */
+pps_status
+refclock_catcher(
+	struct peer *peer,		/* peer structure pointer */
+	struct refclock_ppsctl *ap,	/* PPS context structure pointer */
+	int	mode			/* mode bits */
+	)
+{
+	struct refclockproc *pp;
+	pps_status rc;
+	double	dtemp;
+
+	pp = peer->procptr;
+	rc = refclock_ppsfetch(peer, ap, mode, &pp->lastrec, &dtemp);
+	if (rc != PPS_OK)
+		return rc;
+
+	/*
+	 * Convert to signed fraction offset and stuff in median filter.
+	 */
+	SAMPLE(-dtemp + pp->fudgetime1, pp->lastrec);
 	DPRINT(2, ("refclock_pps: %u %f %f\n", current_time,
 		   dtemp, pp->fudgetime1));
 	return PPS_OK;
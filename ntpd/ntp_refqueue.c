@@ -0,0 +1,308 @@
+/*
+ * ntp_refqueue.c - refclock input read on a thread of its own
+ *
+ * Normally the main loop reads a refclock when select() says it is
+ * ready, along with every other clock and the network sockets, and
+ * stamps the data when its turn comes.  A clock configured with the
+ * thread option instead gets a reader thread that waits in poll() on
+ * the device alone, stamps each read as soon as poll() returns and
+ * hands it over through a queue.  The main loop hears of new reads
+ * through a pipe in its select() set, and passes them to the driver
+ * as it would its own reads.  The stamps then no longer depend on what
+ * else the main loop is doing, so it can answer the network first.
+ *
+ * The queue is a ring of slots with one writer, the reader thread, and
+ * one reader, the main thread.  Each side owns one index and only reads
+ * the other, so neither ever waits for a lock.  When the ring is full,
+ * the reader thread drops what it reads, as the main loop does when it
+ * runs out of receive buffers.  EOF and read errors are queued like
+ * data, to be reported by the main thread, and end the reader thread.
+ *
+ * This needs <stdatomic.h>; without it refq_start() always fails and
+ * the clock is read by the main loop.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
+# include <stdatomic.h>
+# define REFQ_ATOMIC
+#endif /* HAVE_STDATOMIC_H */
+
+#include "ntp_stdlib.h"
+#include "ntp_refqueue.h"
+#include "timespecops.h"
+
+#ifdef REFQ_ATOMIC
+typedef atomic_uint	refq_index;
+# define LOAD(x, mo)	atomic_load_explicit(&(x), memory_order_##mo)
+# define STORE(x, v, mo) atomic_store_explicit(&(x), (v), memory_order_##mo)
+#else
+typedef unsigned int	refq_index;
+# define LOAD(x, mo)	(x)
+# define STORE(x, v, mo) ((x) = (v))
+#endif
+
+struct refqueue {
+	int		fd;		/* the device */
+	size_t		datalen;	/* bytes per read */
+	int		wake[2];	/* reader thread to main thread */
+	int		stop[2];	/* main thread to reader thread */
+	pthread_t	reader;
+	refq_index	head;		/* next slot to fill, reader's */
+	refq_index	tail;		/* next slot to take, main's */
+	refq_index	dropped;	/* reads dropped with the ring full */
+	unsigned int	dropped_seen;	/* of those, reported */
+	struct refq_slot slot[REFQ_SLOTS];
+};
+
+
+/*
+ * refq_claim - the slot for the next read, or NULL if the ring is full
+ */
+static struct refq_slot *
+refq_claim(
+	struct refqueue *	q
+	)
+{
+	unsigned int	head = LOAD(q->head, relaxed);
+
+	if (head - LOAD(q->tail, acquire) >= REFQ_SLOTS)
+		return NULL;
+	return &q->slot[head & (REFQ_SLOTS - 1)];
+}
+
+
+/*
+ * refq_publish - hand the claimed slot to the main thread and wake it
+ */
+static void
+refq_publish(
+	struct refqueue *	q
+	)
+{
+	STORE(q->head, LOAD(q->head, relaxed) + 1, release);
+	if (write(q->wake[1], "", 1) < 0) {
+		/* the pipe is full, so the main thread will look anyway */
+	}
+}
+
+
+/*
+ * refq_reader - the reader thread: wait for input, stamp it, read it
+ * into the next slot and publish that
+ */
+static void *
+refq_reader(
+	void *	arg
+	)
+{
+	struct refqueue *	q = arg;
+	struct pollfd		pfd[2];
+	struct refq_slot *	sp;
+	uint8_t			trash[REFQ_DATA];
+	struct timespec		ts;
+	l_fp			stamp;
+	ssize_t			len;
+	int			err;
+
+	pfd[0].fd = q->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = q->stop[0];
+	pfd[1].events = POLLIN;
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0 && EINTR != errno)
+			pfd[0].revents = POLLERR;
+		if (pfd[1].revents)
+			return NULL;
+		if (!pfd[0].revents)
+			continue;
+
+		/*
+		 * Not get_systime(): its fuzz and its check that time
+		 * runs forward keep state only the main thread may touch.
+		 */
+		clock_gettime(CLOCK_REALTIME, &ts);
+		stamp = tspec_stamp_to_lfp(ts);
+		sp = refq_claim(q);
+		len = read(q->fd, (sp != NULL) ? sp->data : trash,
+			   q->datalen);
+		err = errno;
+		if (len < 0 && (EAGAIN == err || EINTR == err))
+			continue;
+		if (NULL == sp) {
+			if (len > 0) {
+				STORE(q->dropped,
+				      LOAD(q->dropped, relaxed) + 1, relaxed);
+				continue;
+			}
+			/* the end must get through; wait for room */
+			while (NULL == (sp = refq_claim(q)))
+				if (poll(&pfd[1], 1, 100) > 0)
+					return NULL;
+		}
+		sp->stamp = stamp;
+		sp->len = len;
+		sp->err = (len < 0) ? err : 0;
+		refq_publish(q);
+		if (len <= 0)
+			return NULL;
+	}
+}
+
+
+/*
+ * refq_start - start a reader thread on fd, reading up to datalen bytes
+ * at a time, or all a slot takes if 0.  Returns NULL if it cannot.
+ */
+struct refqueue *
+refq_start(
+	int	fd,
+	size_t	datalen
+	)
+{
+#ifdef REFQ_ATOMIC
+	struct refqueue *	q;
+	sigset_t		block_mask, saved_sig_mask;
+	int			rc;
+
+	q = emalloc_zero(sizeof(*q));
+	q->fd = fd;
+	q->datalen = (0 == datalen || datalen > REFQ_DATA) ? REFQ_DATA
+							   : datalen;
+	if (pipe(q->wake) < 0) {
+		free(q);
+		return NULL;
+	}
+	if (pipe(q->stop) < 0) {
+		close(q->wake[0]);
+		close(q->wake[1]);
+		free(q);
+		return NULL;
+	}
+	(void)fcntl(q->wake[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(q->wake[1], F_SETFL, O_NONBLOCK);
+
+	/* signals are for the main thread */
+	sigfillset(&block_mask);
+	pthread_sigmask(SIG_BLOCK, &block_mask, &saved_sig_mask);
+	rc = pthread_create(&q->reader, NULL, refq_reader, q);
+	pthread_sigmask(SIG_SETMASK, &saved_sig_mask, NULL);
+	if (rc) {
+		errno = rc;
+		close(q->wake[0]);
+		close(q->wake[1]);
+		close(q->stop[0]);
+		close(q->stop[1]);
+		free(q);
+		return NULL;
+	}
+	return q;
+#else
+	UNUSED_ARG(fd);
+	UNUSED_ARG(datalen);
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+
+/*
+ * refq_stop - stop the reader thread and free the queue.  The device
+ * is left open.
+ */
+void
+refq_stop(
+	struct refqueue *	q
+	)
+{
+	if (write(q->stop[1], "", 1) < 0) {
+		/* cannot happen; the pipe is empty */
+	}
+	pthread_join(q->reader, NULL);
+	close(q->wake[0]);
+	close(q->wake[1]);
+	close(q->stop[0]);
+	close(q->stop[1]);
+	free(q);
+}
+
+
+/*
+ * refq_wakefd - the descriptor that is readable when reads are queued
+ */
+int
+refq_wakefd(
+	const struct refqueue *	q
+	)
+{
+	return q->wake[0];
+}
+
+
+/*
+ * refq_clear - quiet the wake descriptor.  Call before taking what is
+ * queued, so that a read queued meanwhile wakes the main loop again.
+ */
+void
+refq_clear(
+	struct refqueue *	q
+	)
+{
+	char	buf[64];
+
+	while (read(q->wake[0], buf, sizeof(buf)) > 0)
+		/* empty */;
+}
+
+
+/*
+ * refq_peek - the oldest queued read, or NULL if there is none
+ */
+struct refq_slot *
+refq_peek(
+	struct refqueue *	q
+	)
+{
+	unsigned int	tail = LOAD(q->tail, relaxed);
+
+	if (tail == LOAD(q->head, acquire))
+		return NULL;
+	return &q->slot[tail & (REFQ_SLOTS - 1)];
+}
+
+
+/*
+ * refq_release - give the slot of the oldest queued read back
+ */
+void
+refq_release(
+	struct refqueue *	q
+	)
+{
+	STORE(q->tail, LOAD(q->tail, relaxed) + 1, release);
+}
+
+
+/*
+ * refq_dropped - the reads dropped since the last call
+ */
+unsigned long
+refq_dropped(
+	struct refqueue *	q
+	)
+{
+	unsigned int	dropped = LOAD(q->dropped, relaxed);
+	unsigned int	news = dropped - q->dropped_seen;
+
+	q->dropped_seen = dropped;
+	return news;
+}
@@ -0,0 +1,299 @@
+/*
+ * ntp_refsample.c - what the samples of a refclock come to at a poll
+ *
+ * Between polls a refclock driver puts each offset it measures into a
+ * ring, and at the poll refclock_sample() makes one offset and jitter
+ * of them, trimming the samples furthest from the median.  It used to
+ * copy the ring and qsort() it for that, with the ring never deeper
+ * than 60 samples.  A clock sampled at 10 Hz fills that in six seconds
+ * and lost the rest of each poll.
+ *
+ * The ring is as deep as the "stages" option asks now, and sorting all
+ * of it at every poll would be wasted: the trimming only needs the
+ * median, and then the distance from it that the samples kept do not
+ * pass.  Each is an nth element, which quickselect finds in linear
+ * time.  This keeps the samples nearest the median of them all, where
+ * the sort trimmed one end at a time about the median of what was
+ * left; the two differ only when the samples are lopsided about it.
+ * The jitter is still the RMS of the gaps between the kept samples in
+ * order, so only those are sorted.
+ *
+ * The ring also keeps the receive time of each sample, so the samples
+ * of a poll tell how the offset moved over it: the least squares slope
+ * of offset against time, and the Allan deviation at the mean sample
+ * interval, from the second differences of the offsets.
+ *
+ * A driver reading one event, such as a PPS edge, on several devices at
+ * once can combine their offsets into one sample here, passing over
+ * the devices that disagree with the rest.
+ */
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ntpd.h"
+#include "ntp_refclock.h"
+
+#define SWAP(a, b)	do { double t_ = (a); (a) = (b); (b) = t_; } while (0)
+#define MADSCALE	1.4826	/* median absolute deviation to sigma */
+#define MADLIMIT	4	/* sigmas from the median a device may be */
+
+/*
+ * refsample_cmp - compare two doubles, for qsort()
+ */
+static int
+refsample_cmp(
+	const void *p1,
+	const void *p2
+	)
+{
+	const double *dp1 = (const double *)p1;
+	const double *dp2 = (const double *)p2;
+
+	if (*dp1 < *dp2) {
+		return COMPARE_LESSTHAN;
+	}
+	if (*dp1 > *dp2) {
+		return COMPARE_GREATERTHAN;
+	}
+	return COMPARE_EQUAL;
+}
+
+/*
+ * refsample_select - rearrange the n values of a so that the kth
+ * smallest is at a[k], none of those before it is greater and none of
+ * those after it smaller, and return it.  Quickselect with a median of
+ * three pivot: linear time, short of inputs built to defeat it.
+ */
+double
+refsample_select(
+	double *a,
+	int	n,
+	int	k
+	)
+{
+	int	lo = 0, hi = n - 1;
+	int	i, j, mid;
+	double	pivot;
+
+	while (lo < hi) {
+		/*
+		 * Order a[lo], a[mid] and a[hi] so they stop the scans
+		 * below at either end.
+		 */
+		mid = lo + (hi - lo) / 2;
+		if (a[mid] < a[lo])
+			SWAP(a[mid], a[lo]);
+		if (a[hi] < a[lo])
+			SWAP(a[hi], a[lo]);
+		if (a[hi] < a[mid])
+			SWAP(a[hi], a[mid]);
+		pivot = a[mid];
+
+		i = lo;
+		j = hi;
+		while (i <= j) {
+			while (a[i] < pivot)
+				i++;
+			while (a[j] > pivot)
+				j--;
+			if (i <= j) {
+				SWAP(a[i], a[j]);
+				i++;
+				j--;
+			}
+		}
+
+		/* a[lo..j] <= pivot, a[i..hi] >= pivot, between == pivot */
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+	return a[k];
+}
+
+/*
+ * refsample_summarize - the summary of the n samples of ring, which has
+ * nstage slots, from the oldest at first.  work holds 2 * n doubles.
+ *
+ * The samples furthest from their median are rejected until about 60
+ * percent remain, and the offset is the mean of those and the jitter
+ * the RMS of the differences between them in ascending order.  With three samples or more, spread over time,
+ * the rate and the Allan deviation are worked out from all of them.
+ *
+ * Returns the number of samples, which could be zero.
+ */
+int
+refsample_summarize(
+	const struct refclocksample *ring,
+	int	nstage,
+	int	first,
+	int	n,
+	double *work,
+	struct refclocksummary *sum
+	)
+{
+	double *off = work;
+	double *dist = work + n;
+	double	median, limit;
+	double	tbar, xbar, sxx, sxy, t, x, x1, x2, span, dd;
+	int	i, m, kept, left;
+
+	ZERO(*sum);
+	sum->count = n;
+	if (n == 0)
+		return 0;
+
+	/*
+	 * The median, and the distance from it the m samples kept are
+	 * within.  Of those just at the limit, as many are kept as make
+	 * up m.
+	 */
+	for (i = 0; i < n; i++)
+		off[i] = ring[(first + i) % nstage].offset;
+	median = refsample_select(off, n, n / 2);
+	m = n - (n * 4) / 10;
+	for (i = 0; i < n; i++)
+		dist[i] = fabs(off[i] - median);
+	limit = refsample_select(dist, n, m - 1);
+
+	left = m;
+	for (i = 0; i < n; i++)
+		if (fabs(off[i] - median) < limit)
+			left--;
+
+	kept = 0;
+	for (i = 0; i < n; i++) {
+		x = off[i];
+		if (fabs(x - median) < limit ||
+		    (fabs(x - median) <= limit && left-- > 0)) {
+			sum->offset += x;
+			dist[kept++] = x;
+		}
+	}
+	sum->kept = kept;
+	sum->offset /= kept;
+	if (kept > 1)
+		qsort(dist, (size_t)kept, sizeof(dist[0]), refsample_cmp);
+	for (i = 1; i < kept; i++)
+		sum->jitter += SQUARE(dist[i] - dist[i - 1]);
+	sum->jitter = SQRT(sum->jitter / kept);
+
+	/*
+	 * The least squares slope of offset against receive time, and
+	 * the Allan deviation from the second differences, taking the
+	 * samples as evenly spaced.
+	 */
+	if (n < 3)
+		return n;
+	span = lfptod(ring[(first + n - 1) % nstage].stamp -
+		      ring[first].stamp);
+	if (span <= 0)
+		return n;
+
+	tbar = xbar = 0;
+	for (i = 0; i < n; i++) {
+		tbar += lfptod(ring[(first + i) % nstage].stamp -
+			       ring[first].stamp);
+		xbar += ring[(first + i) % nstage].offset;
+	}
+	tbar /= n;
+	xbar /= n;
+	sxx = sxy = dd = 0;
+	x1 = x2 = 0;
+	for (i = 0; i < n; i++) {
+		t = lfptod(ring[(first + i) % nstage].stamp -
+			   ring[first].stamp) - tbar;
+		x = ring[(first + i) % nstage].offset;
+		sxx += t * t;
+		sxy += t * (x - xbar);
+		if (i >= 2)
+			dd += SQUARE(x - 2 * x1 + x2);
+		x2 = x1;
+		x1 = x;
+	}
+	sum->tau = span / (n - 1);
+	sum->rate = sxy / sxx;
+	sum->adev = SQRT(dd / (2 * (n - 2) * SQUARE(sum->tau)));
+	return n;
+}
+
+/*
+ * median - the median of the n values of a, which are rearranged.  Of
+ * an even number, the mean of the middle two.
+ */
+static double
+median(
+	double *a,
+	int	n
+	)
+{
+	double	hi, lo;
+	int	i;
+
+	hi = refsample_select(a, n, n / 2);
+	if (n % 2)
+		return hi;
+	lo = a[0];
+	for (i = 1; i < n / 2; i++)
+		if (a[i] > lo)
+			lo = a[i];
+	return (lo + hi) / 2;
+}
+
+/*
+ * refsample_combine - the offset of an event seen by the n devices
+ * whose offsets are x.  work holds n doubles.
+ *
+ * Offsets further from the median than gate are rejected, or with
+ * three devices or more, than MADLIMIT times their median absolute
+ * deviation as a sigma, should that be further.  Two devices that
+ * disagree cannot say which of them is wrong, and neither is used.
+ * used[i] tells whether x[i] was, and offset gets the mean of those
+ * that were.
+ *
+ * Returns the number of offsets used, which could be zero.
+ */
+int
+refsample_combine(
+	const double *x,
+	int	n,
+	double	gate,
+	double *work,
+	bool	*used,
+	double	*offset
+	)
+{
+	double	mid, limit;
+	int	i, kept;
+
+	*offset = 0;
+	if (n == 0)
+		return 0;
+
+	memcpy(work, x, sizeof(*work) * (size_t)n);
+	mid = median(work, n);
+	limit = gate;
+	if (n >= 3) {
+		for (i = 0; i < n; i++)
+			work[i] = fabs(x[i] - mid);
+		limit = max(limit, MADLIMIT * MADSCALE * median(work, n));
+	}
+
+	kept = 0;
+	for (i = 0; i < n; i++) {
+		used[i] = fabs(x[i] - mid) <= limit;
+		if (used[i]) {
+			*offset += x[i];
+			kept++;
+		}
+	}
+	if (kept)
+		*offset /= kept;
+	return kept;
+}
@@ -0,0 +1,579 @@
+/*
+ * ntp_replay.c - replay recorded statistics through the ntpd clock
+ * filter, selection and discipline code
+ *
+ * The samples in one or more peerstats or rawstats files are fed to
+ * clock_filter() of a client association per source, in time order,
+ * and from there through clock_select(), clock_combine() and
+ * local_clock() exactly as ntpd would.  The loop filter adjusts a
+ * simulated clock instead of the system clock, and simulated time
+ * runs as fast as the code does, so a day of statistics replays in
+ * well under a second.
+ *
+ * The simulated clock starts with the phase error given by -o and
+ * gains the frequency error given by -f.  The recording host is
+ * taken to have had a perfect clock, so that the recorded offsets are
+ * pure measurement noise; the offset a sample shows the simulated
+ * clock is the recorded one less the simulated phase error.  Delays,
+ * dispersions, and for rawstats the leap, stratum, precision and root
+ * distance of the server, are used as recorded.  The kernel
+ * discipline is not simulated.
+ *
+ * Since nothing is transmitted, sources never become unreachable; a
+ * source that falls silent ages out through its root distance.
+ * Statistics files with binary records are not read.
+ *
+ * Usage: ntpreplay [-lv] [-f ppm] [-o offset] [-m minpoll] [-M maxpoll]
+ *                  [-s settle] [-T name=value] file...
+ *
+ * -T sets the loop parameters the tinker command of ntp.conf does,
+ * for example -T step=0 -T stepout=300.  With -l a line is printed
+ * for every clock update:
+ *
+ *	simulated time (s), phase error (s), frequency (PPM), poll (log2 s)
+ *
+ * At the end follows a summary with the CPU time the replay took per
+ * sample, and the RMS and maximum phase error over each simulated
+ * second after the first settle seconds.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ntpd.h"
+#include "ntp_calendar.h"
+#include "ntp_stdlib.h"
+#include "ntp_syscall.h"
+#include "timespecops.h"
+
+#define MAXFIELDS	24	/* fields in a statistics line */
+
+const char *progname = "ntpreplay";
+bool	listen_to_virtual_ips = true;	/* needed by ntp_io.c */
+int	waitsync_fd_to_close = -1;	/* needed by ntp_proto.c */
+
+/*
+ * One sample of one source, as recorded
+ */
+struct sample {
+	double	time;		/* seconds since the epoch of MJD 0 */
+	int	source;		/* index into sources[] */
+	double	offset;		/* clock offset (s) */
+	double	delay;		/* roundtrip delay (s) */
+	double	rootdelay;	/* root delay of the source (s) */
+	double	rootdisp;	/* root dispersion of the source (s) */
+	uint8_t	leap;		/* leap indicator */
+	uint8_t	stratum;	/* stratum */
+	int8_t	precision;	/* source precision (log2 s) */
+};
+
+static struct sample *samples;
+static size_t	nsamples, samples_size;
+
+static struct source {
+	char	label[64];	/* as in the statistics file */
+	struct peer *peer;	/* the association replaying it */
+} *sources;
+static int	nsources;
+
+/*
+ * The simulated clock, and what became of it
+ */
+static struct {
+	double	phase;		/* phase error (s) */
+	double	freq;		/* intrinsic frequency error (s/s) */
+	double	settle;		/* no statistics before (s) */
+	double	sumsq;		/* sum of squared phase errors */
+	double	maxabs;		/* largest phase error (s) */
+	unsigned long	seconds; /* seconds in the statistics */
+	unsigned long	steps;	/* clock steps */
+	unsigned long	updates; /* clock updates */
+} sim;
+
+static uint8_t	minpoll = NTP_MINDPOLL;
+static uint8_t	maxpoll = NTP_MAXDPOLL;
+static bool	trace;
+
+
+const char *
+ntpd_version(void)
+{
+	static char versionbuf[64];
+
+	snprintf(versionbuf, sizeof(versionbuf),
+		 "ntpreplay ntpsec-%s", NTPSEC_VERSION_EXTENDED);
+	return versionbuf;
+}
+
+
+void
+announce_starting(void)
+{
+	msyslog(LOG_NOTICE, "INIT: %s: Starting", ntpd_version());
+}
+
+
+/*
+ * sim_step, sim_slew, sim_adjtime - clock hooks of the simulated clock.
+ * A slew completes within the second, as adj_host_clock() only asks
+ * for what can be slewed in one.
+ */
+static bool
+sim_step(
+	double	offset
+	)
+{
+	sim.phase += offset;
+	sim.steps++;
+	return true;
+}
+
+
+static bool
+sim_slew(
+	double	offset
+	)
+{
+	sim.phase += offset;
+	return true;
+}
+
+
+static int
+sim_adjtime(
+	struct timex *ntv
+	)
+{
+	UNUSED_ARG(ntv);
+	return TIME_OK;
+}
+
+
+/*
+ * tinker - set a loop parameter by its name in the tinker command
+ */
+static bool
+tinker(
+	const char *arg
+	)
+{
+	static const struct {
+		const char *name;
+		int	item;
+	} items[] = {
+		{ "allan",	LOOP_ALLAN },
+		{ "dispersion",	LOOP_PHI },
+		{ "freq",	LOOP_FREQ },
+		{ "huffpuff",	LOOP_HUFFPUFF },
+		{ "panic",	LOOP_PANIC },
+		{ "step",	LOOP_MAX },
+		{ "stepback",	LOOP_MAX_BACK },
+		{ "stepfwd",	LOOP_MAX_FWD },
+		{ "stepout",	LOOP_MINSTEP },
+	};
+	const char *eq = strchr(arg, '=');
+	char	*end;
+	double	value;
+	size_t	i;
+
+	if (eq == NULL)
+		return false;
+	value = strtod(eq + 1, &end);
+	if (end == eq + 1 || *end != '\0')
+		return false;
+	for (i = 0; i < COUNTOF(items); i++) {
+		if (strlen(items[i].name) == (size_t)(eq - arg) &&
+		    strncmp(items[i].name, arg, (size_t)(eq - arg)) == 0) {
+			loop_config(items[i].item, value);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+ * source_index - find or make the association for a source label
+ */
+static int
+source_index(
+	const char *label
+	)
+{
+	int	i;
+
+	for (i = 0; i < nsources; i++)
+		if (strcmp(sources[i].label, label) == 0)
+			return i;
+
+	sources = erealloc(sources, (size_t)(nsources + 1) * sizeof(*sources));
+	strlcpy(sources[nsources].label, label, sizeof(sources[0].label));
+	sources[nsources].peer = NULL;
+	return nsources++;
+}
+
+
+/*
+ * stamp_diff - the difference a - b of two l_fp timestamps as printed
+ * in rawstats, without going through a double of the full timestamps
+ */
+static bool
+stamp_diff(
+	const char *a,
+	const char *b,
+	double	*diff
+	)
+{
+	long long asec, bsec;
+	double	afrac = 0, bfrac = 0;
+	char	*end;
+
+	errno = 0;
+	asec = strtoll(a, &end, 10);
+	if (*end == '.')
+		afrac = strtod(end, &end);
+	if (*end != '\0' || errno != 0)
+		return false;
+	bsec = strtoll(b, &end, 10);
+	if (*end == '.')
+		bfrac = strtod(end, &end);
+	if (*end != '\0' || errno != 0)
+		return false;
+	*diff = (double)(asec - bsec) + (afrac - bfrac);
+	return true;
+}
+
+
+/*
+ * parse_line - make a sample of a peerstats or rawstats line, which
+ * are told apart by their number of fields
+ */
+static bool
+parse_line(
+	char	*line,
+	struct sample *s
+	)
+{
+	char	*field[MAXFIELDS];
+	char	*cp, *end;
+	int	n = 0;
+	double	t21, t34;
+
+	for (cp = strtok(line, " \t\r\n"); cp != NULL && n < MAXFIELDS;
+	     cp = strtok(NULL, " \t\r\n"))
+		field[n++] = cp;
+	if (n < 2)
+		return false;
+	s->time = strtol(field[0], &end, 10) * (double)SECSPERDAY;
+	if (*end != '\0')
+		return false;
+	s->time += strtod(field[1], &end);
+	if (*end != '\0')
+		return false;
+
+	switch (n) {
+	case 8:		/* peerstats */
+		s->offset = strtod(field[4], NULL);
+		s->delay = strtod(field[5], NULL);
+		s->rootdelay = s->rootdisp = 0;
+		s->leap = LEAP_NOWARNING;
+		s->stratum = 1;
+		s->precision = sys_vars.sys_precision;
+		break;
+
+	case 18:	/* rawstats, t1 to t4 in fields 4 to 7 */
+		if (!stamp_diff(field[5], field[4], &t21) ||
+		    !stamp_diff(field[6], field[7], &t34))
+			return false;
+		s->offset = (t21 + t34) / 2;
+		s->delay = fabs(t21 - t34);
+		s->leap = (uint8_t)atoi(field[8]);
+		s->stratum = (uint8_t)atoi(field[11]);
+		s->precision = (int8_t)atoi(field[13]);
+		/* root delay and dispersion are the raw 16.16 packet fields */
+		s->rootdelay = scalbn(strtod(field[14], NULL), -16);
+		s->rootdisp = scalbn(strtod(field[15], NULL), -16);
+		break;
+
+	default:
+		return false;
+	}
+	s->source = source_index(field[2]);
+	return true;
+}
+
+
+static bool
+read_file(
+	const char *path
+	)
+{
+	FILE	*fp;
+	char	line[512];
+	unsigned long	lineno = 0, bad = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "%s: %s: %s\n", progname, path,
+			strerror(errno));
+		return false;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (nsamples == samples_size) {
+			samples_size = samples_size ? 2 * samples_size : 4096;
+			samples = erealloc(samples,
+					   samples_size * sizeof(*samples));
+		}
+		if (parse_line(line, &samples[nsamples]))
+			nsamples++;
+		else if (bad++ == 0)
+			fprintf(stderr, "%s: %s:%lu: not a peerstats or "
+				"rawstats line\n", progname, path, lineno);
+	}
+	fclose(fp);
+	if (bad > 1)
+		fprintf(stderr, "%s: %s: %lu lines skipped\n", progname,
+			path, bad);
+	return true;
+}
+
+
+static int
+sample_cmp(
+	const void *a,
+	const void *b
+	)
+{
+	const struct sample *sa = a, *sb = b;
+
+	if (sa->time < sb->time)
+		return -1;
+	if (sa->time > sb->time)
+		return 1;
+	return sa->source - sb->source;
+}
+
+
+/*
+ * new_association - set up a client association for a source.  Labels
+ * that are not addresses, like refclock names, get one of TEST-NET-1.
+ */
+static struct peer *
+new_association(
+	int	i
+	)
+{
+	struct peer_ctl ctl;
+	sockaddr_u addr;
+
+	if (decodenetnum(sources[i].label, &addr) != 0) {
+		ZERO(addr);
+		AF(&addr) = AF_INET;
+		SET_ADDR4N(&addr, htonl(0xc0000200 | (uint32_t)(i + 1)));
+	}
+	ZERO(ctl);
+	ctl.version = NTP_VERSION;
+	ctl.minpoll = minpoll;
+	ctl.maxpoll = maxpoll;
+	return newpeer(&addr, NULL, NULL, MODE_CLIENT, &ctl, MDF_UCAST,
+		       true);
+}
+
+
+/*
+ * advance - run simulated time up to a point, as timer() would
+ */
+static void
+advance(
+	uptime_t until
+	)
+{
+	while (current_time < until) {
+		current_time++;
+		sim.phase += sim.freq;
+		adj_host_clock();
+		if (current_time % HUFFPUFF == 0)
+			huffpuff();
+		if (current_time >= sim.settle) {
+			sim.seconds++;
+			sim.sumsq += SQUARE(sim.phase);
+			if (fabs(sim.phase) > sim.maxabs)
+				sim.maxabs = fabs(sim.phase);
+		}
+	}
+}
+
+
+/*
+ * replay - pass a sample to the clock filter, after the checks that
+ * receive() makes of a server packet with the default tos settings
+ */
+static void
+replay(
+	const struct sample *s
+	)
+{
+	struct peer *peer = sources[s->source].peer;
+	double	epsilon;
+
+	if (s->leap == LEAP_NOTINSYNC || s->stratum >= STRATUM_UNSPEC - 1 ||
+	    s->delay > MAXDISTANCE)
+		return;
+
+	peer->leap = s->leap;
+	peer->stratum = s->stratum;
+	peer->precision = s->precision;
+	peer->rootdelay = s->rootdelay;
+	peer->rootdisp = s->rootdisp;
+	peer->reach = (uint8_t)(peer->reach << 1) | 1;
+	epsilon = LOGTOD(sys_vars.sys_precision) + LOGTOD(peer->precision) +
+	    loop_data.clock_phi * s->delay;
+	clock_filter(peer, s->offset - sim.phase, s->delay, epsilon);
+}
+
+
+static void
+usage(void)
+{
+	fputs(
+"usage: ntpreplay [-lv] [-f ppm] [-o offset] [-m minpoll] [-M maxpoll]\n"
+"                 [-s settle] [-T name=value] file...\n"
+"        -f ppm         Frequency error of the simulated clock\n"
+"        -l             Print a line for every clock update\n"
+"        -m minpoll     Minimum poll of the associations (log2 s)\n"
+"        -M maxpoll     Maximum poll of the associations (log2 s)\n"
+"        -o offset      Initial phase error of the simulated clock (s)\n"
+"        -s settle      Leave the first seconds out of the statistics\n"
+"        -T name=value  Set a loop parameter as tinker does\n"
+"        -v             Log events, as ntpd would\n"
+	, stderr);
+	exit(1);
+}
+
+
+int
+main(
+	int	argc,
+	char	*argv[]
+	)
+{
+	struct timespec start, stop;
+	struct peer *last_peer = NULL;
+	uptime_t last_epoch = 0;
+	double	t0, cpu;
+	size_t	i;
+	int	ch;
+
+	syslogit = false;
+	termlogit = false;
+	clock_hooks.step = sim_step;
+	clock_hooks.adjust = sim_slew;
+	clock_hooks.adjtime = sim_adjtime;
+
+	init_util();
+	init_restrict();
+	init_mon();
+	init_control();
+	init_peer();
+	init_proto(false);
+	init_loopfilter();
+	init_timer();
+	sys_vars.sys_precision = -20;	/* the same on every host */
+	clock_ctl.allow_panic = true;
+	clock_ctl.kern_enable = false;
+
+	while ((ch = getopt(argc, argv, "f:lm:M:o:s:T:v")) != -1) {
+		switch (ch) {
+		case 'f':
+			sim.freq = atof(optarg) / US_PER_S;
+			break;
+		case 'l':
+			trace = true;
+			break;
+		case 'm':
+			minpoll = (uint8_t)atoi(optarg);
+			break;
+		case 'M':
+			maxpoll = (uint8_t)atoi(optarg);
+			break;
+		case 'o':
+			sim.phase = atof(optarg);
+			break;
+		case 's':
+			sim.settle = atof(optarg);
+			break;
+		case 'T':
+			if (!tinker(optarg)) {
+				fprintf(stderr, "%s: bad tinker %s\n",
+					progname, optarg);
+				exit(1);
+			}
+			break;
+		case 'v':
+			termlogit = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc)
+		usage();
+
+	for (; optind < argc; optind++)
+		if (!read_file(argv[optind]))
+			exit(1);
+	if (nsamples == 0) {
+		fprintf(stderr, "%s: no samples\n", progname);
+		exit(1);
+	}
+	qsort(samples, nsamples, sizeof(*samples), sample_cmp);
+	for (ch = 0; ch < nsources; ch++)
+		if ((sources[ch].peer = new_association(ch)) == NULL) {
+			fprintf(stderr, "%s: %s: duplicate source\n",
+				progname, sources[ch].label);
+			exit(1);
+		}
+	loop_config(LOOP_DRIFTINIT, 0);
+
+	t0 = samples[0].time - 1;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	for (i = 0; i < nsamples; i++) {
+		advance((uptime_t)(samples[i].time - t0));
+		replay(&samples[i]);
+		if (sys_vars.sys_peer != NULL &&
+		    (sys_vars.sys_peer != last_peer ||
+		     sys_vars.sys_peer->epoch != last_epoch)) {
+			last_peer = sys_vars.sys_peer;
+			last_epoch = last_peer->epoch;
+			sim.updates++;
+			if (trace)
+				printf("%u %.9f %.3f %d\n", current_time,
+				       sim.phase, loop_data.drift_comp *
+				       US_PER_S, clkstate.sys_poll);
+		}
+	}
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stop);
+	cpu = (double)(stop.tv_sec - start.tv_sec) +
+	    (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("# samples %lu sources %d span %u s\n",
+	       (unsigned long)nsamples, nsources, current_time);
+	printf("# updates %lu steps %lu\n", sim.updates, sim.steps);
+	printf("# cpu %.6f s, %.3f us/sample\n", cpu,
+	       cpu * US_PER_S / (double)nsamples);
+	if (sim.seconds > 0)
+		printf("# phase rms %.3e s max %.3e s\n",
+		       sqrt(sim.sumsq / (double)sim.seconds), sim.maxabs);
+	printf("# frequency %.3f PPM, error %.3f PPM\n",
+	       loop_data.drift_comp * US_PER_S,
+	       (loop_data.drift_comp + sim.freq) * US_PER_S);
+	return 0;
+}
@@ -606,7 +606,7 @@ hack_restrict(
 		INSIST(0);
 		break;
 	}
-
+	rstrct.generation++;
 }
 
 
@@ -391,6 +391,10 @@ int scmp_sc[] = {
 #else
 	SCMP_SYS(getitimer),
 	SCMP_SYS(setitimer),
+#endif
+#ifdef HAVE_TIMERFD_CREATE
+	SCMP_SYS(timerfd_create),
+	SCMP_SYS(timerfd_settime),
 #endif
 	SCMP_SYS(write),
 	SCMP_SYS(writev),	/* Needed on Alpine 3.11.3 */
@@ -413,6 +417,8 @@ int scmp_sc[] = {
 
 #ifdef REFCLOCK
 	SCMP_SYS(nanosleep),
+	SCMP_SYS(pipe),		/* refclock reader threads */
+	SCMP_SYS(pipe2),
 #endif
 #ifdef CLOCK_SHM
         SCMP_SYS(shmget),
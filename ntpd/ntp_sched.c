@@ -0,0 +1,101 @@
+/*
+ * ntp_sched.c - deadlines for the event timer
+ *
+ * The event timer in ntp_timer.c wakes the main loop for whichever of
+ * these deadlines comes first.  One of them is the one-second tick
+ * that the clock discipline and the poll process run from; the others
+ * are things that should not wait for it, such as an association that
+ * became due between ticks or the refclock timers, which want to run
+ * just after the second rather than at whatever phase ntpd happened to
+ * start.
+ *
+ * Deadlines are on CLOCK_MONOTONIC, so a step of the system clock does
+ * not move them.  There are only ever a few, so they are kept in a
+ * list sorted by deadline.
+ */
+#include "config.h"
+
+#include "ntpd.h"
+#include "timespecops.h"
+
+static struct sched_event *sched_list;	/* pending, soonest first */
+
+
+/*
+ * sched_cancel - take an event off the list, if it is on it
+ */
+void
+sched_cancel(
+	struct sched_event *	ev
+	)
+{
+	struct sched_event **	pp;
+
+	if (!ev->pending)
+		return;
+	for (pp = &sched_list; *pp != ev; pp = &(*pp)->next)
+		/* do nothing */;
+	*pp = ev->next;
+	ev->next = NULL;
+	ev->pending = false;
+}
+
+
+/*
+ * sched_at - (re)schedule an event for a deadline.  Events with the
+ * same deadline run in the order they were scheduled.
+ */
+void
+sched_at(
+	struct sched_event *	ev,
+	struct timespec		due
+	)
+{
+	struct sched_event **	pp;
+
+	sched_cancel(ev);
+	ev->due = due;
+	for (pp = &sched_list; *pp != NULL; pp = &(*pp)->next)
+		if (cmp_tspec((*pp)->due, due) > 0)
+			break;
+	ev->next = *pp;
+	*pp = ev;
+	ev->pending = true;
+}
+
+
+/*
+ * sched_next - get the soonest deadline.  Returns false if there is
+ * nothing scheduled.
+ */
+bool
+sched_next(
+	struct timespec *	due
+	)
+{
+	if (sched_list == NULL)
+		return false;
+	*due = sched_list->due;
+	return true;
+}
+
+
+/*
+ * sched_due - return the next event due at now, or NULL when there
+ * are no more.  The event is off the list until it is scheduled again.
+ */
+struct sched_event *
+sched_due(
+	struct timespec	now
+	)
+{
+	struct sched_event *	ev;
+
+	ev = sched_list;
+	if (ev == NULL || cmp_tspec(ev->due, now) > 0)
+		return NULL;
+	sched_list = ev->next;
+	ev->next = NULL;
+	ev->pending = false;
+	return ev;
+}
@@ -0,0 +1,279 @@
+/*
+ * ntp_select.c - intersection and clustering for clock_select()
+ *
+ * clock_select() runs after every clock_filter() update, so with
+ * hundreds of associations the cost of these two steps dominates.
+ *
+ * The interval endpoints are kept sorted between calls.  Between
+ * two selections over the same candidates only the offset of the
+ * peer that got a new sample moved, and the root distances of the
+ * rest grew by about the same amount, so the previous order is very
+ * nearly right and an insertion sort restores it in close to linear
+ * time.  When the candidates change the endpoints are rebuilt and
+ * sorted from scratch.
+ *
+ * The cluster algorithm computes the selection jitter of every
+ * survivor in each round.  Done pairwise that is quadratic per round;
+ * here it is linear, from a running mean and spread of the offsets.
+ */
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "ntpd.h"
+#include "ntp_stdlib.h"
+
+static struct endpoint *sel_endpoint;	/* sorted interval endpoints */
+static struct peer **	sel_cand;	/* candidates at the last call */
+static int		sel_ncand;	/* number of them */
+static int		sel_size;	/* candidates there is room for */
+
+
+/*
+ * endpoint_before - sort order of the endpoints, by offset and lower
+ * ends before upper ends at the same offset
+ */
+static inline bool
+endpoint_before(
+	const struct endpoint *a,
+	const struct endpoint *b
+	)
+{
+	if (a->val < b->val)
+		return true;
+	if (a->val > b->val)
+		return false;
+	return a->type < b->type;
+}
+
+
+static int
+endpoint_cmp(
+	const void *a,
+	const void *b
+	)
+{
+	if (endpoint_before(a, b))
+		return -1;
+	if (endpoint_before(b, a))
+		return 1;
+	return 0;
+}
+
+
+/*
+ * select_sort - bring the endpoints of the candidates up to date and
+ * sort them.
+ */
+static void
+select_sort(
+	const peer_select *peers,
+	int	nlist
+	)
+{
+	struct endpoint endp;
+	bool	same;
+	int	i, j;
+
+	if (nlist > sel_size) {
+		sel_size = nlist + nlist / 2;
+		sel_endpoint = erealloc(sel_endpoint, (size_t)sel_size * 2 *
+					sizeof(*sel_endpoint));
+		sel_cand = erealloc(sel_cand, (size_t)sel_size *
+				    sizeof(*sel_cand));
+		sel_ncand = 0;
+	}
+	same = (nlist == sel_ncand);
+	for (i = 0; i < nlist; i++) {
+		if (sel_cand[i] != peers[i].peer) {
+			same = false;
+			sel_cand[i] = peers[i].peer;
+		}
+	}
+	sel_ncand = nlist;
+
+	if (!same) {
+		for (i = 0; i < nlist; i++) {
+			sel_endpoint[2 * i].type = -1;	/* lower end */
+			sel_endpoint[2 * i].cand = i;
+			sel_endpoint[2 * i + 1].type = 1;	/* upper end */
+			sel_endpoint[2 * i + 1].cand = i;
+		}
+	}
+	for (i = 0; i < 2 * nlist; i++) {
+		const peer_select *p = &peers[sel_endpoint[i].cand];
+
+		sel_endpoint[i].val = p->peer->offset +
+		    sel_endpoint[i].type * p->synch;
+	}
+	if (!same) {
+		qsort(sel_endpoint, (size_t)nlist * 2, sizeof(*sel_endpoint),
+		      endpoint_cmp);
+		return;
+	}
+
+	for (i = 1; i < 2 * nlist; i++) {
+		endp = sel_endpoint[i];
+		for (j = i; j > 0 &&
+			    endpoint_before(&endp, &sel_endpoint[j - 1]); j--)
+			sel_endpoint[j] = sel_endpoint[j - 1];
+		sel_endpoint[j] = endp;
+	}
+}
+
+
+/*
+ * select_intersect - find the intersection interval (low, high) of the
+ * candidates.  If none is found, high is not greater than low.
+ *
+ * This is the actual algorithm that cleaves the truechimers
+ * from the falsetickers. The original algorithm was described
+ * in Keith Marzullo's dissertation, but has been modified for
+ * better accuracy.
+ *
+ * Briefly put, we first assume there are no falsetickers, then
+ * scan the candidate list first from the low end upwards and
+ * then from the high end downwards. The scans stop when the
+ * number of intersections equals the number of candidates less
+ * the number of falsetickers. If this doesn't happen for a
+ * given number of falsetickers, we bump the number of
+ * falsetickers and try again. If the number of falsetickers
+ * becomes equal to or greater than half the number of
+ * candidates, the Albanians have won the Byzantine wars and
+ * correct synchronization is not possible.
+ *
+ * Here, nlist is the number of candidates and allow is the
+ * number of falsetickers. Upon exit, the truechimers are the
+ * survivors with offsets not less than low and not greater than
+ * high. There may be none of them.
+ */
+void
+select_intersect(
+	const peer_select *peers,
+	int	nlist,
+	double *lowp,
+	double *highp
+	)
+{
+	double	high, low;
+	int	allow;
+	int	i, j, n;
+	int	nl2 = 2 * nlist;
+
+	select_sort(peers, nlist);
+	for (i = 0; i < nl2; i++)
+		DPRINT(3, ("select: endpoint %2d %.6f\n",
+			   sel_endpoint[i].type, sel_endpoint[i].val));
+
+	low = 1e9;
+	high = -1e9;
+	for (allow = 0; 2 * allow < nlist; allow++) {
+
+		/*
+		 * Bound the interval (low, high) as the smallest
+		 * interval containing points from the most sources.
+		 */
+		n = 0;
+		for (i = 0; i < nl2; i++) {
+			low = sel_endpoint[i].val;
+			n -= sel_endpoint[i].type;
+			if (n >= nlist - allow)
+				break;
+		}
+		n = 0;
+		for (j = nl2 - 1; j >= 0; j--) {
+			high = sel_endpoint[j].val;
+			n += sel_endpoint[j].type;
+			if (n >= nlist - allow)
+				break;
+		}
+
+		/*
+		 * If an interval containing truechimers is found, stop.
+		 * If not, increase the number of falsetickers and go
+		 * around again.
+		 */
+		if (high > low)
+			break;
+	}
+	*lowp = low;
+	*highp = high;
+}
+
+
+/*
+ * select_cluster - vote outliers off the island by select jitter
+ * weighted by root distance. Continue voting as long as there are more
+ * than minclock survivors and the select jitter of the peer with the
+ * worst metric is greater than the minimum peer jitter. Stop if we are
+ * about to discard a TRUE or PREFER peer, who of course have the
+ * immunity idol.  Returns the number of survivors, left at the front
+ * of peers[] with their seljit set.
+ */
+int
+select_cluster(
+	peer_select *peers,
+	int	nlist,
+	int	minclock,
+	int	maxclock
+	)
+{
+	double	d, e, g;
+	double	mean, newmean, spread, x;
+	int	i, k;
+
+	if (nlist <= 0)
+		return 0;
+
+	/*
+	 * The sum of the squared differences between one offset and
+	 * all of them is their spread about the mean plus nlist times
+	 * its own squared distance from the mean.  Both are updated as
+	 * peers are voted off, so each round is a single pass.
+	 */
+	mean = 0;
+	for (i = 0; i < nlist; i++)
+		mean += peers[i].peer->offset;
+	mean /= nlist;
+	spread = 0;
+	for (i = 0; i < nlist; i++)
+		spread += SQUARE(peers[i].peer->offset - mean);
+
+	while (1) {
+		d = 1e9; // Minimum peer jitter
+		e = -1e9; // Worst peer select jitter * synch
+		g = 0; // Worst peer select jitter
+		k = 0; // Index of the worst peer
+		for (i = 0; i < nlist; i++) {
+			if (peers[i].error < d)
+				d = peers[i].error;
+			peers[i].seljit = 0;
+			if (nlist > 1)
+				peers[i].seljit = SQRT((spread + nlist *
+				    SQUARE(peers[i].peer->offset - mean)) /
+				    (nlist - 1));
+			if (peers[i].seljit * peers[i].synch > e) {
+				g = peers[i].seljit;
+				e = peers[i].seljit * peers[i].synch;
+				k = i;
+			}
+		}
+		if (nlist <= max(1, minclock) || g <= d ||
+		    ((FLAG_TRUE | FLAG_PREFER) & peers[k].peer->cfg.flags))
+			break;
+
+		DPRINT(3, ("select: drop %s seljit %.6f jit %.6f\n",
+			   socktoa(&peers[k].peer->srcadr), g, d));
+		if (nlist > maxclock)
+			peers[k].peer->new_status = CTL_PST_SEL_EXCESS;
+		x = peers[k].peer->offset;
+		for (i = k + 1; i < nlist; i++)
+			peers[i - 1] = peers[i];
+		nlist--;
+		newmean = mean + (mean - x) / nlist;
+		spread = max(0, spread - (x - mean) * (x - newmean));
+		mean = newmean;
+	}
+	return nlist;
+}
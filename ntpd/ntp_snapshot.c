@@ -0,0 +1,162 @@
+/*
+ * ntp_snapshot.c - the published copy of the system variables
+ *
+ * Server replies and mode 6 readouts report the system variables:
+ * leap, stratum, precision, root delay and dispersion, refid and
+ * reftime.  These are changed field by field, in clock_update(), in
+ * clock_select() and in the orphan and leap handling of timer(), so a
+ * reader on any thread but the main one could see some fields of one
+ * update and some of the next.
+ *
+ * Instead, the main thread publishes a complete copy after each round
+ * of changes, and the reply paths read that.  The copy is kept twice,
+ * as a sequence latch: the writer bumps the sequence to steer readers
+ * to one copy while it rewrites the other, then does the same again
+ * the other way round.  A reader copies out whichever one the sequence
+ * points at, and tries again only if the sequence moved meanwhile.  It
+ * never waits for the writer, and the writer never waits for readers.
+ *
+ * Without <stdatomic.h> it is a plain copy; the readers are then all
+ * on the main thread anyway.
+ *
+ * Each copy also carries the header of a server reply in wire format,
+ * built once at publication rather than for every request.  A reply
+ * needs only its version, poll and timestamps patched in.
+ */
+#include "config.h"
+
+#include <string.h>
+
+#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
+# include <stdatomic.h>
+# define SNAPSHOT_ATOMIC
+#endif /* HAVE_STDATOMIC_H */
+
+#include "ntpd.h"
+
+static struct sys_snapshot snapshot[2];
+#ifdef SNAPSHOT_ATOMIC
+static atomic_uint	snapshot_seq;
+#else
+static unsigned int	snapshot_seq;
+#endif
+
+
+/*
+ * snapshot_reply - build the reply header of a snapshot.  Version and
+ * the origin, receive and transmit timestamps are left zero.  When
+ * smearing, the refid shows the smear offset and the reftime is
+ * smeared, as the timestamps of the reply will be.
+ */
+static void
+snapshot_reply(
+	struct sys_snapshot *	snap
+	)
+{
+	struct pkt	xpkt;
+	l_fp		reftime = snap->reftime;
+
+	memset(&xpkt, 0, LEN_PKT_NOMAC);
+	xpkt.li_vn_mode = PKT_LI_VN_MODE(snap->leap, 0, MODE_SERVER);
+	xpkt.stratum = STRATUM_TO_PKT(snap->stratum);
+	xpkt.precision = snap->precision;
+	xpkt.rootdelay = HTONS_FP(DTOUFP(snap->rootdelay));
+	xpkt.rootdisp = HTONS_FP(DTOUFP(snap->rootdisp));
+	xpkt.refid = snap->refid;
+	if (snap->smearing) {
+		reftime += snap->smear_offset;
+		xpkt.refid = convertLFPToRefID(snap->smear_offset);
+	}
+	xpkt.reftime = htonl_fp(reftime);
+	memcpy(snap->reply, &xpkt, LEN_PKT_NOMAC);
+}
+
+
+/*
+ * sys_snapshot_publish - make a new copy of the system variables the
+ * one readers see.  Only the main thread may call this.
+ */
+void
+sys_snapshot_publish(
+	const struct sys_snapshot *	snap
+	)
+{
+	struct sys_snapshot	next = *snap;
+#ifdef SNAPSHOT_ATOMIC
+	unsigned int	seq;
+#endif
+
+	snapshot_reply(&next);
+#ifdef SNAPSHOT_ATOMIC
+	seq = atomic_load_explicit(&snapshot_seq, memory_order_relaxed);
+
+	/* readers to copy 1 while copy 0 is rewritten */
+	atomic_store_explicit(&snapshot_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&snapshot[0], &next, sizeof(snapshot[0]));
+
+	/* and back to copy 0, now the new one, for copy 1 */
+	atomic_store_explicit(&snapshot_seq, seq + 2, memory_order_release);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&snapshot[1], &next, sizeof(snapshot[1]));
+#else
+	snapshot[0] = next;
+	snapshot_seq += 2;
+#endif
+}
+
+
+/*
+ * sys_snapshot_read - copy out the last published system variables.
+ * Safe from any thread.  Returns the sequence of the copy; it is even
+ * and moves on by two with each publication.
+ */
+unsigned int
+sys_snapshot_read(
+	struct sys_snapshot *	snap
+	)
+{
+#ifdef SNAPSHOT_ATOMIC
+	unsigned int	seq;
+
+	do {
+		seq = atomic_load_explicit(&snapshot_seq,
+					   memory_order_acquire);
+		memcpy(snap, &snapshot[seq & 1], sizeof(*snap));
+		atomic_thread_fence(memory_order_acquire);
+	} while (atomic_load_explicit(&snapshot_seq, memory_order_relaxed)
+		 != seq);
+	return seq & ~1U;
+#else
+	*snap = snapshot[0];
+	return snapshot_seq;
+#endif
+}
+
+
+/*
+ * sys_reply_header - fill in the header of a server reply from a
+ * snapshot: the prebuilt header, with the request's version, the poll,
+ * the request's transmit time as origin and the receive time, smeared
+ * if need be.  The transmit timestamp is the caller's, to be taken as
+ * late as possible.
+ */
+void
+sys_reply_header(
+	struct pkt *			xpkt,
+	const struct sys_snapshot *	snap,
+	uint8_t				version,
+	uint8_t				ppoll,
+	uint64_t			org,
+	l_fp				rec
+	)
+{
+	memcpy(xpkt, snap->reply, LEN_PKT_NOMAC);
+	xpkt->li_vn_mode |= VN_MODE(version, 0);
+	xpkt->ppoll = ppoll;
+	xpkt->org.l_ui = htonl(org >> 32);
+	xpkt->org.l_uf = htonl(org & 0xFFFFFFFF);
+	if (snap->smearing)
+		rec += snap->smear_offset;
+	xpkt->rec = htonl_fp(rec);
+}
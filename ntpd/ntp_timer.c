@@ -12,8 +12,12 @@
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
+#ifdef HAVE_TIMERFD_CREATE
+# include <sys/timerfd.h>
+#endif
 
 #include "ntp_syscall.h"
+#include "timespecops.h"
 
 #ifdef HAVE_TIMER_CREATE
 /* TC_ERR represents the timer_create() error return value. */
@@ -21,18 +25,24 @@
 #endif
 
 #define	EVENT_TIMEOUT	0	/* one second, that is */
+#define	REFCLOCK_PHASE	(10 * NS_PER_MS) /* refclock timers after the second */
 
 static void check_leapsec(time_t, bool);
 
 /*
- * These routines provide support for the event timer.  The timer is
- * implemented by an interrupt routine which sets a flag once every
- * second, and a timer routine which is called when the mainline code
- * gets around to seeing the flag.  The timer routine dispatches the
- * clock adjustment code if its time has come, then searches the timer
- * queue for expiries which are dispatched to the transmit procedure.
- * Finally, we call the hourly procedure to do cleanup and print a
- * message.
+ * These routines provide support for the event timer.  Where there is
+ * a timerfd, the timer is a CLOCK_MONOTONIC timerfd in the select set
+ * of the I/O loop, armed for the soonest deadline in ntp_sched.c.  The
+ * one-second tick is one of those deadlines; the others let the poll
+ * process and the refclock timers run between ticks.  Elsewhere the
+ * timer is an interrupt routine which sets a flag once every second,
+ * and everything runs from the tick.
+ *
+ * Either way, the timer routine is called when the mainline code gets
+ * around to seeing the flag.  The tick dispatches the clock adjustment
+ * code if its time has come, then searches the timer queue for
+ * expiries which are dispatched to the transmit procedure.  Finally,
+ * we call the hourly procedure to do cleanup and print a message.
  */
 int interface_interval;     /* init_io() sets def. 300s */
 
@@ -62,7 +72,20 @@ uptime_t current_time;		/* seconds since startup */
 uptime_t timer_timereset;
 unsigned long timer_xmtcalls;
 
+int timer_fd = -1;		/* the timerfd, if there is one */
+
 static	void catchALRM (int);
+static	void timer_tick (struct sched_event *);
+static	void timer_hurry (struct sched_event *);
+#ifdef REFCLOCK
+static	void timer_refclock (struct sched_event *);
+#endif
+
+static struct sched_event tick_event = { .func = timer_tick };
+static struct sched_event poll_event = { .func = timer_hurry };
+#ifdef REFCLOCK
+static struct sched_event refclock_event = { .func = timer_refclock };
+#endif
 
 #ifdef HAVE_TIMER_CREATE
 static timer_t timer_id;
@@ -82,6 +105,18 @@ set_timer_or_die(void)
 	const char *	setfunc;
 	int		rc;
 
+#ifdef HAVE_TIMERFD_CREATE
+	if (timer_fd >= 0) {
+		struct itimerspec its;
+
+		/* there is always the tick */
+		ZERO(its);
+		sched_next(&its.it_value);
+		setfunc = "timerfd_settime";
+		rc = timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	} else
+#endif
+	{
 #ifdef HAVE_TIMER_CREATE
 	setfunc = "timer_settime";
 	rc = timer_settime(timer_id, 0, &itimer, NULL);
@@ -89,6 +124,7 @@ set_timer_or_die(void)
 	setfunc = "setitimer";
 	rc = setitimer(ITIMER_REAL, &itimer, NULL);
 #endif
+	}
 	if (-1 == rc) {
 		msyslog(LOG_ERR, "ERR:interval timer %s failed, %s",
 			setfunc, strerror(errno));
@@ -99,10 +135,13 @@ set_timer_or_die(void)
 
 /*
  * reinit_timer - reinitialize interval timer after a clock step.
+ * The deadlines of a timerfd are not moved by a step.
  */
 void
 reinit_timer(void)
 {
+	if (timer_fd >= 0)
+		return;
 	ZERO(itimer);
 #ifdef HAVE_TIMER_CREATE
 	timer_gettime(timer_id, &itimer);
@@ -143,6 +182,32 @@ init_timer(void)
 	timer_xmtcalls = 0;
 	timer_timereset = 0;
 
+#ifdef HAVE_TIMERFD_CREATE
+	/*
+	 * Set up the timerfd.  The first tick comes 2**EVENT_TIMEOUT
+	 * seconds from now, and the associations that are due already
+	 * are polled at once.
+	 */
+	if (timer_fd < 0)
+		timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					  TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd >= 0) {
+		struct timespec now;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		sched_at(&poll_event, now);
+		now.tv_sec += (1 << EVENT_TIMEOUT);
+		sched_at(&tick_event, now);
+# ifdef REFCLOCK
+		timer_refclock(NULL);
+# endif
+		set_timer_or_die();
+		return;
+	}
+	msyslog(LOG_WARNING, "INIT: timerfd_create failed, %s",
+		strerror(errno));
+#endif
+
 	/*
 	 * Set up the alarm interrupt.	The first comes 2**EVENT_TIMEOUT
 	 * seconds from now and they continue on every 2**EVENT_TIMEOUT
@@ -168,11 +233,128 @@ init_timer(void)
  */
 void
 timer(void)
+{
+	struct sched_event *ev;
+	struct timespec	now;
+	uint64_t	expired;
+
+	if (timer_fd < 0) {
+		timer_tick(NULL);
+		return;
+	}
+
+	/* the deadlines say what is due, this only drains the timerfd */
+	(void)(-1 == read(timer_fd, &expired, sizeof(expired)));
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while ((ev = sched_due(now)) != NULL)
+		(*ev->func)(ev);
+	set_timer_or_die();
+}
+
+
+/*
+ * timer_poll - dispatch any peers whose event timer has expired.  The
+ * timer wheel hands out only those, and each is out of the wheel until
+ * its next poll is scheduled, so the peer structure may go away as the
+ * result of the call.  The rate control headway (throttle) drains in
+ * peer_throttle().
+ */
+static void
+timer_poll(void)
 {
 	struct peer *	p;
-	struct peer *	next_peer;
+
+	while ((p = wheel_due(current_time)) != NULL) {
+#ifdef REFCLOCK
+		if (FLAG_REFCLOCK & p->cfg.flags)
+			refclock_transmit(p);
+		else
+#endif	/* REFCLOCK */
+			transmit(p);
+	}
+}
+
+
+/*
+ * timer_poll_soon - poll the associations that fell due since the
+ * last tick without waiting for the next one
+ */
+void
+timer_poll_soon(void)
+{
+	struct timespec	now;
+
+	if (timer_fd < 0 || poll_event.pending)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sched_at(&poll_event, now);
+	set_timer_or_die();
+}
+
+
+static void
+timer_hurry(
+	struct sched_event *ev
+	)
+{
+	UNUSED_ARG(ev);
+
+	wheel_hurry();
+	timer_poll();
+}
+
+
+#ifdef REFCLOCK
+/*
+ * timer_refclock - run the refclock timers just after each second of
+ * the system clock, when the drivers that read their samples from the
+ * timer (PPS, SHM and so on) have a fresh one.  The phase is taken
+ * from the clock each time, so it follows slews and steps.
+ */
+static void
+timer_refclock(
+	struct sched_event *ev
+	)
+{
+	struct timespec	mono, real;
+	long		delay;
+
+	if (ev != NULL)
+		refclock_timer();
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+	delay = NS_PER_S - real.tv_nsec + REFCLOCK_PHASE;
+	if (delay < NS_PER_S / 2)
+		delay += NS_PER_S;	/* running late, skip a second */
+	sched_at(&refclock_event, add_tspec_ns(mono, delay));
+}
+#endif	/* REFCLOCK */
+
+
+/*
+ * timer_tick - the one-second tick.  A tick that is more than a second
+ * late, because ntpd was stopped, is dropped and counted in
+ * alarm_overflow, as a lost alarm signal would be.
+ */
+static void
+timer_tick(
+	struct sched_event *ev
+	)
+{
 	time_t          now;
 
+	if (ev != NULL) {
+		struct timespec mono;
+
+		clock_gettime(CLOCK_MONOTONIC, &mono);
+		ev->due.tv_sec += (1 << EVENT_TIMEOUT);
+		while (cmp_tspec(ev->due, mono) <= 0) {
+			ev->due.tv_sec += (1 << EVENT_TIMEOUT);
+			alarm_overflow++;
+		}
+		sched_at(ev, ev->due);
+	}
+
 	/*
 	 * The basic timerevent is one second.  This is used to adjust the
 	 * system clock in time and frequency, implement the kiss-o'-death
@@ -183,39 +365,12 @@ timer(void)
 		adjust_timer += 1;
 		adj_host_clock();
 #ifdef REFCLOCK
-		for (p = peer_list; p != NULL; p = next_peer) {
-			next_peer = p->p_link;
-			if (FLAG_REFCLOCK & p->cfg.flags)
-				refclock_timer(p);
-		}
+		if (timer_fd < 0)
+			refclock_timer();
 #endif /* REFCLOCK */
 	}
 
-	/*
-	 * Now dispatch any peers whose event timer has expired. Be
-	 * careful here, since the peer structure might go away as the
-	 * result of the call.
-	 */
-	for (p = peer_list; p != NULL; p = next_peer) {
-		next_peer = p->p_link;
-
-		/*
-		 * Restrain the non-burst packet rate not more
-		 * than one packet every 16 seconds. This is
-		 * usually tripped using iburst and minpoll of
-		 * 128 s or less.
-		 */
-		if (p->throttle > 0)
-			p->throttle--;
-		if (p->nextdate <= current_time) {
-#ifdef REFCLOCK
-			if (FLAG_REFCLOCK & p->cfg.flags)
-				refclock_transmit(p);
-			else
-#endif	/* REFCLOCK */
-				transmit(p);
-		}
-	}
+	timer_poll();
 
 	/*
 	 * Orphan mode is active when enabled and when no servers less
@@ -257,6 +412,9 @@ timer(void)
 		}
 	}
 
+	/* make this second's changes visible to the reply paths */
+	sys_publish();
+
 	/*
 	 * Update huff-n'-puff filter.
 	 */
@@ -274,6 +432,9 @@ timer(void)
 		interface_update(NULL, NULL);
 	}
 
+	/* the socket prefilters follow the restrict lists */
+	io_prefilter_check();
+
 	/*
 	 * Finally, do the hourly stats and checks
 	 */
@@ -46,6 +46,7 @@ char *stats_drift_file;			/* frequency file name */
 static double wander_resid;		/* last frequency update */
 double	wander_threshold = 1e-7;	/* initial frequency threshold */
 static char *timespec_to_MJDtime(const struct timespec *);
+static void timespec_to_MJDrec(filegen_record *, const struct timespec *);
 
 /*
  * Statistics file stuff
@@ -65,6 +66,55 @@ static FILEGEN refstats;
 static FILEGEN sysstats;
 static FILEGEN usestats;
 
+/*
+ * Binary record layouts for the statistics that support them.
+ * Keep the column order identical to the text format.
+ */
+#define STATS_LABEL_LEN	48	/* fits socktoa() and refclock_name() */
+#define STATS_REFID_LEN	16	/* fits refid_str() */
+
+static const filegen_column peerstats_cols[] = {
+	{ "day",		'u', 4 },
+	{ "second",		'd', 8 },
+	{ "source",		's', STATS_LABEL_LEN },
+	{ "status",		'x', 4 },
+	{ "offset",		'd', 8 },
+	{ "delay",		'd', 8 },
+	{ "dispersion",		'd', 8 },
+	{ "jitter",		'd', 8 },
+};
+
+static const filegen_column loopstats_cols[] = {
+	{ "day",		'u', 4 },
+	{ "second",		'd', 8 },
+	{ "offset",		'd', 8 },
+	{ "frequency",		'd', 8 },
+	{ "jitter",		'd', 8 },
+	{ "wander",		'd', 8 },
+	{ "poll",		'i', 4 },
+};
+
+static const filegen_column rawstats_cols[] = {
+	{ "day",		'u', 4 },
+	{ "second",		'd', 8 },
+	{ "source",		's', STATS_LABEL_LEN },
+	{ "destination",	's', STATS_LABEL_LEN },
+	{ "t1",			'f', 8 },
+	{ "t2",			'f', 8 },
+	{ "t3",			'f', 8 },
+	{ "t4",			'f', 8 },
+	{ "leap",		'i', 4 },
+	{ "version",		'i', 4 },
+	{ "mode",		'i', 4 },
+	{ "stratum",		'i', 4 },
+	{ "ppoll",		'i', 4 },
+	{ "precision",		'i', 4 },
+	{ "rootdelay",		'd', 8 },
+	{ "rootdisp",		'd', 8 },
+	{ "refid",		's', STATS_REFID_LEN },
+	{ "outcount",		'u', 4 },
+};
+
 /*
  * This controls whether stats are written to the fileset. Provided
  * so that ntpq can turn off stats when the file system fills up.
@@ -133,6 +183,10 @@ init_util(void)
 	filegen_register(statsdir, "protostats",  &protostats);
 	filegen_register(statsdir, "usestats",	  &usestats);
 
+	filegen_columns(&peerstats, peerstats_cols, COUNTOF(peerstats_cols));
+	filegen_columns(&loopstats, loopstats_cols, COUNTOF(loopstats_cols));
+	filegen_columns(&rawstats,  rawstats_cols,  COUNTOF(rawstats_cols));
+
 	/*
 	 * register with libntp ntp_set_tod() to call us back
 	 * when time is stepped.
@@ -371,6 +425,18 @@ timespec_to_MJDtime(const struct timespec *ts) {
 	return buf;
 }
 
+/* timespec_to_MJDrec - binary counterpart of timespec_to_MJDtime
+ */
+
+static void
+timespec_to_MJDrec(filegen_record *rec, const struct timespec *ts) {
+	filegen_put_u32(rec,
+	    (uint32_t)((unsigned long)ts->tv_sec / SECSPERDAY + MJD_1970));
+	filegen_put_double(rec,
+	    (double)((unsigned long)ts->tv_sec % SECSPERDAY)
+	    + (double)ts->tv_nsec / NS_PER_S);
+}
+
 
 static const char *
 peerlabel(const struct peer *peer) {
@@ -408,7 +474,19 @@ record_peer_stats(
 
 	clock_gettime(CLOCK_REALTIME, &now);
 	filegen_setup(&peerstats, now.tv_sec);
-	if (peerstats.fp != NULL) {
+	if (peerstats.fp != NULL && (peerstats.flag & FGEN_FLAG_BINARY)) {
+		filegen_record rec;
+
+		rec.len = 0;
+		timespec_to_MJDrec(&rec, &now);
+		filegen_put_string(&rec, peerlabel(peer), STATS_LABEL_LEN);
+		filegen_put_u32(&rec, (uint32_t)status);
+		filegen_put_double(&rec, peer->offset);
+		filegen_put_double(&rec, peer->delay);
+		filegen_put_double(&rec, peer->disp);
+		filegen_put_double(&rec, peer->jitter);
+		filegen_write(&peerstats, &rec);
+	} else if (peerstats.fp != NULL) {
 		fprintf(peerstats.fp,
 		    "%s %s %x %.9f %.9f %.9f %.9f\n",
 		    timespec_to_MJDtime(&now),
@@ -446,7 +524,18 @@ record_loop_stats(
 
 	clock_gettime(CLOCK_REALTIME, &now);
 	filegen_setup(&loopstats, now.tv_sec);
-	if (loopstats.fp != NULL) {
+	if (loopstats.fp != NULL && (loopstats.flag & FGEN_FLAG_BINARY)) {
+		filegen_record rec;
+
+		rec.len = 0;
+		timespec_to_MJDrec(&rec, &now);
+		filegen_put_double(&rec, offset);
+		filegen_put_double(&rec, freq * US_PER_S);
+		filegen_put_double(&rec, jitter);
+		filegen_put_double(&rec, wander * US_PER_S);
+		filegen_put_i32(&rec, spoll);
+		filegen_write(&loopstats, &rec);
+	} else if (loopstats.fp != NULL) {
 		fprintf(loopstats.fp, "%s %.9f %.6f %.9f %.6f %d\n",
 		    timespec_to_MJDtime(&now),
 		    offset, freq * US_PER_S, jitter,
@@ -548,7 +637,31 @@ record_raw_stats(
 
 	clock_gettime(CLOCK_REALTIME, &now);
 	filegen_setup(&rawstats, now.tv_sec);
-	if (rawstats.fp != NULL) {
+	if (rawstats.fp != NULL && (rawstats.flag & FGEN_FLAG_BINARY)) {
+		filegen_record rec;
+
+		rec.len = 0;
+		timespec_to_MJDrec(&rec, &now);
+		filegen_put_string(&rec, peerlabel(peer), STATS_LABEL_LEN);
+		filegen_put_string(&rec, dstaddr ? socktoa(dstaddr) : "-",
+				   STATS_LABEL_LEN);
+		filegen_put_u64(&rec, t1);
+		filegen_put_u64(&rec, t2);
+		filegen_put_u64(&rec, t3);
+		filegen_put_u64(&rec, t4);
+		filegen_put_i32(&rec, leap);
+		filegen_put_i32(&rec, version);
+		filegen_put_i32(&rec, mode);
+		filegen_put_i32(&rec, stratum);
+		filegen_put_i32(&rec, ppoll);
+		filegen_put_i32(&rec, precision);
+		filegen_put_double(&rec, root_delay);
+		filegen_put_double(&rec, root_dispersion);
+		filegen_put_string(&rec, refid_str(refid, stratum),
+				   STATS_REFID_LEN);
+		filegen_put_u32(&rec, outcount);
+		filegen_write(&rawstats, &rec);
+	} else if (rawstats.fp != NULL) {
 		fprintf(rawstats.fp, "%s %s %s %s %s %s %s %d %d %d %d %d %d %.6f %.6f %s %u\n",
 		    timespec_to_MJDtime(&now),
 		    peerlabel(peer), dstaddr ?  socktoa(dstaddr) : "-",
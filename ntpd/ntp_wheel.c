@@ -0,0 +1,190 @@
+/*
+ * ntp_wheel.c - timer wheel for association polls
+ *
+ * The timer runs once a second, but most associations poll every 64 s
+ * or less often, so looking at every one of them each second is
+ * mostly wasted.  Instead each association is filed in a hierarchical
+ * timer wheel by its nextdate, and a tick only visits the ones due.
+ *
+ * There are WHEEL_LEVELS wheels of WHEEL_SIZE slots.  A slot of the
+ * innermost wheel holds the associations due in one second; a slot of
+ * the next holds those due in a span of WHEEL_SIZE seconds, and so
+ * on.  Whenever the inner wheel comes around, the next slot of the
+ * wheel outside it is emptied into it.  Dates beyond the reach of the
+ * outermost wheel are filed in its last slot and refiled from there.
+ *
+ * poll_update() and everything else that moves a nextdate calls
+ * wheel_schedule() to refile the association.  One whose date has
+ * already passed is set aside until the next tick, or until the timer
+ * calls wheel_hurry() to poll it sooner.
+ */
+#include "config.h"
+
+#include "ntpd.h"
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1U << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_SPAN	(1U << (WHEEL_BITS * WHEEL_LEVELS))
+
+static struct peer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static struct peer *wheel_due_list;	/* due at the last tick */
+static struct peer *wheel_soon_list;	/* past due since then */
+static uptime_t	wheel_tick = 1;		/* next tick to turn to */
+
+
+/*
+ * wheel_link - put a peer at the head of a list
+ */
+static inline void
+wheel_link(
+	struct peer **	head,
+	struct peer *	p
+	)
+{
+	p->wheel_next = *head;
+	if (*head != NULL)
+		(*head)->wheel_pprev = &p->wheel_next;
+	p->wheel_pprev = head;
+	*head = p;
+}
+
+
+/*
+ * wheel_unschedule - take a peer out of the wheel, if it is in it
+ */
+void
+wheel_unschedule(
+	struct peer *	p
+	)
+{
+	if (p->wheel_pprev == NULL)
+		return;
+	*p->wheel_pprev = p->wheel_next;
+	if (p->wheel_next != NULL)
+		p->wheel_next->wheel_pprev = p->wheel_pprev;
+	p->wheel_next = NULL;
+	p->wheel_pprev = NULL;
+}
+
+
+/*
+ * wheel_move - move all the peers on one list to another
+ */
+static void
+wheel_move(
+	struct peer **	to,
+	struct peer **	from
+	)
+{
+	struct peer *	p;
+
+	while ((p = *from) != NULL) {
+		wheel_unschedule(p);
+		wheel_link(to, p);
+	}
+}
+
+
+/*
+ * wheel_schedule - (re)file a peer in the wheel by its nextdate.  A
+ * date that has passed is due at the next tick, or when the wheel is
+ * hurried.  Returns true in that case.
+ */
+bool
+wheel_schedule(
+	struct peer *	p
+	)
+{
+	uptime_t	date, delta;
+	int		level;
+
+	wheel_unschedule(p);
+	if (p->nextdate < wheel_tick) {
+		wheel_link(&wheel_soon_list, p);
+		return true;
+	}
+	date = p->nextdate;
+	delta = date - wheel_tick;
+	if (delta >= WHEEL_SPAN) {
+		delta = WHEEL_SPAN - 1;
+		date = wheel_tick + delta;
+	}
+	for (level = 0; delta >= WHEEL_SIZE; level++)
+		delta >>= WHEEL_BITS;
+	wheel_link(&wheel[level][(date >> (level * WHEEL_BITS)) & WHEEL_MASK],
+		   p);
+	return false;
+}
+
+
+/*
+ * wheel_hurry - make the peers that fell due since the last tick due
+ * now, rather than at the next tick
+ */
+void
+wheel_hurry(void)
+{
+	wheel_move(&wheel_due_list, &wheel_soon_list);
+}
+
+
+/*
+ * wheel_turn - turn the wheel one tick on and move the associations
+ * due then to the due list
+ */
+static void
+wheel_turn(void)
+{
+	struct peer *	p;
+	struct peer *	list;
+	unsigned int	slot;
+	int		level;
+
+	/*
+	 * Empty the slots of the outer wheels that come due, outermost
+	 * first, so that their contents move all the way in.
+	 */
+	for (level = 1; level < WHEEL_LEVELS; level++)
+		if ((wheel_tick >> ((level - 1) * WHEEL_BITS)) & WHEEL_MASK)
+			break;
+	while (--level > 0) {
+		slot = (wheel_tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+		list = wheel[level][slot];
+		wheel[level][slot] = NULL;
+		while ((p = list) != NULL) {
+			list = p->wheel_next;
+			p->wheel_pprev = NULL;
+			wheel_schedule(p);
+		}
+	}
+
+	wheel_move(&wheel_due_list, &wheel_soon_list);
+	wheel_move(&wheel_due_list, &wheel[0][wheel_tick & WHEEL_MASK]);
+	wheel_tick++;
+}
+
+
+/*
+ * wheel_due - return the next association due for a poll at now, or
+ * NULL when there are no more.  Each one returned is out of the wheel
+ * until it is scheduled again.
+ */
+struct peer *
+wheel_due(
+	uptime_t	now
+	)
+{
+	struct peer *	p;
+
+	while (wheel_tick <= now)
+		wheel_turn();
+	while ((p = wheel_due_list) != NULL) {
+		wheel_unschedule(p);
+		if (p->nextdate <= now)
+			return p;
+		wheel_schedule(p);	/* moved later meanwhile */
+	}
+	return NULL;
+}
@@ -1791,6 +1791,8 @@ local_input(
 
 	int count;
 	unsigned char *s;
+	size_t used;
+	int got;
 	timestamp_t ts;
 
 	parse = (struct parseunit *)rbufp->recv_peer->procptr->unitptr;
@@ -1798,15 +1800,20 @@ local_input(
 		return false;
 
 	/*
-	 * eat all characters, parsing then and feeding complete samples
+	 * eat all characters, parsing then and feeding complete samples,
+	 * as much of the buffer at a time as the format can take
 	 */
 	count = (int)rbufp->recv_length;
 	s = (unsigned char *)rbufp->recv_buffer;
 	ts = rbufp->recv_time;
 
-	while (count--)
+	while (count > 0)
 	{
-		if (parse_ioread(&parse->parseio, (char)(*s++), &ts))
+		got = parse_ioread_block(&parse->parseio, (char *)s,
+					 (size_t)count, &used, &ts);
+		s += used;
+		count -= (int)used;
+		if (got)
 		{
 			struct recvbuf *buf;
 
@@ -65,27 +65,11 @@
 #include "ntp_debug.h"
 
 /* =====================================================================
- * Get the little JSMN library directly into our guts. Use the 'parent
- * link' feature for maximum speed.
+ * JSON parsing stuff: the records are indexed by ntp_gpsdjson.c
  */
-#define JSMN_STATIC
-#define JSMN_PARENT_LINKS
-#include "jsmn.h"
+#include "ntp_gpsdjson.h"
 
-/* =====================================================================
- * JSON parsing stuff
- */
-
-#define JSMN_MAXTOK	350
-#define INVALID_TOKEN (-1)
-
-typedef struct json_ctx {
-	char        * buf;
-	int           ntok;
-	jsmntok_t     tok[JSMN_MAXTOK];
-} json_ctx;
-
-typedef int tok_ref;
+typedef gpsd_json json_ctx;
 
 /* We roll our own integer number parser.
  */
@@ -106,6 +90,8 @@ typedef unsigned long int json_uint;
 #include <math.h>
 
 #include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <netinet/tcp.h>
@@ -115,6 +101,7 @@ typedef unsigned long int json_uint;
 #include "ntpd.h"
 #include "ntp_io.h"
 #include "ntp_refclock.h"
+#include "ntp_shm.h"
 #include "ntp_stdlib.h"
 #include "ntp_calendar.h"
 #include "timespecops.h"
@@ -147,6 +134,13 @@ typedef unsigned long int json_uint;
  *   this fails for too long switches back to IBT only until the PPS
  *   signal becomes available again. See the HTML docs for this driver
  *   about the gotchas and why this is not the default.
+ *
+ * + SHM, bit 2 of the mode word and independent of the above, takes
+ *   the TOFF and PPS timing from the shared memory segments GPSD
+ *   exports for NTP rather than from the JSON records. TOFF and PPS
+ *   records name their segment; once that is attached, PPS records
+ *   are switched off and the socket is left with TPV for the fix
+ *   status, and the version and watch replies.
  */
 #define MODE_OP_MASK   0x03
 #define MODE_OP_IBT    0
@@ -154,6 +148,7 @@ typedef unsigned long int json_uint;
 #define MODE_OP_AUTO   2
 #define MODE_OP_MAXVAL 2
 #define MODE_OP_MODE(x)		((x) & MODE_OP_MASK)
+#define MODE_SHM       0x04
 
 #define	PRECISION	(-9)	/* precision assumed (about 2 ms) */
 #define	PPS_PRECISION	(-20)	/* precision assumed (about 1 us) */
@@ -188,6 +183,13 @@ typedef unsigned long int json_uint;
  */
 #define PPS2_MAXCOUNT 10
 
+/* The time segments GPSD exports are those of the SHM driver
+ * (ntp_shm.h).  GPSD writes them in its mode 1: 'count' goes up before
+ * and after an update, and 'valid' is clear during it.
+ */
+#define SHM_SETTLE	3	/* seconds to wait for a PPS segment */
+#define SHM_MAXAGE	5	/* seconds a segment sample stays usable */
+
 #define PROTO_VERSION(hi,lo) \
 	    ((((uint32_t)(hi) << 16) & 0xFFFF0000u) | \
 	     ((uint32_t)(lo) & 0x0FFFFu))
@@ -289,10 +291,19 @@ struct gpsd_unit {
 	bool fl_rawibt: true;	/* permit raw TPV/TOFF time stamps */
 	bool fl_vers  : true;	/* have protocol version */
 	bool fl_watch : true;	/* watch reply seen */
+	bool fl_shm   : true;	/* timing from GPSD's segments */
+	bool fl_nopps : true;	/* PPS records switched off */
 	/* protocol flags */
 	bool pf_nsec  : true;	/* have nanosec PPS info */
 	bool pf_toff  : true;	/* have TOFF record for timing */
 
+	/* GPSD's shared memory segments, with mode bit 2 */
+	struct shmTime *shm_ibt;	/* serial time, as TOFF */
+	struct shmTime *shm_pps;	/* pulse time, as PPS */
+	int          shm_ibt_count;	/* count of the last sample used */
+	int          shm_pps_count;
+	unsigned int shm_settle;	/* countdown to PPS records off */
+
 	/* admin stuff for sockets and device selection */
 	int         fdt;	/* current connecting socket */
 	addrinfoT * addr;	/* next address to try */
@@ -307,6 +318,7 @@ struct gpsd_unit {
 	unsigned int       tc_ibt_used;/* used        --^-- */
 	unsigned int       tc_pps_recv;/* received PPS timing info records */
 	unsigned int       tc_pps_used;/* used        --^-- */
+	unsigned int       tc_shm_recv;/* samples read from the segments */
 
 	/* log bloat throttle */
 	unsigned int       logthrottle;/* seconds to next log slot */
@@ -328,6 +340,14 @@ static void gpsd_stop_socket(peerT * const peer);
 
 static void gpsd_parse(peerT * const peer,
 		       const l_fp  * const rtime);
+static void gpsd_evaluate(peerT * const peer);
+static void set_pps(peerT * const peer);
+static void send_watch(peerT * const peer);
+static bool shm_learn(peerT * const peer, json_ctx * const jctx,
+		      struct shmTime ** const seg,
+		      int * const count);
+static bool shm_fetch(peerT * const peer);
+static void shm_detach(gpsd_unitT * const up);
 static bool convert_ascii_time(l_fp * fp, const char * gps_time);
 static void save_ltc(clockprocT * const pp, const char * const tc);
 static bool syslogok(clockprocT * const pp, gpsd_unitT * const up);
@@ -350,6 +370,12 @@ static const char * const s_req_watch[2] = {
 	"?WATCH={\"device\":\"%s\",\"enable\":true,\"json\":true,\"pps\":true};\r\n"
 };
 
+/* ... and the one that turns TOFF and PPS off again, once their
+ * timing comes from shared memory.
+ */
+static const char * const s_req_watch_nopps =
+	"?WATCH={\"device\":\"%s\",\"enable\":true,\"json\":true,\"pps\":false};\r\n";
+
 static const char * const s_req_version =
     "?VERSION;\r\n";
 
@@ -570,6 +596,7 @@ gpsd_start(
 	if (unit >= 128) {
 		up->pps_peer = peer;
 	} else {
+		up->fl_shm = (0 != (peer->cfg.mode & MODE_SHM));
 		enter_opmode(peer, up->mode);
 	}
 	return true;
@@ -627,6 +654,7 @@ gpsd_shutdown(
 				uscan = &(*uscan)->next_unit;
 			}
 		}
+		shm_detach(up);
 		free(up->logname);
 		free(up->device);
 		free(up);
@@ -719,7 +747,15 @@ poll_primary(
 			refclock_report(peer, CEVNT_TIMEOUT);
 	}
 
-	if (pp->sloppyclockflag & CLK_FLAG4)
+	if ((pp->sloppyclockflag & CLK_FLAG4) && up->fl_shm)
+		mprintf_clock_stats(
+			peer,"%u %u %u %u %u %u %u %u",
+			up->tc_recv,
+			up->tc_breply, up->tc_nosync,
+			up->tc_ibt_recv, up->tc_ibt_used,
+			up->tc_pps_recv, up->tc_pps_used,
+			up->tc_shm_recv);
+	else if (pp->sloppyclockflag & CLK_FLAG4)
 		mprintf_clock_stats(
 			peer,"%u %u %u %u %u %u %u",
 			up->tc_recv,
@@ -735,6 +771,7 @@ poll_primary(
 	up->tc_ibt_used = 0;
 	up->tc_pps_recv = 0;
 	up->tc_pps_used = 0;
+	up->tc_shm_recv = 0;
 }
 
 static void
@@ -863,6 +900,24 @@ timer_primary(
 		if (-1 == pp->io.fd && -1 != up->fdt)
 			gpsd_test_socket(peer);
 	}
+
+	if ( ! up->fl_shm)
+		return;
+
+	/* pick up what the records did not bring in */
+	if (shm_fetch(peer))
+		gpsd_evaluate(peer);
+
+	/* Once the segments are known, TOFF and PPS records are of no
+	 * further use. Give a PPS segment some seconds to show up after
+	 * the serial one, in case there is a PPS at all.
+	 */
+	if (NULL != up->shm_ibt && !up->fl_nopps && -1 != pp->io.fd &&
+	    (NULL != up->shm_pps || 0 == up->shm_settle ||
+	     0 == --up->shm_settle)) {
+		up->fl_nopps = true;
+		send_watch(peer);
+	}
 }
 
 static void
@@ -1144,94 +1199,14 @@ strtojint(
 
 /* ------------------------------------------------------------------ */
 
-static tok_ref
-json_token_skip(
-	const json_ctx * ctx,
-	tok_ref          tid)
-{
-	if (tid >= 0 && tid < ctx->ntok) {
-		int len = ctx->tok[tid].size;
-		/* For arrays and objects, the size is the number of
-		 * ITEMS in the compound. That's the number of objects in
-		 * the array, and the number of key/value pairs for
-		 * objects. In theory, the key must be a string, and we
-		 * could simply skip one token before skipping the
-		 * value, which can be anything. We're a bit paranoid
-		 * and lazy at the same time: We simply double the
-		 * number of tokens to skip and fall through into the
-		 * array processing when encountering an object.
-		 */
-		switch (ctx->tok[tid].type) {
-		case JSMN_OBJECT:
-			len *= 2;
-			/* FALLTHROUGH */
-		case JSMN_ARRAY:
-			for (++tid; len; --len)
-				tid = json_token_skip(ctx, tid);
-			break;
-
-                case JSMN_PRIMITIVE:
-                case JSMN_STRING:
-		default:
-			++tid;
-			break;
-		}
-		if (tid > ctx->ntok) { /* Impossible? Paranoia rulez. */
-			tid = ctx->ntok;
-		}
-	}
-	return tid;
-}
-
-/* ------------------------------------------------------------------ */
-
-static int
-json_object_lookup(
-	const json_ctx * ctx ,
-	tok_ref          tid ,
-	const char     * key ,
-	int              what)
-{
-	int len;
-
-	if (tid < 0 || tid >= ctx->ntok ||
-	    ctx->tok[tid].type != JSMN_OBJECT)
-		return INVALID_TOKEN;
-
-	len = ctx->tok[tid].size;
-	for (++tid; len && tid+1 < ctx->ntok; --len) {
-		if (ctx->tok[tid].type != JSMN_STRING) { /* Blooper! */
-			tid = json_token_skip(ctx, tid); /* skip key */
-			tid = json_token_skip(ctx, tid); /* skip val */
-		} else if (strcmp(key, ctx->buf + ctx->tok[tid].start)) {
-			tid = json_token_skip(ctx, tid+1); /* skip key+val */
-		} else if (what < 0 || what == (int)ctx->tok[tid+1].type) {
-			return tid + 1;
-		} else {
-			break;
-		}
-		/* if skipping ahead returned an error, bail out here. */
-		if (tid < 0) {
-			break;
-		}
-	}
-	return INVALID_TOKEN;
-}
-
-/* ------------------------------------------------------------------ */
-
 static const char*
 json_object_lookup_primitive(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key)
+	gpsd_jkey        key)
 {
-	tid = json_object_lookup(ctx, tid, key, JSMN_PRIMITIVE);
-	if (INVALID_TOKEN  != tid) {
-		return ctx->buf + ctx->tok[tid].start;
-	} else {
-		return NULL;
-	}
+	if (GJT_PRIMITIVE == ctx->type[key])
+		return ctx->val[key];
+	return NULL;
 }
 /* ------------------------------------------------------------------ */
 /* look up a boolean value. This essentially returns a tribool:
@@ -1240,11 +1215,10 @@ json_object_lookup_primitive(
 static int
 json_object_lookup_bool(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key)
+	gpsd_jkey        key)
 {
 	const char *cp;
-	cp  = json_object_lookup_primitive(ctx, tid, key);
+	cp  = json_object_lookup_primitive(ctx, key);
 	switch ( cp ? *cp : '\0') {
 	case 't': return  1;
 	case 'f': return  0;
@@ -1257,25 +1231,21 @@ json_object_lookup_bool(
 static const char*
 json_object_lookup_string(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key)
+	gpsd_jkey        key)
 {
-	tid = json_object_lookup(ctx, tid, key, JSMN_STRING);
-	if (INVALID_TOKEN != tid)
-		return ctx->buf + ctx->tok[tid].start;
+	if (GJT_STRING == ctx->type[key])
+		return ctx->val[key];
 	return NULL;
 }
 
 static const char*
 json_object_lookup_string_default(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key,
+	gpsd_jkey        key,
 	const char     * def)
 {
-	tid = json_object_lookup(ctx, tid, key, JSMN_STRING);
-	if (INVALID_TOKEN != tid)
-		return ctx->buf + ctx->tok[tid].start;
+	if (GJT_STRING == ctx->type[key])
+		return ctx->val[key];
 	return def;
 }
 
@@ -1284,14 +1254,13 @@ json_object_lookup_string_default(
 static json_int
 json_object_lookup_int(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key)
+	gpsd_jkey        key)
 {
 	json_int     ret;
 	const char * cp;
 	char       * ep;
 
-	cp = json_object_lookup_primitive(ctx, tid, key);
+	cp = json_object_lookup_primitive(ctx, key);
 	if (NULL != cp) {
 		ret = strtojint(cp, &ep);
 		if (cp != ep && '\0' == *ep) {
@@ -1306,15 +1275,14 @@ json_object_lookup_int(
 static json_int
 json_object_lookup_int_default(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key,
+	gpsd_jkey        key,
 	json_int         def)
 {
 	json_int     ret;
 	const char * cp;
 	char       * ep;
 
-	cp = json_object_lookup_primitive(ctx, tid, key);
+	cp = json_object_lookup_primitive(ctx, key);
 	if (NULL != cp) {
 		ret = strtojint(cp, &ep);
 		if (cp != ep && '\0' == *ep) {
@@ -1329,15 +1297,14 @@ json_object_lookup_int_default(
 static double
 json_object_lookup_float_default(
 	const json_ctx * ctx,
-	tok_ref          tid,
-	const char     * key,
+	gpsd_jkey        key,
 	double           def)
 {
 	double       ret;
 	const char * cp;
 	char       * ep;
 
-	cp = json_object_lookup_primitive(ctx, tid, key);
+	cp = json_object_lookup_primitive(ctx, key);
 	if (NULL != cp) {
 		ret = strtod(cp, &ep);
 		if (cp != ep && '\0' == *ep) {
@@ -1347,37 +1314,6 @@ json_object_lookup_float_default(
 	return def;
 }
 
-/* ------------------------------------------------------------------ */
-
-static bool
-json_parse_record(
-	json_ctx * ctx,
-	char     * buf,
-	size_t     len)
-{
-	jsmn_parser jsm;
-	int         idx, rc;
-
-	jsmn_init(&jsm);
-	rc = jsmn_parse(&jsm, buf, len, ctx->tok, JSMN_MAXTOK);
-	if (rc <= 0)
-		return false;
-	ctx->buf  = buf;
-	ctx->ntok = rc;
-
-	if (JSMN_OBJECT != ctx->tok[0].type)
-		return false; /* not object!?! */
-
-	/* Make all tokens NUL terminated by overwriting the
-	 * terminator symbol. Makes string compares and number parsing a
-	 * lot easier!
-	 */
-	for (idx = 0; idx < ctx->ntok; ++idx)
-		if (ctx->tok[idx].end > ctx->tok[idx].start)
-			ctx->buf[ctx->tok[idx].end] = '\0';
-	return true;
-}
-
 
 /* =====================================================================
  * static local helpers
@@ -1386,16 +1322,16 @@ static bool
 get_binary_time(
 	l_fp       * const dest     ,
 	json_ctx   * const jctx     ,
-	const char * const time_name,
-	const char * const frac_name,
+	gpsd_jkey          time_key ,
+	gpsd_jkey          frac_key ,
 	long               fscale   )
 {
 	bool            retv = false;
 	struct timespec ts;
 
 	errno = 0;
-	ts.tv_sec  = (time_t)json_object_lookup_int(jctx, 0, time_name);
-	ts.tv_nsec = (long  )json_object_lookup_int(jctx, 0, frac_name);
+	ts.tv_sec  = (time_t)json_object_lookup_int(jctx, time_key);
+	ts.tv_nsec = (long  )json_object_lookup_int(jctx, frac_key);
 	if (0 == errno) {
 		ts.tv_nsec *= fscale;
 		*dest = tspec_stamp_to_lfp(ts);
@@ -1423,13 +1359,13 @@ process_watch(
 
 	UNUSED_ARG(rtime);
 
-	path = json_object_lookup_string(jctx, 0, "device");
+	path = json_object_lookup_string(jctx, GJK_DEVICE);
 	if (NULL == path || strcmp(path, up->device)) {
 		return;
 	}
 
-	if (json_object_lookup_bool(jctx, 0, "enable") > 0 &&
-	    json_object_lookup_bool(jctx, 0, "json"  ) > 0  )
+	if (json_object_lookup_bool(jctx, GJK_ENABLE) > 0 &&
+	    json_object_lookup_bool(jctx, GJK_JSON) > 0  )
 		up->fl_watch = true;
 	else
 		up->fl_watch = false;
@@ -1448,9 +1384,6 @@ process_version(
 	clockprocT * const pp = peer->procptr;
 	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
 
-	size_t len;
-	ssize_t ret;
-	char * buf;
 	const char *revision;
 	const char *release;
 	uint16_t    pvhi, pvlo;
@@ -1459,12 +1392,12 @@ process_version(
 
 	/* get protocol version number */
 	revision = json_object_lookup_string_default(
-		jctx, 0, "rev", "(unknown)");
+		jctx, GJK_REV, "(unknown)");
 	release  = json_object_lookup_string_default(
-		jctx, 0, "release", "(unknown)");
+		jctx, GJK_RELEASE, "(unknown)");
 	errno = 0;
-	pvhi = (uint16_t)json_object_lookup_int(jctx, 0, "proto_major");
-	pvlo = (uint16_t)json_object_lookup_int(jctx, 0, "proto_minor");
+	pvhi = (uint16_t)json_object_lookup_int(jctx, GJK_PROTO_MAJOR);
+	pvlo = (uint16_t)json_object_lookup_int(jctx, GJK_PROTO_MINOR);
 
 	if (0 == errno) {
 		if ( ! up->fl_vers)
@@ -1497,20 +1430,34 @@ process_version(
 	 * The version string is also sent as a life signal, if we have
 	 * seen usable data. So if we're already watching the device,
 	 * skip the request.
-	 *
-	 * Reuse the input buffer, which is no longer needed in the
-	 * current cycle. Also assume that we can write the watch
-	 * request in one sweep into the socket; since we do not do
-	 * output otherwise, this should always work.  (Unless the
-	 * TCP/IP window size gets lower than the length of the
-	 * request. We handle that when it happens.)
 	 */
 	if (up->fl_watch)
 		return;
+	send_watch(peer);
+}
 
-	snprintf(up->buffer, sizeof(up->buffer),
-		 s_req_watch[up->pf_toff], up->device);
-	buf = up->buffer;
+/* ------------------------------------------------------------------ */
+/* Send the watch request for our device. Assume that we can write it
+ * in one sweep into the socket; since we do not do output otherwise,
+ * this should always work.  (Unless the TCP/IP window size gets lower
+ * than the length of the request. We handle that when it happens.)
+ */
+static void
+send_watch(
+	peerT * const peer)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
+
+	char    buf[1024];
+	size_t  len;
+	ssize_t ret;
+
+	if (up->fl_nopps)
+		snprintf(buf, sizeof(buf), s_req_watch_nopps, up->device);
+	else
+		snprintf(buf, sizeof(buf), s_req_watch[up->pf_toff],
+			 up->device);
 	len = strlen(buf);
 	log_data(peer, "send", buf, len);
 	ret = write(pp->io.fd, buf, len);
@@ -1542,10 +1489,10 @@ process_tpv(
 	int          xlog2;
 
 	gps_mode = (int)json_object_lookup_int_default(
-		jctx, 0, "mode", 0);
+		jctx, GJK_MODE, 0);
 
 	gps_time = json_object_lookup_string(
-		jctx, 0, "time");
+		jctx, GJK_TIME);
 
 	/* accept time stamps only in 2d or 3d fix */
 	if (gps_mode < 2 || NULL == gps_time) {
@@ -1597,7 +1544,7 @@ process_tpv(
 	 * precision estimation, since it gets the proper value directly
 	 * from GPSD!)
 	 */
-	ept = json_object_lookup_float_default(jctx, 0, "ept", 2.0e-3);
+	ept = json_object_lookup_float_default(jctx, GJK_EPT, 2.0e-3);
 	ept = frexp(fabs(ept)*0.70710678, &xlog2); /* ~ sqrt(0.5) */
 	if (ept < 0.25)
 		xlog2 = INT_MIN;
@@ -1619,6 +1566,11 @@ process_pps(
 
 	int xlog2;
 
+	/* with mode bit 2, the timing is taken from the segment */
+	if (up->fl_shm &&
+	    shm_learn(peer, jctx, &up->shm_pps, &up->shm_pps_count))
+		return;
+
 	++up->tc_pps_recv;
 
 	/* Bail out if there's indication that time sync is bad or
@@ -1634,17 +1586,17 @@ process_pps(
 	 */
 	if (up->pf_nsec) {
 		if ( ! get_binary_time(&up->pps_recvt2, jctx,
-				       "clock_sec", "clock_nsec", 1))
+				       GJK_CLOCK_SEC, GJK_CLOCK_NSEC, 1))
 			goto fail;
 		if ( ! get_binary_time(&up->pps_stamp2, jctx,
-				       "real_sec", "real_nsec", 1))
+				       GJK_REAL_SEC, GJK_REAL_NSEC, 1))
 			goto fail;
 	} else {
 		if ( ! get_binary_time(&up->pps_recvt2, jctx,
-				       "clock_sec", "clock_musec", 1000))
+				       GJK_CLOCK_SEC, GJK_CLOCK_MUSEC, 1000))
 			goto fail;
 		if ( ! get_binary_time(&up->pps_stamp2, jctx,
-				       "real_sec", "real_musec", 1000))
+				       GJK_REAL_SEC, GJK_REAL_MUSEC, 1000))
 			goto fail;
 	}
 
@@ -1652,8 +1604,27 @@ process_pps(
 	 * not there, take the precision from the serial data.
 	 */
 	xlog2 = (int)json_object_lookup_int_default(
-			jctx, 0, "precision", up->ibt_prec);
+			jctx, GJK_PRECISION, up->ibt_prec);
 	up->pps_prec = clamped_precision(xlog2);
+	set_pps(peer);
+	return;
+
+  fail:
+	DPRINT(1, ("%s: PPS record processing FAILED\n",
+		   up->logname));
+	++up->tc_breply;
+}
+
+/* ------------------------------------------------------------------ */
+/* Take up a pulse: its time on the local clock, GPS time and precision
+ * are in pps_recvt2, pps_stamp2 and pps_prec.
+ */
+static void
+set_pps(
+	peerT * const peer)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
 
 	/* Get fudged receive times for primary & secondary unit */
 	up->pps_recvt = up->pps_recvt2;
@@ -1678,12 +1649,6 @@ process_pps(
 
 	up->fl_pps  = !(pp->sloppyclockflag & CLK_FLAG2);
 	up->fl_pps2 = true;
-	return;
-
-  fail:
-	DPRINT(1, ("%s: PPS record processing FAILED\n",
-		   up->logname));
-	++up->tc_breply;
 }
 
 /* ------------------------------------------------------------------ */
@@ -1697,20 +1662,25 @@ process_toff(
 	clockprocT * const pp = peer->procptr;
 	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
 
-	++up->tc_ibt_recv;
-
 	/* remember this! */
 	up->pf_toff = true;
 
+	/* with mode bit 2, the timing is taken from the segment */
+	if (up->fl_shm &&
+	    shm_learn(peer, jctx, &up->shm_ibt, &up->shm_ibt_count))
+		return;
+
+	++up->tc_ibt_recv;
+
 	/* bail out if there's indication that time sync is bad */
 	if (up->fl_nosync)
 		return;
 
 	if ( ! get_binary_time(&up->ibt_recvt, jctx,
-			       "clock_sec", "clock_nsec", 1))
+			       GJK_CLOCK_SEC, GJK_CLOCK_NSEC, 1))
 			goto fail;
 	if ( ! get_binary_time(&up->ibt_stamp, jctx,
-			       "real_sec", "real_nsec", 1))
+			       GJK_REAL_SEC, GJK_REAL_NSEC, 1))
 			goto fail;
 	up->ibt_recvt -= up->ibt_fudge;
 	up->ibt_local = *rtime;
@@ -1746,17 +1716,16 @@ gpsd_parse(
 		   up->logname, ulfptoa(*rtime, 6),
 		   up->buflen, up->buffer));
 
-	/* See if we can grab anything potentially useful. JSMN does not
-	 * need a trailing NUL, but it needs the number of bytes to
-	 * process. */
-	if (!json_parse_record(&up->json_parse, up->buffer,
+	/* See if we can grab anything potentially useful. The record
+	 * is indexed in place, without a copy. */
+	if (!gpsd_json_parse(&up->json_parse, up->buffer,
                                (size_t)up->buflen)) {
 		++up->tc_breply;
 		return;
 	}
 
 	/* Now dispatch over the objects we know */
-	clsid = json_object_lookup_string(&up->json_parse, 0, "class");
+	clsid = json_object_lookup_string(&up->json_parse, GJK_CLASS);
 	if (NULL == clsid) {
 		++up->tc_breply;
 		return;
@@ -1777,6 +1746,21 @@ gpsd_parse(
 	}
 	++up->tc_recv;
 
+	/* TPV comes after the serial time was put into its segment */
+	if (up->fl_shm)
+		(void)shm_fetch(peer);
+	gpsd_evaluate(peer);
+}
+
+/* ------------------------------------------------------------------ */
+/* Feed the samples at hand to the clocks, as the mode says */
+static void
+gpsd_evaluate(
+	peerT * const peer)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
+
 	/* if possible, feed the PPS side channel */
 	if (up->pps_peer)
 		eval_pps_secondary(
@@ -1814,6 +1798,213 @@ gpsd_parse(
 	}
 }
 
+/* =====================================================================
+ * GPSD's shared memory segments
+ */
+
+/* ------------------------------------------------------------------ */
+/* Attach the segment a record names, like "NTP2", read-only: samples
+ * are told apart by their count, so unlike the SHM driver we need not
+ * clear 'valid', and GPSD's segments can be shared with it.
+ */
+static struct shmTime *
+shm_attach(
+	peerT      * const peer,
+	const char * const name)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
+
+	unsigned int segno;
+	char         junk;
+	int          shmid;
+	void       * seg;
+
+	if (1 != sscanf(name, "NTP%u%c", &segno, &junk) || segno > 255) {
+		if (syslogok(pp, up))
+			msyslog(LOG_WARNING,
+				"REFCLOCK: %s: no segment named '%s'",
+				up->logname, name);
+		return NULL;
+	}
+	shmid = shmget((key_t)(SHM_KEY_BASE + segno), sizeof(struct shmTime), 0);
+	if (-1 == shmid) {
+		seg = NULL;
+	} else {
+		seg = shmat(shmid, NULL, SHM_RDONLY);
+		if ((void *)-1 == seg)
+			seg = NULL;
+	}
+	if (NULL == seg) {
+		if (syslogok(pp, up))
+			msyslog(LOG_WARNING,
+				"REFCLOCK: %s: cannot attach GPSD segment %s: %s",
+				up->logname, name, strerror(errno));
+		return NULL;
+	}
+	msyslog(LOG_INFO, "REFCLOCK: %s: taking time from GPSD segment %s",
+		up->logname, name);
+	return seg;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void
+shm_detach(
+	gpsd_unitT * const up)
+{
+	if (NULL != up->shm_ibt)
+		(void)shmdt(up->shm_ibt);
+	if (NULL != up->shm_pps)
+		(void)shmdt(up->shm_pps);
+	up->shm_ibt    = NULL;
+	up->shm_pps    = NULL;
+	up->shm_settle = 0;
+	up->fl_nopps   = false;
+}
+
+/* ------------------------------------------------------------------ */
+/* Attach the segment a TOFF or PPS record names, if not yet done.
+ * Returns true if the timing of the record is to come from the segment
+ * instead; the record that brings the name is still used itself.
+ */
+static bool
+shm_learn(
+	peerT           * const peer ,
+	json_ctx        * const jctx ,
+	struct shmTime ** const seg  ,
+	int             * const count)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
+
+	const char * name;
+
+	if (NULL != *seg)
+		return true;
+	name = json_object_lookup_string(jctx, GJK_SHM);
+	if (NULL == name)
+		return false;
+	*seg = shm_attach(peer, name);
+	if (NULL != *seg) {
+		*count = (*seg)->count;
+		if (seg == &up->shm_ibt)
+			up->shm_settle = SHM_SETTLE;
+	}
+	return false;
+}
+
+/* ------------------------------------------------------------------ */
+/* Read the sample in a segment, if GPSD put a new one there since the
+ * last call: its GPS time, the local time it was taken and precision.
+ * A sample caught in the middle of an update is left for next time.
+ */
+static bool
+shm_read(
+	struct shmTime * const shm  ,
+	int            * const last ,
+	l_fp           * const stamp,
+	l_fp           * const recvt,
+	int            * const prec )
+{
+	struct timespec tvt, tvr;
+	unsigned        cns, rns;
+	int             cus, rus;
+	int             cnt, valid;
+	l_fp            now;
+
+	cnt = shm->count;
+	if (cnt == *last)
+		return false;
+	memory_barrier();
+	valid      = shm->valid;
+	tvt.tv_sec = shm->clockTimeStampSec;
+	cus        = shm->clockTimeStampUSec;
+	cns        = shm->clockTimeStampNSec;
+	tvr.tv_sec = shm->receiveTimeStampSec;
+	rus        = shm->receiveTimeStampUSec;
+	rns        = shm->receiveTimeStampNSec;
+	*prec      = shm->precision;
+	memory_barrier();
+	if (!valid || 1 != shm->mode || cnt != shm->count)
+		return false;
+	*last = cnt;
+
+	/* the nanoseconds count only if they agree with the micro-
+	 * seconds; older writers leave them alone
+	 */
+	if (cns < NS_PER_S && (int)(cns / 1000) == cus)
+		tvt.tv_nsec = (long)cns;
+	else
+		tvt.tv_nsec = cus * 1000L;
+	if (rns < NS_PER_S && (int)(rns / 1000) == rus)
+		tvr.tv_nsec = (long)rns;
+	else
+		tvr.tv_nsec = rus * 1000L;
+	if (!timespec_isnormal(&tvt) || !timespec_isnormal(&tvr))
+		return false;
+	*stamp = tspec_stamp_to_lfp(tvt);
+	*recvt = tspec_stamp_to_lfp(tvr);
+
+	/* a sample left by a GPSD that has lost its device is no use */
+	get_systime(&now);
+	now -= *recvt;
+	return (abs(lfpsint(now)) < SHM_MAXAGE);
+}
+
+/* ------------------------------------------------------------------ */
+/* Take up the serial and pulse time GPSD put in its segments since the
+ * last call, as if TOFF and PPS records had come in. Returns true if
+ * there was anything new.
+ */
+static bool
+shm_fetch(
+	peerT * const peer)
+{
+	clockprocT * const pp = peer->procptr;
+	gpsd_unitT * const up = (gpsd_unitT *)pp->unitptr;
+
+	l_fp stamp, recvt;
+	int  prec;
+	bool fresh = false;
+
+	/* the fix status still comes from TPV */
+	if (up->fl_nosync)
+		return false;
+
+	if (NULL != up->shm_ibt &&
+	    shm_read(up->shm_ibt, &up->shm_ibt_count, &stamp, &recvt,
+		     &prec)) {
+		++up->tc_ibt_recv;
+		++up->tc_shm_recv;
+		up->ibt_stamp = stamp;
+		up->ibt_local = recvt;
+		up->ibt_recvt = recvt;
+		up->ibt_recvt -= up->ibt_fudge;
+		up->fl_ibt    = true;
+		save_ltc(pp, prettydate(up->ibt_stamp));
+		DPRINT(2, ("%s: serial segment read, stamp='%s', recvt='%s'\n",
+			   up->logname,
+			   prettydate(up->ibt_stamp),
+			   prettydate(up->ibt_recvt)));
+		fresh = true;
+	}
+
+	if (NULL != up->shm_pps &&
+	    shm_read(up->shm_pps, &up->shm_pps_count, &stamp, &recvt,
+		     &prec)) {
+		++up->tc_pps_recv;
+		++up->tc_shm_recv;
+		up->pps_local  = recvt;
+		up->pps_stamp2 = stamp;
+		up->pps_recvt2 = recvt;
+		up->pps_prec   = clamped_precision(prec);
+		set_pps(peer);
+		fresh = true;
+	}
+	return fresh;
+}
+
 /* ------------------------------------------------------------------ */
 
 static void
@@ -1840,6 +2031,9 @@ gpsd_stop_socket(
 	up->fl_ibt   = false;
 	up->fl_pps   = false;
 	up->fl_watch = false;
+
+	/* GPSD may number its segments anew when it comes back */
+	shm_detach(up);
 }
 
 /* ------------------------------------------------------------------ */
@@ -31,6 +31,7 @@
 #include "ntp_refclock.h"
 #include "ntp_stdlib.h"
 #include "ntp_calendar.h"
+#include "ntp_nmea.h"
 #include "ntp_wrapdate.h"
 #include "timespecops.h"
 
@@ -86,11 +87,6 @@
 #define NMEA_EXTLOG_MASK	0x00010000U
 #define NMEA_DATETRUST_MASK	0x02000000U
 
-#define NMEA_PROTO_IDLEN	5	/* tag name must be at least 5 chars */
-/* #define NMEA_PROTO_MINLEN 6 * min chars in sentence, excluding CS UNUSED */
-#define NMEA_PROTO_MAXLEN	80	/* max chars in sentence, excluding CS */
-#define NMEA_PROTO_FIELDS	32	/* not official; limit on fields per record */
-
 /*
  * We check the timecode format and decode its contents.  We only care
  * about a few of them, the most important being the $GPRMC format:
@@ -170,7 +166,8 @@
  */
 #define NMEA_GPZDG	4
 #define NMEA_PGRMF	5
-#define NMEA_ARRAY_SIZE (NMEA_PGRMF + 1)
+#define NMEA_PUBX	6	/* u-blox $PUBX,04 time of day */
+#define NMEA_ARRAY_SIZE (NMEA_PUBX + 1)
 
 /*
  * Sentence selection mode bits
@@ -180,33 +177,7 @@
 #define USE_GPGLL		0x00000004u
 #define USE_GPZDA		0x00000008u
 #define USE_PGRMF		0x00000100u
-
-/* mapping from sentence index to controlling mode bit */
-static const uint32_t sentence_mode[NMEA_ARRAY_SIZE] =
-{
-	USE_GPRMC,
-	USE_GPGGA,
-	USE_GPGLL,
-	USE_GPZDA,
-	USE_GPZDA,
-	USE_PGRMF
-};
-
-/* date formats we support */
-enum date_fmt {
-	DATE_1_DDMMYY,	/* use 1 field	with 2-digit year */
-	DATE_3_DDMMYYYY	/* use 3 fields with 4-digit year */
-};
-
-/* results for 'field_init()'
- *
- * Note: If a checksum is present, the checksum test must pass OK or the
- * sentence is tagged invalid.
- */
-#define CHECK_EMPTY  -1	/* no data			*/
-#define CHECK_INVALID 0	/* not a valid NMEA sentence	*/
-#define CHECK_VALID   1	/* valid but without checksum	*/
-#define CHECK_CSVALID 2	/* valid with checksum OK	*/
+#define USE_PUBX		0x00000200u
 
 /*
  * Unit control structure
@@ -239,14 +210,15 @@ typedef struct {
 } nmea_unit;
 
 /*
- * helper for faster field access
+ * What a sentence decoder makes of a sentence
  */
 typedef struct {
-	char  *base;	/* buffer base		*/
-	char  *cptr;	/* current field ptr	*/
-	int    blen;	/* buffer length	*/
-	int    cidx;	/* current field index	*/
-} nmea_data;
+	struct calendar date;	/* to keep & convert the time stamp */
+	struct timespec tofs;	/* offset to full-second reftime */
+	uint8_t		leap;	/* sync status */
+	bool		rc_date;	/* date is good */
+	bool		rc_time;	/* time is good */
+} nmea_fix;
 
 /*
  * The GPS week time scale starts on Sunday, 1980-01-06. We need the
@@ -273,18 +245,50 @@ static	void	nmea_control	(int, const struct refclockstat *,
 #endif /* HAVE_PPSAPI */
 static	void	nmea_timer	(int, struct peer *);
 
-/* parsing helpers */
-static int	field_init	(nmea_data * data, char * cp, int len);
-static char *	field_parse	(nmea_data * data, int fn);
-static void	field_wipe	(nmea_data * data, ...);
-static uint8_t	parse_qual	(nmea_data * data, int idx,
-				 char tag, int inv);
-static bool	parse_time	(struct calendar * jd, long * nsec,
-				 nmea_data *, int idx);
-static bool	parse_date	(struct calendar *jd, nmea_data*,
-				 int idx, enum date_fmt fmt);
-static bool	parse_weekdata	(gps_weektm *, nmea_data *,
-				 int weekidx, int timeidx, int leapidx);
+/* sentence decoders */
+static void	decode_rmc	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_gga	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_gll	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_zda	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_zdg	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_pgrmf	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+static void	decode_pubx	(nmea_fix *, const nmea_sentence *,
+				 nmea_unit *, uint32_t);
+
+/*
+ * The sentences we use, by sentence index.  A sentence is known by its
+ * name past the talker id, so $GLGGA counts as well as $GPGGA, and for
+ * $PUBX by its message id in field 1 as well.  With flag4 set, the
+ * fields listed under wipe, and the checksum, are hidden in the last
+ * timecode.
+ */
+static const struct {
+	const char *	name;		/* name, past the talker id */
+	int		talker;		/* length of the talker id */
+	const char *	msgid;		/* field 1, or NULL */
+	uint32_t	mode;		/* controlling mode bit */
+	void		(*decode)(nmea_fix *, const nmea_sentence *,
+				  nmea_unit *, uint32_t);
+	int		wipe[5];	/* fields to hide, 0-terminated */
+} sentences[NMEA_ARRAY_SIZE] = {
+	[NMEA_GPRMC] = { "RMC",   2, NULL, USE_GPRMC, decode_rmc,
+			 { 3, 4, 5, 6, 0 } },
+	[NMEA_GPGGA] = { "GGA",   2, NULL, USE_GPGGA, decode_gga,
+			 { 2, 4, 0 } },
+	[NMEA_GPGLL] = { "GLL",   2, NULL, USE_GPGLL, decode_gll,
+			 { 1, 3, 0 } },
+	[NMEA_GPZDA] = { "ZDA",   2, NULL, USE_GPZDA, decode_zda, { 0 } },
+	[NMEA_GPZDG] = { "ZDG",   2, NULL, USE_GPZDA, decode_zdg, { 0 } },
+	[NMEA_PGRMF] = { "PGRMF", 0, NULL, USE_PGRMF, decode_pgrmf,
+			 { 6, 8, 0 } },
+	[NMEA_PUBX]  = { "PUBX",  0, "04", USE_PUBX,  decode_pubx, { 0 } },
+};
 
 static void     save_ltc        (struct refclockproc * const, const char * const,
 				 size_t);
@@ -842,40 +846,33 @@ nmea_receive(
 	nmea_unit	    * const up = (nmea_unit*)pp->unitptr;
 
 	/* Use these variables to hold data until we decide its worth keeping */
-	nmea_data rdata;
+	nmea_sentence rdata;
 	char 	  rd_lastcode[BMAX];
 	l_fp 	  rd_timestamp, rd_reftime;
 	int	  rd_lencode;
 	double	  rd_fudge;
 
 	/* working stuff */
-	struct calendar date;	/* to keep & convert the time stamp */
-	struct timespec tofs;	/* offset to full-second reftime */
-	gps_weektm      gpsw;	/* week time storage */
-	/* results of sentence/date/time parsing */
-	uint8_t		sentence;	/* sentence tag */
+	nmea_fix	fix;		/* date, time and status */
+	const char *	cp;
+	size_t		len;
+	int		sentence;	/* sentence tag */
 	int		checkres;
-	char *		cp;
-	bool		rc_date;
-	bool		rc_time;
+	int		i;
 
 	/* make sure data has defined pristine state */
-	ZERO(tofs);
-	ZERO(date);
-	ZERO(gpsw);
-	sentence = 0;
-	rc_date = false;
-	rc_time = false;
+	ZERO(fix);
 	/*
-	 * Read the timecode and timestamp, then initialise field
-	 * processing. The <CR><LF> at the NMEA line end is translated
-	 * to <LF><LF> by the terminal input routines on most systems,
-	 * and this gives us one spurious empty read per record which we
-	 * better ignore silently.
+	 * Read the timecode and timestamp, then split it into fields.
+	 * The <CR><LF> at the NMEA line end is translated to <LF><LF>
+	 * by the terminal input routines on most systems, and this
+	 * gives us one spurious empty read per record which we better
+	 * ignore silently.
 	 */
 	rd_lencode = refclock_gtlin(rbufp, rd_lastcode,
 				    sizeof(rd_lastcode), &rd_timestamp);
-	checkres = field_init(&rdata, rd_lastcode, rd_lencode);
+	checkres = nmea_split(&rdata, rd_lastcode,
+			      (rd_lencode > 0) ? (size_t)rd_lencode : 0);
 	switch (checkres) {
 
 	case CHECK_INVALID:
@@ -898,25 +895,19 @@ nmea_receive(
 	/*
 	 * --> below this point we have a valid NMEA sentence <--
 	 *
-	 * Check sentence name. Skip first 2 chars (talker ID) in most
-	 * cases, to allow for $GLGGA and $GPGGA etc. Since the name
-	 * field has at least 5 chars we can simply shift the field
-	 * start.
+	 * Look the sentence name up, past the talker id in most cases,
+	 * to allow for $GLGGA and $GPGGA etc.
 	 */
-	cp = field_parse(&rdata, 0);
-	if      (strncmp(cp + 2, "RMC,", 4) == 0) {
-		sentence = NMEA_GPRMC;
-	} else if (strncmp(cp + 2, "GGA,", 4) == 0) {
-		sentence = NMEA_GPGGA;
-	} else if (strncmp(cp + 2, "GLL,", 4) == 0) {
-		sentence = NMEA_GPGLL;
-	} else if (strncmp(cp + 2, "ZDA,", 4) == 0) {
-		sentence = NMEA_GPZDA;
-	} else if (strncmp(cp + 2, "ZDG,", 4) == 0) {
-		sentence = NMEA_GPZDG;
-	} else if (strncmp(cp,   "PGRMF,", 6) == 0) {
-		sentence = NMEA_PGRMF;
-	} else {
+	cp = nmea_field(&rdata, 0, &len);
+	for (sentence = 0; sentence < NMEA_ARRAY_SIZE; sentence++) {
+		i = sentences[sentence].talker;
+		if (len == i + strlen(sentences[sentence].name) &&
+		    !memcmp(cp + i, sentences[sentence].name, len - i) &&
+		    (NULL == sentences[sentence].msgid ||
+		     nmea_field_is(&rdata, 1, sentences[sentence].msgid)))
+			break;
+	}
+	if (NMEA_ARRAY_SIZE == sentence) {
 		return;	/* not something we know about */
 	}
 
@@ -924,13 +915,12 @@ nmea_receive(
 	if (peer->cfg.mode & NMEA_DELAYMEAS_MASK) {
 		mprintf_clock_stats(peer, "delay %0.6f %.*s",
 			 ldexp(lfpfrac(rd_timestamp), -32),
-			 (int)(strchr(rd_lastcode, ',') - rd_lastcode),
-			 rd_lastcode);
+			 (int)len + 1, rd_lastcode);
 	}
 
 	/* See if I want to process this message type */
 	if ((peer->cfg.mode & NMEA_MESSAGE_MASK) &&
-	    !(peer->cfg.mode & sentence_mode[sentence])) {
+	    !(peer->cfg.mode & sentences[sentence].mode)) {
 		up->tally.filtered++;
 		return;
 	}
@@ -979,78 +969,23 @@ nmea_receive(
 	 * Grab fields depending on clock string type and possibly wipe
 	 * sensitive data from the last timecode.
 	 */
-	switch (sentence) {
-
-	case NMEA_GPRMC:
-		/* Check quality byte, fetch data & time */
-		rc_time	 = parse_time(&date, &tofs.tv_nsec, &rdata, 1);
-		pp->leap = parse_qual(&rdata, 2, 'A', 0);
-		rc_date	 = parse_date(&date, &rdata, 9, DATE_1_DDMMYY)
-			&& unfold_century(&date, lfpuint(rd_timestamp));
-		if (CLK_FLAG4 & pp->sloppyclockflag)
-			field_wipe(&rdata, 3, 4, 5, 6, -1);
-		break;
-
-	case NMEA_GPGGA:
-		/* Check quality byte, fetch time only */
-		rc_time	 = parse_time(&date, &tofs.tv_nsec, &rdata, 1);
-		pp->leap = parse_qual(&rdata, 6, '0', 1);
-		rc_date	 = unfold_day(&date, lfpuint(rd_timestamp));
-		if (CLK_FLAG4 & pp->sloppyclockflag)
-			field_wipe(&rdata, 2, 4, -1);
-		break;
-
-	case NMEA_GPGLL:
-		/* Check quality byte, fetch time only */
-		rc_time	 = parse_time(&date, &tofs.tv_nsec, &rdata, 5);
-		pp->leap = parse_qual(&rdata, 6, 'A', 0);
-		rc_date	 = unfold_day(&date, lfpuint(rd_timestamp));
-		if (CLK_FLAG4 & pp->sloppyclockflag)
-			field_wipe(&rdata, 1, 3, -1);
-		break;
-
-	case NMEA_GPZDA:
-		/* No quality.	Assume best, fetch time & full date */
-		pp->leap = LEAP_NOWARNING;
-		rc_time	 = parse_time(&date, &tofs.tv_nsec, &rdata, 1);
-		rc_date	 = parse_date(&date, &rdata, 2, DATE_3_DDMMYYYY);
-		break;
-
-	case NMEA_GPZDG:
-		/* Check quality byte, fetch time & full date */
-		rc_time	 = parse_time(&date, &tofs.tv_nsec, &rdata, 1);
-		rc_date	 = parse_date(&date, &rdata, 2, DATE_3_DDMMYYYY);
-		pp->leap = parse_qual(&rdata, 4, '0', 1);
-		tofs.tv_sec = -1; /* GPZDG is following second */
-		break;
-
-	case NMEA_PGRMF:
-		/* get date, time, qualifier and GPS weektime. We need
-		 * date and time-of-day for the century fix, so we read
-		 * them first.
-		 */
-		rc_date  = parse_weekdata(&gpsw, &rdata, 1, 2, 5)
-		        && parse_date(&date, &rdata, 3, DATE_1_DDMMYY);
-		rc_time  = parse_time(&date, &tofs.tv_nsec, &rdata, 4);
-		pp->leap = parse_qual(&rdata, 11, '0', 1);
-		rc_date  = rc_date
-		        && gpsfix_century(&date, &gpsw, &up->century_cache);
-		if (CLK_FLAG4 & pp->sloppyclockflag)
-			field_wipe(&rdata, 6, 8, -1);
-		break;
-
-	default:
-		INVARIANT(0);	/* Coverity 97123 */
-		return;
+	sentences[sentence].decode(&fix, &rdata, up,
+				   lfpuint(rd_timestamp));
+	pp->leap = fix.leap;
+	if ((CLK_FLAG4 & pp->sloppyclockflag) &&
+	    sentences[sentence].wipe[0]) {
+		for (i = 0; sentences[sentence].wipe[i]; i++)
+			nmea_wipe(&rdata, sentences[sentence].wipe[i]);
+		nmea_wipe(&rdata, NMEA_CKSUM);
 	}
 
 	/* Check sanity of time-of-day. */
-	if (!rc_time) {	/* no time or conversion error? */
+	if (!fix.rc_time) {	/* no time or conversion error? */
 		checkres = CEVNT_BADTIME;
 		up->tally.malformed++;
 	}
 	/* Check sanity of date. */
-	else if (!rc_date) {/* no date or conversion error? */
+	else if (!fix.rc_date) {/* no date or conversion error? */
 		checkres = CEVNT_BADDATE;
 		up->tally.malformed++;
 	}
@@ -1070,8 +1005,8 @@ nmea_receive(
 
 	DPRINT(1, ("%s effective timecode: %04u-%02u-%02u %02d:%02d:%02d\n",
 		   refclock_name(peer),
-		   date.year, date.month, date.monthday,
-		   date.hour, date.minute, date.second));
+		   fix.date.year, fix.date.month, fix.date.monthday,
+		   fix.date.hour, fix.date.minute, fix.date.second));
 
 	/* Check if we must enter GPS time mode; log so if we do */
 	if (!up->gps_time && (sentence == NMEA_GPZDG)) {
@@ -1087,7 +1022,7 @@ nmea_receive(
 	 * timecode timestamp, but only if the PPS is not in control.
 	 * Discard sentence if reference time did not change.
 	 */
-	rd_reftime = eval_gps_time(refclock_name(peer), &date, &tofs,
+	rd_reftime = eval_gps_time(refclock_name(peer), &fix.date, &fix.tofs,
 				   (peer->cfg.mode & NMEA_DATETRUST_MASK), &up->epoch_warp, &rd_timestamp);
 	if (up->last_reftime == rd_reftime) {
 		/* Do not touch pp->a_lastcode on purpose! */
@@ -1317,390 +1252,141 @@ gps_send(
 
 /*
  * -------------------------------------------------------------------
- * helpers for faster field splitting
+ * SENTENCE DECODERS
  * -------------------------------------------------------------------
  *
- * set up a field record, check syntax and verify checksum
- *
- * format is $XXXXX,1,2,3,4*ML
- *
- * 8-bit XOR of characters between $ and * noninclusive is transmitted
- * in last two chars M and L holding most and least significant nibbles
- * in hex representation such as:
- *
- *   $GPGLL,5057.970,N,00146.110,E,142451,A*27
- *   $GPVTG,089.0,T,,,15.2,N,,*7F
- *
- * Some other constraints:
- * + The field name must at least 5 upcase characters or digits and must
- *   start with a character.
- * + The checksum (if present) must be uppercase hex digits.
- * + The length of a sentence is limited to 80 characters (not including
- *   the final CR/LF nor the checksum, but including the leading '$')
- *
- * Return values:
- *  + CHECK_INVALID
- *	The data does not form a valid NMEA sentence or a checksum error
- *	occurred.
- *  + CHECK_VALID
- *	The data is a valid NMEA sentence but contains no checksum.
- *  + CHECK_CSVALID
- *	The data is a valid NMEA sentence and passed the checksum test.
- * -------------------------------------------------------------------
+ * Each takes the date, the time of day and the sync status from a
+ * split sentence of its kind, filling in what the sentence leaves out
+ * of the date from the receive time, rec_ui.
  */
-static int
-field_init(
-	nmea_data * data,	/* context structure		       */
-	char 	  * cptr,	/* start of raw data		       */
-	int	    dlen	/* data len, not counting trailing NUL */
+
+/* $GPRMC: check quality byte, fetch data & time */
+static void
+decode_rmc(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	uint8_t cs_l;	/* checksum local computed	*/
-	uint8_t cs_r;	/* checksum remote given	*/
-	char * eptr;	/* buffer end end pointer	*/
-	char   tmp;	/* char buffer 			*/
-
-	cs_l = 0;
-	cs_r = 0;
-	/* some basic input constraints */
-	if (dlen < 0) {
-		dlen = 0;
-	}
-	eptr = cptr + dlen;
-	*eptr = '\0';
-
-	/* load data context */
-	data->base = cptr;
-	data->cptr = cptr;
-	data->cidx = 0;
-	data->blen = dlen;
-
-	/* syntax check follows here. check allowed character
-	 * sequences, updating the local computed checksum as we go.
-	 *
-	 * regex equiv: '^\$[A-Z][A-Z0-9]{4,}[^*]*(\*[0-9A-F]{2})?$'
-	 */
-
-	/* -*- start character: '^\$' */
-	if (*cptr == '\0') {
-		return CHECK_EMPTY;
-	}
-	if (*cptr++ != '$') {
-		return CHECK_INVALID;
-	}
-
-	/* -*- advance context beyond start character */
-	data->base++;
-	data->cptr++;
-	data->blen--;
-
-	/* -*- field name: '[A-Z][A-Z0-9]{4,},' */
-	if (*cptr < 'A' || *cptr > 'Z') {
-		return CHECK_INVALID;
-	}
-	cs_l ^= *cptr++;
-	while ((*cptr >= 'A' && *cptr <= 'Z') ||
-	       (*cptr >= '0' && *cptr <= '9')  )
-		cs_l ^= *cptr++;
-	if (*cptr != ',' || (cptr - data->base) < NMEA_PROTO_IDLEN) {
-		return CHECK_INVALID;
-}
-	cs_l ^= *cptr++;
-
-	/* -*- data: '[^*]*' */
-	while (*cptr && *cptr != '*')
-		cs_l ^= *cptr++;
-
-	/* -*- checksum field: (\*[0-9A-F]{2})?$ */
-	if (*cptr == '\0') {
-		return CHECK_VALID;
-}
-	if (*cptr != '*' || cptr != eptr - 3 ||
-	    (cptr - data->base) >= NMEA_PROTO_MAXLEN) {
-		return CHECK_INVALID;
+	UNUSED_ARG(up);
+	fix->rc_time = nmea_time(s, 1, &fix->date, &fix->tofs.tv_nsec);
+	fix->leap    = nmea_qual(s, 2, 'A', false);
+	fix->rc_date = nmea_date(s, 9, false, &fix->date)
+		    && unfold_century(&fix->date, rec_ui);
 }
 
-	for (cptr++; (tmp = *cptr) != '\0'; cptr++) {
-		if (tmp >= '0' && tmp <= '9') {
-			cs_r = (cs_r << 4) + (tmp - '0');
-		} else if (tmp >= 'A' && tmp <= 'F') {
-			cs_r = (cs_r << 4) + (tmp - 'A' + 10);
-		} else {
-			break;
-}
-	}
-
-	/* -*- make sure we are at end of string and csum matches */
-	if (cptr != eptr || cs_l != cs_r)
-		return CHECK_INVALID;
-
-	return CHECK_CSVALID;
-}
-
-/*
- * -------------------------------------------------------------------
- * fetch a data field by index, zero being the name field. If this
- * function is called repeatedly with increasing indices, the total load
- * is O(n), n being the length of the string; if it is called with
- * decreasing indices, the total load is O(n^2). Try not to go backwards
- * too often.
- * -------------------------------------------------------------------
- */
-static char *
-field_parse(
-	nmea_data * data,
-	int 	    fn
+/* $GPGGA: check quality byte, fetch time only */
+static void
+decode_gga(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	char tmp;
-
-	if (fn < data->cidx) {
-		data->cidx = 0;
-		data->cptr = data->base;
-	}
-	while ((fn > data->cidx) && (tmp = *data->cptr) != '\0') {
-		data->cidx += (tmp == ',');
-		data->cptr++;
-	}
-	return data->cptr;
+	UNUSED_ARG(up);
+	fix->rc_time = nmea_time(s, 1, &fix->date, &fix->tofs.tv_nsec);
+	fix->leap    = nmea_qual(s, 6, '0', true);
+	fix->rc_date = unfold_day(&fix->date, rec_ui);
 }
 
-/*
- * -------------------------------------------------------------------
- * Wipe (that is, overwrite with '_') data fields and the checksum in
- * the last timecode.  The list of field indices is given as integers
- * in a varargs list, preferably in ascending order, in any case
- * terminated by a negative field index.
- *
- * A maximum number of 8 fields can be overwritten at once to guard
- * against runaway (that is, unterminated) argument lists.
- *
- * This function affects what a remote user can see with
- *
- * ntpq -c clockvar <server>
- *
- * Note that this also removes the wiped fields from any clockstats
- * log.	 Some NTP operators monitor their NMEA GPS using the change in
- * location in clockstats over time as as a proxy for the quality of
- * GPS reception and thereby time reported.
- * -------------------------------------------------------------------
- */
+/* $GPGLL: check quality byte, fetch time only */
 static void
-field_wipe(
-	nmea_data * data,
-	...
+decode_gll(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	va_list	va;		/* vararg index list */
-	int	fcnt;		/* safeguard against runaway arglist */
-	int	fidx;		/* field to nuke, or -1 for checksum */
-	char  * cp;		/* overwrite destination */
-
-	fcnt = 8;
-	cp = NULL;
-	va_start(va, data);
-	do {
-		fidx = va_arg(va, int);
-		if (fidx >= 0 && fidx <= NMEA_PROTO_FIELDS) {
-			cp = field_parse(data, fidx);
-		} else {
-			cp = data->base + data->blen;
-			if (data->blen >= 3 && cp[-3] == '*') {
-				cp -= 2;
-			}
-		}
-		for ( ; '\0' != *cp && '*' != *cp && ',' != *cp; cp++) {
-			if ('.' != *cp) {
-				*cp = '_';
-			}
-		}
-	} while (fcnt-- && fidx >= 0);
-	va_end(va);
+	UNUSED_ARG(up);
+	fix->rc_time = nmea_time(s, 5, &fix->date, &fix->tofs.tv_nsec);
+	fix->leap    = nmea_qual(s, 6, 'A', false);
+	fix->rc_date = unfold_day(&fix->date, rec_ui);
 }
 
-/*
- * -------------------------------------------------------------------
- * PARSING HELPERS
- * -------------------------------------------------------------------
- *
- * Check sync status
- *
- * If the character at the data field start matches the tag value,
- * return LEAP_NOWARNING and LEAP_NOTINSYNC otherwise. If the 'inverted'
- * flag is given, just the opposite value is returned. If there is no
- * data field (*cp points to the NUL byte) the result is LEAP_NOTINSYNC.
- * -------------------------------------------------------------------
- */
-static uint8_t
-parse_qual(
-	nmea_data * rd,
-	int         idx,
-	char        tag,
-	int         inv
+/* $GPZDA: no quality.  Assume best, fetch time & full date */
+static void
+decode_zda(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	static const uint8_t table[2] =
-				{ LEAP_NOTINSYNC, LEAP_NOWARNING };
-	char * dp;
-
-	dp = field_parse(rd, idx);
-
-	return table[ *dp && ((*dp == tag) == !inv) ];
+	UNUSED_ARG(up);
+	UNUSED_ARG(rec_ui);
+	fix->leap    = LEAP_NOWARNING;
+	fix->rc_time = nmea_time(s, 1, &fix->date, &fix->tofs.tv_nsec);
+	fix->rc_date = nmea_date(s, 2, true, &fix->date);
 }
 
-/*
- * -------------------------------------------------------------------
- * Parse a time stamp in HHMMSS[.sss] format with error checking.
- *
- * returns true on success, false on failure
- * -------------------------------------------------------------------
- */
-static bool
-parse_time(
-	struct calendar * jd,	/* result calendar pointer */
-	long		* ns,	/* storage for nsec fraction */
-	nmea_data       * rd,
-	int		  idx
+/* $GPZDG: check quality byte, fetch time & full date */
+static void
+decode_zdg(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	static const unsigned long weight[4] = {
-		0, 100000000, 10000000, 1000000
-	};
-
-	int	rc;
-	unsigned int	h;
-	unsigned int	m;
-	unsigned int	s;
-	int	p1;
-	int	p2;
-	unsigned long	f;
-	char  * dp;
-
-	dp = field_parse(rd, idx);
-	rc = sscanf(dp, "%2u%2u%2u%n.%3lu%n", &h, &m, &s, &p1, &f, &p2);
-	if (rc < 3 || p1 != 6) {
-		DPRINT(1, ("nmea: invalid time code: '%.6s'\n", dp));
-		return false;
-	}
-
-	/* value sanity check */
-	if (h > 23 || m > 59 || s > 60) {
-		DPRINT(1, ("nmea: invalid time spec %02u:%02u:%02u\n",
-			   h, m, s));
-		return false;
-	}
-
-	jd->hour   = (uint8_t)h;
-	jd->minute = (uint8_t)m;
-	jd->second = (uint8_t)s;
-	/* if we have a fraction, scale it up to nanoseconds. */
-	if (rc == 4) {
-		*ns = (long)(f * weight[p2 - p1 - 1]);
-	} else {
-		*ns = 0;
-}
-
-	return true;
+	UNUSED_ARG(up);
+	UNUSED_ARG(rec_ui);
+	fix->rc_time = nmea_time(s, 1, &fix->date, &fix->tofs.tv_nsec);
+	fix->rc_date = nmea_date(s, 2, true, &fix->date);
+	fix->leap    = nmea_qual(s, 4, '0', true);
+	fix->tofs.tv_sec = -1; /* GPZDG is following second */
 }
 
 /*
- * -------------------------------------------------------------------
- * Parse a date string from an NMEA sentence. This could either be a
- * partial date in DDMMYY format in one field, or DD,MM,YYYY full date
- * spec spanning three fields. This function does some extensive error
- * checking to make sure the date string was consistent.
- *
- * returns true on success, false on failure
- * -------------------------------------------------------------------
+ * $PGRMF: get date, time, qualifier and GPS weektime. We need date and
+ * time-of-day for the century fix, so we read them first.
  */
-static bool
-parse_date(
-	struct calendar * jd,	/* result pointer */
-	nmea_data       * rd,
-	int		  idx,
-	enum date_fmt	  fmt
+static void
+decode_pgrmf(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	int		rc;
-	unsigned int	y;
-	unsigned int	m;
-	unsigned int	d;
-	int		p;
-	char  	      * dp;
-
-	dp = field_parse(rd, idx);
-	switch (fmt) {
-
-	case DATE_1_DDMMYY:
-		rc = sscanf(dp, "%2u%2u%2u%n", &d, &m, &y, &p);
-		if (rc != 3 || p != 6) {
-			DPRINT(1, ("nmea: invalid date code: '%.6s'\n",
-				   dp));
-			return false;
-		}
-		break;
-
-	case DATE_3_DDMMYYYY:
-		rc = sscanf(dp, "%2u,%2u,%4u%n", &d, &m, &y, &p);
-		if (rc != 3 || p != 10) {
-			DPRINT(1, ("nmea: invalid date code: '%.10s'\n",
-				   dp));
-			return false;
-		}
-		break;
+	gps_weektm	gpsw;
 
-	default:
-		DPRINT(1, ("nmea: invalid parse format: %u\n", fmt));
-		return false;
-	}
-
-	/* value sanity check */
-	if (d < 1 || d > 31 || m < 1 || m > 12) {
-		DPRINT(1, ("nmea: invalid date spec (YMD) %04u:%02u:%02u\n",
-			   y, m, d));
-		return false;
-	}
-
-	/* store results */
-	jd->monthday = (uint8_t)d;
-	jd->month    = (uint8_t)m;
-	jd->year     = (unsigned short)y;
-
-	return true;
+	UNUSED_ARG(rec_ui);
+	ZERO(gpsw);
+	fix->rc_date = nmea_weekdata(s, 1, 2, 5, &gpsw)
+		    && nmea_date(s, 3, false, &fix->date);
+	fix->rc_time = nmea_time(s, 4, &fix->date, &fix->tofs.tv_nsec);
+	fix->leap    = nmea_qual(s, 11, '0', true);
+	fix->rc_date = fix->rc_date
+		    && gpsfix_century(&fix->date, &gpsw, &up->century_cache);
 }
 
 /*
- * -------------------------------------------------------------------
- * Parse GPS week time info from an NMEA sentence. This info contains
- * the GPS week number, the GPS time-of-week and the leap seconds GPS
- * to UTC.
- *
- * returns true on success, false on failure
- * -------------------------------------------------------------------
+ * $PUBX,04: u-blox time of day, fetch time & date.  There is no fix
+ * status; the receiver marks the leap seconds in field 6 with a 'D'
+ * while it has them from its firmware rather than from the sky, and
+ * until then its UTC may be off by whole seconds.
  */
-static bool
-parse_weekdata(
-	gps_weektm * wd,
-	nmea_data  * rd,
-	int          weekidx,
-	int          timeidx,
-	int          leapidx
+static void
+decode_pubx(
+	nmea_fix *		fix,
+	const nmea_sentence *	s,
+	nmea_unit *		up,
+	uint32_t		rec_ui
 	)
 {
-	unsigned long secs;
-	int    fcnt;
-
-	/* parse fields and count success */
-	fcnt  = sscanf(field_parse(rd, weekidx), "%hu", &wd->wt_week);
-	fcnt += sscanf(field_parse(rd, timeidx), "%lu", &secs);
-	fcnt += sscanf(field_parse(rd, leapidx), "%hd", &wd->wt_leap);
-	if (fcnt != 3 || wd->wt_week >= 1024 || secs >= 7*SECSPERDAY) {
-		DPRINT(1, ("nmea: parse_weekdata: invalid weektime spec\n"));
-		return false;
-	}
-	wd->wt_time = (uint32_t)secs;
-
-	return true;
+	const char *	cp;
+	size_t		len;
+
+	UNUSED_ARG(up);
+	fix->rc_time = nmea_time(s, 2, &fix->date, &fix->tofs.tv_nsec);
+	fix->rc_date = nmea_date(s, 3, false, &fix->date)
+		    && unfold_century(&fix->date, rec_ui);
+	cp = nmea_field(s, 6, &len);
+	fix->leap = (len && 'D' != cp[len - 1]) ? LEAP_NOWARNING
+						: LEAP_NOTINSYNC;
 }
 
 // end
@@ -215,7 +215,7 @@ pps_timer(
 	 * That's so we can make awesome Allan deviation plots.
 	 */
 	if (pp->sloppyclockflag & CLK_FLAG4) {
-		mprintf_clock_stats(peer, "%.9f", pp->filter[pp->coderecv]);
+		mprintf_clock_stats(peer, "%.9f", pp->filter[pp->coderecv].offset);
 	}
 }
 
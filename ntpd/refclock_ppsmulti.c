@@ -0,0 +1,406 @@
+/*
+ * refclock_ppsmulti - clock driver combining several 1-pps signals
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "ntpd.h"
+#include "ntp_io.h"
+#include "ntp_refclock.h"
+#include "ntp_stdlib.h"
+#include "timespecops.h"
+
+/*
+ * This driver requires the PPSAPI interface (RFC 2783)
+ */
+#include "ppsapi_timepps.h"
+#include "refclock_pps.h"
+
+/*
+ * This driver reads the pulse-per-second signals of several devices,
+ * such as a rack of GPS receivers with their PPS outputs wired to one
+ * host, and makes one sample a second of them.  Configured as one pps
+ * driver each, the receivers would be as many sources whose errors
+ * are not independent, and a receiver gone wrong would still be
+ * offered to the selection algorithm every second.
+ *
+ * Once a second each device is asked for its latest edge, as the pps
+ * driver does.  The edges of one second have to be within half a
+ * second of the latest of them, or they are left out as late.  Those
+ * further from their median than the others bear out are rejected
+ * (see refsample_combine()), and the mean of the rest is the sample.
+ * A second in which the devices cannot agree gives no sample.
+ *
+ * Driver options
+ *
+ * The devices are listed in the ppspath option, separated by commas;
+ * with no ppspath the driver reads /dev/pps%d of its unit number
+ * alone.  time2 sets how far in seconds the edges may be
+ * apart before they are sorted out, 10 us by default.  flag2 is as for
+ * the pps driver and applies to all the devices.  flag3 binds the first
+ * device alone to the kernel PPS discipline, which can follow only one
+ * PPS signal; the others would take it over in turn.  If flag4 is
+ * lit, each combined offset is recorded to clockstats with the number
+ * of devices used.  The time1 parameter compensates for delays common
+ * to all the devices.
+ */
+/*
+ * Interface definitions
+ */
+#define DEVICE		"/dev/pps%d"	/* device name and unit */
+#define	PRECISION	(-30)		/* precision assumed (about 1 ns) */
+#define	REFID		"PPS\0"		/* reference ID */
+#define	NAME		"PPSMULTI"	/* shortname */
+#define	DESCRIPTION	"Combined PPS Signals" /* WRU */
+#define	MAXINPUT	16		/* devices at most */
+#define	GATE		10e-6		/* default disagreement passed (s) */
+#define	LENSTATS	160		/* length of the statistics of a device */
+
+/*
+ * One PPS device, and what became of its edges since the last poll
+ */
+struct ppsinput {
+	struct refclock_ppsctl ppsctl; /* PPS context structure */
+	char	*path;		/* device name */
+	int	fddev;		/* file descriptor */
+	int	edges;		/* edges fetched */
+	int	used;		/* edges in the combined sample */
+	int	missed;		/* seconds with no new edge */
+	double	dsum;		/* sum of the offsets of the used edges */
+	double	dsumsq;		/* ... and of their squares, from the
+				 * combined sample */
+	char	stats[LENSTATS]; /* the statistics of the last poll */
+};
+
+/*
+ * PPSMULTI unit control structure
+ */
+struct ppsmultiunit {
+	int	ninput;		/* devices */
+	struct ppsinput input[MAXINPUT];
+	int	pcount;		/* combined samples added to FIFO */
+	int	ncount;		/* seconds with no combined sample */
+};
+
+/*
+ * Function prototypes
+ */
+static	bool	ppsmulti_start	(int, struct peer *);
+static	void	ppsmulti_shutdown (struct refclockproc *);
+static	void	ppsmulti_poll	(int, struct peer *);
+static	void	ppsmulti_control (int, const struct refclockstat *,
+				  struct refclockstat *, struct peer *);
+static	void	ppsmulti_timer	(int, struct peer *);
+
+/*
+ * Transfer vector
+ */
+struct	refclock refclock_ppsmulti = {
+	NAME,			/* basename of driver */
+	ppsmulti_start,		/* start up driver */
+	ppsmulti_shutdown,	/* shut down driver */
+	ppsmulti_poll,		/* transmit poll message */
+	ppsmulti_control,	/* report the devices */
+	NULL,			/* initialize driver (not used) */
+	ppsmulti_timer,		/* called once per second */
+};
+
+
+/*
+ * ppsmulti_start - open the devices
+ */
+static bool
+ppsmulti_start(
+	int unit,		/* unit number */
+	struct peer *peer	/* peer structure pointer */
+	)
+{
+	struct refclockproc *pp;
+	struct ppsmultiunit *up;
+	struct ppsinput *in;
+	char	device[80];
+	char	*paths, *path, *last;
+
+	/*
+	 * Allocate and initialize unit structure
+	 */
+	pp = peer->procptr;
+	peer->is_pps_driver = true;
+	peer->precision = PRECISION;
+	pp->clockname = NAME;
+	pp->clockdesc = DESCRIPTION;
+	pp->stratum = STRATUM_UNSPEC;
+	memcpy((char *)&pp->refid, REFID, REFIDLEN);
+	peer->sstclktype = CTL_SST_TS_ATOM;
+	up = emalloc_zero(sizeof(struct ppsmultiunit));
+	pp->unitptr = up;
+
+	snprintf(device, sizeof(device), DEVICE, unit);
+	paths = estrdup(peer->cfg.ppspath ? peer->cfg.ppspath : device);
+	for (path = strtok_r(paths, ",", &last); path != NULL;
+	     path = strtok_r(NULL, ",", &last)) {
+		if (up->ninput == MAXINPUT) {
+			msyslog(LOG_ERR,
+			    "REFCLOCK: refclock_ppsmulti: more than %d devices",
+			    MAXINPUT);
+			free(paths);
+			return false;
+		}
+		in = &up->input[up->ninput++];
+		in->path = estrdup(path);
+		in->fddev = open(in->path, O_RDWR);
+		if (in->fddev <= 0) {
+			msyslog(LOG_ERR,
+			    "REFCLOCK: refclock_ppsmulti: %s open failed: %s",
+			    in->path, strerror(errno));
+			free(paths);
+			return false;
+		}
+
+		/*
+		 * Light up the PPSAPI interface.
+		 */
+		if (!refclock_ppsapi(in->fddev, &in->ppsctl)) {
+			free(paths);
+			return false;
+		}
+	}
+	free(paths);
+	return (up->ninput > 0);
+}
+
+
+/*
+ * ppsmulti_shutdown - shut down the clock
+ */
+static void
+ppsmulti_shutdown(
+	struct refclockproc *pp	/* refclock structure pointer */
+	)
+{
+	struct ppsmultiunit *up;
+	int	i;
+
+	up = pp->unitptr;
+	for (i = 0; i < up->ninput; i++) {
+		if (up->input[i].fddev > 0) {
+			close(up->input[i].fddev);
+		}
+		free(up->input[i].path);
+	}
+	free(up);
+}
+
+
+/*
+ * ppsmulti_timer - called once per second
+ */
+static void
+ppsmulti_timer(
+	int	unit,		/* unit pointer (not used) */
+	struct peer *peer	/* peer structure pointer */
+	)
+{
+	struct	ppsmultiunit *up;
+	struct	refclockproc *pp;
+	struct	ppsinput *in;
+	l_fp	stamp[MAXINPUT], latest, second;
+	double	frac[MAXINPUT], work[MAXINPUT];
+	double	offset, dtemp;
+	bool	used[MAXINPUT];
+	int	which[MAXINPUT];
+	int	i, n, kept, mode;
+
+	UNUSED_ARG(unit);
+
+	pp = peer->procptr;
+	up = pp->unitptr;
+
+	/*
+	 * Gather the new edges, then drop any more than half a second
+	 * behind the latest, from a second before the others.
+	 */
+	latest = 0;
+	n = 0;
+	for (i = 0; i < up->ninput; i++) {
+		in = &up->input[i];
+		mode = pp->sloppyclockflag;
+		if (i > 0)
+			mode &= ~CLK_FLAG3;
+		if (refclock_ppsfetch(peer, &in->ppsctl, mode, &stamp[n],
+				      &frac[n]) != PPS_OK) {
+			in->missed++;
+			continue;
+		}
+		in->edges++;
+		if (L_ISGTU(stamp[n], latest))
+			latest = stamp[n];
+		which[n++] = i;
+	}
+	kept = 0;
+	for (i = 0; i < n; i++) {
+		if (lfptod(latest - stamp[i]) > .5)
+			continue;
+		stamp[kept] = stamp[i];
+		frac[kept] = frac[i];
+		which[kept++] = which[i];
+	}
+	n = kept;
+
+	kept = refsample_combine(frac, n,
+	    pp->fudgetime2 > 0 ? pp->fudgetime2 : GATE, work, used, &offset);
+	if (kept == 0) {
+		up->ncount++;
+		return;
+	}
+	second = 0;
+	for (i = 0; i < n; i++) {
+		if (!used[i])
+			continue;
+		in = &up->input[which[i]];
+		dtemp = frac[i] - offset;
+		in->used++;
+		in->dsum += dtemp;
+		in->dsumsq += dtemp * dtemp;
+		second = stamp[i] - dtolfp(frac[i]);
+	}
+	up->pcount++;
+
+	/*
+	 * The combined edge came offset after the second the edges
+	 * mark.  Stuff that in the median filter.
+	 */
+	refclock_process_offset(pp, second, second + dtolfp(offset),
+	    pp->fudgetime1);
+	peer->cfg.flags |= FLAG_PPS;
+	DPRINT(2, ("refclock_ppsmulti: %u %f %d/%d\n", current_time,
+		   offset, kept, up->ninput));
+
+	/*
+	 * If flag4 is lit, record each second offset to clockstats.
+	 */
+	if (pp->sloppyclockflag & CLK_FLAG4) {
+		mprintf_clock_stats(peer, "%.9f %d",
+		    pp->filter[pp->coderecv].offset, kept);
+	}
+}
+
+
+/*
+ * ppsmulti_reset - start counting the edges of a poll over
+ */
+static void
+ppsmulti_reset(
+	struct ppsmultiunit *up
+	)
+{
+	struct	ppsinput *in;
+	int	i;
+
+	up->pcount = up->ncount = 0;
+	for (i = 0; i < up->ninput; i++) {
+		in = &up->input[i];
+		in->edges = in->used = in->missed = 0;
+		in->dsum = in->dsumsq = 0;
+	}
+}
+
+
+/*
+ * ppsmulti_poll - called by the transmit procedure
+ */
+static void
+ppsmulti_poll(
+	int unit,		/* unit number (not used) */
+	struct peer *peer	/* peer structure pointer */
+	)
+{
+	struct ppsmultiunit *up;
+	struct refclockproc *pp;
+	struct ppsinput *in;
+	char	buf[MAXINPUT * 24], *tt;
+	double	mean, rms;
+	int	i;
+
+	UNUSED_ARG(unit);
+
+	pp = peer->procptr;
+	up = (struct ppsmultiunit *)pp->unitptr;
+
+	/*
+	 * Don't wiggle the clock until some other driver has numbered
+	 * the seconds.
+	 */
+	if (sys_vars.sys_leap == LEAP_NOTINSYNC) {
+		pp->codeproc = pp->coderecv;
+		ppsmulti_reset(up);
+		return;
+	}
+
+	pp->polls++;
+
+	/*
+	 * Keep what became of the edges of each device for ntpq, and
+	 * log their counts: combined samples and seconds without one,
+	 * then edges and those used, device by device.
+	 */
+	tt = buf;
+	*tt = '\0';
+	for (i = 0; i < up->ninput; i++) {
+		in = &up->input[i];
+		mean = rms = 0;
+		if (in->used) {
+			mean = in->dsum / in->used;
+			rms = SQRT(in->dsumsq / in->used);
+		}
+		snprintf(in->stats, sizeof(in->stats),
+		    "%s edges=%d used=%d missed=%d bias=%.6f rms=%.6f",
+		    in->path, in->edges, in->used, in->missed,
+		    mean * MS_PER_S, rms * MS_PER_S);
+		snprintf(tt, sizeof(buf) - (size_t)(tt - buf), " %d %d",
+		    in->edges, in->used);
+		tt += strlen(tt);
+	}
+	mprintf_clock_stats(peer, "%d %d%s", up->pcount, up->ncount, buf);
+	ppsmulti_reset(up);
+
+	if (pp->codeproc == pp->coderecv) {
+		peer->cfg.flags &= ~FLAG_PPS;
+		refclock_report(peer, CEVNT_TIMEOUT);
+		return;
+	}
+	pp->lastref = pp->lastrec;
+	refclock_receive(peer);
+}
+
+
+/*
+ * ppsmulti_control - report the devices
+ */
+static void
+ppsmulti_control(
+	int unit,		/* unit number (not used) */
+	const struct refclockstat *in,
+	struct refclockstat *out,
+	struct peer *peer	/* peer structure pointer */
+	)
+{
+	struct ppsmultiunit *up;
+	char	*tt;
+	int	i;
+
+	UNUSED_ARG(unit);
+	UNUSED_ARG(in);
+
+	up = peer->procptr->unitptr;
+	if (out == NULL || up == NULL)
+		return;
+
+	for (i = 0; i < up->ninput; i++) {
+		tt = add_var(&out->kv_list, LENSTATS + 16, RO|DEF);
+		snprintf(tt, LENSTATS + 16, "pps%d=\"%s\"", i,
+		    up->input[i].stats[0] ? up->input[i].stats :
+		    up->input[i].path);
+	}
+}
@@ -1,8 +1,8 @@
 /*
  * refclock_shm - clock driver for utc via shared memory
  * - under construction -
- * To add new modes: Extend or union the shmTime-struct. Do not
- * extend/shrink size, because otherwise existing implementations
+ * To add new modes: Extend or union the shmTime-struct (ntp_shm.h).
+ * Do not extend/shrink size, because otherwise existing implementations
  * will specify wrong size of shared memory-segment
  * PB 18.3.97
  */
@@ -15,6 +15,7 @@
 #include "ntp_io.h"
 #undef fileno
 #include "ntp_refclock.h"
+#include "ntp_shm.h"
 #undef fileno
 #include "timespecops.h"
 #include "ntp_calendar.h"	/* for SECSPERHR */
@@ -28,14 +29,14 @@
 
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 
-#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
-# include <stdatomic.h>
-#endif /* HAVE_STDATOMIC_H */
-
 /*
  * This driver supports a reference clock attached through shared memory
  */
@@ -54,6 +55,7 @@
  * Mode flags
  */
 #define SHM_MODE_PRIVATE 0x0001
+#define SHM_MODE_RING    0x0002
 
 /*
  * Function prototypes
@@ -65,6 +67,8 @@ static  void    shm_timer       (int unit, struct peer *peer);
 static	void	shm_clockstats  (int unit, struct peer *peer);
 static	void	shm_control	(int unit, const struct refclockstat * in_st,
 				 struct refclockstat * out_st, struct peer *peer);
+static	int	shm_doorbell	(struct recvbuf *rbufp);
+static	void	shm_receive	(struct recvbuf *rbufp);
 
 /*
  * Transfer vector
@@ -79,31 +83,54 @@ struct  refclock refclock_shm = {
 	shm_timer,              /* once per second */
 };
 
-struct shmTime {
-	int    mode; /* 0 - if valid is set:
-		      *       use values,
-		      *       clear valid
-		      * 1 - if valid is set:
-		      *       if count before and after read of values is equal,
-		      *         use values
-		      *       clear valid
-		      */
-	volatile int    count;
-	time_t		clockTimeStampSec;
-	int		clockTimeStampUSec;
-	time_t		receiveTimeStampSec;
-	int		receiveTimeStampUSec;
-	int		leap;
-	int		precision;
-	int		nsamples;
-	volatile int    valid;
-	unsigned	clockTimeStampNSec;	/* Unsigned ns timestamps */
-	unsigned	receiveTimeStampNSec;	/* Unsigned ns timestamps */
-	int		dummy[8];
+/*
+ * With mode bit 1 set, the segment goes on after the shmTime with a
+ * ring of samples, for producers with more than one sample a second.
+ * The shmTime stays in front, so producers of modes 0 and 1 work on
+ * either kind of segment.
+ *
+ * The producer writes sample number n, counting from 0, to slot
+ * n % nslots.  It sets the seq of the slot to 2 * lap + 1, where lap is
+ * n / nslots, writes the sample, sets seq to 2 * lap + 2 and then head
+ * to n + 1, with a memory barrier between each step.  Neither side
+ * ever waits for the other; a sample overwritten before it was read is
+ * counted as lost.  ntpd sets nslots, slotsize, version and then magic
+ * when it creates the ring; the producer should not start before.
+ */
+#define SHM_RING_MAGIC		0x4e545052	/* NTPR */
+#define SHM_RING_VERSION	1
+#define SHM_RING_SLOTS		64		/* must be a power of 2 */
+
+struct shmSample {
+	volatile uint32_t seq;
+	int32_t		leap;
+	int64_t		clockTimeStampSec;
+	int64_t		receiveTimeStampSec;
+	uint32_t	clockTimeStampNSec;
+	uint32_t	receiveTimeStampNSec;
+	int32_t		precision;
+	int32_t		dummy;
+};
+
+struct shmRing {
+	volatile uint32_t magic;
+	uint32_t	version;
+	uint32_t	nslots;
+	uint32_t	slotsize;	/* sizeof(struct shmSample) */
+	volatile uint64_t head;		/* number of samples written */
+	int32_t		dummy[8];
+	struct shmSample slot[SHM_RING_SLOTS];
+};
+
+struct shmSegment {
+	struct shmTime	classic;
+	struct shmRing	ring;
 };
 
 struct shmunit {
 	struct shmTime *shm;	/* pointer to shared memory segment */
+	struct shmRing *ring;	/* its ring, if it has one */
+	uint64_t tail;		/* next sample to read from the ring */
 	int forall;		/* access for all UIDs?	*/
 
 	/* debugging/monitoring counters - reset when printed */
@@ -112,28 +139,52 @@ struct shmunit {
 	int notready;		/* number of peeks without data ready */
 	int bad;		/* number of invalid samples */
 	int clash;		/* number of access clashes while reading */
+	int lost;		/* number of ring samples overwritten unread */
+	int fresh;		/* samples found since the last tick */
+
+	/* ingestion delays of the good samples, in seconds */
+	double delay_sum;
+	double delay_max;
 
 	time_t max_delta;	/* difference limit */
 	time_t max_delay;	/* age/stale limit */
 };
 
 
+/*
+ * getShmTime - attach the segment of a unit.  If *ring, try for one with
+ * a ring; if a segment without one is in the way, settle for that and
+ * clear *ring.
+ */
 static struct shmTime*
 getShmTime(
 	int unit,
-	bool forall
+	bool forall,
+	bool *ring
 	)
 {
 	struct shmTime *p = NULL;
 
 	int shmid;
 
-	/* 0x4e545030 is NTP0.
+	/* SHM_KEY_BASE is NTP0.
 	 * Big units will give non-ascii but that's OK
 	 * as long as everybody does it the same way.
 	 */
-	shmid=shmget(0x4e545030 + unit, sizeof (struct shmTime),
-		      IPC_CREAT | (forall ? 0666 : 0600));
+	shmid = -1;
+	if (*ring) {
+		shmid = shmget(SHM_KEY_BASE + unit, sizeof(struct shmSegment),
+			       IPC_CREAT | (forall ? 0666 : 0600));
+		if (shmid == -1 && EINVAL == errno) {
+			msyslog(LOG_WARNING,
+				"REFCLOCK: SHM(%d) segment too small for a ring, remove it to get one",
+				unit);
+			*ring = false;
+		}
+	}
+	if (!*ring)
+		shmid = shmget(SHM_KEY_BASE + unit, sizeof(struct shmTime),
+			       IPC_CREAT | (forall ? 0666 : 0600));
 	if (shmid == -1) { /* error */
 		msyslog(LOG_ERR, "REFCLOCK: SHM shmget (unit %d): %s", unit, strerror(errno));
 		return NULL;
@@ -148,6 +199,85 @@ getShmTime(
 }
 
 
+/*
+ * shm_ring_init - set up the ring of a segment, unless a producer has
+ * found it set up already, and start reading at its head
+ */
+static void
+shm_ring_init(
+	struct shmunit *up
+	)
+{
+	struct shmRing *ring = &((struct shmSegment *)up->shm)->ring;
+
+	if (ring->magic != SHM_RING_MAGIC ||
+	    ring->version != SHM_RING_VERSION ||
+	    ring->nslots != SHM_RING_SLOTS ||
+	    ring->slotsize != sizeof(struct shmSample)) {
+		ring->magic = 0;
+		memory_barrier();
+		memset((void *)ring, 0, sizeof(*ring));
+		ring->version = SHM_RING_VERSION;
+		ring->nslots = SHM_RING_SLOTS;
+		ring->slotsize = sizeof(struct shmSample);
+		memory_barrier();
+		ring->magic = SHM_RING_MAGIC;
+	}
+	up->ring = ring;
+	up->tail = ring->head;
+}
+
+
+/*
+ * shm_bell_open - open the doorbell socket of a unit at path, a unix
+ * datagram socket producers can send to after each sample.  Without
+ * it, samples are fetched once a second only.
+ */
+static void
+shm_bell_open(
+	struct peer *peer,
+	const char *path,
+	bool forall
+	)
+{
+	struct refclockproc * const pp = peer->procptr;
+	struct sockaddr_un sun;
+	int fd;
+
+	ZERO(sun);
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		msyslog(LOG_ERR, "REFCLOCK: SHM doorbell path too long: %s",
+			path);
+		return;
+	}
+	strlcpy(sun.sun_path, path, sizeof(sun.sun_path));
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		msyslog(LOG_ERR, "REFCLOCK: SHM doorbell socket: %s",
+			strerror(errno));
+		return;
+	}
+	(void)unlink(path);
+	/* the I/O loop reads until there is nothing left */
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+	    bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+	    chmod(path, forall ? 0666 : 0600) < 0) {
+		msyslog(LOG_ERR, "REFCLOCK: SHM doorbell %s: %s",
+			path, strerror(errno));
+		close(fd);
+		return;
+	}
+	pp->io.fd = fd;
+	pp->io.io_input = shm_doorbell;
+	pp->io.clock_recv = shm_receive;
+	if (!io_addclock(&pp->io)) {
+		close(fd);
+		pp->io.fd = -1;
+	}
+}
+
+
 /*
  * shm_start - attach to shared memory
  */
@@ -159,6 +289,7 @@ shm_start(
 {
 	struct refclockproc * const pp = peer->procptr;
 	struct shmunit *      const up = emalloc_zero(sizeof(*up));
+	bool ring = (peer->cfg.mode & SHM_MODE_RING) != 0;
 
 	pp->io.clock_recv = NULL;
 	pp->io.srcclock = peer;
@@ -167,7 +298,7 @@ shm_start(
 
 	up->forall = (unit >= 2) && !(peer->cfg.mode & SHM_MODE_PRIVATE);
 
-	up->shm = getShmTime(unit, up->forall);
+	up->shm = getShmTime(unit, up->forall, &ring);
 
 	/*
 	 * Initialize miscellaneous peer variables
@@ -180,6 +311,10 @@ shm_start(
 		peer->precision = (int8_t)up->shm->precision;
 		up->shm->valid = 0;
 		up->shm->nsamples = NSAMPLES;
+		if (ring)
+			shm_ring_init(up);
+		if (peer->cfg.path)
+			shm_bell_open(peer, peer->cfg.path, up->forall);
 		pp->clockname = NAME;
 		pp->clockdesc = DESCRIPTION;
 		/* items to be changed later in 'shm_control()': */
@@ -243,6 +378,10 @@ shm_shutdown(
 	}
 
 	(void)shmdt((char *)up->shm);
+	if (-1 != pp->io.fd) {
+		io_closeclock(&pp->io);
+		(void)unlink(pp->io.srcclock->cfg.path);
+	}
 
 	free(up);
 }
@@ -305,12 +444,6 @@ struct shm_stat_t {
 	int leap;
 };
 
-static inline void memory_barrier(void) {
-#if defined(HAVE_STDATOMIC_H) && !defined(__COVERITY__)
-	atomic_thread_fence(memory_order_seq_cst);
-#endif /* HAVE_STDATOMIC_H */
-}
-
 static enum segstat_t shm_query(volatile struct shmTime *shm_in, struct shm_stat_t *shm_stat) {
 /* try to grab a sample from the specified SHM segment */
 	volatile struct shmTime shmcopy, *shm = shm_in;
@@ -328,13 +461,7 @@ static enum segstat_t shm_query(volatile struct shmTime *shm_in, struct shm_stat
 	}
 
 	/*@-type@*//* splint is confused about struct timespec */
-	shm_stat->tvc.tv_sec = shm_stat->tvc.tv_nsec = 0;
-	{
-		time_t now;
-
-		time(&now);
-		shm_stat->tvc.tv_sec = now;
-	}
+	clock_gettime(CLOCK_REALTIME, &shm_stat->tvc);
 
 	/* relying on word access to be atomic here */
 	if (shm->valid == 0) {
@@ -440,39 +567,172 @@ static enum segstat_t shm_query(volatile struct shmTime *shm_in, struct shm_stat
 }
 
 /*
- * shm_timer - called once every second.
- *
- * This tries to grab a sample from the SHM segment, filtering bad ones
+ * shm_sample - check a sample and feed it to the median filter.  Bad
+ * samples are logged only if log is set.
  */
 static void
-shm_timer(
+shm_sample(
 	int unit,
-	struct peer *peer
+	struct peer *peer,
+	const struct shm_stat_t *shm_stat,
+	bool log
 	)
 {
 	struct refclockproc * const pp = peer->procptr;
 	struct shmunit *      const up = pp->unitptr;
 
-	volatile struct shmTime *shm;
-
 	l_fp tsrcv;
 	l_fp tsref;
+	double delay;
 	int c;
 	time_t tt;
 
-	enum segstat_t status;
+	/*
+	 * Add POSIX UTC seconds and fractional seconds as a timecode.
+	 * We used to unpack this to calendar time, but it is bad
+	 * practice for the driver to pretend to know calendar time;
+	 * that interpretation is best left to higher levels.
+	 */
+	/* a_lastcode is seen as timecode with: ntpq -c cv [associd] */
+	c = snprintf(pp->a_lastcode, sizeof(pp->a_lastcode), "%ld.%09ld",
+		     (long)shm_stat->tvt.tv_sec, (long)shm_stat->tvt.tv_nsec);
+	pp->lencode = (c < (int)sizeof(pp->a_lastcode)) ? c : 0;
+
+	/* check 1: age control of local time stamp */
+	tt = shm_stat->tvc.tv_sec - shm_stat->tvr.tv_sec;
+	if (tt < 0 || tt > up->max_delay) {
+		DPRINT(1, ("%s:SHM(%d) stale/bad receive time, delay=%llds\n",
+			   refclock_name(peer), unit, (long long)tt));
+		up->bad++;
+		if (log)
+			msyslog (LOG_ERR,
+				 "SHM(%d): stale/bad receive time, delay=%llds",
+				 unit, (long long)tt);
+		return;
+	}
+
+	/* check 2: delta check */
+	tt = shm_stat->tvr.tv_sec - shm_stat->tvt.tv_sec - (shm_stat->tvr.tv_nsec < shm_stat->tvt.tv_nsec);
+	if (tt < 0) {
+		tt = -tt;
+	}
+	if (up->max_delta > 0 && tt > up->max_delta) {
+		DPRINT(1, ("%s: SHM(%d) diff limit exceeded, delta=%llds\n",
+			   refclock_name(peer), unit, (long long)tt));
+		up->bad++;
+		if (log)
+			msyslog (LOG_ERR,
+				 "SHM(%d): difference limit exceeded, delta=%llds\n",
+				 unit, (long long)tt);
+		return;
+	}
+
+	/* if we really made it to this point... we're winners! */
+	DPRINT(2, ("%s: SHM(%d) feeding data\n", refclock_name(peer), unit));
+	tsrcv = tspec_stamp_to_lfp(shm_stat->tvr);
+	tsref = tspec_stamp_to_lfp(shm_stat->tvt);
+	pp->leap = (uint8_t)shm_stat->leap;
+	peer->precision = (int8_t)shm_stat->precision;
+	refclock_process_offset(pp, tsref, tsrcv, pp->fudgetime1);
+	up->good++;
+
+	/* how long the sample waited for us */
+	delay = (double)lfptod(tspec_intv_to_lfp(
+		sub_tspec(shm_stat->tvc, shm_stat->tvr)));
+	up->delay_sum += delay;
+	up->delay_max = max(up->delay_max, delay);
+}
+
+/*
+ * shm_ring_drain - feed all samples the producer put in the ring since
+ * the last call.  Returns the number found, good or bad.
+ */
+static int
+shm_ring_drain(
+	int unit,
+	struct peer *peer
+	)
+{
+	struct refclockproc * const pp = peer->procptr;
+	struct shmunit *      const up = pp->unitptr;
+	struct shmRing *ring = up->ring;
+	struct shmSample sample;
 	struct shm_stat_t shm_stat;
+	uint64_t head;
+	uint32_t seq, want;
+	int found = 0;
 
-	up->ticks++;
-	if ((shm = up->shm) == NULL) {
-		/* try to map again - this may succeed if meanwhile some-
-		body has ipcrm'ed the old (unaccessible) shared mem segment */
-		shm = up->shm = getShmTime(unit, up->forall);
-		if (shm == NULL) {
-			DPRINT(1, ("%s: no SHM segment\n",refclock_name(peer)));
-			return;
+	head = ring->head;
+	memory_barrier();
+	if (head < up->tail) {
+		/* the producer started over */
+		up->tail = head;
+	} else if (head - up->tail > SHM_RING_SLOTS) {
+		up->lost += (int)(head - up->tail - SHM_RING_SLOTS);
+		up->tail = head - SHM_RING_SLOTS;
+	}
+
+	ZERO(shm_stat);
+	clock_gettime(CLOCK_REALTIME, &shm_stat.tvc);
+	for (; up->tail != head; up->tail++) {
+		struct shmSample *slot = &ring->slot[up->tail % SHM_RING_SLOTS];
+
+		found++;
+		want = 2 * (uint32_t)(up->tail / SHM_RING_SLOTS) + 2;
+		seq = slot->seq;
+		memory_barrier();
+		memcpy(&sample, (void *)slot, sizeof(sample));
+		memory_barrier();
+		if (seq != want) {
+			/* a later lap got here first */
+			up->lost++;
+			continue;
+		}
+		if (slot->seq != seq) {
+			up->clash++;
+			continue;
+		}
+		shm_stat.tvt.tv_sec = (time_t)sample.clockTimeStampSec;
+		shm_stat.tvt.tv_nsec = (long)sample.clockTimeStampNSec;
+		shm_stat.tvr.tv_sec = (time_t)sample.receiveTimeStampSec;
+		shm_stat.tvr.tv_nsec = (long)sample.receiveTimeStampNSec;
+		shm_stat.leap = sample.leap;
+		shm_stat.precision = sample.precision;
+		if (shm_stat.tvt.tv_nsec >= NS_PER_S ||
+		    shm_stat.tvr.tv_nsec >= NS_PER_S) {
+			up->bad++;
+			continue;
 		}
+		/* one complaint a second is plenty */
+		shm_sample(unit, peer, &shm_stat, found == 1);
 	}
+	return found;
+}
+
+/*
+ * shm_fetch - grab a sample from the SHM segment, filtering bad ones,
+ * and all new samples from its ring, if it has one.  On the tick of
+ * the timer, finding nothing since the last one counts as not ready.
+ */
+static void
+shm_fetch(
+	int unit,
+	struct peer *peer,
+	bool tick
+	)
+{
+	struct refclockproc * const pp = peer->procptr;
+	struct shmunit *      const up = pp->unitptr;
+
+	volatile struct shmTime *shm = up->shm;
+	int found = 0;
+
+	enum segstat_t status;
+	struct shm_stat_t shm_stat;
+
+	if (up->ring != NULL)
+		found = shm_ring_drain(unit, peer);
+	up->fresh += found;
 
 	/* query the segment, atomically */
 	status = shm_query(shm, &shm_stat);
@@ -486,6 +746,8 @@ shm_timer(
 	    /* should never happen, but is harmless */
 	    return;
 	case NOT_READY:
+	    if (!tick || up->fresh > 0)
+		return;
 	    DPRINT(1, ("%s: SHM(%d) not ready\n",refclock_name(peer), unit));
 	    up->notready++;
 	    return;
@@ -512,53 +774,72 @@ shm_timer(
 	    return;
 	}
 
+	up->fresh++;
+	shm_sample(unit, peer, &shm_stat, true);
+}
 
-	/*
-	 * Add POSIX UTC seconds and fractional seconds as a timecode.
-	 * We used to unpack this to calendar time, but it is bad
-	 * practice for the driver to pretend to know calendar time;
-	 * that interpretation is best left to higher levels.
-	 */
-	/* a_lastcode is seen as timecode with: ntpq -c cv [associd] */
-	c = snprintf(pp->a_lastcode, sizeof(pp->a_lastcode), "%ld.%09ld",
-		     (long)shm_stat.tvt.tv_sec, (long)shm_stat.tvt.tv_nsec);
-	pp->lencode = (c < (int)sizeof(pp->a_lastcode)) ? c : 0;
+/*
+ * shm_timer - called once every second.
+ */
+static void
+shm_timer(
+	int unit,
+	struct peer *peer
+	)
+{
+	struct refclockproc * const pp = peer->procptr;
+	struct shmunit *      const up = pp->unitptr;
 
-	/* check 1: age control of local time stamp */
-	tt = shm_stat.tvc.tv_sec - shm_stat.tvr.tv_sec;
-	if (tt < 0 || tt > up->max_delay) {
-		DPRINT(1, ("%s:SHM(%d) stale/bad receive time, delay=%llds\n",
-			   refclock_name(peer), unit, (long long)tt));
-		up->bad++;
-		msyslog (LOG_ERR,
-                         "SHM(%d): stale/bad receive time, delay=%llds",
-			 unit, (long long)tt);
-		return;
-	}
+	bool ring;
 
-	/* check 2: delta check */
-	tt = shm_stat.tvr.tv_sec - shm_stat.tvt.tv_sec - (shm_stat.tvr.tv_nsec < shm_stat.tvt.tv_nsec);
-	if (tt < 0) {
-		tt = -tt;
-	}
-	if (up->max_delta > 0 && tt > up->max_delta) {
-		DPRINT(1, ("%s: SHM(%d) diff limit exceeded, delta=%llds\n",
-			   refclock_name(peer), unit, (long long)tt));
-		up->bad++;
-		msyslog (LOG_ERR,
-                         "SHM(%d): difference limit exceeded, delta=%llds\n",
-			 unit, (long long)tt);
-		return;
+	up->ticks++;
+	if (up->shm == NULL) {
+		/* try to map again - this may succeed if meanwhile some-
+		body has ipcrm'ed the old (unaccessible) shared mem segment */
+		ring = (peer->cfg.mode & SHM_MODE_RING) != 0;
+		up->shm = getShmTime(unit, up->forall, &ring);
+		if (up->shm == NULL) {
+			DPRINT(1, ("%s: no SHM segment\n",refclock_name(peer)));
+			return;
+		}
+		if (ring)
+			shm_ring_init(up);
 	}
+	shm_fetch(unit, peer, true);
+	up->fresh = 0;
+}
 
-	/* if we really made it to this point... we're winners! */
-	DPRINT(2, ("%s: SHM(%d) feeding data\n", refclock_name(peer), unit));
-	tsrcv = tspec_stamp_to_lfp(shm_stat.tvr);
-	tsref = tspec_stamp_to_lfp(shm_stat.tvt);
-	pp->leap = (uint8_t)shm_stat.leap;
-	peer->precision = (int8_t)shm_stat.precision;
-	refclock_process_offset(pp, tsref, tsrcv, pp->fudgetime1);
-	up->good++;
+/*
+ * shm_doorbell - the producer rang: fetch its samples now rather than
+ * at the next second.  Only the last of a burst of rings gets here
+ * with anything to do; the others are swallowed.
+ */
+static int
+shm_doorbell(
+	struct recvbuf *rbufp
+	)
+{
+	struct peer * const peer = rbufp->recv_peer;
+	struct refclockproc * const pp = peer->procptr;
+	struct shmunit *      const up = pp->unitptr;
+	char junk[16];
+
+	while (recv(rbufp->fd, junk, sizeof(junk), MSG_DONTWAIT) > 0)
+		continue;
+	if (up->shm != NULL)
+		shm_fetch(pp->refclkunit, peer, false);
+	return 0;
+}
+
+/*
+ * shm_receive - not called, shm_doorbell() consumes all input
+ */
+static void
+shm_receive(
+	struct recvbuf *rbufp
+	)
+{
+	UNUSED_ARG(rbufp);
 }
 
 /*
@@ -573,12 +854,22 @@ static void shm_clockstats(
 	struct shmunit *      const up = pp->unitptr;
 
 	UNUSED_ARG(unit);
-	if (pp->sloppyclockflag & CLK_FLAG4) {
+	if ((pp->sloppyclockflag & CLK_FLAG4) &&
+	    (up->ring != NULL || pp->io.fd != -1)) {
+		mprintf_clock_stats(
+			peer, "%3d %3d %3d %3d %3d %3d %.6f %.6f",
+			up->ticks, up->good, up->notready,
+			up->bad, up->clash, up->lost,
+			up->good ? up->delay_sum / up->good : 0.,
+			up->delay_max);
+	} else if (pp->sloppyclockflag & CLK_FLAG4) {
 		mprintf_clock_stats(
 			peer, "%3d %3d %3d %3d %3d",
 			up->ticks, up->good, up->notready,
 			up->bad, up->clash);
 	}
 	up->ticks = up->good = up->notready = up->bad = up->clash = 0;
+	up->lost = 0;
+	up->delay_sum = up->delay_max = 0.;
 }
 
@@ -9,20 +9,233 @@ Requires gnuplot and liberation fonts installed.
 # SPDX-License-Identifier: BSD-2-Clause
 from __future__ import print_function, division
 
+import array
 import calendar
 import glob
 import gzip
+import mmap
 import os
 import socket
+import struct
 import sys
 import time
 
 
+class StatTable:
+    """Time-sorted statistics rows, stored column by column.
+
+    Rows look like those from NTPStats.unixize(): Unix time in
+    milliseconds, Unix time as a string, then the fields of the log
+    line.  Only the Unix time is kept for the first two; each field
+    column is an array of doubles when it is numeric, and a list of
+    strings otherwise.  Missing trailing fields read as NaN or ''."""
+
+    def __init__(self, times=None, columns=None):
+        if times is None:
+            times = array.array('d')
+        self.times = times
+        self.columns = columns or []
+
+    @classmethod
+    def from_rows(cls, rows, text=()):
+        """Build a table from time-sorted rows.  Columns named in text,
+        and columns that do not parse as numbers, are kept as strings."""
+        times = array.array('d', [float(row[1]) for row in rows])
+        width = max([len(row) for row in rows] or [2])
+        columns = []
+        for n in range(2, width):
+            values = [row[n] if n < len(row) else None for row in rows]
+            column = None
+            if n not in text:
+                try:
+                    column = array.array('d', [float('nan') if v is None
+                                               else float(v)
+                                               for v in values])
+                except ValueError:
+                    pass
+            if column is None:
+                column = ['' if v is None else v for v in values]
+            columns.append(column)
+        return cls(times, columns)
+
+    @classmethod
+    def merge(cls, tables):
+        """Join tables into one, in time order.  A column that is text
+        in any of them is text in the result."""
+        tables = [table for table in tables if table]
+        if 1 >= len(tables):
+            return tables[0] if tables else cls()
+        times = array.array('d')
+        for table in tables:
+            times.extend(table.times)
+        columns = []
+        for n in range(max(len(table.columns) for table in tables)):
+            parts = [table.columns[n] if n < len(table.columns) else None
+                     for table in tables]
+            if any(isinstance(part, list) for part in parts):
+                column = []
+                for (table, part) in zip(tables, parts):
+                    if part is None:
+                        column.extend([''] * len(table))
+                    elif isinstance(part, list):
+                        column.extend(part)
+                    else:
+                        column.extend(str(v) if v == v else ''
+                                      for v in part)
+            else:
+                column = array.array('d')
+                for (table, part) in zip(tables, parts):
+                    if part is None:
+                        column.extend([float('nan')] * len(table))
+                    else:
+                        column.extend(part)
+            columns.append(column)
+        merged = cls(times, columns)
+        return merged.take(sorted(range(len(times)), key=times.__getitem__))
+
+    def __len__(self):
+        return len(self.times)
+
+    def __bool__(self):
+        return 0 < len(self.times)
+
+    __nonzero__ = __bool__
+
+    def __getitem__(self, i):
+        "Return row i, rendered the way unixize() makes rows."
+        stamp = self.times[i]
+        row = [int(stamp * 1000), str(stamp)]
+        for column in self.columns:
+            value = column[i]
+            if isinstance(column, array.array):
+                if value != value:
+                    break
+                value = str(value)
+            elif '' == value:
+                break
+            row.append(value)
+        return row
+
+    def __iter__(self):
+        for i in range(len(self.times)):
+            yield self[i]
+
+    def __eq__(self, other):
+        "Compare row by row, with another table or a list of rows."
+        return list(self) == list(other)
+
+    def __ne__(self, other):
+        return not self == other
+
+    __hash__ = None
+
+    def column(self, n):
+        "Return field n, counting the two time fields, as a sequence."
+        if 0 == n:
+            return [int(stamp * 1000) for stamp in self.times]
+        if 1 == n:
+            return self.times
+        if len(self.columns) <= n - 2:
+            # nothing has that many fields, all missing
+            return array.array('d', [float('nan')] * len(self.times))
+        return self.columns[n - 2]
+
+    def values(self, n):
+        "Return the numbers in field n, skipping missing ones."
+        return [value for value in self.column(n) if value == value]
+
+    def take(self, indices):
+        "Return a new table holding the given rows."
+        times = array.array('d', [self.times[i] for i in indices])
+        columns = []
+        for column in self.columns:
+            picked = [column[i] for i in indices]
+            if isinstance(column, array.array):
+                picked = array.array('d', picked)
+            columns.append(picked)
+        return StatTable(times, columns)
+
+    def split(self, n):
+        """Return a dictionary mapping the values of text field n to
+        tables of the rows holding them."""
+        groups = {}
+        for (i, key) in enumerate(self.column(n)):
+            if '' != key and key == key:
+                groups.setdefault(key, []).append(i)
+        return dict((key, self.take(indices))
+                    for (key, indices) in groups.items())
+
+    def buckets(self, count):
+        """Yield lists of row indices, one per non-empty bucket when
+        the time span is cut into count equal intervals."""
+        if not self.times:
+            return
+        first = self.times[0]
+        width = (self.times[-1] - first) / count or 1.0
+        current = []
+        bucket = 0
+        for (i, stamp) in enumerate(self.times):
+            this = min(int((stamp - first) / width), count - 1)
+            if this != bucket and current:
+                yield current
+                current = []
+            bucket = this
+            current.append(i)
+        if current:
+            yield current
+
+    def downsample(self, count, how="mean", n=2):
+        """Reduce the table to at most count buckets of equal duration.
+
+        how is "min", "max" or "mean" to make one row per bucket from
+        the minimum, maximum or mean of every numeric field (text fields
+        come from the first row), or "minmax" to keep the rows holding
+        the minimum and maximum of field n, which preserves the outline
+        of a plot with at most 2 * count points."""
+        if len(self) <= count:
+            return self
+        if "minmax" == how:
+            column = self.column(n)
+            keep = []
+            for indices in self.buckets(count):
+                valid = [i for i in indices if column[i] == column[i]]
+                if not valid:
+                    continue
+                low = min(valid, key=column.__getitem__)
+                high = max(valid, key=column.__getitem__)
+                keep += sorted(set((low, high)))
+            return self.take(keep)
+
+        reduce = {"min": min, "max": max,
+                  "mean": lambda v: sum(v) / len(v)}[how]
+        times = array.array('d')
+        columns = [array.array('d') if isinstance(column, array.array)
+                   else [] for column in self.columns]
+        for indices in self.buckets(count):
+            times.append(sum(self.times[i] for i in indices) / len(indices))
+            for (column, out) in zip(self.columns, columns):
+                if isinstance(column, array.array):
+                    picked = [column[i] for i in indices
+                              if column[i] == column[i]]
+                    out.append(reduce(picked) if picked else float('nan'))
+                else:
+                    out.append(column[indices[0]])
+        return StatTable(times, columns)
+
+
 class NTPStats:
     "Gather statistics for a specified NTP site"
     SecondsInDay = 24*60*60
     DefaultPeriod = 7*24*60*60  # default 7 days, 604800 secs
     peermap = {}    # cached result of peersplit()
+    # fields to keep as text even when they look like numbers
+    TextColumns = {"clockstats": (2,),
+                   "peerstats": (2, 3),
+                   "rawstats": (2, 3, 16),
+                   "temps": (2,),
+                   "gpsd": (2,)}
+    # bisect text files down to about this many bytes
+    IndexGranule = 64 * 1024
     period = None
     starttime = None
     endtime = None
@@ -54,6 +267,179 @@ class NTPStats:
                 lines1.append(split)
         return lines1
 
+    # binary statistics files, see include/ntp_filegen.h
+    BinaryMagic = b"NTPSBIN1"
+    BinaryHeader = struct.Struct("<8sHHHH16s")
+    BinaryColumn = struct.Struct("<14scB")
+    BinaryTypes = {b'u': 'I', b'x': 'I', b'i': 'i', b'd': 'd', b'f': 'Q'}
+
+    @staticmethod
+    def binary_layout(data):
+        """Parse the header of a binary statistics file.
+        Return (header length, record Struct, column types), or None
+        if data does not start with a valid header."""
+        if len(data) < NTPStats.BinaryHeader.size:
+            return None
+        (magic, hdrlen, reclen, ncols, _, _) = \
+            NTPStats.BinaryHeader.unpack_from(data, 0)
+        if magic != NTPStats.BinaryMagic or len(data) < hdrlen:
+            return None
+        fmt = "<"
+        types = []
+        offset = NTPStats.BinaryHeader.size
+        for _ in range(ncols):
+            (_, ctype, width) = NTPStats.BinaryColumn.unpack_from(data,
+                                                                  offset)
+            offset += NTPStats.BinaryColumn.size
+            if ctype == b's':
+                fmt += "%ds" % width
+            elif ctype in NTPStats.BinaryTypes:
+                fmt += NTPStats.BinaryTypes[ctype]
+            else:
+                return None
+            types.append(ctype)
+        record = struct.Struct(fmt)
+        if record.size != reclen or types[:2] != [b'u', b'd']:
+            # every layout starts with MJD day and seconds
+            return None
+        return (hdrlen, record, types)
+
+    @staticmethod
+    def binary_column(ctype, values, text):
+        """Make a StatTable column of one decoded column: an array of
+        doubles, or strings for strings and for columns kept as text,
+        rendered the way the text format does."""
+        if ctype == b's':
+            return [v.rstrip(b'\0').decode('ascii', 'replace')
+                    for v in values]
+        if ctype == b'f':
+            # NTP fixed point to seconds
+            return array.array('d', [v * 2.0 ** -32 for v in values])
+        if text:
+            if ctype == b'x':
+                return ["%x" % v for v in values]
+            return [str(v) for v in values]
+        return array.array('d', values)
+
+    @staticmethod
+    def unixize_binary(data, starttime, endtime, text=()):
+        """Decode a binary statistics file into a StatTable, with the
+        same fields that unixize() and StatTable.from_rows() make of
+        text.  Fields named in text are kept as strings."""
+        layout = NTPStats.binary_layout(data)
+        if layout is None:
+            return None
+        (hdrlen, record, types) = layout
+        # ignore a partial record at the end, ntpd may be writing it
+        count = (len(data) - hdrlen) // record.size
+        stamp = struct.Struct(record.format[:3])
+
+        def stamp_at(i):
+            "Unix time of record i"
+            (mjd, second) = stamp.unpack_from(data, hdrlen + i * record.size)
+            return NTPStats.SecondsInDay * mjd + second - 3506716800
+
+        def bisect(when, inclusive):
+            "First record at (or after) when; records are time ordered"
+            (low, high) = (0, count)
+            while low < high:
+                middle = (low + high) // 2
+                at = stamp_at(middle)
+                if at < when or (not inclusive and at == when):
+                    low = middle + 1
+                else:
+                    high = middle
+            return low
+
+        # fixed-width records index themselves, decode only the range
+        first = bisect(starttime, True)
+        last = bisect(endtime, False)
+        if first >= last:
+            return StatTable()
+        view = memoryview(data)[hdrlen + first * record.size:
+                                hdrlen + last * record.size]
+        columns = list(zip(*record.iter_unpack(view)))
+        view.release()
+        count = last - first
+
+        # day and seconds to Unix time, drop any strays from clock steps
+        times = [NTPStats.SecondsInDay * mjd + second - 3506716800
+                 for (mjd, second) in zip(columns[0], columns[1])]
+        keep = [i for (i, t) in enumerate(times) if starttime <= t <= endtime]
+        if len(keep) != count:
+            times = [times[i] for i in keep]
+            columns = [[col[i] for i in keep] for col in columns]
+
+        return StatTable(array.array('d', times),
+                         [NTPStats.binary_column(ctype, col, n in text)
+                          for (n, ctype, col) in zip(range(2, len(types)),
+                                                     types[2:],
+                                                     columns[2:])])
+
+    @staticmethod
+    def mjd_stamp(line):
+        "Unix time of an ntpd statistics line, MJD and seconds, or None."
+        split = line.split(None, 2)
+        try:
+            return (NTPStats.SecondsInDay * int(split[0]) + float(split[1])
+                    - 3506716800)
+        except (ValueError, IndexError):
+            return None
+
+    @staticmethod
+    def unix_stamp(line):
+        "Unix time of a temps or gpsd line, or None."
+        split = line.split(None, 1)
+        try:
+            return float(split[0])
+        except (ValueError, IndexError):
+            return None
+
+    @staticmethod
+    def lines_in_range(logfile, stamp, starttime, endtime):
+        """Read the lines of a time-ordered log file that can fall in
+        [starttime, endtime].  The file is bisected on byte offsets to
+        find the first one, and reading stops after the last one, so
+        only the requested part of a large file is read."""
+        if not hasattr(logfile, "seek"):
+            return logfile.readlines()
+
+        def next_stamp():
+            "Time of the next line with one, or None at the end."
+            while True:
+                line = logfile.readline()
+                if not line:
+                    return None
+                when = stamp(line)
+                if when is not None:
+                    return when
+
+        logfile.seek(0, 2)
+        low = 0
+        high = logfile.tell()
+        while NTPStats.IndexGranule < high - low:
+            middle = (low + high) // 2
+            logfile.seek(middle)
+            logfile.readline()      # skip to a line boundary
+            when = next_stamp()
+            if when is None or starttime <= when:
+                high = middle
+            else:
+                low = middle
+        logfile.seek(low)
+        if low:
+            logfile.readline()
+
+        lines = []
+        for line in logfile:
+            when = stamp(line)
+            if when is not None and endtime < when:
+                break
+            lines.append(line)
+        if lines and isinstance(lines[0], bytes):
+            lines = [line.decode('utf-8', 'replace') for line in lines]
+        return lines
+
     @staticmethod
     def timestamp(line):
         "get Unix time from converted line."
@@ -134,40 +520,87 @@ class NTPStats:
                              % statsdir)
             raise SystemExit(1)
 
-        self.clockstats = []
-        self.peerstats = []
-        self.loopstats = []
-        self.rawstats = []
-        self.temps = []
-        self.gpsd = []
+        self.clockstats = StatTable()
+        self.peerstats = StatTable()
+        self.loopstats = StatTable()
+        self.rawstats = StatTable()
+        self.temps = StatTable()
+        self.gpsd = StatTable()
 
         for stem in ("clockstats", "peerstats", "loopstats",
                      "rawstats", "temps", "gpsd"):
-            lines = self.__load_stem(statsdir, stem)
-            processed = self.__process_stem(stem, lines)
+            lines, tables = self.__load_stem(statsdir, stem)
+            processed = self.__process_stem(stem, lines, tables)
             setattr(self, stem, processed)
 
     def __load_stem(self, statsdir, stem):
+        """Return the text lines of the logs of stem, and the tables
+        decoded from its binary logs."""
         lines = []
+        tables = []
         try:
             pattern = os.path.join(statsdir, stem)
             if stem != "temps" and stem != "gpsd":
                 pattern += "."
-            for logpart in glob.glob(pattern + "*"):
+                stamp = NTPStats.mjd_stamp
+            else:
+                stamp = NTPStats.unix_stamp
+            logparts = glob.glob(pattern + "*")
+            for logpart in logparts:
+                binary = (logpart == pattern + "bin" or
+                          logpart.startswith(pattern + "bin."))
+                # skip the link to the current binary generation, a
+                # hard link, but not the only file of "type none"
+                if logpart == pattern + "bin" and any(
+                        other.startswith(pattern + "bin.") and
+                        os.path.samefile(logpart, other)
+                        for other in logparts):
+                    continue
                 # skip files older than starttime
                 if self.starttime > os.path.getmtime(logpart):
                     continue
-                if logpart.endswith("gz"):
+                if binary:
+                    tables.append(self.__load_binary(logpart, stem))
+                elif logpart.endswith("gz"):
                     lines += gzip.open(logpart, 'rt').readlines()
                 else:
-                    lines += open(logpart, 'r').readlines()
+                    with open(logpart, 'rb') as logfile:
+                        lines += NTPStats.lines_in_range(logfile, stamp,
+                                                         self.starttime,
+                                                         self.endtime)
         except IOError:  # pragma: no cover
             sys.stderr.write("ntpviz: WARNING: could not read %s\n"
                              % logpart)
 
-        return lines
+        return lines, tables
 
-    def __process_stem(self, stem, lines):
+    def __load_binary(self, logpart, stem):
+        "Decode one binary statistics file, memory mapped when possible."
+        text = NTPStats.TextColumns.get(stem, ())
+        if logpart.endswith("gz"):
+            data = gzip.open(logpart, 'rb').read()
+            table = NTPStats.unixize_binary(data, self.starttime,
+                                            self.endtime, text)
+        else:
+            with open(logpart, 'rb') as logfile:
+                try:
+                    data = mmap.mmap(logfile.fileno(), 0,
+                                     access=mmap.ACCESS_READ)
+                except ValueError:
+                    # empty file, nothing written yet
+                    return StatTable()
+                try:
+                    table = NTPStats.unixize_binary(data, self.starttime,
+                                                    self.endtime, text)
+                finally:
+                    data.close()
+        if table is None:
+            sys.stderr.write("ntpviz: WARNING: %s is not a binary "
+                             "statistics file\n" % logpart)
+            table = StatTable()
+        return table
+
+    def __process_stem(self, stem, lines, tables=()):
         lines1 = []
         if stem == "temps" or stem == "gpsd":
             # temps and gpsd are already in UNIX time
@@ -197,7 +630,10 @@ class NTPStats:
         # integer of milli seconds.  This is faster than using
         # cmp= or key=
         lines1.sort()
-        return lines1
+        # then drop the per-line strings for compact columns
+        table = StatTable.from_rows(lines1, NTPStats.TextColumns.get(stem, ()))
+        # binary files came as columns already, join them by column
+        return StatTable.merge([table] + list(tables))
 
     def peersplit(self):
         """Return a dictionary mapping peerstats IPs to entry subsets.
@@ -205,44 +641,17 @@ class NTPStats:
         if self.peermap:
             return self.peermap
 
-        for row in self.peerstats:
-            try:
-                ip_address = row[2]     # peerstats field 2, refclock id
-                if ip_address not in self.peermap:
-                    self.peermap[ip_address] = []
-                self.peermap[ip_address].append(row)
-            except IndexError:  # pragma: no cover
-                # ignore corrupted rows
-                pass
+        # peerstats field 2, IP address or refclock id
+        self.peermap.update(self.peerstats.split(2))
         return self.peermap
 
     def gpssplit(self):
         "Return a dictionary mapping gps sources to entry subsets."
-        gpsmap = {}
-        for row in self.gpsd:
-            try:
-                source = row[2]
-                if source not in gpsmap:
-                    gpsmap[source] = []
-                gpsmap[source].append(row)
-            except IndexError:  # pragma: no cover
-                # ignore corrupted rows
-                pass
-        return gpsmap
+        return self.gpsd.split(2)
 
     def tempssplit(self):
         "Return a dictionary mapping temperature sources to entry subsets."
-        tempsmap = {}
-        for row in self.temps:
-            try:
-                source = row[2]
-                if source not in tempsmap:
-                    tempsmap[source] = []
-                tempsmap[source].append(row)
-            except IndexError:  # pragma: no cover
-                # ignore corrupted rows
-                pass
-        return tempsmap
+        return self.temps.split(2)
 
 
 def iso_to_posix(time_string):
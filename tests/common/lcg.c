@@ -0,0 +1,20 @@
+#include "config.h"
+
+#include "lcg.h"
+
+/*
+ * The generator of the C standard's rand() example, so tests drawing
+ * from it see the same sequence on every platform.  The low bits are
+ * poor; use the top ones.
+ */
+uint32_t
+lcg_next(uint32_t *seed) {
+	*seed = *seed * 1103515245U + 12345U;
+	return *seed;
+}
+
+/* uniform in [0, 1) */
+double
+lcg_uniform(uint32_t *seed) {
+	return (lcg_next(seed) >> 8) / 16777216.0;
+}
@@ -0,0 +1,10 @@
+#ifndef GUARD_TESTS_LCG_H
+#define GUARD_TESTS_LCG_H
+
+#include <stdint.h>
+
+uint32_t lcg_next(uint32_t *seed);
+double lcg_uniform(uint32_t *seed);
+
+
+#endif // GUARD_TESTS_LCG_H
@@ -0,0 +1,47 @@
+#include "config.h"
+#include <string.h>
+
+#include "lcg.h"
+#include "mutate.h"
+
+/*
+ * Mutilate the string of len bytes in src, in a buffer of cap: rounds
+ * times change a byte to one of junk, drop a byte, double a byte or
+ * cut the string short.  The same seed makes the same damage on every
+ * platform.
+ */
+void
+mutate(char *src, size_t *len, size_t cap, const char *junk, int rounds,
+       uint32_t *seed) {
+	size_t pos, n = *len;
+	uint32_t r;
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		r = lcg_next(seed);
+		pos = (r >> 8) % (n + 1);
+		switch ((r >> 24) & 3) {
+		case 0:		/* change a byte */
+			if (pos < n)
+				src[pos] = junk[(r >> 4) % strlen(junk)];
+			break;
+		case 1:		/* drop a byte */
+			if (pos < n) {
+				memmove(src + pos, src + pos + 1, n - pos);
+				n--;
+			}
+			break;
+		case 2:		/* double a byte */
+			if (pos < n && n + 2 < cap) {
+				memmove(src + pos + 1, src + pos, n - pos + 1);
+				n++;
+			}
+			break;
+		default:	/* cut short */
+			n = pos;
+			src[n] = '\0';
+			break;
+		}
+	}
+	*len = n;
+}
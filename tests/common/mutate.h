@@ -0,0 +1,11 @@
+#ifndef GUARD_TESTS_MUTATE_H
+#define GUARD_TESTS_MUTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void mutate(char *src, size_t *len, size_t cap, const char *junk,
+	    int rounds, uint32_t *seed);
+
+
+#endif // GUARD_TESTS_MUTATE_H
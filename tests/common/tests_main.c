@@ -65,12 +65,26 @@ static void RunAllTests(void)
 	RUN_TEST_GROUP(binio);
 	RUN_TEST_GROUP(gpstolfp);
 	RUN_TEST_GROUP(ieee754io);
+	RUN_TEST_GROUP(parse);
 #endif
 
 #ifdef TEST_NTPD
 	RUN_TEST_GROUP(leapsec);
 	RUN_TEST_GROUP(hackrestrict);
 	RUN_TEST_GROUP(recvbuff);
+	RUN_TEST_GROUP(refqueue);
+	RUN_TEST_GROUP(refsample);
+	RUN_TEST_GROUP(filter);
+	RUN_TEST_GROUP(sched);
+	RUN_TEST_GROUP(snapshot);
+	RUN_TEST_GROUP(prefilter);
+	RUN_TEST_GROUP(select);
+	RUN_TEST_GROUP(wheel);
+	RUN_TEST_GROUP(gpsdjson);
+	RUN_TEST_GROUP(nmea);
+#ifdef CLOCK_PPSMULTI
+	RUN_TEST_GROUP(ppsmulti);
+#endif
 #ifndef DISABLE_NTS
 	RUN_TEST_GROUP(nts);
 	RUN_TEST_GROUP(nts_client);
@@ -0,0 +1,285 @@
+#include "config.h"
+#include "ntp_stdlib.h"
+#include "ntp_fp.h"
+#include "parse.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "lcg.h"
+
+/*
+ * Tests for parse_ioread_block() in libparse/parse.c, in -lparse:
+ * whatever way a stream is cut into reads, taking each read in one go
+ * has to come up with what taking it byte by byte does.
+ */
+
+TEST_GROUP(parse);
+
+TEST_SETUP(parse) {}
+
+TEST_TEAR_DOWN(parse) {}
+
+#define STREAMLEN	6000
+#define MAXEVENTS	1000
+
+/* a sample as the caller of the parser sees it */
+struct event {
+	size_t		pos;		/* bytes consumed when it came */
+	unsigned long	status;
+	l_fp		stime;
+	unsigned short	ldsize;
+	char		ldata[PARSE_TCMAX];
+};
+
+struct run {
+	int		nevent;
+	struct event	event[MAXEVENTS];
+	/* the stamp and the fill of the buffer after each read */
+	l_fp		stime[STREAMLEN];
+	unsigned short	index[STREAMLEN];
+};
+
+static struct run bytewise, blockwise;
+
+static unsigned char stream[STREAMLEN];
+static size_t cut[STREAMLEN + 1];	/* read boundaries */
+static int ncut;
+
+static uint32_t seed;
+
+/* the top 24 bits of the shared generator */
+static uint32_t
+lcg(void)
+{
+	return lcg_next(&seed) >> 8;
+}
+
+static void
+setup_parse(parse_t *p, const char *name, unsigned long cs)
+{
+	parsectl_t dct;
+
+	memset(p, 0, sizeof(*p));
+	TEST_ASSERT_TRUE(parse_ioinit(p));
+
+	memset(&dct, 0, sizeof(dct));
+	dct.parseformat.parse_count = (unsigned short)(strlen(name) + 1);
+	memcpy(dct.parseformat.parse_buffer, name, strlen(name) + 1);
+	TEST_ASSERT_TRUE(parse_setfmt(&dct, p));
+
+	memset(&dct, 0, sizeof(dct));
+	dct.parsesetcs.parse_cs = cs;
+	TEST_ASSERT_TRUE(parse_setcs(&dct, p));
+}
+
+static void
+record(struct run *r, parse_t *p, size_t pos)
+{
+	struct event *e;
+
+	TEST_ASSERT_TRUE(r->nevent < MAXEVENTS);
+	e = &r->event[r->nevent++];
+	e->pos = pos;
+	e->status = p->parse_dtime.parse_status;
+	e->stime = p->parse_dtime.parse_stime;
+	e->ldsize = p->parse_ldsize;
+	memcpy(e->ldata, p->parse_ldata, p->parse_ldsize);
+	parse_iodone(p);
+}
+
+static l_fp
+stamp(int read)
+{
+	return lfpinit_u(3800000000U + (uint32_t)read, 0x80000000U);
+}
+
+static void
+feed_bytewise(parse_t *p, struct run *r)
+{
+	timestamp_t ts;
+	size_t i;
+	int c;
+
+	r->nevent = 0;
+	for (c = 0; c < ncut; c++) {
+		ts = stamp(c);
+		for (i = cut[c]; i < cut[c + 1]; i++) {
+			if (parse_ioread(p, (char)stream[i], &ts)) {
+				record(r, p, i + 1);
+			}
+		}
+		r->stime[c] = p->parse_dtime.parse_stime;
+		r->index[c] = p->parse_index;
+	}
+}
+
+static void
+feed_blockwise(parse_t *p, struct run *r)
+{
+	static char buf[STREAMLEN];
+	timestamp_t ts;
+	size_t pos, used;
+	int c;
+
+	memcpy(buf, stream, sizeof(buf));
+	r->nevent = 0;
+	for (c = 0; c < ncut; c++) {
+		ts = stamp(c);
+		for (pos = cut[c]; pos < cut[c + 1]; pos += used) {
+			used = 0;
+			if (parse_ioread_block(p, buf + pos, cut[c + 1] - pos,
+					       &used, &ts)) {
+				record(r, p, pos + used);
+			}
+			TEST_ASSERT_TRUE(used > 0);
+			TEST_ASSERT_TRUE(pos + used <= cut[c + 1]);
+		}
+		r->stime[c] = p->parse_dtime.parse_stime;
+		r->index[c] = p->parse_index;
+	}
+}
+
+static void
+compare(parse_t *p1, parse_t *p2)
+{
+	int i;
+
+	TEST_ASSERT_EQUAL_INT(bytewise.nevent, blockwise.nevent);
+	for (i = 0; i < bytewise.nevent; i++) {
+		struct event *e1 = &bytewise.event[i];
+		struct event *e2 = &blockwise.event[i];
+
+		TEST_ASSERT_EQUAL_UINT(e1->pos, e2->pos);
+		TEST_ASSERT_EQUAL_HEX(e1->status, e2->status);
+		TEST_ASSERT_TRUE(e1->stime == e2->stime);
+		TEST_ASSERT_EQUAL_UINT(e1->ldsize, e2->ldsize);
+		if (e1->ldsize)
+			TEST_ASSERT_EQUAL_MEMORY(e1->ldata, e2->ldata,
+						 e1->ldsize);
+	}
+	for (i = 0; i < ncut; i++) {
+		TEST_ASSERT_TRUE(bytewise.stime[i] == blockwise.stime[i]);
+		TEST_ASSERT_EQUAL_UINT(bytewise.index[i], blockwise.index[i]);
+	}
+	TEST_ASSERT_EQUAL_UINT(p1->parse_badformat, p2->parse_badformat);
+	TEST_ASSERT_EQUAL_UINT(p1->parse_index, p2->parse_index);
+	if (p1->parse_index)
+		TEST_ASSERT_EQUAL_MEMORY(p1->parse_data, p2->parse_data,
+					 p1->parse_index);
+	TEST_ASSERT_TRUE(p1->parse_lastchar == p2->parse_lastchar);
+}
+
+/*
+ * a stream of good messages in several formats, broken ones, runs too
+ * long for any buffer and noise heavy in the characters that frame
+ * messages, cut into reads of 1 to 200 bytes
+ */
+static void
+make_stream(void)
+{
+	static const char *const good[] = {
+		"T:20:10:19:01:12:34:56\r\n",		/* Computime */
+		"20-10-19-01-12-34-56-00\r",		/* ELV DCF7000 */
+		"T:20:13:19:01:12:34:56\r\n",
+	};
+	static const char frame[] = "T\r\n\002\003\375\001<>:-0123456789";
+	const char *msg;
+	size_t len = 0, n;
+	int c;
+
+	while (len < STREAMLEN) {
+		switch (lcg() % 8) {
+		case 0:
+		case 1:
+			msg = good[lcg() % COUNTOF(good)];
+			n = strlen(msg);
+			if (len + n > STREAMLEN)
+				n = STREAMLEN - len;
+			memcpy(stream + len, msg, n);
+			len += n;
+			break;
+
+		case 2:
+			for (n = 100 + lcg() % 500; n && len < STREAMLEN; n--)
+				stream[len++] = (unsigned char)('0' + lcg() % 10);
+			break;
+
+		case 3:
+			stream[len++] = (unsigned char)lcg();
+			break;
+
+		default:
+			stream[len++] = (unsigned char)frame[lcg() % (sizeof(frame) - 1)];
+			break;
+		}
+	}
+
+	ncut = 0;
+	cut[0] = 0;
+	while (cut[ncut] < STREAMLEN) {
+		n = 1 + lcg() % (1 + (lcg() % 2 ? 200 : 3));
+		c = ncut + 1;
+		cut[c] = cut[ncut] + n > STREAMLEN ? STREAMLEN : cut[ncut] + n;
+		ncut = c;
+	}
+}
+
+static void
+check_format(const char *name, unsigned long cs, uint32_t s)
+{
+	static parse_t p1, p2;
+
+	seed = s;
+	make_stream();
+	setup_parse(&p1, name, cs);
+	setup_parse(&p2, name, cs);
+	feed_bytewise(&p1, &bytewise);
+	feed_blockwise(&p2, &blockwise);
+	compare(&p1, &p2);
+	parse_ioend(&p1);
+	parse_ioend(&p2);
+}
+
+
+TEST(parse, BlockMatchesBytewise) {
+	unsigned short i;
+	uint32_t s;
+
+	for (i = 0; i < nformats; i++) {
+		for (s = 1; s <= 20; s++) {
+			check_format(clockformats[i]->name, PARSE_IO_CS8, s);
+			check_format(clockformats[i]->name, PARSE_IO_CS7, s);
+		}
+	}
+}
+
+TEST(parse, BlockSample) {
+#ifdef CLOCK_COMPUTIME
+	static parse_t p;
+	char msg[] = "xxT:20:10:19:01:12:34:56\r\nT:20";
+	timestamp_t ts = stamp(1);
+	size_t used;
+
+	setup_parse(&p, "Diem's Computime Radio Clock", PARSE_IO_CS8);
+	TEST_ASSERT_TRUE(parse_ioread_block(&p, msg, strlen(msg), &used, &ts));
+	TEST_ASSERT_EQUAL_UINT(26, used);
+	TEST_ASSERT_EQUAL_HEX(CVT_OK, p.parse_dtime.parse_status & CVT_MASK);
+	TEST_ASSERT_TRUE(p.parse_dtime.parse_stime == ts);
+	TEST_ASSERT_EQUAL_UINT(24, p.parse_ldsize);
+	parse_iodone(&p);
+
+	TEST_ASSERT_FALSE(parse_ioread_block(&p, msg + used, strlen(msg) - used,
+					     &used, &ts));
+	TEST_ASSERT_EQUAL_UINT(4, used);
+	TEST_ASSERT_EQUAL_UINT(4, p.parse_index);
+	parse_ioend(&p);
+#else
+	TEST_IGNORE_MESSAGE("no Computime format");
+#endif
+}
+
+TEST_GROUP_RUNNER(parse) {
+	RUN_TEST_CASE(parse, BlockMatchesBytewise);
+	RUN_TEST_CASE(parse, BlockSample);
+}
@@ -0,0 +1,242 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "lcg.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+
+
+TEST_GROUP(filter);
+
+#define MAXDISP	16.0
+#define ALLAN	1024UL
+
+static struct peer peer, ref;
+static uint32_t seed;
+
+TEST_SETUP(filter) {
+	int i;
+
+	ZERO(peer);
+	for (i = 0; i < NTP_SHIFT; i++) {
+		peer.filter_delay[i] = MAXDISP;
+		peer.filter_disp[i] = MAXDISP;
+	}
+	seed = 1;
+}
+
+TEST_TEAR_DOWN(filter) {}
+
+
+/* shift a sample into the register, as clock_filter() does */
+static void
+shift(struct peer *p, double offset, double delay, double disp,
+      uptime_t epoch) {
+	int j = p->filter_nextpt;
+
+	p->filter_offset[j] = offset;
+	p->filter_delay[j] = delay;
+	p->filter_disp[j] = disp;
+	p->filter_epoch[j] = epoch;
+	p->filter_nextpt = (j + 1) % NTP_SHIFT;
+}
+
+/* the aging and exchange sort of clock_filter() before filter_sort() */
+static void
+old_sort(struct peer *p, double aging, double maxdisp,
+	 unsigned long allan, bool sort, double *dst, int *ord) {
+	double etemp;
+	int i, j, k;
+
+	j = p->filter_nextpt;
+	for (i = NTP_SHIFT - 1; i >= 0; i--) {
+		if (i != 0)
+			p->filter_disp[j] += aging;
+		if (p->filter_disp[j] >= maxdisp) {
+			p->filter_disp[j] = maxdisp;
+			dst[i] = maxdisp;
+		} else if (p->update - p->filter_epoch[j] > allan) {
+			dst[i] = p->filter_delay[j] + p->filter_disp[j];
+		} else {
+			dst[i] = p->filter_delay[j];
+		}
+		ord[i] = j;
+		j = (j + 1) % NTP_SHIFT;
+	}
+	if (sort) {
+		for (i = 1; i < NTP_SHIFT; i++) {
+			for (j = 0; j < i; j++) {
+				if (dst[j] > dst[i]) {
+					k = ord[j];
+					ord[j] = ord[i];
+					ord[i] = k;
+					etemp = dst[j];
+					dst[j] = dst[i];
+					dst[i] = etemp;
+				}
+			}
+		}
+	}
+}
+
+/* age of the stage in register index t, 0 for the newest */
+static int
+age(const struct peer *p, int t) {
+	return (p->filter_nextpt - 1 - t + 2 * NTP_SHIFT) % NTP_SHIFT;
+}
+
+/*
+ * Check that two sorts agree.  The distances must match to the bit,
+ * and so must the order, except within a run of equal distances,
+ * where the exchange sort leaves the stages in no particular order.
+ * Both put the newest of the nearest stages first.
+ */
+static void
+same_sort(const double *odst, const int *oord, const double *dst,
+	  const int *ord) {
+	unsigned int oset, set;
+	int i, j;
+
+	TEST_ASSERT_EQUAL_MEMORY(odst, dst, NTP_SHIFT * sizeof(*dst));
+	TEST_ASSERT_EQUAL_INT(oord[0], ord[0]);
+	for (i = 0; i < NTP_SHIFT; i = j) {
+		oset = set = 0;
+		for (j = i; j < NTP_SHIFT && !(dst[i] < dst[j]); j++) {
+			oset |= 1U << oord[j];
+			set |= 1U << ord[j];
+		}
+		TEST_ASSERT_EQUAL_HEX(oset, set);
+	}
+}
+
+/*
+ * Feed n samples with random delays and intervals to both sorts and
+ * check that they agree.
+ */
+static void
+golden(int n, bool sort) {
+	double dst[NTP_SHIFT], odst[NTP_SHIFT];
+	int ord[NTP_SHIFT], oord[NTP_SHIFT];
+	uptime_t now = 1;
+	double aging, offset, delay, disp;
+	int i, k;
+
+	ref = peer;
+	for (k = 0; k < n; k++) {
+		aging = 15e-6 * (now - peer.update);
+		peer.update = ref.update = now;
+		offset = lcg_uniform(&seed) - 0.5;
+		delay = lcg_uniform(&seed) * 0.1;
+		disp = lcg_uniform(&seed) * 1e-3;
+		shift(&peer, offset, delay, disp, now);
+		shift(&ref, offset, delay, disp, now);
+
+		filter_sort(&peer, aging, MAXDISP, ALLAN, sort, dst, ord);
+		old_sort(&ref, aging, MAXDISP, ALLAN, sort, odst, oord);
+
+		TEST_ASSERT_EQUAL_MEMORY(ref.filter_disp, peer.filter_disp,
+					 sizeof(peer.filter_disp));
+		if (sort) {
+			same_sort(odst, oord, dst, ord);
+			for (i = 1; i < NTP_SHIFT; i++)
+				if (!(dst[i - 1] < dst[i]))
+					TEST_ASSERT_TRUE(age(&peer, ord[i - 1]) <
+							 age(&peer, ord[i]));
+		} else {
+			TEST_ASSERT_EQUAL_MEMORY(odst, dst, sizeof(dst));
+			TEST_ASSERT_EQUAL_INT_ARRAY(oord, ord, NTP_SHIFT);
+		}
+
+		/* mostly about 1024 s apart, now and then long enough to clamp */
+		if (lcg_uniform(&seed) < 0.01)
+			now += 2000000;
+		else
+			now += 1 + (uptime_t)(lcg_uniform(&seed) * 2048);
+	}
+}
+
+
+TEST(filter, GoldenSorted) {
+	golden(20000, true);
+}
+
+TEST(filter, GoldenUnsorted) {
+	golden(2000, false);
+}
+
+TEST(filter, StartupClamped) {
+	double dst[NTP_SHIFT], odst[NTP_SHIFT];
+	int ord[NTP_SHIFT], oord[NTP_SHIFT];
+
+	/* two samples in a fresh register, the rest still clamped */
+	peer.update = 64;
+	shift(&peer, 0.001, 0.020, 0.0001, 0);
+	shift(&peer, 0.002, 0.010, 0.0001, 64);
+	ref = peer;
+
+	filter_sort(&peer, 0.001, MAXDISP, ALLAN, true, dst, ord);
+	old_sort(&ref, 0.001, MAXDISP, ALLAN, true, odst, oord);
+
+	TEST_ASSERT_EQUAL_MEMORY(odst, dst, sizeof(dst));
+	TEST_ASSERT_EQUAL_INT(oord[0], ord[0]);
+	TEST_ASSERT_EQUAL_INT(1, ord[0]);
+	TEST_ASSERT_EQUAL_INT(0, ord[1]);
+	/* the empty stages follow, newest first */
+	TEST_ASSERT_EQUAL_INT(7, ord[2]);
+	TEST_ASSERT_EQUAL_INT(6, ord[3]);
+	TEST_ASSERT_EQUAL_INT(2, ord[7]);
+}
+
+TEST(filter, TiesNewestFirst) {
+	double dst[NTP_SHIFT];
+	int ord[NTP_SHIFT];
+	int i;
+
+	peer.update = 100;
+	for (i = 0; i < NTP_SHIFT; i++)
+		shift(&peer, 0, 0.005, 0, 100);
+	shift(&peer, 0, 0.001, 0, 100);	/* the best, in stage 0 */
+
+	filter_sort(&peer, 0, MAXDISP, ALLAN, true, dst, ord);
+
+	TEST_ASSERT_EQUAL_INT(0, ord[0]);
+	for (i = 1; i < NTP_SHIFT; i++)
+		TEST_ASSERT_EQUAL_INT(NTP_SHIFT - i, ord[i]);
+}
+
+/* By the 0-1 principle, sorting all 256 bit patterns proves the network. */
+TEST(filter, NetworkSorts) {
+	double dst[NTP_SHIFT];
+	int ord[NTP_SHIFT];
+	unsigned int bits;
+	int i;
+
+	for (bits = 0; bits < 256; bits++) {
+		for (i = 0; i < NTP_SHIFT; i++) {
+			peer.filter_delay[i] = (bits >> i) & 1;
+			peer.filter_disp[i] = 0;
+			peer.filter_epoch[i] = 0;
+		}
+		peer.update = 0;
+		filter_sort(&peer, 0, MAXDISP, ALLAN, true, dst, ord);
+		for (i = 1; i < NTP_SHIFT; i++) {
+			TEST_ASSERT_FALSE(dst[i] < dst[i - 1]);
+			if (!(dst[i - 1] < dst[i]))
+				TEST_ASSERT_TRUE(age(&peer, ord[i - 1]) <
+						 age(&peer, ord[i]));
+		}
+	}
+}
+
+TEST_GROUP_RUNNER(filter) {
+	RUN_TEST_CASE(filter, GoldenSorted);
+	RUN_TEST_CASE(filter, GoldenUnsorted);
+	RUN_TEST_CASE(filter, StartupClamped);
+	RUN_TEST_CASE(filter, TiesNewestFirst);
+	RUN_TEST_CASE(filter, NetworkSorts);
+}
@@ -0,0 +1,231 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "mutate.h"
+
+#include "ntp_stdlib.h"
+#include "ntp_gpsdjson.h"
+
+
+/* how fast the records are taken apart: attic/gpsd-json-timing.c */
+
+TEST_GROUP(gpsdjson);
+
+TEST_SETUP(gpsdjson) {}
+
+TEST_TEAR_DOWN(gpsdjson) {}
+
+/* records as a gpsd 3.25 sends them */
+static const char *records[] = {
+	"{\"class\":\"VERSION\",\"release\":\"3.25\",\"rev\":\"3.25\","
+	"\"proto_major\":3,\"proto_minor\":15}",
+	"{\"class\":\"WATCH\",\"enable\":true,\"json\":true,\"nmea\":false,"
+	"\"raw\":0,\"scaled\":false,\"timing\":false,\"split24\":false,"
+	"\"pps\":true,\"device\":\"/dev/ttyS0\"}",
+	"{\"class\":\"TPV\",\"device\":\"/dev/ttyS0\",\"status\":2,\"mode\":3,"
+	"\"time\":\"2024-05-01T12:00:00.000Z\",\"leapseconds\":18,"
+	"\"ept\":0.005,\"lat\":48.1,\"lon\":11.5,\"altHAE\":520.3}",
+	"{\"class\":\"SKY\",\"device\":\"/dev/ttyS0\",\"hdop\":0.9,"
+	"\"satellites\":[{\"PRN\":5,\"el\":42.0,\"az\":101.0,\"ss\":40.0,"
+	"\"used\":true,\"time\":\"nested\"},{\"PRN\":12,\"el\":13.0,"
+	"\"az\":300.0,\"ss\":22.0,\"used\":false,\"mode\":9}],\"time\":"
+	"\"2024-05-01T12:00:00.000Z\"}",
+	"{\"class\":\"PPS\",\"device\":\"/dev/ttyS0\",\"real_sec\":1714564800,"
+	"\"real_nsec\":0,\"clock_sec\":1714564800,\"clock_nsec\":120,"
+	"\"precision\":-20,\"shm\":\"NTP3\",\"qErr\":3}",
+	"{\"class\":\"TOFF\",\"device\":\"/dev/ttyS0\",\"real_sec\":1714564800,"
+	"\"real_nsec\":0,\"clock_sec\":1714564800,\"clock_nsec\":90210345,"
+	"\"precision\":-1,\"shm\":\"NTP2\"}",
+};
+
+/* parse a copy of str in buf */
+static bool
+parse(gpsd_json *rec, char *buf, size_t size, const char *str) {
+	size_t len = strlen(str);
+
+	TEST_ASSERT_TRUE(len < size);
+	memcpy(buf, str, len);
+	return gpsd_json_parse(rec, buf, len);
+}
+
+static void
+check(const gpsd_json *rec, gpsd_jkey key, gpsd_jtype type,
+      const char *val) {
+	TEST_ASSERT_EQUAL_INT(type, rec->type[key]);
+	if (GJT_NONE == type)
+		TEST_ASSERT_NULL(rec->val[key]);
+	else
+		TEST_ASSERT_EQUAL_STRING(val, rec->val[key]);
+}
+
+
+TEST(gpsdjson, Keys) {
+	const char *names[GJK_COUNT] = {
+		"class", "device", "enable", "json", "rev", "release",
+		"proto_major", "proto_minor", "mode", "time", "ept",
+		"clock_sec", "clock_nsec", "clock_musec", "real_sec",
+		"real_nsec", "real_musec", "precision", "shm"
+	};
+	int i;
+
+	for (i = 0; i < GJK_COUNT; i++)
+		TEST_ASSERT_EQUAL_INT(i, gpsd_json_key(names[i],
+						       strlen(names[i])));
+	TEST_ASSERT_EQUAL_INT(-1, gpsd_json_key("classy", 6));
+	TEST_ASSERT_EQUAL_INT(-1, gpsd_json_key("clock_usec", 10));
+	TEST_ASSERT_EQUAL_INT(-1, gpsd_json_key("proto_mayor", 11));
+	TEST_ASSERT_EQUAL_INT(-1, gpsd_json_key("", 0));
+	/* only the given length counts */
+	TEST_ASSERT_EQUAL_INT(GJK_REV, gpsd_json_key("revision", 3));
+}
+
+TEST(gpsdjson, Version) {
+	gpsd_json rec;
+	char buf[1500];
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[0]));
+	check(&rec, GJK_CLASS, GJT_STRING, "VERSION");
+	check(&rec, GJK_RELEASE, GJT_STRING, "3.25");
+	check(&rec, GJK_REV, GJT_STRING, "3.25");
+	check(&rec, GJK_PROTO_MAJOR, GJT_PRIMITIVE, "3");
+	check(&rec, GJK_PROTO_MINOR, GJT_PRIMITIVE, "15");
+	check(&rec, GJK_DEVICE, GJT_NONE, NULL);
+}
+
+TEST(gpsdjson, Watch) {
+	gpsd_json rec;
+	char buf[1500];
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[1]));
+	check(&rec, GJK_CLASS, GJT_STRING, "WATCH");
+	check(&rec, GJK_ENABLE, GJT_PRIMITIVE, "true");
+	check(&rec, GJK_JSON, GJT_PRIMITIVE, "true");
+	check(&rec, GJK_DEVICE, GJT_STRING, "/dev/ttyS0");
+}
+
+TEST(gpsdjson, Tpv) {
+	gpsd_json rec;
+	char buf[1500];
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[2]));
+	check(&rec, GJK_CLASS, GJT_STRING, "TPV");
+	check(&rec, GJK_MODE, GJT_PRIMITIVE, "3");
+	check(&rec, GJK_TIME, GJT_STRING, "2024-05-01T12:00:00.000Z");
+	check(&rec, GJK_EPT, GJT_PRIMITIVE, "0.005");
+	check(&rec, GJK_PRECISION, GJT_NONE, NULL);
+}
+
+/* the keys of the satellites are not those of the record */
+TEST(gpsdjson, Nested) {
+	gpsd_json rec;
+	char buf[1500];
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[3]));
+	check(&rec, GJK_CLASS, GJT_STRING, "SKY");
+	check(&rec, GJK_TIME, GJT_STRING, "2024-05-01T12:00:00.000Z");
+	check(&rec, GJK_MODE, GJT_NONE, NULL);
+}
+
+TEST(gpsdjson, PpsToff) {
+	gpsd_json rec;
+	char buf[1500];
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[4]));
+	check(&rec, GJK_CLASS, GJT_STRING, "PPS");
+	check(&rec, GJK_REAL_SEC, GJT_PRIMITIVE, "1714564800");
+	check(&rec, GJK_REAL_NSEC, GJT_PRIMITIVE, "0");
+	check(&rec, GJK_CLOCK_SEC, GJT_PRIMITIVE, "1714564800");
+	check(&rec, GJK_CLOCK_NSEC, GJT_PRIMITIVE, "120");
+	check(&rec, GJK_PRECISION, GJT_PRIMITIVE, "-20");
+	check(&rec, GJK_SHM, GJT_STRING, "NTP3");
+	check(&rec, GJK_CLOCK_MUSEC, GJT_NONE, NULL);
+
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf), records[5]));
+	check(&rec, GJK_CLASS, GJT_STRING, "TOFF");
+	check(&rec, GJK_CLOCK_NSEC, GJT_PRIMITIVE, "90210345");
+	check(&rec, GJK_PRECISION, GJT_PRIMITIVE, "-1");
+	check(&rec, GJK_SHM, GJT_STRING, "NTP2");
+}
+
+TEST(gpsdjson, Odd) {
+	gpsd_json rec;
+	char buf[200];
+
+	/* the first of duplicate keys counts */
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf),
+			       "{\"mode\":2,\"mode\":3,\"class\":\"\"}"));
+	check(&rec, GJK_MODE, GJT_PRIMITIVE, "2");
+	check(&rec, GJK_CLASS, GJT_STRING, "");
+
+	/* compound values are filed, but not as strings */
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf),
+			       "{\"time\":[1,2],\"device\":{\"a\":1}}"));
+	TEST_ASSERT_EQUAL_INT(GJT_COMPOUND, rec.type[GJK_TIME]);
+	TEST_ASSERT_EQUAL_INT(GJT_COMPOUND, rec.type[GJK_DEVICE]);
+
+	/* escapes are stepped over, not undone */
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf),
+			       "{\"device\":\"a\\\"}\",\"x\":[\"]\"],\"mode\":1}"));
+	check(&rec, GJK_DEVICE, GJT_STRING, "a\\\"}");
+	check(&rec, GJK_MODE, GJT_PRIMITIVE, "1");
+
+	/* values are not keys */
+	TEST_ASSERT_TRUE(parse(&rec, buf, sizeof(buf),
+			       "{\"x\":\"mode\",\"y\":\"class\"}"));
+	check(&rec, GJK_MODE, GJT_NONE, NULL);
+	check(&rec, GJK_CLASS, GJT_NONE, NULL);
+
+	TEST_ASSERT_FALSE(parse(&rec, buf, sizeof(buf), "[1,2,3]"));
+	TEST_ASSERT_FALSE(parse(&rec, buf, sizeof(buf), "\"mode\""));
+	TEST_ASSERT_FALSE(parse(&rec, buf, sizeof(buf), ""));
+	TEST_ASSERT_FALSE(parse(&rec, buf, sizeof(buf), "{\"mode\":"));
+}
+
+/*
+ * Mutilate the records: change, drop and duplicate bytes and cut them
+ * short.  Whatever comes out, every value filed must be a string that
+ * starts and ends inside the buffer.
+ */
+TEST(gpsdjson, Fuzz) {
+	static const char junk[] = "{}[]\":,\\ 0aet-";
+	uint32_t seed = 42;
+	gpsd_json rec;
+	char src[1500], buf[1500];
+	size_t len;
+	int round, k;
+
+	for (round = 0; round < 20000; round++) {
+		strlcpy(src, records[round % COUNTOF(records)], sizeof(src));
+		len = strlen(src);
+		mutate(src, &len, sizeof(src), junk, 4, &seed);
+		memset(buf, 'X', sizeof(buf));
+		memcpy(buf, src, len);
+		if (!gpsd_json_parse(&rec, buf, len))
+			continue;
+		for (k = 0; k < GJK_COUNT; k++) {
+			if (GJT_NONE == rec.type[k]) {
+				TEST_ASSERT_NULL(rec.val[k]);
+				continue;
+			}
+			TEST_ASSERT_TRUE(rec.val[k] >= buf &&
+					 rec.val[k] < buf + len);
+			TEST_ASSERT_TRUE(rec.val[k] + strlen(rec.val[k])
+					 <= buf + len);
+		}
+	}
+}
+
+TEST_GROUP_RUNNER(gpsdjson) {
+	RUN_TEST_CASE(gpsdjson, Keys);
+	RUN_TEST_CASE(gpsdjson, Version);
+	RUN_TEST_CASE(gpsdjson, Watch);
+	RUN_TEST_CASE(gpsdjson, Tpv);
+	RUN_TEST_CASE(gpsdjson, Nested);
+	RUN_TEST_CASE(gpsdjson, PpsToff);
+	RUN_TEST_CASE(gpsdjson, Odd);
+	RUN_TEST_CASE(gpsdjson, Fuzz);
+}
@@ -0,0 +1,374 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "mutate.h"
+
+#include "ntp.h"
+#include "ntp_stdlib.h"
+#include "ntp_nmea.h"
+
+
+/* the longest line the refclock reads, BMAX */
+#define LINEMAX 128
+
+TEST_GROUP(nmea);
+
+TEST_SETUP(nmea) {}
+
+TEST_TEAR_DOWN(nmea) {}
+
+/* a second of output of the receivers the refclock knows */
+static const char *sentences[] = {
+	"$GPRMC,123519.00,A,4807.038,N,01131.000,E,022.4,084.4,230394,"
+	"003.1,W*44",
+	"$GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,"
+	"*69",
+	"$GNGLL,4807.038,N,01131.000,E,123519.00,A,A*78",
+	"$GPZDA,123519.00,23,03,1994,00,00*6C",
+	"$GPZDG,123519.00,23,03,1994,00.50,1*70",
+	"$PGRMF,753,389737,230394,123519,11,4807.0380,N,01131.0000,E,A,2,0,"
+	"62,2,1*2D",
+	"$PUBX,04,123519.00,230394,389737.00,753,10,-125236,-1196.398,21*15",
+	"$GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00"
+	"*74",
+};
+
+/* split a copy of str in buf */
+static int
+split(nmea_sentence *s, char *buf, size_t size, const char *str) {
+	size_t len = strlen(str);
+
+	TEST_ASSERT_TRUE(len < size);
+	memcpy(buf, str, len + 1);
+	return nmea_split(s, buf, len);
+}
+
+static void
+check(const nmea_sentence *s, int idx, const char *val) {
+	const char *f;
+	size_t len;
+
+	f = nmea_field(s, idx, &len);
+	TEST_ASSERT_EQUAL_INT((int)strlen(val), (int)len);
+	if (len)
+		TEST_ASSERT_EQUAL_MEMORY(val, f, len);
+	TEST_ASSERT_TRUE(nmea_field_is(s, idx, val));
+}
+
+
+TEST(nmea, Recorded) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+	unsigned int i;
+
+	for (i = 0; i < COUNTOF(sentences); i++)
+		TEST_ASSERT_EQUAL_INT(CHECK_CSVALID,
+				      split(&s, buf, sizeof(buf),
+					    sentences[i]));
+}
+
+TEST(nmea, Fields) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+
+	TEST_ASSERT_EQUAL_INT(CHECK_CSVALID,
+			      split(&s, buf, sizeof(buf), sentences[1]));
+	TEST_ASSERT_EQUAL_INT(15, s.nfield);
+	check(&s, 0, "GPGGA");
+	check(&s, 1, "123519.00");
+	check(&s, 6, "1");
+	check(&s, 12, "M");
+	check(&s, 13, "");
+	/* the last field ends at the checksum */
+	check(&s, 14, "");
+	/* fields that are not there are empty */
+	check(&s, 15, "");
+	check(&s, -1, "");
+	/* and the line is left alone */
+	TEST_ASSERT_EQUAL_STRING(sentences[1], buf);
+
+	TEST_ASSERT_EQUAL_INT(CHECK_CSVALID,
+			      split(&s, buf, sizeof(buf), sentences[6]));
+	check(&s, 0, "PUBX");
+	check(&s, 1, "04");
+	check(&s, 9, "21");
+}
+
+TEST(nmea, Checksum) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+
+	TEST_ASSERT_EQUAL_INT(CHECK_VALID,
+			      split(&s, buf, sizeof(buf),
+				    "$GPZDA,123519.00,23,03,1994,00,00"));
+	check(&s, 6, "00");
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+			      split(&s, buf, sizeof(buf),
+				    "$GPZDA,123519.00,23,03,1994,00,00*6D"));
+	/* upper case hex only */
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+			      split(&s, buf, sizeof(buf),
+				    "$GPZDA,123519.00,23,03,1994,00,00*6c"));
+	/* nothing after it */
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+			      split(&s, buf, sizeof(buf),
+				    "$GPZDA,123519.00,23,03,1994,00,00*6C0"));
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+			      split(&s, buf, sizeof(buf),
+				    "$GPZDA,123519.00,23,03,1994,00,00*6"));
+	/* no more than 80 characters before it */
+	TEST_ASSERT_EQUAL_INT(CHECK_CSVALID,
+			      split(&s, buf, sizeof(buf), "$GPXXX,"
+				    "0000000000000000000000000000000000000000"
+				    "000000000000000000000000000000000*53"));
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+			      split(&s, buf, sizeof(buf), "$GPXXX,"
+				    "0000000000000000000000000000000000000000"
+				    "0000000000000000000000000000000000*63"));
+}
+
+TEST(nmea, Invalid) {
+	static const char *bad[] = {
+		"GPZDA,123519.00,23,03,1994,00,00",	/* no '$' */
+		"$gpzda,123519.00,23,03,1994,00,00",	/* lower case */
+		"$1PZDA,123519.00,23,03,1994,00,00",	/* digit first */
+		"$ZDA,123519.00,23,03,1994,00,00",	/* name too short */
+		"$GPXX,123519.00",			/* and not 'P' */
+		"$PUB,04",				/* too short anyway */
+		"$GPZDA",				/* no comma */
+		"$GPZ-A,123519.00",			/* not in a name */
+		"$",
+	};
+	nmea_sentence s;
+	char buf[LINEMAX];
+	unsigned int i;
+
+	for (i = 0; i < COUNTOF(bad); i++)
+		TEST_ASSERT_EQUAL_INT(CHECK_INVALID,
+				      split(&s, buf, sizeof(buf), bad[i]));
+	TEST_ASSERT_EQUAL_INT(CHECK_EMPTY, split(&s, buf, sizeof(buf), ""));
+	/* a NUL inside */
+	memcpy(buf, "$GPZDA,12\0" "519.00", 16);
+	TEST_ASSERT_EQUAL_INT(CHECK_INVALID, nmea_split(&s, buf, 16));
+}
+
+/* past NMEA_PROTO_FIELDS, fields are not recorded */
+TEST(nmea, ManyFields) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+	char line[LINEMAX] = "$GPGSV";
+	int i;
+
+	for (i = 1; i <= NMEA_PROTO_FIELDS + 5; i++)
+		snprintf(line + strlen(line), sizeof(line) - strlen(line),
+			 ",%d", i);
+	TEST_ASSERT_EQUAL_INT(CHECK_VALID,
+			      split(&s, buf, sizeof(buf), line));
+	TEST_ASSERT_EQUAL_INT(NMEA_PROTO_FIELDS + 1, s.nfield);
+	check(&s, NMEA_PROTO_FIELDS - 1, "31");
+	check(&s, NMEA_PROTO_FIELDS, "32");
+	check(&s, NMEA_PROTO_FIELDS + 1, "");
+}
+
+TEST(nmea, Time) {
+	static const struct {
+		const char *	field;
+		bool		ok;
+		int		h, m, s;
+		long		ns;
+	} cases[] = {
+		{ "123519",	true,  12, 35, 19, 0 },
+		{ "123519.",	true,  12, 35, 19, 0 },
+		{ "123519.5",	true,  12, 35, 19, 500000000 },
+		{ "235960.25",	true,  23, 59, 60, 250000000 },
+		{ "000000.123456", true, 0, 0, 0, 123000000 },
+		{ "",		false, 0, 0, 0, 0 },
+		{ "12351",	false, 0, 0, 0, 0 },
+		{ "12a519",	false, 0, 0, 0, 0 },
+		{ " 23519",	false, 0, 0, 0, 0 },
+		{ "243519",	false, 0, 0, 0, 0 },
+		{ "126019",	false, 0, 0, 0, 0 },
+		{ "123561",	false, 0, 0, 0, 0 },
+		{ "123519Z",	false, 0, 0, 0, 0 },
+		{ "123519.1x",	false, 0, 0, 0, 0 },
+	};
+	nmea_sentence s;
+	struct calendar jd;
+	char buf[LINEMAX], line[LINEMAX];
+	long ns;
+	unsigned int i;
+
+	for (i = 0; i < COUNTOF(cases); i++) {
+		snprintf(line, sizeof(line), "$GPGGA,%s,4807.038",
+			 cases[i].field);
+		TEST_ASSERT_EQUAL_INT(CHECK_VALID,
+				      split(&s, buf, sizeof(buf), line));
+		ZERO(jd);
+		ns = -1;
+		TEST_ASSERT_EQUAL(cases[i].ok, nmea_time(&s, 1, &jd, &ns));
+		if (!cases[i].ok)
+			continue;
+		TEST_ASSERT_EQUAL_INT(cases[i].h, jd.hour);
+		TEST_ASSERT_EQUAL_INT(cases[i].m, jd.minute);
+		TEST_ASSERT_EQUAL_INT(cases[i].s, jd.second);
+		TEST_ASSERT_EQUAL_INT64(cases[i].ns, ns);
+	}
+}
+
+TEST(nmea, Date) {
+	nmea_sentence s;
+	struct calendar jd;
+	char buf[LINEMAX];
+
+	ZERO(jd);
+	split(&s, buf, sizeof(buf), sentences[0]);
+	TEST_ASSERT_TRUE(nmea_date(&s, 9, false, &jd));
+	TEST_ASSERT_EQUAL_INT(23, jd.monthday);
+	TEST_ASSERT_EQUAL_INT(3, jd.month);
+	TEST_ASSERT_EQUAL_INT(94, jd.year);
+	/* not a date */
+	TEST_ASSERT_FALSE(nmea_date(&s, 8, false, &jd));
+
+	ZERO(jd);
+	split(&s, buf, sizeof(buf), sentences[3]);
+	TEST_ASSERT_TRUE(nmea_date(&s, 2, true, &jd));
+	TEST_ASSERT_EQUAL_INT(23, jd.monthday);
+	TEST_ASSERT_EQUAL_INT(3, jd.month);
+	TEST_ASSERT_EQUAL_INT(1994, jd.year);
+
+	split(&s, buf, sizeof(buf), "$GPRMC,123519,A,,,,,,,320394");
+	TEST_ASSERT_FALSE(nmea_date(&s, 9, false, &jd));
+	split(&s, buf, sizeof(buf), "$GPRMC,123519,A,,,,,,,231394");
+	TEST_ASSERT_FALSE(nmea_date(&s, 9, false, &jd));
+	split(&s, buf, sizeof(buf), "$GPRMC,123519,A,,,,,,,23039");
+	TEST_ASSERT_FALSE(nmea_date(&s, 9, false, &jd));
+	split(&s, buf, sizeof(buf), "$GPZDA,123519,23,3,1994,00,00");
+	TEST_ASSERT_FALSE(nmea_date(&s, 2, true, &jd));
+	split(&s, buf, sizeof(buf), "$GPZDA,123519,23,03,94,00,00");
+	TEST_ASSERT_FALSE(nmea_date(&s, 2, true, &jd));
+	split(&s, buf, sizeof(buf), "$GPZDA,123519,00,03,1994,00,00");
+	TEST_ASSERT_FALSE(nmea_date(&s, 2, true, &jd));
+	/* the year is the last field */
+	split(&s, buf, sizeof(buf), "$GPZDA,123519,23,03");
+	TEST_ASSERT_FALSE(nmea_date(&s, 2, true, &jd));
+}
+
+TEST(nmea, Weekdata) {
+	nmea_sentence s;
+	gps_weektm wd;
+	char buf[LINEMAX];
+
+	ZERO(wd);
+	split(&s, buf, sizeof(buf), sentences[5]);
+	TEST_ASSERT_TRUE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	TEST_ASSERT_EQUAL_INT(753, wd.wt_week);
+	TEST_ASSERT_EQUAL_UINT32(389737, wd.wt_time);
+	TEST_ASSERT_EQUAL_INT(11, wd.wt_leap);
+
+	split(&s, buf, sizeof(buf), "$PGRMF,753,389737,,,-3");
+	TEST_ASSERT_TRUE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	TEST_ASSERT_EQUAL_INT(-3, wd.wt_leap);
+	split(&s, buf, sizeof(buf), "$PGRMF,1024,389737,,,11");
+	TEST_ASSERT_FALSE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	split(&s, buf, sizeof(buf), "$PGRMF,753,604800,,,11");
+	TEST_ASSERT_FALSE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	split(&s, buf, sizeof(buf), "$PGRMF,753,389737,,,");
+	TEST_ASSERT_FALSE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	split(&s, buf, sizeof(buf), "$PGRMF,,389737,,,11");
+	TEST_ASSERT_FALSE(nmea_weekdata(&s, 1, 2, 5, &wd));
+	split(&s, buf, sizeof(buf), "$PGRMF,753,38973x,,,11");
+	TEST_ASSERT_FALSE(nmea_weekdata(&s, 1, 2, 5, &wd));
+}
+
+TEST(nmea, Qual) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+
+	split(&s, buf, sizeof(buf), "$GPRMC,123519,A,,,,,,,,,,,,,,,V,0,");
+	TEST_ASSERT_EQUAL_INT(LEAP_NOWARNING, nmea_qual(&s, 2, 'A', false));
+	TEST_ASSERT_EQUAL_INT(LEAP_NOTINSYNC, nmea_qual(&s, 2, 'A', true));
+	TEST_ASSERT_EQUAL_INT(LEAP_NOTINSYNC, nmea_qual(&s, 17, 'A', false));
+	TEST_ASSERT_EQUAL_INT(LEAP_NOTINSYNC, nmea_qual(&s, 18, '0', true));
+	/* an empty field is no status */
+	TEST_ASSERT_EQUAL_INT(LEAP_NOTINSYNC, nmea_qual(&s, 19, '0', true));
+	TEST_ASSERT_EQUAL_INT(LEAP_NOTINSYNC, nmea_qual(&s, 40, '0', true));
+}
+
+TEST(nmea, Wipe) {
+	nmea_sentence s;
+	char buf[LINEMAX];
+
+	split(&s, buf, sizeof(buf), sentences[2]);
+	nmea_wipe(&s, 1);
+	nmea_wipe(&s, 3);
+	nmea_wipe(&s, NMEA_CKSUM);
+	nmea_wipe(&s, 20);
+	TEST_ASSERT_EQUAL_STRING(
+		"$GNGLL,____.___,N,_____.___,E,123519.00,A,A*__", buf);
+
+	/* no checksum, nothing to wipe */
+	split(&s, buf, sizeof(buf), "$GPZDA,123519.00,23,03,1994,00,00");
+	nmea_wipe(&s, NMEA_CKSUM);
+	TEST_ASSERT_EQUAL_STRING("$GPZDA,123519.00,23,03,1994,00,00", buf);
+}
+
+/* mangled sentences never make fields outside the line */
+TEST(nmea, Fuzz) {
+	static const char junk[] = "$*,.0A9FZ-";
+	uint32_t seed = 42;
+	nmea_sentence s;
+	struct calendar jd;
+	gps_weektm wd;
+	char src[LINEMAX], buf[LINEMAX];
+	const char *f;
+	size_t len, flen;
+	long ns;
+	int round, k, rc;
+
+	for (round = 0; round < 20000; round++) {
+		strlcpy(src, sentences[round % COUNTOF(sentences)],
+			sizeof(src));
+		len = strlen(src);
+		mutate(src, &len, sizeof(src), junk, 3, &seed);
+		memset(buf, 'X', sizeof(buf));
+		memcpy(buf, src, len);
+		rc = nmea_split(&s, buf, len);
+		if (CHECK_VALID != rc && CHECK_CSVALID != rc)
+			continue;
+		TEST_ASSERT_TRUE(s.nfield >= 1 &&
+				 s.nfield <= NMEA_PROTO_FIELDS + 1);
+		for (k = 0; k < s.nfield; k++) {
+			f = nmea_field(&s, k, &flen);
+			TEST_ASSERT_TRUE(f > buf && f + flen <= buf + len);
+			TEST_ASSERT_NULL(memchr(f, ',', flen));
+			TEST_ASSERT_NULL(memchr(f, '*', flen));
+		}
+		for (k = 0; k < 12; k++) {
+			(void)nmea_time(&s, k, &jd, &ns);
+			(void)nmea_date(&s, k, k & 1, &jd);
+			(void)nmea_qual(&s, k, '0', k & 1);
+		}
+		(void)nmea_weekdata(&s, 1, 2, 5, &wd);
+		for (k = -1; k < 12; k++)
+			nmea_wipe(&s, k);
+		TEST_ASSERT_EQUAL_INT('X', buf[len]);
+	}
+}
+
+TEST_GROUP_RUNNER(nmea) {
+	RUN_TEST_CASE(nmea, Recorded);
+	RUN_TEST_CASE(nmea, Fields);
+	RUN_TEST_CASE(nmea, Checksum);
+	RUN_TEST_CASE(nmea, Invalid);
+	RUN_TEST_CASE(nmea, ManyFields);
+	RUN_TEST_CASE(nmea, Time);
+	RUN_TEST_CASE(nmea, Date);
+	RUN_TEST_CASE(nmea, Weekdata);
+	RUN_TEST_CASE(nmea, Qual);
+	RUN_TEST_CASE(nmea, Wipe);
+	RUN_TEST_CASE(nmea, Fuzz);
+}
@@ -0,0 +1,209 @@
+#include "config.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+#include "ntp_refclock.h"
+#include "ppsapi_timepps.h"
+#include "refclock_pps.h"
+
+/*
+ * The ppsmulti driver run through its transfer vector, with the PPSAPI
+ * and the rest of the refclock code it calls faked below: each device
+ * gives the edge set for it, and the samples the driver makes and the
+ * lines it logs are kept here to look at.
+ */
+
+TEST_GROUP(ppsmulti);
+
+#define NDEV	4
+#define SECOND	3800000000U	/* some second of NTP era 0 */
+
+struct system_variables sys_vars;
+
+static struct peer peer;
+static struct refclockproc proc;
+
+static int ndev;		/* devices opened */
+static bool ready[NDEV];	/* a new edge waits */
+static l_fp edge[NDEV];		/* ... and when it came */
+static int modes[NDEV];		/* the mode each device was set up in */
+static int samples;		/* refclock_process_offset() calls */
+static l_fp lasttim, lastrec;	/* ... and what it got last */
+static char logged[256];	/* the last clockstats line */
+
+TEST_SETUP(ppsmulti) {
+	ZERO(peer);
+	ZERO(proc);
+	peer.procptr = &proc;
+	sys_vars.sys_leap = LEAP_NOWARNING;
+	ndev = 0;
+	ZERO(ready);
+	ZERO(modes);
+	samples = 0;
+	logged[0] = '\0';
+}
+
+TEST_TEAR_DOWN(ppsmulti) {
+	if (proc.unitptr != NULL)
+		refclock_ppsmulti.clock_shutdown(&proc);
+	proc.unitptr = NULL;
+}
+
+
+bool
+refclock_ppsapi(int fddev, struct refclock_ppsctl *ap) {
+	UNUSED_ARG(fddev);
+	ap->handle = (pps_handle_t)++ndev;
+	return true;
+}
+
+pps_status
+refclock_ppsfetch(struct peer *p, struct refclock_ppsctl *ap, int mode,
+		  l_fp *stamp, double *frac) {
+	int dev = (int)ap->handle - 1;
+
+	UNUSED_ARG(p);
+	modes[dev] = mode;
+	if (!ready[dev])
+		return PPS_NREADY;
+	ready[dev] = false;
+	*stamp = edge[dev];
+	*frac = lfpfrac(edge[dev]) / FRAC;
+	if (*frac > .5)
+		*frac -= 1.;
+	return PPS_OK;
+}
+
+void
+refclock_process_offset(struct refclockproc *pp, l_fp tim, l_fp rec,
+			double fudge) {
+	UNUSED_ARG(pp);
+	UNUSED_ARG(fudge);
+	samples++;
+	lasttim = tim;
+	lastrec = rec;
+}
+
+void
+refclock_report(struct peer *p, int code) {
+	UNUSED_ARG(p);
+	UNUSED_ARG(code);
+}
+
+void
+refclock_receive(struct peer *p) {
+	UNUSED_ARG(p);
+}
+
+char *
+add_var(struct ctl_var **kv, unsigned long size, unsigned short def) {
+	static char buf[256];
+
+	UNUSED_ARG(kv);
+	UNUSED_ARG(def);
+	TEST_ASSERT_TRUE(size <= sizeof(buf));
+	return buf;
+}
+
+int
+mprintf_clock_stats(struct peer *p, const char *fmt, ...) {
+	va_list ap;
+
+	UNUSED_ARG(p);
+	va_start(ap, fmt);
+	vsnprintf(logged, sizeof(logged), fmt, ap);
+	va_end(ap);
+	return (int)strlen(logged);
+}
+
+
+static void
+start(const char *paths) {
+	static char buf[128];
+
+	strlcpy(buf, paths, sizeof(buf));
+	peer.cfg.ppspath = buf;
+	TEST_ASSERT_TRUE(refclock_ppsmulti.clock_start(0, &peer));
+}
+
+/* device dev saw an edge off seconds from the second sec after SECOND */
+static void
+put(int dev, int sec, double off) {
+	ready[dev] = true;
+	edge[dev] = lfpinit_u(SECOND + (uint32_t)sec, 0) + dtolfp(off);
+}
+
+
+/* three devices, one a millisecond off: the other two make the sample */
+TEST(ppsmulti, Combine) {
+	start("/dev/null,/dev/null,/dev/null");
+	put(0, 0, 2e-6);
+	put(1, 0, -1e-6);
+	put(2, 0, 1e-3);
+	refclock_ppsmulti.clock_timer(0, &peer);
+	TEST_ASSERT_EQUAL_INT(1, samples);
+	TEST_ASSERT_TRUE(lasttim == lfpinit_u(SECOND, 0));
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.5e-6, lfptod(lastrec - lasttim));
+
+	/* the counts of the poll: samples, none, edges and used */
+	refclock_ppsmulti.clock_poll(0, &peer);
+	TEST_ASSERT_EQUAL_STRING("1 0 1 1 1 1 1 0", logged);
+}
+
+/* an edge of the second before is left out, a missing one is counted */
+TEST(ppsmulti, LateAndMissing) {
+	start("/dev/null,/dev/null,/dev/null,/dev/null");
+	put(0, 5, 1e-6);
+	put(1, 5, 3e-6);
+	put(2, 4, 2e-6);
+	refclock_ppsmulti.clock_timer(0, &peer);
+	TEST_ASSERT_EQUAL_INT(1, samples);
+	TEST_ASSERT_TRUE(lasttim == lfpinit_u(SECOND + 5, 0));
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, 2e-6, lfptod(lastrec - lasttim));
+
+	/* two that disagree give no sample */
+	put(0, 6, 1e-6);
+	put(1, 6, 1e-4);
+	refclock_ppsmulti.clock_timer(0, &peer);
+	TEST_ASSERT_EQUAL_INT(1, samples);
+
+	refclock_ppsmulti.clock_poll(0, &peer);
+	TEST_ASSERT_EQUAL_STRING("1 1 2 1 2 1 1 0 0 0", logged);
+}
+
+/* an edge just before the second is a negative offset from it */
+TEST(ppsmulti, Wrap) {
+	start("/dev/null,/dev/null");
+	put(0, 1, -2e-6);
+	put(1, 1, 2e-6);
+	refclock_ppsmulti.clock_timer(0, &peer);
+	TEST_ASSERT_EQUAL_INT(1, samples);
+	TEST_ASSERT_TRUE(lasttim == lfpinit_u(SECOND + 1, 0));
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.0, lfptod(lastrec - lasttim));
+}
+
+/* the kernel follows the first device only */
+TEST(ppsmulti, KernelFirstOnly) {
+	int i;
+
+	proc.sloppyclockflag = CLK_FLAG2 | CLK_FLAG3;
+	start("/dev/null,/dev/null,/dev/null");
+	refclock_ppsmulti.clock_timer(0, &peer);
+	TEST_ASSERT_EQUAL_INT(CLK_FLAG2 | CLK_FLAG3, modes[0]);
+	for (i = 1; i < 3; i++)
+		TEST_ASSERT_EQUAL_INT(CLK_FLAG2, modes[i]);
+}
+
+TEST_GROUP_RUNNER(ppsmulti) {
+	RUN_TEST_CASE(ppsmulti, Combine);
+	RUN_TEST_CASE(ppsmulti, LateAndMissing);
+	RUN_TEST_CASE(ppsmulti, Wrap);
+	RUN_TEST_CASE(ppsmulti, KernelFirstOnly);
+}
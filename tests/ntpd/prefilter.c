@@ -0,0 +1,194 @@
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_LINUX_FILTER_H
+# include <linux/filter.h>
+#endif
+
+#include "ntpd.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+
+TEST_GROUP(prefilter);
+
+#define MARKER	0xEE	/* stratum of the packet sent after each test */
+
+static int rx = -1, tx = -1, tx2 = -1;
+
+static sockaddr_u
+addr4(const char *ip) {
+	sockaddr_u sa;
+
+	ZERO(sa);
+	SET_AF(&sa, AF_INET);
+	PSOCK_ADDR4(&sa)->s_addr = inet_addr(ip);
+	return sa;
+}
+
+/* a UDP socket on ip, any port */
+static int
+udp_socket(const char *ip) {
+	sockaddr_u sa = addr4(ip);
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (fd >= 0 && bind(fd, &sa.sa, sizeof(sa.sa4)) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+TEST_SETUP(prefilter) {
+	if (NULL == rstrct.restrictlist4)
+		init_restrict();
+	rx = udp_socket("127.0.0.1");
+	tx = udp_socket("127.0.0.1");
+	tx2 = udp_socket("127.0.0.2");
+}
+
+TEST_TEAR_DOWN(prefilter) {
+	sockaddr_u a = addr4("127.0.0.2"), m = addr4("255.255.255.255");
+
+	hack_restrict(RESTRICT_REMOVE, &a, &m, 0, 0);
+	if (rx >= 0)
+		close(rx);
+	if (tx >= 0)
+		close(tx);
+	if (tx2 >= 0)
+		close(tx2);
+	rx = tx = tx2 = -1;
+}
+
+
+/* send len bytes of an NTP header with the given first byte from fd */
+static void
+send_pkt(int fd, uint8_t li_vn_mode, uint8_t stratum, size_t len) {
+	uint8_t buf[LEN_PKT_NOMAC];
+	sockaddr_u to;
+	socklen_t tolen = sizeof(to);
+
+	TEST_ASSERT_EQUAL_INT(0, getsockname(rx, &to.sa, &tolen));
+	memset(buf, 0, sizeof(buf));
+	buf[0] = li_vn_mode;
+	buf[1] = stratum;
+	TEST_ASSERT_EQUAL_INT((int)len, (int)sendto(fd, buf, len, 0, &to.sa,
+						     tolen));
+}
+
+/*
+ * Send a packet and a good one after it, and report whether the first
+ * got through: loopback keeps the order, so the marker arriving first
+ * means the packet was dropped.
+ */
+static bool
+passes(int fd, uint8_t li_vn_mode, size_t len) {
+	struct pollfd pfd = { rx, POLLIN, 0 };
+	uint8_t buf[LEN_PKT_NOMAC];
+
+	send_pkt(fd, li_vn_mode, 0, len);
+	send_pkt(tx, PKT_LI_VN_MODE(0, NTP_VERSION, MODE_CLIENT), MARKER,
+		 LEN_PKT_NOMAC);
+	TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 1000));
+	TEST_ASSERT_TRUE(recv(rx, buf, sizeof(buf), 0) >= 2);
+	if (MARKER == buf[1])
+		return false;
+	TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 1000));
+	TEST_ASSERT_TRUE(recv(rx, buf, sizeof(buf), 0) >= 2);
+	TEST_ASSERT_EQUAL_HEX8(MARKER, buf[1]);
+	return true;
+}
+
+
+TEST(prefilter, HeaderChecks) {
+#ifdef HAVE_LINUX_FILTER_H
+	uint64_t drops;
+
+	TEST_ASSERT_TRUE(rx >= 0 && tx >= 0);
+	TEST_ASSERT_TRUE(prefilter_attach(rx, AF_INET));
+	drops = socket_drops(rx);
+
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_CLIENT), 48));
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(0, 3, MODE_SERVER), 48));
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(3, 2, MODE_CLIENT), 12));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_CLIENT), 11));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 1, MODE_CLIENT), 48));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 5, MODE_CLIENT), 48));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_ACTIVEx), 48));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_BROADCASTx),
+				 48));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_PRIVATEx), 48));
+	TEST_ASSERT_EQUAL_UINT64(drops + 6, socket_drops(rx));
+
+	prefilter_detach(rx);
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_PRIVATEx), 48));
+#else
+	TEST_IGNORE_MESSAGE("no socket filters");
+#endif
+}
+
+TEST(prefilter, Restrictions) {
+#ifdef HAVE_LINUX_FILTER_H
+	sockaddr_u a = addr4("127.0.0.2"), m = addr4("255.255.255.255");
+	sockaddr_u any = addr4("0.0.0.0");
+	unsigned int gen = rstrct.generation;
+
+	TEST_ASSERT_TRUE(rx >= 0 && tx >= 0 && tx2 >= 0);
+
+	/* the default entry has noquery */
+	TEST_ASSERT_TRUE(prefilter_attach(rx, AF_INET));
+	TEST_ASSERT_FALSE(passes(tx, PKT_LI_VN_MODE(0, 2, MODE_CONTROL),
+				 12));
+	TEST_ASSERT_TRUE(passes(tx2, PKT_LI_VN_MODE(0, 4, MODE_CLIENT), 48));
+
+	/* a more specific entry goes first */
+	hack_restrict(RESTRICT_FLAGS, &a, &m, 0, RES_IGNORE);
+	TEST_ASSERT_TRUE(rstrct.generation != gen);
+	TEST_ASSERT_TRUE(prefilter_attach(rx, AF_INET));
+	TEST_ASSERT_FALSE(passes(tx2, PKT_LI_VN_MODE(0, 4, MODE_CLIENT),
+				 48));
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(0, 4, MODE_CLIENT), 48));
+
+	hack_restrict(RESTRICT_UNFLAG, &a, &m, 0, RES_IGNORE);
+	hack_restrict(RESTRICT_FLAGS, &a, &m, 0, RES_DONTSERVE | RES_VERSION);
+	hack_restrict(RESTRICT_UNFLAG, &any, &any, 0, RES_NOQUERY);
+	TEST_ASSERT_TRUE(prefilter_attach(rx, AF_INET));
+	TEST_ASSERT_FALSE(passes(tx2, PKT_LI_VN_MODE(0, 4, MODE_CLIENT),
+				 48));
+	TEST_ASSERT_FALSE(passes(tx2, PKT_LI_VN_MODE(0, 2, MODE_CONTROL),
+				 12));
+	TEST_ASSERT_TRUE(passes(tx2, PKT_LI_VN_MODE(0, 4, MODE_CONTROL),
+				12));
+	TEST_ASSERT_TRUE(passes(tx, PKT_LI_VN_MODE(0, 2, MODE_CONTROL), 12));
+	hack_restrict(RESTRICT_FLAGS, &any, &any, 0, RES_NOQUERY);
+#else
+	TEST_IGNORE_MESSAGE("no socket filters");
+#endif
+}
+
+TEST(prefilter, TooLong) {
+#ifdef HAVE_LINUX_FILTER_H
+	struct sock_filter prog[BPF_MAXINSNS];
+	int len;
+
+	len = prefilter_build(AF_INET, prog, BPF_MAXINSNS);
+	TEST_ASSERT_TRUE(len > 0);
+	TEST_ASSERT_EQUAL_INT(-1, prefilter_build(AF_INET, prog, len - 1));
+	TEST_ASSERT_TRUE(prefilter_build(AF_INET6, prog, BPF_MAXINSNS) > 0);
+#else
+	TEST_IGNORE_MESSAGE("no socket filters");
+#endif
+}
+
+TEST_GROUP_RUNNER(prefilter) {
+	RUN_TEST_CASE(prefilter, HeaderChecks);
+	RUN_TEST_CASE(prefilter, Restrictions);
+	RUN_TEST_CASE(prefilter, TooLong);
+}
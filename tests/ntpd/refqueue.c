@@ -0,0 +1,185 @@
+#include "config.h"
+
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "ntp_stdlib.h"
+#include "ntp_refqueue.h"
+#include "timespecops.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+
+TEST_GROUP(refqueue);
+
+#ifdef HAVE_STDATOMIC_H
+# define NEEDS_THREADS()
+#else
+# define NEEDS_THREADS() TEST_IGNORE_MESSAGE("no reader threads")
+#endif
+
+/* a device that keeps message boundaries and reports EOF: sv[0] */
+static int sv[2] = { -1, -1 };
+
+TEST_SETUP(refqueue) {
+	TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv));
+}
+
+TEST_TEAR_DOWN(refqueue) {
+	if (sv[0] >= 0)
+		close(sv[0]);
+	if (sv[1] >= 0)
+		close(sv[1]);
+	sv[0] = sv[1] = -1;
+}
+
+
+/* wait for the reader thread to queue something */
+static struct refq_slot *
+next(struct refqueue *q) {
+	struct pollfd pfd = { refq_wakefd(q), POLLIN, 0 };
+	struct refq_slot *sp;
+
+	while (NULL == (sp = refq_peek(q))) {
+		TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 1000));
+		refq_clear(q);
+	}
+	return sp;
+}
+
+/* the clock the reader thread stamps by, without get_systime()'s fuzz */
+static l_fp
+now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return tspec_stamp_to_lfp(ts);
+}
+
+static void
+put(const char *msg) {
+	TEST_ASSERT_EQUAL_INT((int)strlen(msg),
+			      (int)write(sv[1], msg, strlen(msg)));
+}
+
+
+TEST(refqueue, Order) {
+	static const char *msgs[] = { "$GPRMC,1", "$GPGGA,22", "$GPZDA,333" };
+	struct refqueue *q = refq_start(sv[0], 0);
+	struct refq_slot *sp;
+	l_fp before, after, last = 0;
+	unsigned int i;
+
+	NEEDS_THREADS();
+	TEST_ASSERT_NOT_NULL(q);
+	for (i = 0; i < COUNTOF(msgs); i++) {
+		before = now();
+		put(msgs[i]);
+		sp = next(q);
+		after = now();
+		TEST_ASSERT_EQUAL_INT((int)strlen(msgs[i]), (int)sp->len);
+		TEST_ASSERT_EQUAL_MEMORY(msgs[i], sp->data, strlen(msgs[i]));
+		/* stamped between the write and the hand-over */
+		TEST_ASSERT_TRUE(sp->stamp >= before && sp->stamp <= after);
+		TEST_ASSERT_TRUE(sp->stamp >= last);
+		last = sp->stamp;
+		refq_release(q);
+	}
+	TEST_ASSERT_NULL(refq_peek(q));
+	TEST_ASSERT_EQUAL_UINT(0, refq_dropped(q));
+	refq_stop(q);
+}
+
+/* reads are cut to the given length */
+TEST(refqueue, Datalen) {
+	struct refqueue *q = refq_start(sv[0], 4);
+	struct refq_slot *sp;
+
+	NEEDS_THREADS();
+	TEST_ASSERT_NOT_NULL(q);
+	put("abcdefgh");
+	sp = next(q);
+	TEST_ASSERT_EQUAL_INT(4, (int)sp->len);
+	TEST_ASSERT_EQUAL_MEMORY("abcd", sp->data, 4);
+	refq_release(q);
+	refq_stop(q);
+}
+
+/* with the ring full, later reads are dropped and counted */
+TEST(refqueue, Full) {
+	struct refqueue *q = refq_start(sv[0], 0);
+	struct refq_slot *sp;
+	unsigned long dropped = 0;
+	char msg[16];
+	int i, tries;
+
+	NEEDS_THREADS();
+	TEST_ASSERT_NOT_NULL(q);
+	for (i = 0; i < REFQ_SLOTS + 5; i++) {
+		snprintf(msg, sizeof(msg), "m%d", i);
+		put(msg);
+	}
+	for (tries = 0; dropped < 5 && tries < 100; tries++) {
+		usleep(10000);
+		dropped += refq_dropped(q);
+	}
+	TEST_ASSERT_EQUAL_UINT(5, dropped);
+	for (i = 0; i < REFQ_SLOTS; i++) {
+		snprintf(msg, sizeof(msg), "m%d", i);
+		sp = next(q);
+		TEST_ASSERT_EQUAL_INT((int)strlen(msg), (int)sp->len);
+		TEST_ASSERT_EQUAL_MEMORY(msg, sp->data, strlen(msg));
+		refq_release(q);
+	}
+	TEST_ASSERT_NULL(refq_peek(q));
+
+	/* and there is room again */
+	put("again");
+	sp = next(q);
+	TEST_ASSERT_EQUAL_MEMORY("again", sp->data, 5);
+	refq_release(q);
+	refq_stop(q);
+}
+
+/* EOF is queued after the data, and ends the reader */
+TEST(refqueue, Eof) {
+	struct refqueue *q = refq_start(sv[0], 0);
+	struct refq_slot *sp;
+
+	NEEDS_THREADS();
+	TEST_ASSERT_NOT_NULL(q);
+	put("last");
+	close(sv[1]);
+	sv[1] = -1;
+	sp = next(q);
+	TEST_ASSERT_EQUAL_INT(4, (int)sp->len);
+	refq_release(q);
+	sp = next(q);
+	TEST_ASSERT_EQUAL_INT(0, (int)sp->len);
+	refq_release(q);
+	refq_stop(q);
+}
+
+/* a reader waiting for input stops */
+TEST(refqueue, Stop) {
+	struct refqueue *q = refq_start(sv[0], 0);
+
+	NEEDS_THREADS();
+	TEST_ASSERT_NOT_NULL(q);
+	usleep(1000);
+	refq_stop(q);
+	/* the device is left open */
+	put("still");
+}
+
+TEST_GROUP_RUNNER(refqueue) {
+	RUN_TEST_CASE(refqueue, Order);
+	RUN_TEST_CASE(refqueue, Datalen);
+	RUN_TEST_CASE(refqueue, Full);
+	RUN_TEST_CASE(refqueue, Eof);
+	RUN_TEST_CASE(refqueue, Stop);
+}
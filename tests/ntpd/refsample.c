@@ -0,0 +1,265 @@
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "lcg.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+#include "ntp_refclock.h"
+
+
+TEST_GROUP(refsample);
+
+#define NSTAGE_T	301
+
+static struct refclocksample ring[NSTAGE_T];
+static double work[2 * NSTAGE_T];
+static struct refclocksummary sum;
+static uint32_t seed;
+
+TEST_SETUP(refsample) {
+	ZERO(ring);
+	ZERO(sum);
+	seed = 1;
+}
+
+TEST_TEAR_DOWN(refsample) {}
+
+
+static int
+cmp(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* sample i of n from slot first on, t seconds after the first */
+static void
+put(int first, int i, double offset, double t) {
+	struct refclocksample *rs = &ring[(first + i) % NSTAGE_T];
+
+	rs->offset = offset;
+	rs->stamp = lfpinit_u(3800000000U, 0) + dtolfp(t);
+}
+
+
+TEST(refsample, Select) {
+	double a[200], b[200], c[200];
+	int n, k, i, round;
+
+	for (round = 0; round < 20; round++) {
+		for (n = 1; n <= 200; n += 1 + round) {
+			for (i = 0; i < n; i++)
+				/* every third round, heaps of duplicates */
+				a[i] = (round % 3) ? lcg_uniform(&seed) :
+				    floor(lcg_uniform(&seed) * 5);
+			memcpy(b, a, sizeof(a[0]) * (size_t)n);
+			qsort(b, (size_t)n, sizeof(b[0]), cmp);
+			for (k = 0; k < n; k++) {
+				memcpy(c, a, sizeof(a[0]) * (size_t)n);
+				TEST_ASSERT_EQUAL_DOUBLE(b[k],
+				    refsample_select(c, n, k));
+				for (i = 0; i < k; i++)
+					TEST_ASSERT_TRUE(c[i] <= c[k]);
+				for (i = k + 1; i < n; i++)
+					TEST_ASSERT_TRUE(c[i] >= c[k]);
+			}
+		}
+	}
+}
+
+/*
+ * the m samples closest to the median, by sorting: with no two samples
+ * as far from it, they are the ones kept
+ */
+TEST(refsample, TrimMatchesSort) {
+	double off[NSTAGE_T], d[NSTAGE_T], e[NSTAGE_T], limit, mean, jit;
+	int n, m, i, kept, first;
+
+	for (n = 1; n < NSTAGE_T; n += 7) {
+		first = (int)(lcg_uniform(&seed) * NSTAGE_T);
+		for (i = 0; i < n; i++) {
+			/* mostly small, with spikes */
+			off[i] = (lcg_uniform(&seed) - 0.5) * 1e-3;
+			if (lcg_uniform(&seed) < 0.1)
+				off[i] += (lcg_uniform(&seed) - 0.5);
+			put(first, i, off[i], i);
+		}
+		TEST_ASSERT_EQUAL_INT(n, refsample_summarize(ring, NSTAGE_T,
+		    first, n, work, &sum));
+
+		memcpy(d, off, sizeof(d[0]) * (size_t)n);
+		qsort(d, (size_t)n, sizeof(d[0]), cmp);
+		m = n - (n * 4) / 10;
+		limit = d[n / 2];
+		for (i = 0; i < n; i++)
+			d[i] = fabs(off[i] - limit);
+		qsort(d, (size_t)n, sizeof(d[0]), cmp);
+		mean = jit = 0;
+		kept = 0;
+		for (i = 0; i < n; i++)
+			if (fabs(off[i] - limit) <= d[m - 1]) {
+				mean += off[i];
+				e[kept++] = off[i];
+			}
+		mean /= kept;
+		/* the jitter from the gaps between those kept, sorted */
+		qsort(e, (size_t)kept, sizeof(e[0]), cmp);
+		for (i = 1; i < kept; i++)
+			jit += (e[i] - e[i - 1]) * (e[i] - e[i - 1]);
+		jit = sqrt(jit / kept);
+
+		TEST_ASSERT_EQUAL_INT(n, sum.count);
+		TEST_ASSERT_EQUAL_INT(m, kept);
+		TEST_ASSERT_EQUAL_INT(m, sum.kept);
+		TEST_ASSERT_DOUBLE_WITHIN(1e-12, mean, sum.offset);
+		TEST_ASSERT_DOUBLE_WITHIN(1e-12, jit, sum.jitter);
+	}
+}
+
+/* all the samples the same: as many of them kept as ever */
+TEST(refsample, Ties) {
+	int i;
+
+	for (i = 0; i < 10; i++)
+		put(0, i, 0.25, i);
+	refsample_summarize(ring, NSTAGE_T, 0, 10, work, &sum);
+	TEST_ASSERT_EQUAL_INT(6, sum.kept);
+	TEST_ASSERT_EQUAL_DOUBLE(0.25, sum.offset);
+	TEST_ASSERT_EQUAL_DOUBLE(0.0, sum.jitter);
+}
+
+TEST(refsample, Few) {
+	TEST_ASSERT_EQUAL_INT(0, refsample_summarize(ring, NSTAGE_T, 5, 0,
+						     work, &sum));
+	TEST_ASSERT_EQUAL_INT(0, sum.count);
+
+	put(NSTAGE_T - 1, 0, 0.5, 0);
+	put(NSTAGE_T - 1, 1, 0.7, 1);
+	TEST_ASSERT_EQUAL_INT(1, refsample_summarize(ring, NSTAGE_T,
+						     NSTAGE_T - 1, 1,
+						     work, &sum));
+	TEST_ASSERT_EQUAL_DOUBLE(0.5, sum.offset);
+	TEST_ASSERT_EQUAL_DOUBLE(0.0, sum.jitter);
+	TEST_ASSERT_EQUAL_DOUBLE(0.0, sum.tau);
+
+	/* the ring wraps between the two */
+	TEST_ASSERT_EQUAL_INT(2, refsample_summarize(ring, NSTAGE_T,
+						     NSTAGE_T - 1, 2,
+						     work, &sum));
+	TEST_ASSERT_EQUAL_INT(2, sum.kept);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.6, sum.offset);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, sqrt(0.02), sum.jitter);
+	TEST_ASSERT_EQUAL_DOUBLE(0.0, sum.tau);
+}
+
+/* an offset drifting steadily: that rate, and no Allan deviation */
+TEST(refsample, Rate) {
+	int i;
+
+	for (i = 0; i < 100; i++)
+		put(250, i, 0.001 + 2e-6 * i * 0.1, i * 0.1);
+	refsample_summarize(ring, NSTAGE_T, 250, 100, work, &sum);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-6, 0.1, sum.tau);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, 2e-6, sum.rate);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-9, 0.0, sum.adev);
+}
+
+/*
+ * an offset alternating by +-a each tau: second differences of 4a,
+ * Allan deviation sqrt(16 a^2 / (2 tau^2)), no rate to speak of
+ */
+TEST(refsample, Adev) {
+	const double a = 1e-6, tau = 2.0;
+	int i, n = 101;
+
+	for (i = 0; i < n; i++)
+		put(17, i, (i % 2) ? a : -a, i * tau);
+	refsample_summarize(ring, NSTAGE_T, 17, n, work, &sum);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-6, tau, sum.tau);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 2 * sqrt(2.0) * a / tau, sum.adev);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-10, 0.0, sum.rate);
+}
+
+TEST(refsample, CombineFew) {
+	double x[2] = { 0, 0 }, off;
+	bool used[2];
+
+	TEST_ASSERT_EQUAL_INT(0, refsample_combine(x, 0, 1e-5, work, used,
+						   &off));
+
+	x[0] = 0.25;
+	TEST_ASSERT_EQUAL_INT(1, refsample_combine(x, 1, 1e-5, work, used,
+						   &off));
+	TEST_ASSERT_TRUE(used[0]);
+	TEST_ASSERT_EQUAL_DOUBLE(0.25, off);
+
+	/* two that agree, and two that do not: no telling which is off */
+	x[0] = 1e-6;
+	x[1] = 3e-6;
+	TEST_ASSERT_EQUAL_INT(2, refsample_combine(x, 2, 1e-5, work, used,
+						   &off));
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 2e-6, off);
+	x[1] = 3e-5;
+	TEST_ASSERT_EQUAL_INT(0, refsample_combine(x, 2, 1e-5, work, used,
+						   &off));
+	TEST_ASSERT_FALSE(used[0]);
+	TEST_ASSERT_FALSE(used[1]);
+}
+
+/* a device a millisecond off among four that agree */
+TEST(refsample, CombineOutlier) {
+	double x[5] = { 2e-6, -1e-6, 1e-3, 0.0, 3e-6 }, off;
+	bool used[5];
+	int i;
+
+	TEST_ASSERT_EQUAL_INT(4, refsample_combine(x, 5, 1e-5, work, used,
+						   &off));
+	for (i = 0; i < 5; i++)
+		TEST_ASSERT_EQUAL(i != 2, used[i]);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 1e-6, off);
+
+	/* and one a second late wrapped round to the other side */
+	x[2] = -0.4999;
+	TEST_ASSERT_EQUAL_INT(4, refsample_combine(x, 5, 1e-5, work, used,
+						   &off));
+	TEST_ASSERT_FALSE(used[2]);
+}
+
+/*
+ * devices noisier than the gate: the spread they share lets them all
+ * through, one far off still does not get through
+ */
+TEST(refsample, CombineNoisy) {
+	double x[9], off, mean = 0;
+	bool used[9];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		x[i] = (lcg_uniform(&seed) - 0.5) * 2e-5;
+		mean += x[i];
+	}
+	x[8] = 5e-4;
+	TEST_ASSERT_EQUAL_INT(8, refsample_combine(x, 9, 1e-6, work, used,
+						   &off));
+	TEST_ASSERT_FALSE(used[8]);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, mean / 8, off);
+}
+
+TEST_GROUP_RUNNER(refsample) {
+	RUN_TEST_CASE(refsample, Select);
+	RUN_TEST_CASE(refsample, TrimMatchesSort);
+	RUN_TEST_CASE(refsample, Ties);
+	RUN_TEST_CASE(refsample, Few);
+	RUN_TEST_CASE(refsample, Rate);
+	RUN_TEST_CASE(refsample, Adev);
+	RUN_TEST_CASE(refsample, CombineFew);
+	RUN_TEST_CASE(refsample, CombineOutlier);
+	RUN_TEST_CASE(refsample, CombineNoisy);
+}
@@ -0,0 +1,101 @@
+#include "config.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+
+
+TEST_GROUP(sched);
+
+#define NEVENTS	4
+
+static struct sched_event ev[NEVENTS];
+
+static struct timespec
+at(time_t sec, long nsec) {
+	struct timespec ts;
+
+	ts.tv_sec = sec;
+	ts.tv_nsec = nsec;
+	return ts;
+}
+
+TEST_SETUP(sched) {
+	int i;
+
+	for (i = 0; i < NEVENTS; i++)
+		sched_cancel(&ev[i]);
+}
+
+TEST_TEAR_DOWN(sched) {}
+
+
+TEST(sched, Empty) {
+	struct timespec due;
+
+	TEST_ASSERT_FALSE(sched_next(&due));
+	TEST_ASSERT_NULL(sched_due(at(1000, 0)));
+}
+
+TEST(sched, DeadlineOrder) {
+	struct timespec due;
+
+	sched_at(&ev[0], at(10, 500000000));
+	sched_at(&ev[1], at(10, 0));
+	sched_at(&ev[2], at(11, 0));
+
+	TEST_ASSERT_TRUE(sched_next(&due));
+	TEST_ASSERT_EQUAL(10, due.tv_sec);
+	TEST_ASSERT_EQUAL(0, due.tv_nsec);
+
+	TEST_ASSERT_NULL(sched_due(at(9, 999999999)));
+	TEST_ASSERT_EQUAL_PTR(&ev[1], sched_due(at(10, 700000000)));
+	TEST_ASSERT_EQUAL_PTR(&ev[0], sched_due(at(10, 700000000)));
+	TEST_ASSERT_NULL(sched_due(at(10, 700000000)));
+	TEST_ASSERT_TRUE(ev[2].pending);
+	TEST_ASSERT_FALSE(ev[0].pending);
+	TEST_ASSERT_EQUAL_PTR(&ev[2], sched_due(at(11, 0)));
+}
+
+TEST(sched, SameDeadline) {
+	sched_at(&ev[0], at(5, 0));
+	sched_at(&ev[1], at(5, 0));
+	sched_at(&ev[2], at(5, 0));
+
+	TEST_ASSERT_EQUAL_PTR(&ev[0], sched_due(at(5, 0)));
+	TEST_ASSERT_EQUAL_PTR(&ev[1], sched_due(at(5, 0)));
+	TEST_ASSERT_EQUAL_PTR(&ev[2], sched_due(at(5, 0)));
+}
+
+TEST(sched, Reschedule) {
+	sched_at(&ev[0], at(5, 0));
+	sched_at(&ev[1], at(6, 0));
+	sched_at(&ev[0], at(7, 0));
+
+	TEST_ASSERT_EQUAL_PTR(&ev[1], sched_due(at(8, 0)));
+	TEST_ASSERT_EQUAL_PTR(&ev[0], sched_due(at(8, 0)));
+	TEST_ASSERT_NULL(sched_due(at(8, 0)));
+}
+
+TEST(sched, Cancel) {
+	sched_at(&ev[0], at(5, 0));
+	sched_at(&ev[1], at(6, 0));
+	sched_at(&ev[2], at(7, 0));
+	sched_cancel(&ev[1]);
+	sched_cancel(&ev[1]);
+
+	TEST_ASSERT_FALSE(ev[1].pending);
+	TEST_ASSERT_EQUAL_PTR(&ev[0], sched_due(at(8, 0)));
+	TEST_ASSERT_EQUAL_PTR(&ev[2], sched_due(at(8, 0)));
+	TEST_ASSERT_NULL(sched_due(at(8, 0)));
+}
+
+TEST_GROUP_RUNNER(sched) {
+	RUN_TEST_CASE(sched, Empty);
+	RUN_TEST_CASE(sched, DeadlineOrder);
+	RUN_TEST_CASE(sched, SameDeadline);
+	RUN_TEST_CASE(sched, Reschedule);
+	RUN_TEST_CASE(sched, Cancel);
+}
@@ -0,0 +1,128 @@
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+
+
+TEST_GROUP(select);
+
+#define NPEERS	5
+
+static struct peer peer[NPEERS];
+static peer_select peers[NPEERS];
+
+/* fill peers[] with n candidates at the given offsets */
+static void
+candidates(const double *offset, int n, double synch) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		peer[i].offset = offset[i];
+		peers[i].peer = &peer[i];
+		peers[i].synch = synch;
+		peers[i].error = 1e-4;
+		peers[i].seljit = 0;
+	}
+}
+
+TEST_SETUP(select) {
+	memset(peer, 0, sizeof(peer));
+	memset(peers, 0, sizeof(peers));
+}
+
+TEST_TEAR_DOWN(select) {}
+
+
+TEST(select, IntersectionDropsFalseticker) {
+	const double offset[] = { 0.0, 0.001, -0.001, 1.0 };
+	double low, high;
+
+	candidates(offset, 4, 0.01);
+	select_intersect(peers, 4, &low, &high);
+
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, -0.009, low);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.009, high);
+}
+
+TEST(select, IntersectionFollowsUpdates) {
+	const double offset[] = { 0.0, 0.001, -0.001, 1.0 };
+	double low, high;
+
+	candidates(offset, 4, 0.01);
+	select_intersect(peers, 4, &low, &high);
+
+	/* same candidates, so the sorted endpoints are reused */
+	peer[3].offset = 0.0025;
+	select_intersect(peers, 4, &low, &high);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, -0.0075, low);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.009, high);
+
+	peer[3].offset = -1.0;
+	peers[0].synch = 0.02;
+	select_intersect(peers, 4, &low, &high);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, -0.009, low);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.009, high);
+
+	/* fewer candidates, so the endpoints are rebuilt */
+	select_intersect(peers + 1, 2, &low, &high);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, -0.009, low);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, 0.009, high);
+}
+
+TEST(select, NoIntersection) {
+	const double offset[] = { 0.0, 1.0 };
+	double low, high;
+
+	candidates(offset, 2, 0.01);
+	select_intersect(peers, 2, &low, &high);
+
+	TEST_ASSERT_TRUE(high <= low);
+}
+
+TEST(select, ClusterSelectionJitter) {
+	const double offset[] = { 1.0, 2.0, 4.0 };
+
+	candidates(offset, 3, 0.01);
+	TEST_ASSERT_EQUAL(3, select_cluster(peers, 3, 3, 10));
+
+	/* root mean square of the differences to the others */
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, sqrt(10 / 2.), peers[0].seljit);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, sqrt(5 / 2.), peers[1].seljit);
+	TEST_ASSERT_DOUBLE_WITHIN(1e-12, sqrt(13 / 2.), peers[2].seljit);
+}
+
+TEST(select, ClusterDropsOutlier) {
+	const double offset[] = { 0.0, 0.0, 0.05, 0.0, 0.0 };
+	int i, n;
+
+	candidates(offset, 5, 0.01);
+	n = select_cluster(peers, 5, 3, 10);
+
+	TEST_ASSERT_EQUAL(4, n);
+	for (i = 0; i < n; i++)
+		TEST_ASSERT_TRUE(peers[i].peer != &peer[2]);
+}
+
+TEST(select, ClusterKeepsPrefer) {
+	const double offset[] = { 0.0, 0.0, 0.05, 0.0, 0.0 };
+
+	candidates(offset, 5, 0.01);
+	peer[2].cfg.flags |= FLAG_PREFER;
+
+	TEST_ASSERT_EQUAL(5, select_cluster(peers, 5, 3, 10));
+}
+
+TEST_GROUP_RUNNER(select) {
+	RUN_TEST_CASE(select, IntersectionDropsFalseticker);
+	RUN_TEST_CASE(select, IntersectionFollowsUpdates);
+	RUN_TEST_CASE(select, NoIntersection);
+	RUN_TEST_CASE(select, ClusterSelectionJitter);
+	RUN_TEST_CASE(select, ClusterDropsOutlier);
+	RUN_TEST_CASE(select, ClusterKeepsPrefer);
+}
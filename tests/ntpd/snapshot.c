@@ -0,0 +1,211 @@
+#include "config.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+
+
+TEST_GROUP(snapshot);
+
+TEST_SETUP(snapshot) {}
+
+TEST_TEAR_DOWN(snapshot) {}
+
+
+/* a snapshot whose every field follows from n */
+static void
+fill(struct sys_snapshot *snap, unsigned int n) {
+	ZERO(*snap);
+	snap->leap = n & 3;
+	snap->stratum = (uint8_t)n;
+	snap->precision = (int8_t)-(int)(n & 31);
+	snap->smearing = n & 1;
+	snap->rootdelay = n * 0.5;
+	snap->rootdisp = n * 0.25;
+	snap->rootdist = n * 0.125;
+	snap->refid = n;
+	snap->reftime = (l_fp)n << 32 | n;
+	snap->smear_offset = (l_fp)n;
+}
+
+/* the same variables, leaving the reply header aside */
+static bool
+same(const struct sys_snapshot *a, const struct sys_snapshot *b) {
+	return memcmp(a, b, offsetof(struct sys_snapshot, reply)) == 0;
+}
+
+/* all of one publication, reply header and all */
+static bool
+consistent(const struct sys_snapshot *snap) {
+	struct sys_snapshot want;
+	struct pkt xpkt;
+
+	fill(&want, snap->refid);
+	if (!same(&want, snap))
+		return false;
+	memcpy(&xpkt, snap->reply, LEN_PKT_NOMAC);
+	return xpkt.stratum == STRATUM_TO_PKT(want.stratum) &&
+	    xpkt.refid == (want.smearing ?
+			   convertLFPToRefID(want.smear_offset) : want.refid);
+}
+
+static volatile bool done;
+
+static void *
+publisher(void *arg) {
+	struct sys_snapshot snap;
+	unsigned int n;
+
+	UNUSED_ARG(arg);
+	for (n = 1; !done; n++) {
+		fill(&snap, n);
+		sys_snapshot_publish(&snap);
+	}
+	return NULL;
+}
+
+
+TEST(snapshot, RoundTrip) {
+	struct sys_snapshot in, out;
+
+	fill(&in, 12345);
+	sys_snapshot_publish(&in);
+	sys_snapshot_read(&out);
+	TEST_ASSERT_TRUE(same(&in, &out));
+}
+
+TEST(snapshot, ReplyHeader) {
+	struct sys_snapshot snap;
+	struct pkt xpkt;
+
+	ZERO(snap);
+	snap.leap = LEAP_ADDSECOND;
+	snap.stratum = 2;
+	snap.precision = -20;
+	snap.rootdelay = 0.015625;
+	snap.rootdisp = 0.5;
+	snap.refid = htonl(0xc0000201);
+	snap.reftime = 0x0102030405060708;
+	sys_snapshot_publish(&snap);
+	sys_snapshot_read(&snap);
+
+	memset(&xpkt, 0xff, sizeof(xpkt));
+	sys_reply_header(&xpkt, &snap, 3, 6, 0x1112131415161718,
+			 0x2122232425262728);
+	TEST_ASSERT_EQUAL_HEX8(PKT_LI_VN_MODE(LEAP_ADDSECOND, 3, MODE_SERVER),
+			       xpkt.li_vn_mode);
+	TEST_ASSERT_EQUAL_UINT8(2, xpkt.stratum);
+	TEST_ASSERT_EQUAL_UINT8(6, xpkt.ppoll);
+	TEST_ASSERT_EQUAL_INT8(-20, xpkt.precision);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x00000400), xpkt.rootdelay);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x00008000), xpkt.rootdisp);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0xc0000201), xpkt.refid);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x01020304), xpkt.reftime.l_ui);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x05060708), xpkt.reftime.l_uf);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x11121314), xpkt.org.l_ui);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x15161718), xpkt.org.l_uf);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x21222324), xpkt.rec.l_ui);
+	TEST_ASSERT_EQUAL_HEX32(htonl(0x25262728), xpkt.rec.l_uf);
+	/* the transmit timestamp is left to the caller */
+	TEST_ASSERT_EQUAL_HEX32(0, xpkt.xmt.l_ui);
+}
+
+TEST(snapshot, ReplyUnsynchronized) {
+	struct sys_snapshot snap;
+	struct pkt xpkt;
+
+	ZERO(snap);
+	snap.leap = LEAP_NOTINSYNC;
+	snap.stratum = STRATUM_UNSPEC;
+	memcpy(&snap.refid, "INIT", REFIDLEN);
+	sys_snapshot_publish(&snap);
+	sys_snapshot_read(&snap);
+
+	sys_reply_header(&xpkt, &snap, 4, 10, 0, 0);
+	TEST_ASSERT_EQUAL_HEX8(PKT_LI_VN_MODE(LEAP_NOTINSYNC, 4, MODE_SERVER),
+			       xpkt.li_vn_mode);
+	TEST_ASSERT_EQUAL_UINT8(STRATUM_PKT_UNSPEC, xpkt.stratum);
+	TEST_ASSERT_EQUAL_MEMORY("INIT", &xpkt.refid, REFIDLEN);
+}
+
+TEST(snapshot, ReplySmeared) {
+	struct sys_snapshot snap;
+	struct pkt xpkt;
+	l_fp offset = dtolfp(-0.25);
+
+	ZERO(snap);
+	snap.stratum = 1;
+	snap.reftime = 0x0000100000000000;
+	snap.smearing = true;
+	snap.smear_offset = offset;
+	sys_snapshot_publish(&snap);
+	sys_snapshot_read(&snap);
+
+	sys_reply_header(&xpkt, &snap, 4, 6, 0, 0x0000200000000000);
+	TEST_ASSERT_EQUAL_HEX32(convertLFPToRefID(offset), xpkt.refid);
+	TEST_ASSERT_EQUAL_HEX32(htonl(lfpuint(0x0000100000000000 + offset)),
+				xpkt.reftime.l_ui);
+	TEST_ASSERT_EQUAL_HEX32(htonl(lfpfrac(0x0000100000000000 + offset)),
+				xpkt.reftime.l_uf);
+	TEST_ASSERT_EQUAL_HEX32(htonl(lfpuint(0x0000200000000000 + offset)),
+				xpkt.rec.l_ui);
+	TEST_ASSERT_EQUAL_HEX32(htonl(lfpfrac(0x0000200000000000 + offset)),
+				xpkt.rec.l_uf);
+}
+
+TEST(snapshot, SequenceAdvances) {
+	struct sys_snapshot snap;
+	unsigned int seq;
+
+	fill(&snap, 1);
+	sys_snapshot_publish(&snap);
+	seq = sys_snapshot_read(&snap);
+	TEST_ASSERT_EQUAL_UINT(0, seq & 1);
+	TEST_ASSERT_EQUAL_UINT(seq, sys_snapshot_read(&snap));
+
+	fill(&snap, 2);
+	sys_snapshot_publish(&snap);
+	TEST_ASSERT_EQUAL_UINT(seq + 2, sys_snapshot_read(&snap));
+	TEST_ASSERT_EQUAL_UINT(2, snap.refid);
+}
+
+/* readers on another thread never see a mix of two publications */
+TEST(snapshot, NeverTorn) {
+	struct sys_snapshot snap;
+	pthread_t thread;
+	unsigned int seq, last = 0;
+	int i;
+
+	fill(&snap, 0);
+	sys_snapshot_publish(&snap);
+	done = false;
+	TEST_ASSERT_EQUAL_INT(0, pthread_create(&thread, NULL, publisher,
+						NULL));
+	for (i = 0; i < 200000; i++) {
+		seq = sys_snapshot_read(&snap);
+		if (!consistent(&snap))
+			break;
+		/* the sequence never goes back */
+		if (seq - last > 0x80000000U)
+			break;
+		last = seq;
+	}
+	done = true;
+	pthread_join(thread, NULL);
+	TEST_ASSERT_EQUAL_INT(200000, i);
+}
+
+TEST_GROUP_RUNNER(snapshot) {
+	RUN_TEST_CASE(snapshot, RoundTrip);
+	RUN_TEST_CASE(snapshot, SequenceAdvances);
+	RUN_TEST_CASE(snapshot, ReplyHeader);
+	RUN_TEST_CASE(snapshot, ReplyUnsynchronized);
+	RUN_TEST_CASE(snapshot, ReplySmeared);
+	RUN_TEST_CASE(snapshot, NeverTorn);
+}
@@ -0,0 +1,154 @@
+#include "config.h"
+
+#include <string.h>
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#include "ntp.h"
+#include "ntpd.h"
+
+
+TEST_GROUP(wheel);
+
+#define NPEERS	4
+
+static struct peer peer[NPEERS];
+static uptime_t now;		/* the wheel only turns forward */
+
+/*
+ * Turn the wheel a tick at a time up to limit and return the tick at
+ * which p came due, or 0.  Every peer that comes due must be p.
+ */
+static uptime_t
+due_at(struct peer *p, uptime_t limit) {
+	struct peer *q;
+
+	while (now < limit) {
+		now++;
+		while ((q = wheel_due(now)) != NULL) {
+			TEST_ASSERT_EQUAL_PTR(p, q);
+			return now;
+		}
+	}
+	return 0;
+}
+
+TEST_SETUP(wheel) {
+	int i;
+
+	for (i = 0; i < NPEERS; i++)
+		wheel_unschedule(&peer[i]);
+	memset(peer, 0, sizeof(peer));
+}
+
+TEST_TEAR_DOWN(wheel) {}
+
+
+TEST(wheel, DueAtNextdate) {
+	const uptime_t ahead[] = { 1, 63, 64, 65, 4095, 4096, 5000,
+				   262143, 262144, 300000 };
+	uptime_t when;
+	unsigned int i;
+
+	for (i = 0; i < COUNTOF(ahead); i++) {
+		peer[0].nextdate = now + ahead[i];
+		wheel_schedule(&peer[0]);
+		when = peer[0].nextdate;
+		TEST_ASSERT_EQUAL_UINT32(when, due_at(&peer[0], when + 10));
+	}
+}
+
+TEST(wheel, PastDueAtNextTick) {
+	uptime_t next = now + 1;
+
+	peer[0].nextdate = now - 5;
+	TEST_ASSERT_TRUE(wheel_schedule(&peer[0]));
+
+	TEST_ASSERT_EQUAL_UINT32(next, due_at(&peer[0], now + 10));
+}
+
+TEST(wheel, PastDueHurried) {
+	peer[0].nextdate = now + 10;
+	peer[1].nextdate = now;
+	TEST_ASSERT_FALSE(wheel_schedule(&peer[0]));
+	TEST_ASSERT_TRUE(wheel_schedule(&peer[1]));
+	TEST_ASSERT_NULL(wheel_due(now));
+
+	/* between ticks, and only the one that is due */
+	wheel_hurry();
+	TEST_ASSERT_EQUAL_PTR(&peer[1], wheel_due(now));
+	TEST_ASSERT_NULL(wheel_due(now));
+
+	/* polled and due again at once, it waits for the next tick */
+	TEST_ASSERT_TRUE(wheel_schedule(&peer[1]));
+	TEST_ASSERT_NULL(wheel_due(now));
+	TEST_ASSERT_EQUAL_PTR(&peer[1], wheel_due(now + 1));
+	now++;
+	TEST_ASSERT_EQUAL_UINT32(peer[0].nextdate,
+				 due_at(&peer[0], now + 20));
+}
+
+TEST(wheel, BeyondSpan) {
+	uptime_t when = now + (1U << 24) + 100;
+
+	peer[0].nextdate = when;
+	wheel_schedule(&peer[0]);
+
+	TEST_ASSERT_EQUAL_UINT32(when, due_at(&peer[0], when + 10));
+}
+
+TEST(wheel, Unschedule) {
+	peer[0].nextdate = now + 100;
+	peer[1].nextdate = now + 200;
+	wheel_schedule(&peer[0]);
+	wheel_schedule(&peer[1]);
+	wheel_unschedule(&peer[0]);
+
+	TEST_ASSERT_EQUAL_UINT32(peer[1].nextdate,
+				 due_at(&peer[1], now + 300));
+}
+
+TEST(wheel, Reschedule) {
+	uptime_t start = now;
+
+	/* earlier */
+	peer[0].nextdate = start + 5000;
+	wheel_schedule(&peer[0]);
+	peer[0].nextdate = start + 70;
+	wheel_schedule(&peer[0]);
+	TEST_ASSERT_EQUAL_UINT32(start + 70, due_at(&peer[0], start + 6000));
+
+	/* later, without telling the wheel */
+	peer[0].nextdate = now + 10;
+	wheel_schedule(&peer[0]);
+	peer[0].nextdate = now + 100;
+	TEST_ASSERT_EQUAL_UINT32(peer[0].nextdate,
+				 due_at(&peer[0], now + 200));
+}
+
+TEST(wheel, SameTick) {
+	struct peer *p, *q;
+
+	peer[0].nextdate = peer[1].nextdate = now + 130;
+	wheel_schedule(&peer[0]);
+	wheel_schedule(&peer[1]);
+	now += 130;
+
+	p = wheel_due(now);
+	q = wheel_due(now);
+	TEST_ASSERT_NOT_NULL(p);
+	TEST_ASSERT_NOT_NULL(q);
+	TEST_ASSERT_TRUE(p != q);
+	TEST_ASSERT_NULL(wheel_due(now));
+}
+
+TEST_GROUP_RUNNER(wheel) {
+	RUN_TEST_CASE(wheel, DueAtNextdate);
+	RUN_TEST_CASE(wheel, PastDueAtNextTick);
+	RUN_TEST_CASE(wheel, PastDueHurried);
+	RUN_TEST_CASE(wheel, BeyondSpan);
+	RUN_TEST_CASE(wheel, Unschedule);
+	RUN_TEST_CASE(wheel, Reschedule);
+	RUN_TEST_CASE(wheel, SameTick);
+}
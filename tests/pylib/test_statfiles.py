@@ -4,7 +4,13 @@
 import unittest
 import ntp.statfiles
 import jigs
+import io
+import os
+import array
+import shutil
+import struct
 import sys
+import tempfile
 
 
 class TestPylibStatfiles(unittest.TestCase):
@@ -30,6 +36,81 @@ class TestPylibStatfiles(unittest.TestCase):
             "2016-12-06T04:49:46")
 
 
+class TestStatTable(unittest.TestCase):
+    target = ntp.statfiles.StatTable
+
+    rows = [[1000, "1.0", "a", "0.5", "7"],
+            [2000, "2.0", "b", "-1.5", "8"],
+            [3000, "3.0", "a", "2.5"],
+            [4000, "4.0", "a", "0.25", "9"]]
+
+    def test_from_rows(self):
+        table = self.target.from_rows(self.rows)
+        self.assertEqual(len(table), 4)
+        self.assertEqual(list(table.column(1)), [1.0, 2.0, 3.0, 4.0])
+        self.assertEqual(table.column(2), ["a", "b", "a", "a"])
+        self.assertEqual(table.values(4), [7.0, 8.0, 9.0])
+        # Short rows come back short
+        self.assertEqual(table[2], [3000, "3.0", "a", "2.5"])
+        self.assertEqual(table, [[1000, "1.0", "a", "0.5", "7.0"],
+                                 [2000, "2.0", "b", "-1.5", "8.0"],
+                                 [3000, "3.0", "a", "2.5"],
+                                 [4000, "4.0", "a", "0.25", "9.0"]])
+        # Test text columns
+        table = self.target.from_rows(self.rows, (4,))
+        self.assertEqual(table.column(4), ["7", "8", "", "9"])
+        # Test missing columns
+        self.assertEqual(len(table.column(9)), 4)
+        self.assertEqual(table.values(9), [])
+        # Test empty
+        self.assertFalse(self.target.from_rows([]))
+        self.assertEqual(self.target().split(2), {})
+
+    def test_merge(self):
+        table = self.target.from_rows(self.rows[1:3])
+        other = self.target(array.array('d', [1.0, 4.0]),
+                            [["a", "a"], array.array('d', [0.5, 0.25])])
+        merged = self.target.merge([table, other])
+        self.assertEqual(list(merged.column(1)), [1.0, 2.0, 3.0, 4.0])
+        self.assertEqual(merged.column(2), ["a", "b", "a", "a"])
+        self.assertEqual(list(merged.column(3)), [0.5, -1.5, 2.5, 0.25])
+        self.assertEqual(merged.values(4), [8.0])
+        # Test text in one table makes text of the column
+        text = self.target.from_rows(self.rows[:1], (3,))
+        merged = self.target.merge([text, other])
+        self.assertEqual(merged.column(3), ["0.5", "0.5", "0.25"])
+        # Test nothing to merge
+        self.assertIs(self.target.merge([other, self.target()]), other)
+        self.assertFalse(self.target.merge([]))
+
+    def test_split(self):
+        table = self.target.from_rows(self.rows)
+        split = table.split(2)
+        self.assertEqual(sorted(split.keys()), ["a", "b"])
+        self.assertEqual(list(split["a"].column(1)), [1.0, 3.0, 4.0])
+        self.assertEqual(split["b"], [[2000, "2.0", "b", "-1.5", "8.0"]])
+
+    def test_downsample(self):
+        table = self.target.from_rows(self.rows)
+        # Test nothing to do
+        self.assertIs(table.downsample(4), table)
+        # Test mean of two buckets
+        mean = table.downsample(2)
+        self.assertEqual(list(mean.column(1)), [1.5, 3.5])
+        self.assertEqual(list(mean.column(3)), [-0.5, 1.375])
+        self.assertEqual(list(mean.column(4)), [7.5, 9.0])
+        self.assertEqual(mean.column(2), ["a", "a"])
+        # Test min and max
+        self.assertEqual(list(table.downsample(2, "min").column(3)),
+                         [-1.5, 0.25])
+        self.assertEqual(list(table.downsample(2, "max").column(3)),
+                         [0.5, 2.5])
+        # Test minmax keeps whole rows
+        self.assertEqual(table.downsample(1, "minmax", 3),
+                         [[2000, "2.0", "b", "-1.5", "8.0"],
+                          [3000, "3.0", "a", "2.5"]])
+
+
 class TestNTPStats(unittest.TestCase):
     target = ntp.statfiles.NTPStats
 
@@ -54,10 +135,10 @@ class TestNTPStats(unittest.TestCase):
         ret = TestNTPStats.load_stem_returns.pop(0)
         if ret is None:
             raise IOError
-        return ret
+        return ret, []
 
     @staticmethod
-    def process_stem_jig(cls, stem, lines):
+    def process_stem_jig(cls, stem, lines, tables=()):
         TestNTPStats.process_stem_calls.append((stem, lines))
         return TestNTPStats.process_stem_returns.pop(0)
 
@@ -80,6 +161,104 @@ class TestNTPStats(unittest.TestCase):
                             "40587 86399", "40588 1"], 1, 86400),
                          [[1062, "1.0625"], [86399000, "86399.0"]])
 
+    @staticmethod
+    def binary_blob(columns, fmt, records):
+        "Build a binary statistics file like ntp_filegen.c writes."
+        header = struct.pack("<8sHHHH16s", b"NTPSBIN1",
+                             32 + 16 * len(columns), struct.calcsize(fmt),
+                             len(columns), 0, b"teststats")
+        for (name, ctype, width) in columns:
+            header += struct.pack("<14scB", name, ctype, width)
+        return header + b"".join(struct.pack(fmt, *rec) for rec in records)
+
+    def test_binary_layout(self):
+        f = self.target.binary_layout
+
+        columns = [(b"day", b"u", 4), (b"second", b"d", 8),
+                   (b"source", b"s", 8), (b"status", b"x", 4)]
+        blob = self.binary_blob(columns, "<Id8sI", [])
+        (hdrlen, record, types) = f(blob)
+        self.assertEqual(hdrlen, 96)
+        self.assertEqual(record.format, "<Id8sI")
+        self.assertEqual(types, [b"u", b"d", b"s", b"x"])
+        # Test text file
+        self.assertEqual(f(b"40587 0.000 foo bar\n"), None)
+        # Test truncated header
+        self.assertEqual(f(blob[:40]), None)
+        # Test unknown column type
+        columns[3] = (b"status", b"?", 4)
+        self.assertEqual(f(self.binary_blob(columns, "<Id8sI", [])), None)
+
+    def test_unixize_binary(self):
+        f = self.target.unixize_binary
+
+        columns = [(b"day", b"u", 4), (b"second", b"d", 8),
+                   (b"source", b"s", 8), (b"status", b"x", 4),
+                   (b"poll", b"i", 4), (b"t1", b"f", 8)]
+        fmt = "<Id8sIiQ"
+        records = [(40587, 0.125, b"NMEA(0)", 0x9014, -6, 0x100000000),
+                   (40587, 86399.0, b"1.2.3.4", 0x1, 4, 0x180000000),
+                   (40588, 1.0, b"1.2.3.4", 0x1, 4, 0x280000000)]
+        blob = self.binary_blob(columns, fmt, records)
+        # Test empty
+        self.assertEqual(f(self.binary_blob(columns, fmt, []),
+                           0, 0xFFFFFFFF), [])
+        # Test not binary
+        self.assertEqual(f(b"40587 0.125 foo", 0, 0xFFFFFFFF), None)
+        # Test everything in range
+        table = f(blob, 0, 0xFFFFFFFF)
+        self.assertEqual(list(table.column(1)), [0.125, 86399.0, 86401.0])
+        self.assertEqual(table.column(2), ["NMEA(0)", "1.2.3.4", "1.2.3.4"])
+        self.assertEqual(list(table.column(3)), [0x9014, 1.0, 1.0])
+        self.assertEqual(list(table.column(4)), [-6.0, 4.0, 4.0])
+        self.assertEqual(list(table.column(5)), [1.0, 1.5, 2.5])
+        self.assertEqual(table,
+                         [[125, "0.125", "NMEA(0)", "36884.0", "-6.0", "1.0"],
+                          [86399000, "86399.0", "1.2.3.4", "1.0", "4.0",
+                           "1.5"],
+                          [86401000, "86401.0", "1.2.3.4", "1.0", "4.0",
+                           "2.5"]])
+        # Test text columns, hex as the text format writes it
+        table = f(blob, 0, 0xFFFFFFFF, (3, 4))
+        self.assertEqual(table.column(3), ["9014", "1", "1"])
+        self.assertEqual(table.column(4), ["-6", "4", "4"])
+        # Test fixed point keeps all of the fraction
+        records[0] = (40587, 0.125, b"NMEA(0)", 0x9014, -6, 0x1ffffffff)
+        table = f(self.binary_blob(columns, fmt, records), 0, 1)
+        self.assertEqual(list(table.column(5)), [0x1ffffffff / 2.0 ** 32])
+        # Test something not in range, and a partial trailing record
+        self.assertEqual(f(blob + b"\0\0\0", 1, 86400),
+                         [[86399000, "86399.0", "1.2.3.4", "1.0", "4.0",
+                           "1.5"]])
+
+    def test_lines_in_range(self):
+        f = self.target.lines_in_range
+
+        lines = ["#header\n"] + ["40587 %d.5 x\n" % n for n in range(10000)]
+        data = "".join(lines).encode("ascii")
+        stamp = self.target.mjd_stamp
+        granule = self.target.IndexGranule
+        try:
+            self.target.IndexGranule = 64
+            # Test whole file
+            self.assertEqual(f(io.BytesIO(data), stamp, 0, 1e10), lines)
+            # Test a slice, the bisection may start a little early
+            got = f(io.BytesIO(data), stamp, 5000, 5002)
+            self.assertEqual(got[-3:], lines[5000:5003])
+            self.assertTrue(len(got) < 10)
+            # Test nothing in range, only the last few lines are read
+            self.assertTrue(len(f(io.BytesIO(data), stamp, 2e4, 3e4)) < 10)
+            self.assertEqual(f(io.BytesIO(data), stamp, -2, -1), lines[:1])
+            # Test unix stamps
+            self.assertEqual(f(io.BytesIO(b"1.0 a\n2.0 b\n3.0 c\n"),
+                               self.target.unix_stamp, 2, 2),
+                             ["1.0 a\n", "2.0 b\n"])
+            # Test objects that can not seek
+            self.assertEqual(f(jigs.FileJig(["a\n", "b"]), stamp, 0, 1),
+                             ["a\n", "b"])
+        finally:
+            self.target.IndexGranule = granule
+
     def test_timestamp(self):
         f = self.target.timestamp
 
@@ -136,10 +315,10 @@ class TestNTPStats(unittest.TestCase):
 
         def loadjig(self, statsdir, stem):
             load_args.append((statsdir, stem))
-            return load_returns.pop(0)
+            return load_returns.pop(0), []
         process_args = []
 
-        def processjig(self, stem, lines):
+        def processjig(self, stem, lines, tables=()):
             process_args.append((stem, lines))
             return [stem + " " + line for line in lines]
         try:
@@ -349,32 +528,32 @@ class TestNTPStats(unittest.TestCase):
             TestNTPStats.process_stem_returns = [[]] * 6
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "clockstats"),
-                             ['40594 10\n', '40594 11',
-                              '40594 20\n', '40594 21'])
+                             (['40594 10\n', '40594 11',
+                               '40594 20\n', '40594 21'], []))
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "peerstats"),
-                             ['40594 30\n', '40594 31',
-                              '40594 40\n', '40594 41'])
+                             (['40594 30\n', '40594 31',
+                               '40594 40\n', '40594 41'], []))
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "loopstats"),
-                             ['40594 50\n', '40594 51',
-                              '40594 60\n', '40594 61'])
+                             (['40594 50\n', '40594 51',
+                               '40594 60\n', '40594 61'], []))
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "rawstats"),
-                             ['40594 70\n', '40594 71',
-                              '40594 80\n', '40594 81'])
+                             (['40594 70\n', '40594 71',
+                               '40594 80\n', '40594 81'], []))
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "temps"),
-                             ["604801.25 40594 90\n",
-                              "#blah",
-                              "604802.25 40594 91",
-                              "604803.25 40594 100\n",
-                              "#blah",
-                              "604804.25 40594 101"])
+                             (["604801.25 40594 90\n",
+                               "#blah",
+                               "604802.25 40594 91",
+                               "604803.25 40594 100\n",
+                               "#blah",
+                               "604804.25 40594 101"], []))
             self.assertEqual(cls._NTPStats__load_stem("/foo/bar",
                                                       "gpsd"),
-                             ['604805.25 40594 110\n', '#blah',
-                              '604806.25 40594 111'])
+                             (['604805.25 40594 110\n', '#blah',
+                               '604806.25 40594 111'], []))
         finally:
             ntp.statfiles.gzip = gziptemp
             ntp.statfiles.socket = socktemp
@@ -385,6 +564,32 @@ class TestNTPStats(unittest.TestCase):
             sys.stderr = errtemp
             self.target._NTPStats__process_stem = prostemp
 
+    def test___load_stem_binary(self):
+        columns = [(b"day", b"u", 4), (b"second", b"d", 8),
+                   (b"source", b"s", 8), (b"status", b"x", 4)]
+        blob = self.binary_blob(columns, "<Id8sI",
+                                [(40587, 10.0, b"1.2.3.4", 0x961a),
+                                 (40587, 20.0, b"1.2.3.4", 0x961a)])
+        statsdir = tempfile.mkdtemp()
+        try:
+            # Test "type none", one file with no generation suffix
+            name = os.path.join(statsdir, "peerstats.bin")
+            with open(name, "wb") as logfile:
+                logfile.write(blob)
+            cls = self.target(statsdir, "sitename", starttime=0,
+                              endtime=86400)
+            self.assertEqual(cls.peerstats,
+                             [[10000, "10.0", "1.2.3.4", "961a"],
+                              [20000, "20.0", "1.2.3.4", "961a"]])
+            # Test the link to the current generation is read once
+            os.rename(name, name + ".19700101")
+            os.link(name + ".19700101", name)
+            cls = self.target(statsdir, "sitename", starttime=0,
+                              endtime=86400)
+            self.assertEqual(len(cls.peerstats), 2)
+        finally:
+            shutil.rmtree(statsdir)
+
     def test___process_stem_lines(self):
         try:
             fakeosmod = jigs.OSModuleJig()
@@ -457,23 +662,23 @@ class TestNTPStats(unittest.TestCase):
             TestNTPStats.load_stem_returns = [[]] * 6
             TestNTPStats.process_stem_returns = [[]] * 6
             cls = self.target("/foo/bar")
-            cls.peerstats = [[604830000, "604830.0", "1.2.3.4"],
-                             [604831000, "604831.0", "1.2.3.4"],
-                             [604840000, "604840.0", "1.2.3.4"],
-                             [604841000, "604841.0", "5.6.7.8"]]
+            self.target.peermap.clear()
+            rows = [[604830000, "604830.0", "1.2.3.4"],
+                    [604831000, "604831.0", "1.2.3.4"],
+                    [604840000, "604840.0", "1.2.3.4"],
+                    [604841000, "604841.0", "5.6.7.8"]]
+            cls.peerstats = ntp.statfiles.StatTable.from_rows(rows, (2,))
             # Test
-            self.assertEqual(cls.peersplit(),
+            peermap = cls.peersplit()
+            self.assertEqual(peermap,
                              {'1.2.3.4': [[604830000, '604830.0', '1.2.3.4'],
                                           [604831000, '604831.0', '1.2.3.4'],
                                           [604840000, '604840.0', '1.2.3.4']],
                               '5.6.7.8': [[604841000, '604841.0', '5.6.7.8']]})
-            self.target.peermap["1.2.3.4"][0][0] = 42
             # Test that it uses cache
-            self.assertEqual(cls.peersplit(),
-                             {'1.2.3.4': [[42, '604830.0', '1.2.3.4'],
-                                          [604831000, '604831.0', '1.2.3.4'],
-                                          [604840000, '604840.0', '1.2.3.4']],
-                              '5.6.7.8': [[604841000, '604841.0', '5.6.7.8']]})
+            cls.peerstats = ntp.statfiles.StatTable()
+            self.assertIs(cls.peersplit(), peermap)
+            self.assertEqual(len(cls.peersplit()), 2)
         finally:
             ntp.statfiles.socket = socktemp
             ntp.statfiles.os = ostemp
@@ -508,25 +713,21 @@ class TestNTPStats(unittest.TestCase):
             TestNTPStats.load_stem_returns = [[]] * 6
             TestNTPStats.process_stem_returns = [[]] * 6
             cls = self.target("/foo/bar")
-            cls.gpsd = [["604801.25", "40594", "90"],
-                        ["604802.25", "40594", "90"],
-                        ["argh!"],
-                        ["604803.25", "40594", "100"],
-                        ["604804.25", "40594", "100"],
-                        ["604804.25", "40594", "110"],
-                        ["604804.25", "40594", "110"],
-                        ["604804.25", "40594", "120"],
-                        ["604804.25", "40594", "120"]]
+            rows = [[604801250, "604801.25", "90", "4"],
+                    [604802250, "604802.25", "90", "4"],
+                    [604802500, "604802.5"],
+                    [604803250, "604803.25", "100", "4"],
+                    [604804250, "604804.25", "100", "4"],
+                    [604805250, "604805.25", "110", "4"]]
+            cls.gpsd = ntp.statfiles.StatTable.from_rows(rows, (2,))
             # Test
             self.assertEqual(cls.gpssplit(),
-                             {'90': [['604801.25', '40594', '90'],
-                                     ['604802.25', '40594', '90']],
-                              '100': [['604803.25', '40594', '100'],
-                                      ['604804.25', '40594', '100']],
-                              '110': [['604804.25', '40594', '110'],
-                                      ['604804.25', '40594', '110']],
-                              '120': [['604804.25', '40594', '120'],
-                                      ['604804.25', '40594', '120']]})
+                             {'90': [[604801250, '604801.25', '90', '4.0'],
+                                     [604802250, '604802.25', '90', '4.0']],
+                              '100': [[604803250, '604803.25', '100', '4.0'],
+                                      [604804250, '604804.25', '100', '4.0']],
+                              '110': [[604805250, '604805.25', '110',
+                                       '4.0']]})
         finally:
             ntp.statfiles.socket = socktemp
             ntp.statfiles.os = ostemp
@@ -561,25 +762,21 @@ class TestNTPStats(unittest.TestCase):
             TestNTPStats.load_stem_returns = [[]] * 6
             TestNTPStats.process_stem_returns = [[]] * 6
             cls = self.target("/foo/bar")
-            cls.temps = [["604801.25", "40594", "90"],
-                         ["604802.25", "40594", "90"],
-                         ["argh!"],
-                         ["604803.25", "40594", "100"],
-                         ["604804.25", "40594", "100"],
-                         ["604804.25", "40594", "110"],
-                         ["604804.25", "40594", "110"],
-                         ["604804.25", "40594", "120"],
-                         ["604804.25", "40594", "120"]]
+            rows = [[604801250, "604801.25", "90", "4"],
+                    [604802250, "604802.25", "90", "4"],
+                    [604802500, "604802.5"],
+                    [604803250, "604803.25", "100", "4"],
+                    [604804250, "604804.25", "100", "4"],
+                    [604805250, "604805.25", "110", "4"]]
+            cls.temps = ntp.statfiles.StatTable.from_rows(rows, (2,))
             # Test
             self.assertEqual(cls.tempssplit(),
-                             {'90': [['604801.25', '40594', '90'],
-                                     ['604802.25', '40594', '90']],
-                              '100': [['604803.25', '40594', '100'],
-                                      ['604804.25', '40594', '100']],
-                              '110': [['604804.25', '40594', '110'],
-                                      ['604804.25', '40594', '110']],
-                              '120': [['604804.25', '40594', '120'],
-                                      ['604804.25', '40594', '120']]})
+                             {'90': [[604801250, '604801.25', '90', '4.0'],
+                                     [604802250, '604802.25', '90', '4.0']],
+                              '100': [[604803250, '604803.25', '100', '4.0'],
+                                      [604804250, '604804.25', '100', '4.0']],
+                              '110': [[604805250, '604805.25', '110',
+                                       '4.0']]})
         finally:
             ntp.statfiles.socket = socktemp
             ntp.statfiles.os = ostemp
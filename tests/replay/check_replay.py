@@ -0,0 +1,44 @@
+#! /usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Replay a recorded peerstats file and compare the summary with the
+one recorded for it.  The replay is deterministic, so any difference
+means the filter, selection or discipline code behaves differently.
+
+Usage: check_replay.py ntpreplay peerstats summary
+"""
+
+from __future__ import print_function
+
+import subprocess
+import sys
+
+# a clock 5 ms and 20 PPM off to start with
+ARGS = ["-f", "20", "-o", "0.005"]
+
+
+def summary(ntpreplay, peerstats):
+    "The summary lines of a replay, less the CPU time it took."
+    out = subprocess.check_output([ntpreplay] + ARGS + [peerstats],
+                                  universal_newlines=True)
+    return [line for line in out.splitlines()
+            if line.startswith("#") and not line.startswith("# cpu")]
+
+
+def main(argv):
+    if len(argv) != 4:
+        sys.stderr.write(__doc__)
+        return 2
+    got = summary(argv[1], argv[2])
+    with open(argv[3]) as f:
+        want = f.read().splitlines()
+    if got != want:
+        print("ntpreplay summary differs from %s" % argv[3])
+        print("expected:\n  " + "\n  ".join(want))
+        print("got:\n  " + "\n  ".join(got))
+        return 1
+    print("ntpreplay summary matches %s" % argv[3])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -99,6 +99,13 @@ refclock_map = {
         "descr":    "GPSD NG client protocol",
         "define":   "CLOCK_GPSDJSON",
         "file":     "gpsd"
+    },
+
+    "ppsmulti": {
+        "descr":    "Combined PPS Signals",
+        "define":   "CLOCK_PPSMULTI",
+        "require":  ["ppsapi"],
+        "file":     "ppsmulti"
     }
 }
 